@@ -0,0 +1,346 @@
+// API server load generator.
+// Opens N keep-alive connections to a running server and sends requests
+// back to back on each, reading Content-Length and chunked (NDJSON / SSE)
+// responses. Reports throughput, end-to-end latency and time to the first
+// body byte, which for streamed generation is the time to first token.
+//
+// Usage: api_bench [--host 127.0.0.1] [--port 8080] [--path /api/generate]
+//                  [--connections 8] [--requests 200] [--model ID]
+//                  [--prompt TEXT] [--max-tokens 32] [--stream]
+// GET is used for /health, /api/tags and /v1/models, POST otherwise.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  std::string path = "/api/generate";
+  int connections = 8;
+  int requests = 200;
+  std::string model;
+  std::string prompt = "Write one sentence about the sea.";
+  int max_tokens = 32;
+  bool stream = false;
+};
+
+struct Sample {
+  double latency_ms;
+  double first_byte_ms;
+  size_t body_bytes;
+};
+
+std::string jsonEscape(const std::string &s) {
+  std::string out;
+  for (char c : s) {
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default: out += c;
+    }
+  }
+  return out;
+}
+
+bool isGetPath(const std::string &path) {
+  return path == "/health" || path == "/api/tags" || path == "/v1/models";
+}
+
+std::string requestBody(const Options &o) {
+  const std::string model = "\"model\":\"" + jsonEscape(o.model) + "\"";
+  const std::string stream = std::string("\"stream\":") + (o.stream ? "true" : "false");
+  const std::string prompt = jsonEscape(o.prompt);
+  if (o.path == "/api/generate") {
+    return "{" + model + ",\"prompt\":\"" + prompt + "\"," + stream +
+           ",\"options\":{\"num_predict\":" + std::to_string(o.max_tokens) + "}}";
+  }
+  const std::string messages = "\"messages\":[{\"role\":\"user\",\"content\":\"" + prompt + "\"}]";
+  if (o.path == "/api/chat") {
+    return "{" + model + "," + messages + "," + stream +
+           ",\"options\":{\"num_predict\":" + std::to_string(o.max_tokens) + "}}";
+  }
+  return "{" + model + "," + messages + "," + stream +
+         ",\"max_tokens\":" + std::to_string(o.max_tokens) + "}";
+}
+
+int connectTo(const Options &o) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(o.port));
+  inet_pton(AF_INET, o.host.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+// Minimal blocking HTTP/1.1 response reader over one connection
+class Reader {
+public:
+  explicit Reader(int fd) : fd_(fd) {}
+
+  // Reads one response; false on a connection or protocol error
+  bool readResponse(int &status, bool &keep_alive, size_t &body_bytes,
+                    Clock::time_point &first_byte) {
+    std::string line;
+    if (!readLine(line) || line.compare(0, 9, "HTTP/1.1 ") != 0) {
+      return false;
+    }
+    status = std::atoi(line.c_str() + 9);
+    long long content_length = -1;
+    bool chunked = false;
+    keep_alive = true;
+    for (;;) {
+      if (!readLine(line)) {
+        return false;
+      }
+      if (line.empty()) {
+        break;
+      }
+      std::string lower = line;
+      std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+      if (lower.compare(0, 15, "content-length:") == 0) {
+        content_length = std::atoll(lower.c_str() + 15);
+      } else if (lower.find("transfer-encoding:") == 0 &&
+                 lower.find("chunked") != std::string::npos) {
+        chunked = true;
+      } else if (lower.find("connection:") == 0 &&
+                 lower.find("close") != std::string::npos) {
+        keep_alive = false;
+      }
+    }
+    body_bytes = 0;
+    first_byte = Clock::time_point();
+    if (chunked) {
+      for (;;) {
+        if (!readLine(line)) {
+          return false;
+        }
+        const size_t size = std::strtoul(line.c_str(), nullptr, 16);
+        if (size == 0) {
+          return readLine(line); // trailing CRLF
+        }
+        if (!readBytes(size + 2, first_byte)) {
+          return false;
+        }
+        body_bytes += size;
+      }
+    }
+    if (content_length < 0) {
+      keep_alive = false; // body runs to connection close
+      while (fill(first_byte)) {
+        body_bytes += buffer_.size();
+        buffer_.clear();
+      }
+      return true;
+    }
+    body_bytes = static_cast<size_t>(content_length);
+    return readBytes(body_bytes, first_byte);
+  }
+
+private:
+  bool fill(Clock::time_point &first_byte) {
+    char chunk[16384];
+    const ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    if (first_byte == Clock::time_point()) {
+      first_byte = Clock::now();
+    }
+    buffer_.append(chunk, static_cast<size_t>(n));
+    return true;
+  }
+
+  bool readLine(std::string &line) {
+    Clock::time_point ignored = Clock::now();
+    size_t end;
+    while ((end = buffer_.find("\r\n")) == std::string::npos) {
+      if (!fill(ignored)) {
+        return false;
+      }
+    }
+    line = buffer_.substr(0, end);
+    buffer_.erase(0, end + 2);
+    return true;
+  }
+
+  bool readBytes(size_t n, Clock::time_point &first_byte) {
+    if (!buffer_.empty() && first_byte == Clock::time_point()) {
+      first_byte = Clock::now();
+    }
+    while (buffer_.size() < n) {
+      if (!fill(first_byte)) {
+        return false;
+      }
+    }
+    buffer_.erase(0, n);
+    return true;
+  }
+
+  int fd_;
+  std::string buffer_;
+};
+
+double percentile(std::vector<double> v, double q) {
+  if (v.empty()) {
+    return 0.0;
+  }
+  std::sort(v.begin(), v.end());
+  const size_t i = std::min(v.size() - 1, static_cast<size_t>(q * (v.size() - 1) + 0.5));
+  return v[i];
+}
+
+bool parseArgs(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    auto next = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+    const char *v = nullptr;
+    if (arg == "--stream") {
+      o.stream = true;
+    } else if (arg == "--host" && (v = next())) {
+      o.host = v;
+    } else if (arg == "--port" && (v = next())) {
+      o.port = std::atoi(v);
+    } else if (arg == "--path" && (v = next())) {
+      o.path = v;
+    } else if (arg == "--connections" && (v = next())) {
+      o.connections = std::max(1, std::atoi(v));
+    } else if (arg == "--requests" && (v = next())) {
+      o.requests = std::max(1, std::atoi(v));
+    } else if (arg == "--model" && (v = next())) {
+      o.model = v;
+    } else if (arg == "--prompt" && (v = next())) {
+      o.prompt = v;
+    } else if (arg == "--max-tokens" && (v = next())) {
+      o.max_tokens = std::atoi(v);
+    } else {
+      std::fprintf(stderr, "unknown or incomplete argument: %s\n", arg.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options o;
+  if (!parseArgs(argc, argv, o)) {
+    return 2;
+  }
+
+  std::string request;
+  if (isGetPath(o.path)) {
+    request = "GET " + o.path + " HTTP/1.1\r\nHost: " + o.host + "\r\n\r\n";
+  } else {
+    const std::string body = requestBody(o);
+    request = "POST " + o.path + " HTTP/1.1\r\nHost: " + o.host +
+              "\r\nContent-Type: application/json\r\nContent-Length: " +
+              std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+
+  std::atomic<int> next_request{0};
+  std::atomic<int> failures{0};
+  std::atomic<int> reconnects{0};
+  std::mutex samples_mutex;
+  std::vector<Sample> samples;
+
+  const auto wall_start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int c = 0; c < o.connections; ++c) {
+    threads.emplace_back([&] {
+      int fd = -1;
+      std::unique_ptr<Reader> reader;
+      while (next_request.fetch_add(1) < o.requests) {
+        if (fd < 0) {
+          fd = connectTo(o);
+          if (fd < 0) {
+            failures++;
+            continue;
+          }
+          reader.reset(new Reader(fd));
+          reconnects++;
+        }
+        const auto start = Clock::now();
+        int status = 0;
+        bool keep_alive = false;
+        size_t body_bytes = 0;
+        Clock::time_point first_byte;
+        const bool ok = ::send(fd, request.data(), request.size(), MSG_NOSIGNAL) ==
+                            static_cast<ssize_t>(request.size()) &&
+                        reader->readResponse(status, keep_alive, body_bytes, first_byte);
+        const auto end = Clock::now();
+        if (!ok || status != 200) {
+          failures++;
+        } else {
+          std::lock_guard<std::mutex> lock(samples_mutex);
+          samples.push_back(
+              {std::chrono::duration<double, std::milli>(end - start).count(),
+               std::chrono::duration<double, std::milli>(first_byte - start).count(),
+               body_bytes});
+        }
+        if (!ok || !keep_alive) {
+          close(fd);
+          fd = -1;
+        }
+      }
+      if (fd >= 0) {
+        close(fd);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  const double wall_s = std::chrono::duration<double>(Clock::now() - wall_start).count();
+
+  std::vector<double> latency, first_byte;
+  size_t bytes = 0;
+  for (const auto &s : samples) {
+    latency.push_back(s.latency_ms);
+    first_byte.push_back(s.first_byte_ms);
+    bytes += s.body_bytes;
+  }
+  std::printf("%s %s connections=%d requests=%d stream=%s\n",
+              isGetPath(o.path) ? "GET" : "POST", o.path.c_str(), o.connections,
+              o.requests, o.stream ? "yes" : "no");
+  std::printf("  ok %zu  failed %d  connections opened %d\n", samples.size(),
+              failures.load(), reconnects.load());
+  std::printf("  %.1f req/s  %.1f KiB/s body  (%.2f s)\n", samples.size() / wall_s,
+              bytes / 1024.0 / wall_s, wall_s);
+  std::printf("  latency ms     p50 %8.2f  p90 %8.2f  p99 %8.2f\n", percentile(latency, 0.5),
+              percentile(latency, 0.9), percentile(latency, 0.99));
+  std::printf("  first byte ms  p50 %8.2f  p90 %8.2f  p99 %8.2f\n",
+              percentile(first_byte, 0.5), percentile(first_byte, 0.9),
+              percentile(first_byte, 0.99));
+  return failures.load() == 0 ? 0 : 1;
+}
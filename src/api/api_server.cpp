@@ -1,605 +1,1525 @@
-// #include "api_server.h"
-// #include "../core/model_manager.h"
-// #include "../core/logger.h"
-
-// #include <iostream>
-// #include <sstream>
-// #include <regex>
-// #include <chrono>
-// #include <sys/socket.h>
-// #include <netinet/in.h>
-// #include <arpa/inet.h>
-// #include <unistd.h>
-// #include <fcntl.h>
-
-// namespace duorou {
-
-// ApiServer::ApiServer(std::shared_ptr<core::ModelManager> model_manager,
-//                      std::shared_ptr<core::Logger> logger,
-//                      int port)
-//     : model_manager_(model_manager)
-//     , logger_(logger)
-//     , port_(port)
-//     , address_("127.0.0.1")
-//     , running_(false)
-//     , server_socket_(-1) {
-//     setupRoutes();
-// }
-
-// ApiServer::~ApiServer() {
-//     stop();
-// }
-
-// bool ApiServer::start() {
-//     if (running_) {
-//         return true;
-//     }
-
-//     // Create socket
-//     server_socket_ = socket(AF_INET, SOCK_STREAM, 0);
-//     if (server_socket_ < 0) {
-//         logger_->error("Failed to create socket");
-//         return false;
-//     }
-
-//     // Set socket options
-//     int opt = 1;
-//     if (setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &opt,
-//     sizeof(opt)) < 0) {
-//         logger_->error("Failed to set socket options");
-//         close(server_socket_);
-//         return false;
-//     }
-
-//     // Bind socket
-//     struct sockaddr_in address;
-//     address.sin_family = AF_INET;
-//     address.sin_addr.s_addr = inet_addr(address_.c_str());
-//     address.sin_port = htons(port_);
-
-//     if (bind(server_socket_, (struct sockaddr*)&address, sizeof(address)) <
-//     0) {
-//         logger_->error("Failed to bind socket to port " +
-//         std::to_string(port_)); close(server_socket_); return false;
-//     }
-
-//     // Listen for connections
-//     if (listen(server_socket_, 10) < 0) {
-//         logger_->error("Failed to listen on socket");
-//         close(server_socket_);
-//         return false;
-//     }
-
-//     running_ = true;
-//     server_thread_ = std::thread(&ApiServer::serverLoop, this);
-
-//     logger_->info("API Server started on " + address_ + ":" +
-//     std::to_string(port_)); return true;
-// }
-
-// void ApiServer::stop() {
-//     if (!running_) {
-//         return;
-//     }
-
-//     running_ = false;
-
-//     if (server_socket_ >= 0) {
-//         close(server_socket_);
-//         server_socket_ = -1;
-//     }
-
-//     if (server_thread_.joinable()) {
-//         server_thread_.join();
-//     }
-
-//     logger_->info("API Server stopped");
-// }
-
-// void ApiServer::addRoute(const std::string& method, const std::string& path,
-// RouteHandler handler) {
-//     routes_[method][path] = handler;
-// }
-
-// void ApiServer::serverLoop() {
-//     while (running_) {
-//         struct sockaddr_in client_addr;
-//         socklen_t client_len = sizeof(client_addr);
-
-//         int client_socket = accept(server_socket_, (struct
-//         sockaddr*)&client_addr, &client_len); if (client_socket < 0) {
-//             if (running_) {
-//                 logger_->error("Failed to accept client connection");
-//             }
-//             continue;
-//         }
-
-//         // Handle request in a separate thread for better concurrency
-//         std::thread([this, client_socket]() {
-//             // Read request
-//             char buffer[4096];
-//             ssize_t bytes_read = recv(client_socket, buffer, sizeof(buffer) -
-//             1, 0);
-
-//             if (bytes_read > 0) {
-//                 buffer[bytes_read] = '\0';
-
-//                 // Parse HTTP request
-//                 HttpRequest request;
-//                 std::string request_str(buffer);
-
-//                 // Parse request line
-//                 std::istringstream iss(request_str);
-//                 std::string line;
-//                 if (std::getline(iss, line)) {
-//                     std::istringstream line_stream(line);
-//                     line_stream >> request.method >> request.path;
-//                 }
-
-//                 // Parse headers
-//                 while (std::getline(iss, line) && line != "\r") {
-//                     size_t colon_pos = line.find(':');
-//                     if (colon_pos != std::string::npos) {
-//                         std::string key = line.substr(0, colon_pos);
-//                         std::string value = line.substr(colon_pos + 1);
-//                         // Trim whitespace
-//                         value.erase(0, value.find_first_not_of(" \t"));
-//                         value.erase(value.find_last_not_of(" \r") + 1);
-//                         request.headers[key] = value;
-//                     }
-//                 }
-
-//                 // Read body if present
-//                 auto content_length_it =
-//                 request.headers.find("Content-Length"); if (content_length_it
-//                 != request.headers.end()) {
-//                     int content_length =
-//                     std::stoi(content_length_it->second); if (content_length
-//                     > 0) {
-//                         request.body.resize(content_length);
-//                         recv(client_socket, &request.body[0], content_length,
-//                         0);
-//                     }
-//                 }
-
-//                 // Handle request
-//                 HttpResponse response = handleRequest(request);
-
-//                 // Send response
-//                 std::ostringstream response_stream;
-//                 response_stream << "HTTP/1.1 " << response.status_code << "
-//                 OK\r\n";
-
-//                 for (const auto& header : response.headers) {
-//                     response_stream << header.first << ": " << header.second
-//                     << "\r\n";
-//                 }
-
-//                 response_stream << "Content-Length: " <<
-//                 response.body.length() << "\r\n"; response_stream << "\r\n";
-//                 response_stream << response.body;
-
-//                 std::string response_str = response_stream.str();
-//                 send(client_socket, response_str.c_str(),
-//                 response_str.length(), 0);
-//             }
-
-//             close(client_socket);
-//         }).detach();
-//     }
-// }
-
-// HttpResponse ApiServer::handleRequest(const HttpRequest& request) {
-//     logger_->info("API Request: " + request.method + " " + request.path);
-
-//     // Find handler
-//     RouteHandler handler = findHandler(request.method, request.path);
-//     if (handler) {
-//         try {
-//             return handler(request);
-//         } catch (const std::exception& e) {
-//             HttpResponse response;
-//             response.setError(500, "Internal server error: " +
-//             std::string(e.what()), "internal_error"); return response;
-//         }
-//     }
-
-//     // Route not found
-//     HttpResponse response;
-//     response.setError(404, "Route not found: " + request.method + " " +
-//     request.path, "not_found_error"); return response;
-// }
-
-// RouteHandler ApiServer::findHandler(const std::string& method, const
-// std::string& path) {
-//     auto method_it = routes_.find(method);
-//     if (method_it != routes_.end()) {
-//         auto path_it = method_it->second.find(path);
-//         if (path_it != method_it->second.end()) {
-//             return path_it->second;
-//         }
-
-//         // Try pattern matching for parameterized routes
-//         for (const auto& route : method_it->second) {
-//             if (route.first.find("{") != std::string::npos) {
-//                 // Simple pattern matching - can be enhanced
-//                 // For now, just do simple string comparison
-//                 if (route.first == path) {
-//                     return route.second;
-//                 }
-//             }
-//         }
-//     }
-
-//     return nullptr;
-// }
-
-// void ApiServer::setupRoutes() {
-//     // Health and info endpoints
-//     addRoute("GET", "/health", [this](const HttpRequest& req) { return
-//     handleHealth(req); }); addRoute("GET", "/info", [this](const HttpRequest&
-//     req) { return handleInfo(req); });
-
-//     // Model management endpoints
-//     addRoute("GET", "/v1/models", [this](const HttpRequest& req) { return
-//     handleListModels(req); }); addRoute("POST", "/v1/models/load",
-//     [this](const HttpRequest& req) { return handleLoadModel(req); });
-//     addRoute("POST", "/v1/models/unload", [this](const HttpRequest& req) {
-//     return handleUnloadModel(req); }); addRoute("GET", "/v1/models/info",
-//     [this](const HttpRequest& req) { return handleModelInfo(req); });
-
-//     // OpenAI compatible endpoints
-//     addRoute("POST", "/v1/chat/completions", [this](const HttpRequest& req) {
-//     return handleChatCompletions(req); }); addRoute("POST",
-//     "/v1/completions", [this](const HttpRequest& req) { return
-//     handleCompletions(req); });
-
-//     // Image generation endpoints
-//     addRoute("POST", "/v1/images/generations", [this](const HttpRequest& req)
-//     { return handleImageGeneration(req); });
-// }
-
-// HttpResponse ApiServer::handleHealth(const HttpRequest& request) {
-//     HttpResponse response;
-//     nlohmann::json health_json = {
-//         {"status", "healthy"},
-//         {"timestamp", std::chrono::duration_cast<std::chrono::seconds>(
-//             std::chrono::system_clock::now().time_since_epoch()).count()},
-//         {"version", "1.0.0"}
-//     };
-//     response.setJson(health_json);
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleInfo(const HttpRequest& request) {
-//     HttpResponse response;
-//     nlohmann::json info_json = {
-//         {"name", "Duorou AI Server"},
-//         {"version", "1.0.0"},
-//         {"description", "Multi-modal AI inference server"},
-//         {"supported_models", nlohmann::json::array({"language",
-//         "diffusion"})},
-//         {"endpoints", nlohmann::json::array({
-//             "/health", "/info", "/v1/models", "/v1/chat/completions",
-//             "/v1/images/generations"
-//         })}
-//     };
-//     response.setJson(info_json);
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleListModels(const HttpRequest& request) {
-//     HttpResponse response;
-
-//     auto models = model_manager_->getAllModels();
-//     nlohmann::json models_json = nlohmann::json::array();
-
-//     for (const auto& model : models) {
-//         nlohmann::json model_json = {
-//             {"id", model.name},
-//             {"object", "model"},
-//             {"created", std::chrono::duration_cast<std::chrono::seconds>(
-//                 std::chrono::system_clock::now().time_since_epoch()).count()},
-//             {"owned_by", "duorou"},
-//             {"type", model.type == core::ModelType::LANGUAGE_MODEL ?
-//             "language" : "diffusion"},
-//             {"status", model.status == core::ModelStatus::LOADED ? "loaded" :
-//             "not_loaded"},
-//             {"path", model.path},
-//             {"memory_usage", model.memory_usage}
-//         };
-//         models_json.push_back(model_json);
-//     }
-
-//     nlohmann::json result = {
-//         {"object", "list"},
-//         {"data", models_json}
-//     };
-
-//     response.setJson(result);
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleLoadModel(const HttpRequest& request) {
-//     HttpResponse response;
-
-//     try {
-//         nlohmann::json req_json = parseRequestBody(request);
-
-//         if (!req_json.contains("path") || !req_json.contains("type")) {
-//             response.setError(400, "Missing required fields: path, type",
-//             "invalid_request_error"); return response;
-//         }
-
-//         std::string path = req_json["path"];
-//         std::string type_str = req_json["type"];
-
-//         core::ModelType type = (type_str == "language") ?
-//         core::ModelType::LANGUAGE_MODEL : core::ModelType::DIFFUSION_MODEL;
-
-//         // Note: ModelManager::loadModel expects model_id, not path
-//         // For now, use path as model_id - this should be improved
-//         bool success = model_manager_->loadModel(path);
-
-//         if (success) {
-//             nlohmann::json result = {
-//                 {"success", true},
-//                 {"message", "Model loaded successfully"},
-//                 {"path", path},
-//                 {"type", type_str}
-//             };
-//             response.setJson(result);
-//         } else {
-//             response.setError(500, "Failed to load model",
-//             "model_load_error");
-//         }
-
-//     } catch (const std::exception& e) {
-//         response.setError(400, "Invalid JSON request: " +
-//         std::string(e.what()), "invalid_request_error");
-//     }
-
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleUnloadModel(const HttpRequest& request) {
-//     HttpResponse response;
-
-//     try {
-//         nlohmann::json req_json = parseRequestBody(request);
-
-//         if (!req_json.contains("path")) {
-//             response.setError(400, "Missing required field: path",
-//             "invalid_request_error"); return response;
-//         }
-
-//         std::string path = req_json["path"];
-//         // Note: ModelManager::unloadModel expects model_id, not path
-//         // For now, use path as model_id - this should be improved
-//         model_manager_->unloadModel(path);
-
-//         nlohmann::json result = {
-//             {"success", true},
-//             {"message", "Model unloaded successfully"},
-//             {"path", path}
-//         };
-//         response.setJson(result);
-
-//     } catch (const std::exception& e) {
-//         response.setError(400, "Invalid JSON request: " +
-//         std::string(e.what()), "invalid_request_error");
-//     }
-
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleModelInfo(const HttpRequest& request) {
-//     HttpResponse response;
-
-//     auto models = model_manager_->getAllModels();
-//     nlohmann::json info_json = {
-//         {"total_models", models.size()},
-//         {"loaded_models", std::count_if(models.begin(), models.end(),
-//             [](const core::ModelInfo& m) { return m.status ==
-//             core::ModelStatus::LOADED; })},
-//         {"total_memory_usage", std::accumulate(models.begin(), models.end(),
-//         0ULL,
-//             [](size_t sum, const core::ModelInfo& m) { return sum +
-//             m.memory_usage; })}
-//     };
-
-//     response.setJson(info_json);
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleChatCompletions(const HttpRequest& request) {
-//     HttpResponse response;
-
-//     try {
-//         nlohmann::json req_json = parseRequestBody(request);
-
-//         if (!req_json.contains("messages")) {
-//             response.setError(400, "Missing required field: messages",
-//             "invalid_request_error"); return response;
-//         }
-
-//         // Extract parameters
-//         auto messages = req_json["messages"];
-//         std::string model = req_json.value("model", "default");
-//         int max_tokens = req_json.value("max_tokens", 100);
-//         float temperature = req_json.value("temperature", 0.7f);
-
-//         // Build prompt from messages
-//         std::string prompt;
-//         for (const auto& message : messages) {
-//             std::string role = message["role"];
-//             std::string content = message["content"];
-//             prompt += role + ": " + content + "\n";
-//         }
-//         prompt += "assistant: ";
-
-//         // Generate response using model manager
-//         // Note: This is a placeholder - actual text generation would need to
-//         be implemented std::string generated_text = "Generated response for:
-//         " + prompt.substr(0, 50) + "...";
-
-//         // Format OpenAI-compatible response
-//         nlohmann::json result = {
-//             {"id", "chatcmpl-" +
-//             std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
-//                 std::chrono::system_clock::now().time_since_epoch()).count())},
-//             {"object", "chat.completion"},
-//             {"created", std::chrono::duration_cast<std::chrono::seconds>(
-//                 std::chrono::system_clock::now().time_since_epoch()).count()},
-//             {"model", model},
-//             {"choices", nlohmann::json::array({
-//                 {
-//                     {"index", 0},
-//                     {"message", {
-//                         {"role", "assistant"},
-//                         {"content", generated_text}
-//                     }},
-//                     {"finish_reason", "stop"}
-//                 }
-//             })},
-//             {"usage", {
-//                 {"prompt_tokens", prompt.length() / 4}, // Rough estimate
-//                 {"completion_tokens", generated_text.length() / 4},
-//                 {"total_tokens", (prompt.length() + generated_text.length())
-//                 / 4}
-//             }}
-//         };
-
-//         response.setJson(result);
-
-//     } catch (const std::exception& e) {
-//         response.setError(400, "Invalid request: " + std::string(e.what()),
-//         "invalid_request_error");
-//     }
-
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleCompletions(const HttpRequest& request) {
-//     HttpResponse response;
-
-//     try {
-//         nlohmann::json req_json = parseRequestBody(request);
-
-//         if (!req_json.contains("prompt")) {
-//             response.setError(400, "Missing required field: prompt",
-//             "invalid_request_error"); return response;
-//         }
-
-//         std::string prompt = req_json["prompt"];
-//         std::string model = req_json.value("model", "default");
-//         int max_tokens = req_json.value("max_tokens", 100);
-//         float temperature = req_json.value("temperature", 0.7f);
-
-//         // Generate response
-//         // Note: This is a placeholder - actual text generation would need to
-//         be implemented std::string generated_text = "Generated response for:
-//         " + prompt.substr(0, 50) + "...";
-
-//         // Format OpenAI-compatible response
-//         nlohmann::json result = {
-//             {"id", "cmpl-" +
-//             std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
-//                 std::chrono::system_clock::now().time_since_epoch()).count())},
-//             {"object", "text_completion"},
-//             {"created", std::chrono::duration_cast<std::chrono::seconds>(
-//                 std::chrono::system_clock::now().time_since_epoch()).count()},
-//             {"model", model},
-//             {"choices", nlohmann::json::array({
-//                 {
-//                     {"text", generated_text},
-//                     {"index", 0},
-//                     {"finish_reason", "stop"}
-//                 }
-//             })},
-//             {"usage", {
-//                 {"prompt_tokens", prompt.length() / 4},
-//                 {"completion_tokens", generated_text.length() / 4},
-//                 {"total_tokens", (prompt.length() + generated_text.length())
-//                 / 4}
-//             }}
-//         };
-
-//         response.setJson(result);
-
-//     } catch (const std::exception& e) {
-//         response.setError(400, "Invalid request: " + std::string(e.what()),
-//         "invalid_request_error");
-//     }
-
-//     return response;
-// }
-
-// HttpResponse ApiServer::handleImageGeneration(const HttpRequest& request) {
-//     HttpResponse response;
-
-//     try {
-//         nlohmann::json req_json = parseRequestBody(request);
-
-//         if (!req_json.contains("prompt")) {
-//             response.setError(400, "Missing required field: prompt",
-//             "invalid_request_error"); return response;
-//         }
-
-//         std::string prompt = req_json["prompt"];
-//         std::string model = req_json.value("model", "default");
-//         int width = req_json.value("width", 512);
-//         int height = req_json.value("height", 512);
-//         int steps = req_json.value("steps", 20);
-//         float cfg_scale = req_json.value("cfg_scale", 7.5f);
-
-//         // Generate image using model manager
-//         // Note: This is a placeholder - actual image generation would need
-//         to be implemented std::string image_data = ""; // Empty for now
-
-//         if (image_data.empty()) {
-//             response.setError(500, "Failed to generate image",
-//             "image_generation_error"); return response;
-//         }
-
-//         // Format response
-//         nlohmann::json result = {
-//             {"created", std::chrono::duration_cast<std::chrono::seconds>(
-//                 std::chrono::system_clock::now().time_since_epoch()).count()},
-//             {"data", nlohmann::json::array({
-//                 {
-//                     {"url", "data:image/png;base64," + image_data}, // Base64
-//                     encoded image
-//                     {"width", width},
-//                     {"height", height}
-//                 }
-//             })}
-//         };
-
-//         response.setJson(result);
-
-//     } catch (const std::exception& e) {
-//         response.setError(400, "Invalid request: " + std::string(e.what()),
-//         "invalid_request_error");
-//     }
-
-//     return response;
-// }
-
-// std::string ApiServer::extractModelId(const std::string& path) {
-//     size_t pos = path.find_last_of('/');
-//     if (pos != std::string::npos) {
-//         return path.substr(pos + 1);
-//     }
-//     return path;
-// }
-
-// nlohmann::json ApiServer::parseRequestBody(const HttpRequest& request) {
-//     if (request.body.empty()) {
-//         return nlohmann::json::object();
-//     }
-
-//     return nlohmann::json::parse(request.body);
-// }
-
-// } // namespace duorou
\ No newline at end of file
+#include "api_server.h"
+#include "../core/logger.h"
+#include "../core/model_manager.h"
+#include "../core/text_generator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace duorou {
+
+// Per-connection state. The event loop owns the socket and the input and
+// output buffers; the worker answering the current request appends to
+// `pending` under `mutex` and wakes the loop.
+struct ResponseWriter::Connection {
+  uint64_t id = 0;
+  int fd = -1;
+  std::string remote_address;
+
+  // Event loop only
+  std::string input;
+  std::string output;          ///< Bytes being written to the socket
+  bool busy = false;           ///< A request is being answered
+  bool continue_sent = false;  ///< "100 Continue" sent for the current request
+  bool want_write = false;     ///< EPOLLOUT registered
+  std::chrono::steady_clock::time_point last_active;
+
+  // Shared with the worker
+  std::mutex mutex;
+  std::string pending;
+  bool response_done = false;
+  bool response_keep_alive = true;
+  std::atomic<bool> closed{false};
+};
+
+namespace {
+
+constexpr uint64_t kListenerId = 0;
+constexpr uint64_t kWakeId = 1;
+
+const char *reasonPhrase(int code) {
+  switch (code) {
+  case 100: return "Continue";
+  case 200: return "OK";
+  case 400: return "Bad Request";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 411: return "Length Required";
+  case 413: return "Payload Too Large";
+  case 429: return "Too Many Requests";
+  case 431: return "Request Header Fields Too Large";
+  case 500: return "Internal Server Error";
+  case 503: return "Service Unavailable";
+  default: return "Unknown";
+  }
+}
+
+std::string toLower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return s;
+}
+
+std::string trim(const std::string &s) {
+  const size_t begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+}
+
+std::string urlDecode(const std::string &s) {
+  std::string out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '+') {
+      out += ' ';
+    } else if (s[i] == '%' && i + 2 < s.size() &&
+               std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+               std::isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+      out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+      i += 2;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+// Parse the request line and headers (up to, not including, the blank
+// line). False on malformed input.
+bool parseHead(const std::string &head, HttpRequest &request) {
+  size_t line_end = head.find("\r\n");
+  const std::string request_line = head.substr(0, line_end);
+  std::istringstream line_stream(request_line);
+  std::string target;
+  if (!(line_stream >> request.method >> target >> request.version) ||
+      request.version.compare(0, 5, "HTTP/") != 0 || target.empty()) {
+    return false;
+  }
+
+  const size_t query = target.find('?');
+  request.path = target.substr(0, query);
+  if (query != std::string::npos) {
+    std::istringstream params(target.substr(query + 1));
+    std::string pair;
+    while (std::getline(params, pair, '&')) {
+      const size_t eq = pair.find('=');
+      request.query_params[urlDecode(pair.substr(0, eq))] =
+          eq == std::string::npos ? "" : urlDecode(pair.substr(eq + 1));
+    }
+  }
+
+  while (line_end != std::string::npos) {
+    const size_t start = line_end + 2;
+    line_end = head.find("\r\n", start);
+    const std::string line = head.substr(start, line_end - start);
+    if (line.empty()) {
+      continue;
+    }
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos || colon == 0) {
+      return false;
+    }
+    request.headers[toLower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+  }
+  return true;
+}
+
+bool wantsKeepAlive(const HttpRequest &request) {
+  const std::string connection = toLower(request.header("connection"));
+  if (request.version == "HTTP/1.0") {
+    return connection == "keep-alive";
+  }
+  return connection != "close";
+}
+
+int64_t unixSeconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// RFC 3339 UTC timestamp, as Ollama's created_at
+std::string isoTimestamp() {
+  const std::time_t now = std::time(nullptr);
+  std::tm tm{};
+#ifdef _WIN32
+  gmtime_s(&tm, &now);
+#else
+  gmtime_r(&now, &tm);
+#endif
+  std::ostringstream oss;
+  oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
+  return oss.str();
+}
+
+bool generationFailed(const core::GenerationResult &result) {
+  return result.stop_reason == "error" || result.stop_reason == "exception";
+}
+
+std::string finishReason(const core::GenerationResult &result,
+                         const core::GenerationParams &params) {
+  return params.max_tokens > 0 &&
+                 result.generated_tokens >= static_cast<size_t>(params.max_tokens)
+             ? "length"
+             : "stop";
+}
+
+// Optional request fields. Absent or null means the default; any other
+// type mismatch is reported to the client as std::invalid_argument.
+const nlohmann::json *optionalField(const nlohmann::json &object, const char *key) {
+  auto it = object.find(key);
+  return it == object.end() || it->is_null() ? nullptr : &*it;
+}
+
+template <typename T>
+T numberField(const nlohmann::json &object, const char *key, T fallback) {
+  const nlohmann::json *value = optionalField(object, key);
+  if (!value) {
+    return fallback;
+  }
+  if (!value->is_number()) {
+    throw std::invalid_argument(std::string("field '") + key + "' must be a number");
+  }
+  return value->get<T>();
+}
+
+bool boolField(const nlohmann::json &object, const char *key, bool fallback) {
+  const nlohmann::json *value = optionalField(object, key);
+  if (!value) {
+    return fallback;
+  }
+  if (!value->is_boolean()) {
+    throw std::invalid_argument(std::string("field '") + key + "' must be a boolean");
+  }
+  return value->get<bool>();
+}
+
+std::string stringField(const nlohmann::json &object, const char *key,
+                        const std::string &fallback) {
+  const nlohmann::json *value = optionalField(object, key);
+  if (!value) {
+    return fallback;
+  }
+  if (!value->is_string()) {
+    throw std::invalid_argument(std::string("field '") + key + "' must be a string");
+  }
+  return value->get<std::string>();
+}
+
+void readStop(const nlohmann::json &value, core::GenerationParams &params) {
+  if (value.is_string()) {
+    params.stop_sequences.push_back(value.get<std::string>());
+  } else if (value.is_array()) {
+    for (const auto &stop : value) {
+      if (stop.is_string()) {
+        params.stop_sequences.push_back(stop.get<std::string>());
+      }
+    }
+  }
+}
+
+// Ollama "options" object; std::invalid_argument on mistyped fields
+core::GenerationParams ollamaParams(const nlohmann::json &body) {
+  core::GenerationParams params;
+  const nlohmann::json *found = optionalField(body, "options");
+  if (found && !found->is_object()) {
+    throw std::invalid_argument("field 'options' must be an object");
+  }
+  const nlohmann::json options = found ? *found : nlohmann::json::object();
+  params.max_tokens = numberField(options, "num_predict", params.max_tokens);
+  params.temperature = numberField(options, "temperature", params.temperature);
+  params.top_p = numberField(options, "top_p", params.top_p);
+  params.top_k = numberField(options, "top_k", params.top_k);
+  params.repeat_penalty = numberField(options, "repeat_penalty", params.repeat_penalty);
+  params.repeat_last_n = numberField(options, "repeat_last_n", params.repeat_last_n);
+  params.seed = numberField(options, "seed", params.seed);
+  if (options.contains("stop")) {
+    readStop(options["stop"], params);
+  }
+  return params;
+}
+
+// OpenAI chat completion parameters; std::invalid_argument on mistyped fields
+core::GenerationParams openAiParams(const nlohmann::json &body) {
+  core::GenerationParams params;
+  params.max_tokens = numberField(body, "max_tokens", params.max_tokens);
+  params.max_tokens = numberField(body, "max_completion_tokens", params.max_tokens);
+  params.temperature = numberField(body, "temperature", params.temperature);
+  params.top_p = numberField(body, "top_p", params.top_p);
+  params.seed = numberField(body, "seed", params.seed);
+  if (body.contains("stop")) {
+    readStop(body["stop"], params);
+  }
+  return params;
+}
+
+HttpResponse ollamaError(int code, const std::string &message) {
+  HttpResponse response;
+  response.status_code = code;
+  response.setJson({{"error", message}});
+  return response;
+}
+
+HttpResponse openAiError(int code, const std::string &message) {
+  HttpResponse response;
+  response.setError(code, message, code == 429 ? "rate_limit_error" : "server_error");
+  return response;
+}
+
+// Who a request is accounted to by the inference queue
+std::string clientId(const HttpRequest &request, const nlohmann::json &body) {
+  std::string id = request.header("x-client-id");
+  if (id.empty() && body.contains("user") && body["user"].is_string()) {
+    id = body["user"].get<std::string>();
+  }
+  if (id.empty()) {
+    id = request.remote_address;
+  }
+  return id.empty() ? "anonymous" : id;
+}
+
+// Prometheus label value: backslash, double quote and newline escaped
+std::string labelValue(const std::string &value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// One model's series of a histogram in the Prometheus text format
+void writeHistogram(std::ostringstream &out, const char *name, const std::string &model,
+                    const core::LatencyHistogramMetrics &histogram) {
+  const std::string label = "model=\"" + labelValue(model) + "\"";
+  uint64_t cumulative = 0;
+  for (size_t b = 0; b < histogram.bounds_ms.size(); ++b) {
+    cumulative += histogram.counts[b];
+    out << name << "_bucket{" << label << ",le=\"" << histogram.bounds_ms[b] / 1000.0
+        << "\"} " << cumulative << "\n";
+  }
+  out << name << "_bucket{" << label << ",le=\"+Inf\"} " << histogram.count << "\n"
+      << name << "_sum{" << label << "} " << histogram.sum_ms / 1000.0 << "\n"
+      << name << "_count{" << label << "} " << histogram.count << "\n";
+}
+
+} // namespace
+
+// ---- HttpRequest / HttpResponse ----
+
+std::string HttpRequest::header(const std::string &name) const {
+  auto it = headers.find(name);
+  return it == headers.end() ? std::string() : it->second;
+}
+
+void HttpResponse::setJson(const nlohmann::json &json) {
+  headers["Content-Type"] = "application/json";
+  body = json.dump();
+}
+
+void HttpResponse::setError(int code, const std::string &message,
+                            const std::string &type) {
+  status_code = code;
+  nlohmann::json error_json = {
+      {"error", {{"code", code}, {"message", message}, {"type", type}}}};
+  setJson(error_json);
+}
+
+// ---- ResponseWriter ----
+
+ResponseWriter::ResponseWriter(ApiServer *server,
+                               std::shared_ptr<Connection> connection,
+                               bool keep_alive, bool chunked)
+    : server_(server), connection_(std::move(connection)),
+      keep_alive_(keep_alive), chunked_(chunked) {}
+
+ResponseWriter::~ResponseWriter() {
+  if (done_) {
+    return;
+  }
+  if (started_) {
+    endStream();
+  } else {
+    HttpResponse response;
+    response.setError(500, "Handler returned no response", "internal_error");
+    send(response);
+  }
+}
+
+void ResponseWriter::send(const HttpResponse &response) {
+  if (started_ || done_) {
+    return;
+  }
+  std::ostringstream oss;
+  oss << "HTTP/1.1 " << response.status_code << " "
+      << reasonPhrase(response.status_code) << "\r\n";
+  for (const auto &header : response.headers) {
+    oss << header.first << ": " << header.second << "\r\n";
+  }
+  oss << "Content-Length: " << response.body.size() << "\r\n"
+      << "Connection: " << (keep_alive_ ? "keep-alive" : "close") << "\r\n\r\n"
+      << response.body;
+  started_ = true;
+  queue(oss.str(), true);
+}
+
+void ResponseWriter::beginStream(int status_code, const std::string &content_type) {
+  if (started_ || done_) {
+    return;
+  }
+  // HTTP/1.0 has no chunked encoding: the body ends when the connection does
+  if (!chunked_) {
+    keep_alive_ = false;
+  }
+  std::ostringstream oss;
+  oss << "HTTP/1.1 " << status_code << " " << reasonPhrase(status_code) << "\r\n"
+      << "Content-Type: " << content_type << "\r\n"
+      << "Cache-Control: no-cache\r\n"
+      << "Connection: " << (keep_alive_ ? "keep-alive" : "close") << "\r\n";
+  if (chunked_) {
+    oss << "Transfer-Encoding: chunked\r\n";
+  }
+  oss << "\r\n";
+  started_ = true;
+  queue(oss.str(), false);
+}
+
+bool ResponseWriter::writeChunk(const std::string &data) {
+  if (!started_ || done_) {
+    return false;
+  }
+  if (!data.empty()) {
+    if (chunked_) {
+      std::ostringstream oss;
+      oss << std::hex << data.size() << "\r\n" << data << "\r\n";
+      queue(oss.str(), false);
+    } else {
+      queue(data, false);
+    }
+  }
+  return clientConnected();
+}
+
+void ResponseWriter::endStream() {
+  if (!started_ || done_) {
+    return;
+  }
+  queue(chunked_ ? "0\r\n\r\n" : "", true);
+}
+
+bool ResponseWriter::clientConnected() const { return !connection_->closed; }
+
+void ResponseWriter::queue(std::string data, bool done) {
+  {
+    std::lock_guard<std::mutex> lock(connection_->mutex);
+    if (connection_->closed) {
+      done_ = done_ || done;
+      return;
+    }
+    connection_->pending += data;
+    if (done) {
+      connection_->response_done = true;
+      connection_->response_keep_alive = keep_alive_;
+    }
+  }
+  done_ = done_ || done;
+  server_->wakeLoop(connection_->id);
+}
+
+// ---- ApiServer ----
+
+ApiServer::ApiServer(std::shared_ptr<core::ModelManager> model_manager,
+                     std::shared_ptr<core::Logger> logger, int port)
+    : ApiServer(std::move(model_manager), std::move(logger), [port] {
+        ApiServerOptions options;
+        options.port = port;
+        return options;
+      }()) {}
+
+ApiServer::ApiServer(std::shared_ptr<core::ModelManager> model_manager,
+                     std::shared_ptr<core::Logger> logger,
+                     const ApiServerOptions &options)
+    : model_manager_(std::move(model_manager)), logger_(std::move(logger)),
+      options_(options), running_(false), workers_stopping_(false),
+      queued_jobs_(0), server_socket_(-1), epoll_fd_(-1), wake_fd_(-1),
+      next_connection_id_(kWakeId + 1) {
+  setupRoutes();
+}
+
+ApiServer::~ApiServer() { stop(); }
+
+void ApiServer::addRoute(const std::string &method, const std::string &path,
+                         RouteHandler handler) {
+  routes_[method][path] = [handler](const HttpRequest &request,
+                                    ResponseWriter &writer) {
+    writer.send(handler(request));
+  };
+}
+
+void ApiServer::addStreamRoute(const std::string &method,
+                               const std::string &path,
+                               StreamRouteHandler handler) {
+  routes_[method][path] = std::move(handler);
+}
+
+StreamRouteHandler ApiServer::findHandler(const std::string &method,
+                                          const std::string &path) const {
+  auto method_it = routes_.find(method);
+  if (method_it != routes_.end()) {
+    auto path_it = method_it->second.find(path);
+    if (path_it != method_it->second.end()) {
+      return path_it->second;
+    }
+  }
+  return nullptr;
+}
+
+#ifdef __linux__
+
+bool ApiServer::start() {
+  if (running_) {
+    return true;
+  }
+
+  auto fail = [this](const std::string &message) {
+    logger_->error(message + ": " + std::strerror(errno));
+    for (int *fd : {&server_socket_, &epoll_fd_, &wake_fd_}) {
+      if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+      }
+    }
+    return false;
+  };
+
+  server_socket_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server_socket_ < 0) {
+    return fail("Failed to create socket");
+  }
+  int opt = 1;
+  setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(options_.port));
+  if (inet_pton(AF_INET, options_.address.c_str(), &address.sin_addr) != 1) {
+    errno = EINVAL;
+    return fail("Invalid listen address " + options_.address);
+  }
+  if (bind(server_socket_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+    return fail("Failed to bind socket to port " + std::to_string(options_.port));
+  }
+  if (listen(server_socket_, SOMAXCONN) < 0) {
+    return fail("Failed to listen on socket");
+  }
+  // Port 0 picks a free port; report the real one
+  socklen_t len = sizeof(address);
+  if (getsockname(server_socket_, reinterpret_cast<sockaddr *>(&address), &len) == 0) {
+    options_.port = ntohs(address.sin_port);
+  }
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    return fail("Failed to create event loop");
+  }
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = kListenerId;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_socket_, &event);
+  event.data.u64 = kWakeId;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+  workers_stopping_ = false;
+  const size_t n_workers = std::max<size_t>(1, options_.worker_threads);
+  for (size_t i = 0; i < n_workers; ++i) {
+    workers_.emplace_back(&ApiServer::workerLoop, this);
+  }
+  running_ = true;
+  server_thread_ = std::thread(&ApiServer::serverLoop, this);
+
+  logger_->info("API Server started on " + options_.address + ":" +
+                std::to_string(options_.port) + " (" +
+                std::to_string(n_workers) + " workers)");
+  return true;
+}
+
+void ApiServer::stop() {
+  if (!running_) {
+    return;
+  }
+
+  running_ = false;
+  wakeLoop(kWakeId);
+  if (server_thread_.joinable()) {
+    server_thread_.join();
+  }
+
+  // Handlers still generating finish into closed connections; the wakeup
+  // fd stays open until they are done. Queued generations whose client is
+  // gone are skipped when their turn comes.
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    workers_stopping_ = true;
+    jobs_.clear();
+  }
+  jobs_cv_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+    jobs_cv_.wait(lock, [this] { return queued_jobs_ == 0; });
+  }
+
+  for (int *fd : {&server_socket_, &epoll_fd_, &wake_fd_}) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+  logger_->info("API Server stopped");
+}
+
+void ApiServer::serverLoop() {
+  constexpr int kMaxEvents = 64;
+  epoll_event events[kMaxEvents];
+  auto last_sweep = std::chrono::steady_clock::now();
+
+  while (running_) {
+    const int n = epoll_wait(epoll_fd_, events, kMaxEvents, 1000);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      logger_->error(std::string("epoll_wait failed: ") + std::strerror(errno));
+      break;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      const uint64_t id = events[i].data.u64;
+      if (id == kListenerId) {
+        acceptConnections();
+        continue;
+      }
+      if (id == kWakeId) {
+        drainWakeups();
+        continue;
+      }
+      auto it = connections_.find(id);
+      if (it == connections_.end()) {
+        continue; // closed earlier in this batch
+      }
+      std::shared_ptr<Connection> connection = it->second;
+      const uint32_t mask = events[i].events;
+      if (mask & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        readFromConnection(connection);
+      }
+      if (!connection->closed && (mask & EPOLLOUT)) {
+        flushConnection(connection);
+      }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_sweep >= std::chrono::seconds(1)) {
+      closeIdleConnections();
+      last_sweep = now;
+    }
+  }
+
+  while (!connections_.empty()) {
+    closeConnection(connections_.begin()->second);
+  }
+}
+
+void ApiServer::acceptConnections() {
+  for (;;) {
+    sockaddr_in peer{};
+    socklen_t peer_len = sizeof(peer);
+    const int fd = accept4(server_socket_, reinterpret_cast<sockaddr *>(&peer), &peer_len,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        logger_->warning(std::string("Failed to accept client connection: ") +
+                         std::strerror(errno));
+      }
+      return;
+    }
+    if (connections_.size() >= options_.max_connections) {
+      close(fd);
+      continue;
+    }
+    // Streamed tokens are small writes that must not wait for Nagle
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    auto connection = std::make_shared<Connection>();
+    connection->id = next_connection_id_++;
+    connection->fd = fd;
+    char peer_ip[INET_ADDRSTRLEN] = {};
+    if (inet_ntop(AF_INET, &peer.sin_addr, peer_ip, sizeof(peer_ip))) {
+      connection->remote_address = peer_ip;
+    }
+    connection->last_active = std::chrono::steady_clock::now();
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = connection->id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+      close(fd);
+      continue;
+    }
+    connections_.emplace(connection->id, std::move(connection));
+  }
+}
+
+void ApiServer::readFromConnection(const std::shared_ptr<Connection> &connection) {
+  // One request's worth of input; reading continues while a request is
+  // answered (to notice disconnects), so this is what bounds the buffer
+  const size_t max_input = options_.max_header_bytes + 4 + options_.max_body_bytes;
+  char buffer[16384];
+  for (;;) {
+    const ssize_t n = recv(connection->fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      connection->input.append(buffer, static_cast<size_t>(n));
+      if (connection->input.size() > max_input && !connection->busy) {
+        processInput(connection); // dispatches or rejects the buffered request
+        if (connection->closed) {
+          return;
+        }
+      }
+      if (connection->input.size() > max_input) {
+        closeConnection(connection);
+        return;
+      }
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    // Peer closed or reset: a handler still running writes into the void
+    closeConnection(connection);
+    return;
+  }
+  connection->last_active = std::chrono::steady_clock::now();
+  processInput(connection);
+}
+
+void ApiServer::processInput(const std::shared_ptr<Connection> &connection) {
+  if (connection->busy || connection->closed) {
+    return; // pipelined requests wait for the current response
+  }
+  std::string &input = connection->input;
+  const size_t head_end = input.find("\r\n\r\n");
+  if (head_end == std::string::npos) {
+    if (input.size() > options_.max_header_bytes) {
+      rejectRequest(connection, 431, "Request headers too large");
+    }
+    return;
+  }
+  if (head_end > options_.max_header_bytes) {
+    rejectRequest(connection, 431, "Request headers too large");
+    return;
+  }
+
+  HttpRequest request;
+  if (!parseHead(input.substr(0, head_end), request)) {
+    rejectRequest(connection, 400, "Malformed HTTP request");
+    return;
+  }
+  if (!request.header("transfer-encoding").empty()) {
+    rejectRequest(connection, 411, "Chunked request bodies are not supported");
+    return;
+  }
+  size_t content_length = 0;
+  const std::string length_header = request.header("content-length");
+  if (!length_header.empty()) {
+    if (length_header.size() > 18 ||
+        !std::all_of(length_header.begin(), length_header.end(),
+                     [](unsigned char c) { return std::isdigit(c); })) {
+      rejectRequest(connection, 400, "Invalid Content-Length");
+      return;
+    }
+    content_length = std::stoull(length_header);
+  }
+  if (content_length > options_.max_body_bytes) {
+    rejectRequest(connection, 413,
+                  "Request body exceeds " + std::to_string(options_.max_body_bytes) +
+                      " bytes");
+    return;
+  }
+
+  const size_t body_start = head_end + 4;
+  if (input.size() < body_start + content_length) {
+    if (!connection->continue_sent &&
+        toLower(request.header("expect")) == "100-continue") {
+      connection->continue_sent = true;
+      connection->output += "HTTP/1.1 100 Continue\r\n\r\n";
+      flushConnection(connection);
+    }
+    return;
+  }
+
+  request.body = input.substr(body_start, content_length);
+  request.remote_address = connection->remote_address;
+  input.erase(0, body_start + content_length);
+  connection->busy = true;
+  connection->continue_sent = false;
+  dispatch(connection, std::move(request));
+}
+
+void ApiServer::flushConnection(const std::shared_ptr<Connection> &connection) {
+  bool done = false;
+  bool keep_alive = true;
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->output += connection->pending;
+    connection->pending.clear();
+    done = connection->response_done;
+    keep_alive = connection->response_keep_alive;
+  }
+
+  size_t sent = 0;
+  while (sent < connection->output.size()) {
+    const ssize_t n = ::send(connection->fd, connection->output.data() + sent,
+                             connection->output.size() - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += static_cast<size_t>(n);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      closeConnection(connection);
+      return;
+    }
+  }
+  connection->output.erase(0, sent);
+  if (!connection->output.empty()) {
+    updateEvents(connection, true);
+    return;
+  }
+  updateEvents(connection, false);
+  if (!done) {
+    return;
+  }
+
+  // Response fully written
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->response_done = false;
+  }
+  connection->busy = false;
+  connection->last_active = std::chrono::steady_clock::now();
+  if (!keep_alive) {
+    closeConnection(connection);
+    return;
+  }
+  processInput(connection);
+}
+
+void ApiServer::updateEvents(const std::shared_ptr<Connection> &connection,
+                             bool want_write) {
+  if (connection->want_write == want_write) {
+    return;
+  }
+  epoll_event event{};
+  event.events = EPOLLIN | (want_write ? EPOLLOUT : 0u);
+  event.data.u64 = connection->id;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection->fd, &event);
+  connection->want_write = want_write;
+}
+
+void ApiServer::closeConnection(const std::shared_ptr<Connection> &connection) {
+  {
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->closed = true;
+    connection->pending.clear();
+  }
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->fd, nullptr);
+  close(connection->fd);
+  connections_.erase(connection->id);
+}
+
+void ApiServer::closeIdleConnections() {
+  const auto deadline = std::chrono::steady_clock::now() -
+                        std::chrono::milliseconds(options_.keep_alive_timeout_ms);
+  std::vector<std::shared_ptr<Connection>> idle;
+  for (const auto &entry : connections_) {
+    const auto &connection = entry.second;
+    if (!connection->busy && connection->output.empty() &&
+        connection->last_active < deadline) {
+      idle.push_back(connection);
+    }
+  }
+  for (const auto &connection : idle) {
+    closeConnection(connection);
+  }
+}
+
+void ApiServer::rejectRequest(const std::shared_ptr<Connection> &connection,
+                              int code, const std::string &message) {
+  connection->busy = true;
+  connection->input.clear();
+  ResponseWriter writer(this, connection, false, false);
+  HttpResponse response;
+  response.setError(code, message, "invalid_request_error");
+  writer.send(response);
+}
+
+void ApiServer::wakeLoop(uint64_t connection_id) {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_ids_.push_back(connection_id);
+  }
+  const uint64_t one = 1;
+  ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+  (void)ignored;
+}
+
+void ApiServer::drainWakeups() {
+  uint64_t value = 0;
+  ssize_t ignored = read(wake_fd_, &value, sizeof(value));
+  (void)ignored;
+  std::vector<uint64_t> ids;
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    ids.swap(wake_ids_);
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  for (uint64_t id : ids) {
+    auto it = connections_.find(id);
+    if (it != connections_.end()) {
+      std::shared_ptr<Connection> connection = it->second;
+      flushConnection(connection);
+    }
+  }
+}
+
+#else // !__linux__
+
+bool ApiServer::start() {
+  logger_->error("API Server requires epoll and is only available on Linux");
+  return false;
+}
+
+void ApiServer::stop() {}
+void ApiServer::serverLoop() {}
+void ApiServer::acceptConnections() {}
+void ApiServer::readFromConnection(const std::shared_ptr<Connection> &) {}
+void ApiServer::processInput(const std::shared_ptr<Connection> &) {}
+void ApiServer::flushConnection(const std::shared_ptr<Connection> &) {}
+void ApiServer::updateEvents(const std::shared_ptr<Connection> &, bool) {}
+void ApiServer::closeConnection(const std::shared_ptr<Connection> &) {}
+void ApiServer::closeIdleConnections() {}
+void ApiServer::rejectRequest(const std::shared_ptr<Connection> &, int,
+                              const std::string &) {}
+void ApiServer::wakeLoop(uint64_t) {}
+void ApiServer::drainWakeups() {}
+
+#endif // __linux__
+
+void ApiServer::workerLoop() {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex_);
+      jobs_cv_.wait(lock, [this] { return workers_stopping_ || !jobs_.empty(); });
+      if (workers_stopping_) {
+        return;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    job();
+  }
+}
+
+void ApiServer::dispatch(const std::shared_ptr<Connection> &connection,
+                         HttpRequest request) {
+  const bool keep_alive = wantsKeepAlive(request);
+  const bool chunked = request.version != "HTTP/1.0";
+  auto job = [this, connection, keep_alive, chunked,
+              request = std::move(request)]() {
+    std::shared_ptr<ResponseWriter> writer(
+        new ResponseWriter(this, connection, keep_alive, chunked));
+    if (connection->closed) {
+      return;
+    }
+    StreamRouteHandler handler = findHandler(request.method, request.path);
+    if (!handler) {
+      HttpResponse response;
+      response.setError(404, "Route not found: " + request.method + " " + request.path,
+                        "not_found_error");
+      writer->send(response);
+      return;
+    }
+    try {
+      handler(request, *writer);
+    } catch (const std::exception &e) {
+      logger_->error("API handler " + request.path + " failed: " + e.what());
+      HttpResponse response;
+      response.setError(500, "Internal server error: " + std::string(e.what()),
+                        "internal_error");
+      writer->send(response);
+    }
+  };
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    jobs_.push_back(std::move(job));
+  }
+  jobs_cv_.notify_one();
+}
+
+// ---- Routes ----
+
+void ApiServer::setupRoutes() {
+  // Health and model listing
+  addRoute("GET", "/health", [this](const HttpRequest &req) { return handleHealth(req); });
+  addRoute("GET", "/v1/models", [this](const HttpRequest &req) { return handleListModels(req); });
+  addRoute("GET", "/api/tags", [this](const HttpRequest &req) { return handleOllamaTags(req); });
+  addRoute("GET", "/metrics", [this](const HttpRequest &req) { return handleMetrics(req); });
+
+  // Generation (Ollama and OpenAI compatible)
+  addStreamRoute("POST", "/api/generate", [this](const HttpRequest &req, ResponseWriter &w) {
+    handleOllamaGenerate(req, w);
+  });
+  addStreamRoute("POST", "/api/chat", [this](const HttpRequest &req, ResponseWriter &w) {
+    handleOllamaChat(req, w);
+  });
+  addStreamRoute("POST", "/v1/chat/completions",
+                 [this](const HttpRequest &req, ResponseWriter &w) {
+                   handleChatCompletions(req, w);
+                 });
+}
+
+HttpResponse ApiServer::handleHealth(const HttpRequest &) {
+  HttpResponse response;
+  response.setJson({{"status", "healthy"}, {"timestamp", unixSeconds()}});
+  return response;
+}
+
+HttpResponse ApiServer::handleListModels(const HttpRequest &) {
+  nlohmann::json models_json = nlohmann::json::array();
+  for (const auto &model : model_manager_->getAllModels()) {
+    if (model.type != core::ModelType::LANGUAGE_MODEL) {
+      continue;
+    }
+    models_json.push_back({{"id", model.id},
+                           {"object", "model"},
+                           {"created", unixSeconds()},
+                           {"owned_by", "duorou"}});
+  }
+  HttpResponse response;
+  response.setJson({{"object", "list"}, {"data", models_json}});
+  return response;
+}
+
+HttpResponse ApiServer::handleOllamaTags(const HttpRequest &) {
+  nlohmann::json models_json = nlohmann::json::array();
+  for (const auto &model : model_manager_->getAllModels()) {
+    if (model.type != core::ModelType::LANGUAGE_MODEL) {
+      continue;
+    }
+    models_json.push_back({{"name", model.id},
+                           {"model", model.id},
+                           {"size", model.memory_usage}});
+  }
+  HttpResponse response;
+  response.setJson({{"models", models_json}});
+  return response;
+}
+
+HttpResponse ApiServer::handleMetrics(const HttpRequest &) {
+  const core::InferenceQueueMetrics metrics = model_manager_->getInferenceQueue().getMetrics();
+  std::ostringstream out;
+  out << "# HELP duorou_queue_wait_seconds Time generation requests waited in the queue\n"
+      << "# TYPE duorou_queue_wait_seconds histogram\n";
+  uint64_t cumulative = 0;
+  for (size_t b = 0; b < metrics.wait_bounds_ms.size(); ++b) {
+    cumulative += metrics.wait_counts[b];
+    out << "duorou_queue_wait_seconds_bucket{le=\"" << metrics.wait_bounds_ms[b] / 1000.0
+        << "\"} " << cumulative << "\n";
+  }
+  out << "duorou_queue_wait_seconds_bucket{le=\"+Inf\"} " << metrics.wait_count << "\n"
+      << "duorou_queue_wait_seconds_sum " << metrics.wait_sum_ms / 1000.0 << "\n"
+      << "duorou_queue_wait_seconds_count " << metrics.wait_count << "\n"
+      << "# HELP duorou_queue_depth Generation requests waiting in the queue\n"
+      << "# TYPE duorou_queue_depth gauge\n"
+      << "duorou_queue_depth " << metrics.queued << "\n"
+      << "# HELP duorou_queue_running Generation requests running\n"
+      << "# TYPE duorou_queue_running gauge\n"
+      << "duorou_queue_running " << metrics.running << "\n"
+      << "# HELP duorou_queue_requests_total Generation requests by admission outcome\n"
+      << "# TYPE duorou_queue_requests_total counter\n"
+      << "duorou_queue_requests_total{result=\"admitted\"} " << metrics.admitted << "\n"
+      << "duorou_queue_requests_total{result=\"rate_limited\"} " << metrics.rate_limited << "\n"
+      << "duorou_queue_requests_total{result=\"queue_full\"} " << metrics.queue_full << "\n"
+      << "duorou_queue_requests_total{result=\"timed_out\"} " << metrics.timed_out << "\n"
+      << "# HELP duorou_queue_completed_total Generation requests that ran to completion\n"
+      << "# TYPE duorou_queue_completed_total counter\n"
+      << "duorou_queue_completed_total " << metrics.completed << "\n";
+
+  // Engine-side latency of each loaded model
+  const std::vector<core::ModelLatencyMetrics> latency = model_manager_->getLatencyMetrics();
+  out << "# HELP duorou_time_to_first_token_seconds Time from request start to its first token\n"
+      << "# TYPE duorou_time_to_first_token_seconds histogram\n";
+  for (const auto &model : latency) {
+    writeHistogram(out, "duorou_time_to_first_token_seconds", model.model_id, model.ttft);
+  }
+  out << "# HELP duorou_inter_token_latency_seconds Gap between consecutive generated tokens\n"
+      << "# TYPE duorou_inter_token_latency_seconds histogram\n";
+  for (const auto &model : latency) {
+    writeHistogram(out, "duorou_inter_token_latency_seconds", model.model_id, model.itl);
+  }
+  HttpResponse response;
+  response.headers["Content-Type"] = "text/plain; version=0.0.4";
+  response.body = out.str();
+  return response;
+}
+
+void ApiServer::handleOllamaGenerate(const HttpRequest &request,
+                                     ResponseWriter &writer) {
+  nlohmann::json body;
+  try {
+    body = parseRequestBody(request);
+  } catch (const std::exception &e) {
+    writer.send(ollamaError(400, "Invalid JSON request: " + std::string(e.what())));
+    return;
+  }
+  if (!body.contains("prompt") || !body["prompt"].is_string()) {
+    writer.send(ollamaError(400, "Missing required field: prompt"));
+    return;
+  }
+  std::string requested_model;
+  core::GenerationParams params;
+  bool stream = true;
+  try {
+    requested_model = stringField(body, "model", "");
+    params = ollamaParams(body);
+    stream = boolField(body, "stream", true);
+  } catch (const std::invalid_argument &e) {
+    writer.send(ollamaError(400, e.what()));
+    return;
+  }
+  std::string model_id;
+  std::shared_ptr<core::TextGenerator> generator =
+      resolveGenerator(requested_model, model_id);
+  if (!generator) {
+    writer.send(ollamaError(404, "model '" + model_id + "' not found"));
+    return;
+  }
+
+  std::string prompt = body["prompt"].get<std::string>();
+  if (body.contains("system") && body["system"].is_string()) {
+    prompt = body["system"].get<std::string>() + "\n\n" + prompt;
+  }
+  const auto start = std::chrono::steady_clock::now();
+
+  auto generate = [=](ResponseWriter &writer) {
+    auto finalFields = [&](nlohmann::json &json, const core::GenerationResult &result) {
+      json["done"] = true;
+      json["done_reason"] = finishReason(result, params);
+      json["total_duration"] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+      json["prompt_eval_count"] = result.prompt_tokens;
+      json["eval_count"] = result.generated_tokens;
+    };
+
+    if (!stream) {
+      const core::GenerationResult result = generator->generate(prompt, params);
+      if (generationFailed(result)) {
+        writer.send(ollamaError(500, result.text));
+        return;
+      }
+      nlohmann::json json = {{"model", model_id},
+                             {"created_at", isoTimestamp()},
+                             {"response", result.text}};
+      finalFields(json, result);
+      HttpResponse response;
+      response.setJson(json);
+      writer.send(response);
+      return;
+    }
+
+    writer.beginStream(200, "application/x-ndjson");
+    const core::GenerationResult result = generator->generateStream(
+        prompt,
+        [&](int, const std::string &text, bool) {
+          if (text.empty()) {
+            return writer.clientConnected();
+          }
+          nlohmann::json chunk = {{"model", model_id},
+                                  {"created_at", isoTimestamp()},
+                                  {"response", text},
+                                  {"done", false}};
+          return writer.writeChunk(chunk.dump() + "\n");
+        },
+        params);
+    nlohmann::json last = {{"model", model_id},
+                           {"created_at", isoTimestamp()},
+                           {"response", ""}};
+    if (generationFailed(result)) {
+      last["error"] = result.text;
+    }
+    finalFields(last, result);
+    writer.writeChunk(last.dump() + "\n");
+    writer.endStream();
+  };
+  enqueueGeneration(request, body,
+                    core::InferenceQueue::estimateCost(prompt.size(), params.max_tokens),
+                    writer, ollamaError, std::move(generate));
+}
+
+void ApiServer::handleOllamaChat(const HttpRequest &request, ResponseWriter &writer) {
+  nlohmann::json body;
+  try {
+    body = parseRequestBody(request);
+  } catch (const std::exception &e) {
+    writer.send(ollamaError(400, "Invalid JSON request: " + std::string(e.what())));
+    return;
+  }
+  if (!body.contains("messages") || !body["messages"].is_array()) {
+    writer.send(ollamaError(400, "Missing required field: messages"));
+    return;
+  }
+  std::string requested_model;
+  std::string prompt;
+  core::GenerationParams params;
+  bool stream = true;
+  try {
+    requested_model = stringField(body, "model", "");
+    prompt = promptFromMessages(body["messages"]);
+    params = ollamaParams(body);
+    stream = boolField(body, "stream", true);
+  } catch (const std::invalid_argument &e) {
+    writer.send(ollamaError(400, e.what()));
+    return;
+  }
+  std::string model_id;
+  std::shared_ptr<core::TextGenerator> generator =
+      resolveGenerator(requested_model, model_id);
+  if (!generator) {
+    writer.send(ollamaError(404, "model '" + model_id + "' not found"));
+    return;
+  }
+  const auto start = std::chrono::steady_clock::now();
+
+  auto generate = [=](ResponseWriter &writer) {
+    auto message = [](const std::string &content) {
+      return nlohmann::json{{"role", "assistant"}, {"content", content}};
+    };
+    auto finalFields = [&](nlohmann::json &json, const core::GenerationResult &result) {
+      json["done"] = true;
+      json["done_reason"] = finishReason(result, params);
+      json["total_duration"] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+      json["prompt_eval_count"] = result.prompt_tokens;
+      json["eval_count"] = result.generated_tokens;
+    };
+
+    if (!stream) {
+      const core::GenerationResult result = generator->generate(prompt, params);
+      if (generationFailed(result)) {
+        writer.send(ollamaError(500, result.text));
+        return;
+      }
+      nlohmann::json json = {{"model", model_id},
+                             {"created_at", isoTimestamp()},
+                             {"message", message(result.text)}};
+      finalFields(json, result);
+      HttpResponse response;
+      response.setJson(json);
+      writer.send(response);
+      return;
+    }
+
+    writer.beginStream(200, "application/x-ndjson");
+    const core::GenerationResult result = generator->generateStream(
+        prompt,
+        [&](int, const std::string &text, bool) {
+          if (text.empty()) {
+            return writer.clientConnected();
+          }
+          nlohmann::json chunk = {{"model", model_id},
+                                  {"created_at", isoTimestamp()},
+                                  {"message", message(text)},
+                                  {"done", false}};
+          return writer.writeChunk(chunk.dump() + "\n");
+        },
+        params);
+    nlohmann::json last = {{"model", model_id},
+                           {"created_at", isoTimestamp()},
+                           {"message", message("")}};
+    if (generationFailed(result)) {
+      last["error"] = result.text;
+    }
+    finalFields(last, result);
+    writer.writeChunk(last.dump() + "\n");
+    writer.endStream();
+  };
+  enqueueGeneration(request, body,
+                    core::InferenceQueue::estimateCost(prompt.size(), params.max_tokens),
+                    writer, ollamaError, std::move(generate));
+}
+
+void ApiServer::handleChatCompletions(const HttpRequest &request,
+                                      ResponseWriter &writer) {
+  HttpResponse response;
+  nlohmann::json body;
+  try {
+    body = parseRequestBody(request);
+  } catch (const std::exception &e) {
+    response.setError(400, "Invalid JSON request: " + std::string(e.what()),
+                      "invalid_request_error");
+    writer.send(response);
+    return;
+  }
+  if (!body.contains("messages") || !body["messages"].is_array()) {
+    response.setError(400, "Missing required field: messages", "invalid_request_error");
+    writer.send(response);
+    return;
+  }
+  std::string requested_model;
+  std::string prompt;
+  core::GenerationParams params;
+  bool stream = false;
+  try {
+    requested_model = stringField(body, "model", "");
+    prompt = promptFromMessages(body["messages"]);
+    params = openAiParams(body);
+    stream = boolField(body, "stream", false);
+  } catch (const std::invalid_argument &e) {
+    response.setError(400, e.what(), "invalid_request_error");
+    writer.send(response);
+    return;
+  }
+  std::string model_id;
+  std::shared_ptr<core::TextGenerator> generator =
+      resolveGenerator(requested_model, model_id);
+  if (!generator) {
+    response.setError(404, "The model '" + model_id + "' does not exist",
+                      "invalid_request_error");
+    writer.send(response);
+    return;
+  }
+  const int64_t created = unixSeconds();
+  const std::string id =
+      "chatcmpl-" + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(
+                                       std::chrono::system_clock::now().time_since_epoch())
+                                       .count());
+
+  auto generate = [=](ResponseWriter &writer) {
+    if (!stream) {
+      HttpResponse response;
+      const core::GenerationResult result = generator->generate(prompt, params);
+      if (generationFailed(result)) {
+        response.setError(500, result.text, "generation_error");
+        writer.send(response);
+        return;
+      }
+      response.setJson(
+          {{"id", id},
+           {"object", "chat.completion"},
+           {"created", created},
+           {"model", model_id},
+           {"choices",
+            nlohmann::json::array({{{"index", 0},
+                                    {"message", {{"role", "assistant"}, {"content", result.text}}},
+                                    {"finish_reason", finishReason(result, params)}}})},
+           {"usage",
+            {{"prompt_tokens", result.prompt_tokens},
+             {"completion_tokens", result.generated_tokens},
+             {"total_tokens", result.prompt_tokens + result.generated_tokens}}}});
+      writer.send(response);
+      return;
+    }
+
+    // Server-Sent Events: one chat.completion.chunk per event, then [DONE]
+    auto event = [&](const nlohmann::json &delta, const nlohmann::json &finish_reason) {
+      nlohmann::json chunk = {
+          {"id", id},
+          {"object", "chat.completion.chunk"},
+          {"created", created},
+          {"model", model_id},
+          {"choices", nlohmann::json::array({{{"index", 0},
+                                              {"delta", delta},
+                                              {"finish_reason", finish_reason}}})}};
+      return writer.writeChunk("data: " + chunk.dump() + "\n\n");
+    };
+    writer.beginStream(200, "text/event-stream");
+    event({{"role", "assistant"}, {"content", ""}}, nullptr);
+    const core::GenerationResult result = generator->generateStream(
+        prompt,
+        [&](int, const std::string &text, bool) {
+          return text.empty() ? writer.clientConnected() : event({{"content", text}}, nullptr);
+        },
+        params);
+    if (generationFailed(result)) {
+      nlohmann::json error = {
+          {"error", {{"message", result.text}, {"type", "generation_error"}}}};
+      writer.writeChunk("data: " + error.dump() + "\n\n");
+    } else {
+      event(nlohmann::json::object(), finishReason(result, params));
+    }
+    writer.writeChunk("data: [DONE]\n\n");
+    writer.endStream();
+  };
+  enqueueGeneration(request, body,
+                    core::InferenceQueue::estimateCost(prompt.size(), params.max_tokens),
+                    writer, openAiError, std::move(generate));
+}
+
+void ApiServer::enqueueGeneration(const HttpRequest &request, const nlohmann::json &body,
+                                  size_t cost, ResponseWriter &writer,
+                                  const ErrorFormatter &error,
+                                  std::function<void(ResponseWriter &)> generate) {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    ++queued_jobs_;
+  }
+  // The writer stays open until the queue runs the job; generation then
+  // happens on a queue thread, leaving the request workers free
+  auto job = [this, writer = writer.keepOpen(), error, generate = std::move(generate),
+              path = request.path](const core::QueueGrant &grant) mutable {
+    if (!grant.granted()) {
+      writer->send(error(503, grant.timed_out ? "Timed out waiting for a free model slot"
+                                              : "Server is shutting down"));
+    } else if (writer->clientConnected()) {
+      try {
+        generate(*writer);
+      } catch (const std::exception &e) {
+        logger_->error("API handler " + path + " failed: " + e.what());
+        writer->send(error(500, "Internal server error: " + std::string(e.what())));
+      } catch (...) {
+        writer->send(error(500, "Internal server error"));
+      }
+    }
+    writer.reset();
+    finishQueuedJob();
+  };
+  const core::Admission admission = model_manager_->getInferenceQueue().submit(
+      clientId(request, body), cost, std::move(job));
+  if (admission.admitted()) {
+    return;
+  }
+  finishQueuedJob();
+
+  if (admission.result == core::AdmissionResult::SHUTTING_DOWN) {
+    writer.send(error(503, "Server is shutting down"));
+    return;
+  }
+  HttpResponse response =
+      error(429, admission.result == core::AdmissionResult::RATE_LIMITED
+                     ? "Rate limit exceeded, retry later"
+                     : "Too many requests queued, retry later");
+  response.headers["Retry-After"] = std::to_string(static_cast<int>(
+      std::ceil(std::max(1.0, admission.retry_after_seconds))));
+  writer.send(response);
+}
+
+void ApiServer::finishQueuedJob() {
+  // Notify under the lock: stop() may return, and the server be destroyed,
+  // as soon as the count reaches zero
+  std::lock_guard<std::mutex> lock(jobs_mutex_);
+  --queued_jobs_;
+  jobs_cv_.notify_all();
+}
+
+// ---- Utilities ----
+
+std::shared_ptr<core::TextGenerator>
+ApiServer::resolveGenerator(const std::string &model_id, std::string &resolved_id) {
+  resolved_id = model_id;
+  if (resolved_id.empty()) {
+    const std::vector<std::string> loaded = model_manager_->getLoadedModels();
+    if (loaded.empty()) {
+      return nullptr;
+    }
+    resolved_id = loaded.front();
+  }
+  std::shared_ptr<core::TextGenerator> generator =
+      model_manager_->getTextGenerator(resolved_id);
+  if (!generator && !model_manager_->isModelLoaded(resolved_id) &&
+      model_manager_->loadModel(resolved_id)) {
+    generator = model_manager_->getTextGenerator(resolved_id);
+  }
+  return generator;
+}
+
+nlohmann::json ApiServer::parseRequestBody(const HttpRequest &request) {
+  if (request.body.empty()) {
+    return nlohmann::json::object();
+  }
+  nlohmann::json json = nlohmann::json::parse(request.body);
+  if (!json.is_object()) {
+    throw std::runtime_error("request body must be a JSON object");
+  }
+  return json;
+}
+
+std::string ApiServer::promptFromMessages(const nlohmann::json &messages) {
+  std::string prompt;
+  for (const auto &message : messages) {
+    if (!message.is_object()) {
+      continue;
+    }
+    std::string content;
+    const nlohmann::json &value = message.contains("content") ? message["content"]
+                                                              : nlohmann::json();
+    if (value.is_string()) {
+      content = value.get<std::string>();
+    } else if (value.is_array()) {
+      // OpenAI content parts: keep the text ones
+      for (const auto &part : value) {
+        if (part.is_object() && stringField(part, "type", "") == "text") {
+          content += stringField(part, "text", "");
+        }
+      }
+    }
+    prompt += stringField(message, "role", "user") + ": " + content + "\n";
+  }
+  prompt += "assistant: ";
+  return prompt;
+}
+
+} // namespace duorou
@@ -1,129 +1,249 @@
-// #pragma once
-
-// #include <string>
-// #include <memory>
-// #include <functional>
-// #include <thread>
-// #include <atomic>
-// #include <map>
-// #include "../../third_party/llama.cpp/vendor/nlohmann/json.hpp"
-
-// namespace duorou {
-
-// namespace core {
-//     class ModelManager;
-//     class Logger;
-// }
-
-// class ModelManager;
-// class Logger;
-
-// // HTTP request structure
-// struct HttpRequest {
-//     std::string method;
-//     std::string path;
-//     std::map<std::string, std::string> headers;
-//     std::string body;
-//     std::map<std::string, std::string> query_params;
-// };
-
-// // HTTP response structure
-// struct HttpResponse {
-//     int status_code = 200;
-//     std::map<std::string, std::string> headers;
-//     std::string body;
-
-//     void setJson(const nlohmann::json& json) {
-//         headers["Content-Type"] = "application/json";
-//         body = json.dump();
-//     }
-
-//     void setError(int code, const std::string& message, const std::string&
-//     type = "error") {
-//         status_code = code;
-//         nlohmann::json error_json = {
-//             {"error", {
-//                 {"code", code},
-//                 {"message", message},
-//                 {"type", type}
-//             }}
-//         };
-//         setJson(error_json);
-//     }
-// };
-
-// // Route handler function type
-// using RouteHandler = std::function<HttpResponse(const HttpRequest&)>;
-
-// // API Server class
-// class ApiServer {
-// public:
-//     ApiServer(std::shared_ptr<core::ModelManager> model_manager,
-//               std::shared_ptr<core::Logger> logger,
-//               int port = 8080);
-//     ~ApiServer();
-
-//     // Server control
-//     bool start();
-//     void stop();
-//     bool isRunning() const { return running_; }
-
-//     // Route registration
-//     void addRoute(const std::string& method, const std::string& path,
-//     RouteHandler handler);
-
-//     // Get server info
-//     int getPort() const { return port_; }
-//     std::string getAddress() const { return address_; }
-
-// private:
-//     // Core server functionality
-//     void serverLoop();
-//     HttpResponse handleRequest(const HttpRequest& request);
-
-//     // Route matching
-//     RouteHandler findHandler(const std::string& method, const std::string&
-//     path);
-
-//     // Built-in API endpoints
-//     void setupRoutes();
-
-//     // Health and info endpoints
-//     HttpResponse handleHealth(const HttpRequest& request);
-//     HttpResponse handleInfo(const HttpRequest& request);
-
-//     // Model management endpoints
-//     HttpResponse handleListModels(const HttpRequest& request);
-//     HttpResponse handleLoadModel(const HttpRequest& request);
-//     HttpResponse handleUnloadModel(const HttpRequest& request);
-//     HttpResponse handleModelInfo(const HttpRequest& request);
-
-//     // Text generation endpoints (OpenAI compatible)
-//     HttpResponse handleChatCompletions(const HttpRequest& request);
-//     HttpResponse handleCompletions(const HttpRequest& request);
-
-//     // Image generation endpoints
-//     HttpResponse handleImageGeneration(const HttpRequest& request);
-
-//     // Utility methods
-//     std::string extractModelId(const std::string& path);
-//     nlohmann::json parseRequestBody(const HttpRequest& request);
-
-// private:
-//     std::shared_ptr<core::ModelManager> model_manager_;
-//     std::shared_ptr<core::Logger> logger_;
-
-//     int port_;
-//     std::string address_;
-//     std::atomic<bool> running_;
-//     std::thread server_thread_;
-
-//     // Route storage
-//     std::map<std::string, std::map<std::string, RouteHandler>> routes_; //
-//     method -> path -> handler
-
-//     // Server socket (implementation specific)
-//     int server_socket_;
-// };
-
-// } // namespace duorou
\ No newline at end of file
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../../third_party/llama.cpp/vendor/nlohmann/json.hpp"
+
+namespace duorou {
+
+namespace core {
+class ModelManager;
+class Logger;
+class TextGenerator;
+} // namespace core
+
+class ApiServer;
+
+// HTTP request structure
+struct HttpRequest {
+  std::string method;
+  std::string path; ///< Path without the query string
+  std::string version; ///< "HTTP/1.1" or "HTTP/1.0"
+  std::map<std::string, std::string> headers; ///< Header names lower-cased
+  std::string body;
+  std::map<std::string, std::string> query_params;
+  std::string remote_address; ///< Peer IP address
+
+  /// Header value by lower-case name, empty when absent
+  std::string header(const std::string &name) const;
+};
+
+// HTTP response structure
+struct HttpResponse {
+  int status_code = 200;
+  std::map<std::string, std::string> headers;
+  std::string body;
+
+  void setJson(const nlohmann::json &json);
+  void setError(int code, const std::string &message,
+                const std::string &type = "error");
+};
+
+/**
+ * @brief Writes the response to one request from a worker thread
+ *
+ * Bytes are queued on the connection and sent by the event loop, so a slow
+ * client never blocks a worker. Either call send() once, or stream with
+ * beginStream() / writeChunk() / endStream(). A handler that returns
+ * without responding gets a 500; an unfinished stream is ended.
+ *
+ * A handler that answers later, from another thread, holds on to the
+ * writer with keepOpen(); the response then ends when the last reference
+ * is dropped.
+ */
+class ResponseWriter : public std::enable_shared_from_this<ResponseWriter> {
+public:
+  ~ResponseWriter();
+
+  ResponseWriter(const ResponseWriter &) = delete;
+  ResponseWriter &operator=(const ResponseWriter &) = delete;
+
+  /// Send a complete response
+  void send(const HttpResponse &response);
+
+  /// Start a streamed response (chunked on HTTP/1.1)
+  void beginStream(int status_code, const std::string &content_type);
+  /// Queue one piece of the body; false once the client has disconnected
+  bool writeChunk(const std::string &data);
+  void endStream();
+
+  /// False once the client has disconnected
+  bool clientConnected() const;
+
+  /// Keep the response open after the handler returns
+  std::shared_ptr<ResponseWriter> keepOpen() { return shared_from_this(); }
+
+private:
+  friend class ApiServer;
+  struct Connection;
+
+  ResponseWriter(ApiServer *server, std::shared_ptr<Connection> connection,
+                 bool keep_alive, bool chunked);
+
+  void queue(std::string data, bool done);
+
+  ApiServer *server_;
+  std::shared_ptr<Connection> connection_;
+  bool keep_alive_;
+  bool chunked_;
+  bool started_ = false;
+  bool done_ = false;
+};
+
+// Route handler function types
+using RouteHandler = std::function<HttpResponse(const HttpRequest &)>;
+using StreamRouteHandler =
+    std::function<void(const HttpRequest &, ResponseWriter &)>;
+/// Formats an error body in the style of the route (Ollama or OpenAI)
+using ErrorFormatter = std::function<HttpResponse(int, const std::string &)>;
+
+/**
+ * @brief Server limits and threading
+ */
+struct ApiServerOptions {
+  std::string address = "127.0.0.1";
+  int port = 8080;
+  size_t worker_threads = 4; ///< Handlers, and so generation, run here
+  size_t max_header_bytes = 64 * 1024;
+  size_t max_body_bytes = 8 * 1024 * 1024;
+  size_t max_connections = 1024;
+  int keep_alive_timeout_ms = 5000; ///< Idle keep-alive connections close after this
+};
+
+/**
+ * @brief Headless HTTP API server
+ *
+ * One thread runs a non-blocking epoll loop that accepts connections,
+ * parses requests and writes queued responses; handlers run on a small
+ * worker pool. Connections are kept alive between requests, and generation
+ * endpoints stream tokens as NDJSON (Ollama: /api/generate, /api/chat) or
+ * Server-Sent Events (OpenAI: /v1/chat/completions).
+ *
+ * Generation goes through the model manager's InferenceQueue, keyed by
+ * client (X-Client-Id header, OpenAI "user" field, or peer address): a
+ * client over its rate or a full queue gets 429 with Retry-After right
+ * away. Queue metrics are served in Prometheus text format on /metrics.
+ *
+ * The event loop needs epoll, so start() fails on platforms without it.
+ */
+class ApiServer {
+public:
+  ApiServer(std::shared_ptr<core::ModelManager> model_manager,
+            std::shared_ptr<core::Logger> logger, int port = 8080);
+  ApiServer(std::shared_ptr<core::ModelManager> model_manager,
+            std::shared_ptr<core::Logger> logger,
+            const ApiServerOptions &options);
+  ~ApiServer();
+
+  // Server control
+  bool start();
+  void stop();
+  bool isRunning() const { return running_; }
+
+  // Route registration (before start())
+  void addRoute(const std::string &method, const std::string &path,
+                RouteHandler handler);
+  void addStreamRoute(const std::string &method, const std::string &path,
+                      StreamRouteHandler handler);
+
+  // Get server info
+  int getPort() const { return options_.port; }
+  std::string getAddress() const { return options_.address; }
+  const ApiServerOptions &getOptions() const { return options_; }
+
+private:
+  friend class ResponseWriter;
+  using Connection = ResponseWriter::Connection;
+
+  // Event loop (loop thread only)
+  void serverLoop();
+  void acceptConnections();
+  void readFromConnection(const std::shared_ptr<Connection> &connection);
+  void processInput(const std::shared_ptr<Connection> &connection);
+  void flushConnection(const std::shared_ptr<Connection> &connection);
+  void closeConnection(const std::shared_ptr<Connection> &connection);
+  void closeIdleConnections();
+  void updateEvents(const std::shared_ptr<Connection> &connection, bool want_write);
+  void drainWakeups();
+  // Respond from the loop thread itself (parse errors, limits) and close
+  void rejectRequest(const std::shared_ptr<Connection> &connection, int code,
+                     const std::string &message);
+
+  // Called by ResponseWriter on worker threads
+  void wakeLoop(uint64_t connection_id);
+
+  void workerLoop();
+  void dispatch(const std::shared_ptr<Connection> &connection, HttpRequest request);
+  StreamRouteHandler findHandler(const std::string &method,
+                                 const std::string &path) const;
+
+  // Built-in API endpoints
+  void setupRoutes();
+  HttpResponse handleHealth(const HttpRequest &request);
+  HttpResponse handleListModels(const HttpRequest &request);
+  HttpResponse handleOllamaTags(const HttpRequest &request);
+  HttpResponse handleMetrics(const HttpRequest &request);
+  void handleOllamaGenerate(const HttpRequest &request, ResponseWriter &writer);
+  void handleOllamaChat(const HttpRequest &request, ResponseWriter &writer);
+  void handleChatCompletions(const HttpRequest &request, ResponseWriter &writer);
+
+  // Run `generate` on the inference queue, or answer the rejection
+  void enqueueGeneration(const HttpRequest &request, const nlohmann::json &body,
+                         size_t cost, ResponseWriter &writer,
+                         const ErrorFormatter &error,
+                         std::function<void(ResponseWriter &)> generate);
+  void finishQueuedJob();
+
+  // Utility methods
+  // The generator is captured by the queued job; holding it keeps it intact
+  // if the model is unloaded or replaced before the job runs
+  std::shared_ptr<core::TextGenerator> resolveGenerator(const std::string &model_id,
+                                                        std::string &resolved_id);
+  static nlohmann::json parseRequestBody(const HttpRequest &request);
+  /// Throws std::invalid_argument on mistyped message fields
+  static std::string promptFromMessages(const nlohmann::json &messages);
+
+private:
+  std::shared_ptr<core::ModelManager> model_manager_;
+  std::shared_ptr<core::Logger> logger_;
+  ApiServerOptions options_;
+
+  std::atomic<bool> running_;
+  std::thread server_thread_;
+
+  // Request workers: parse requests and run the non-generating handlers, so
+  // the event loop never blocks. Generation itself runs on the inference
+  // queue's threads (see enqueueGeneration()).
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> jobs_;
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_cv_;
+  bool workers_stopping_;
+  size_t queued_jobs_; ///< Generations handed to the inference queue, guarded by jobs_mutex_
+
+  // Route storage: method -> path -> handler
+  std::map<std::string, std::map<std::string, StreamRouteHandler>> routes_;
+
+  // Sockets and connections (loop thread only, except the wakeup list)
+  int server_socket_;
+  int epoll_fd_;
+  int wake_fd_;
+  uint64_t next_connection_id_;
+  std::unordered_map<uint64_t, std::shared_ptr<Connection>> connections_;
+  std::mutex wake_mutex_;
+  std::vector<uint64_t> wake_ids_;
+};
+
+} // namespace duorou
@@ -0,0 +1,338 @@
+#include "api_server.h"
+#include "../core/logger.h"
+#include "../core/model_manager.h"
+
+#include <arpa/inet.h>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Loopback test of the HTTP API server: routing, keep-alive, request limits
+// (413 / 431 / 400), streamed NDJSON and SSE framing, and a client that
+// disconnects mid-stream. The server listens on port 0 and generates with
+// a placeholder model, whose simulated replies need no model files.
+
+namespace {
+
+const char *kModel = "api-test-model";
+
+struct Response {
+  int status = 0;
+  std::string headers; ///< Lower-cased header block
+  std::string body;    ///< Chunked bodies already de-chunked
+  bool chunked = false;
+};
+
+class Client {
+public:
+  explicit Client(int port) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout{5, 0};
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+      close();
+    }
+  }
+  ~Client() { close(); }
+
+  bool connected() const { return fd_ >= 0; }
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  bool sendRaw(const std::string &data) {
+    size_t sent = 0;
+    while (fd_ >= 0 && sent < data.size()) {
+      const ssize_t n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        return false;
+      }
+      sent += static_cast<size_t>(n);
+    }
+    return sent == data.size();
+  }
+
+  bool request(const std::string &method, const std::string &path,
+               const std::string &body = "") {
+    std::string req = method + " " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+    if (!body.empty()) {
+      req += "Content-Type: application/json\r\nContent-Length: " +
+             std::to_string(body.size()) + "\r\n";
+    }
+    return sendRaw(req + "\r\n" + body);
+  }
+
+  // Status line and headers; the body is read separately
+  bool readHead(Response &response) {
+    size_t end;
+    while ((end = buffer_.find("\r\n\r\n")) == std::string::npos) {
+      if (!fill()) {
+        return false;
+      }
+    }
+    std::string head = buffer_.substr(0, end + 2);
+    buffer_.erase(0, end + 4);
+    if (head.compare(0, 9, "HTTP/1.1 ") != 0 && head.compare(0, 9, "HTTP/1.0 ") != 0) {
+      return false;
+    }
+    response.status = std::atoi(head.c_str() + 9);
+    for (char &c : head) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    response.headers = head;
+    response.chunked = head.find("transfer-encoding: chunked") != std::string::npos;
+    return true;
+  }
+
+  // Next piece of a chunked body; false at the terminating chunk
+  bool readChunk(std::string &chunk) {
+    size_t line;
+    while ((line = buffer_.find("\r\n")) == std::string::npos) {
+      if (!fill()) {
+        return false;
+      }
+    }
+    const size_t size = std::strtoul(buffer_.c_str(), nullptr, 16);
+    while (buffer_.size() < line + 2 + size + 2) {
+      if (!fill()) {
+        return false;
+      }
+    }
+    chunk = buffer_.substr(line + 2, size);
+    buffer_.erase(0, line + 2 + size + 2);
+    return size > 0;
+  }
+
+  bool readResponse(Response &response) {
+    if (!readHead(response)) {
+      return false;
+    }
+    if (response.chunked) {
+      std::string chunk;
+      while (readChunk(chunk)) {
+        response.body += chunk;
+      }
+      return true;
+    }
+    const size_t at = response.headers.find("content-length: ");
+    const size_t length = at == std::string::npos ? 0 : std::strtoul(
+                                                            response.headers.c_str() + at + 16,
+                                                            nullptr, 10);
+    while (buffer_.size() < length) {
+      if (!fill()) {
+        return false;
+      }
+    }
+    response.body = buffer_.substr(0, length);
+    buffer_.erase(0, length);
+    return true;
+  }
+
+  // True once the server has closed the connection
+  bool closedByPeer() {
+    char byte;
+    return buffer_.empty() && recv(fd_, &byte, 1, 0) == 0;
+  }
+
+private:
+  bool fill() {
+    char data[4096];
+    const ssize_t n = recv(fd_, data, sizeof(data), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer_.append(data, static_cast<size_t>(n));
+    return true;
+  }
+
+  int fd_ = -1;
+  std::string buffer_;
+};
+
+} // namespace
+
+int main() {
+  // No local model directories: only the model registered below exists
+  const auto models_dir = std::filesystem::temp_directory_path() / "duorou_api_server_test";
+  std::filesystem::create_directories(models_dir);
+  setenv("DUOROU_MODELS_DIR", models_dir.string().c_str(), 1);
+
+  auto model_manager = std::make_shared<duorou::core::ModelManager>();
+  duorou::core::ModelManagerInfo info;
+  info.id = kModel;
+  info.name = kModel;
+  info.type = duorou::core::ModelType::LANGUAGE_MODEL;
+  info.format = duorou::core::ModelFormat::UNKNOWN;
+  if (!model_manager->initialize() || !model_manager->registerModel(info) ||
+      !model_manager->loadModel(kModel)) {
+    std::cerr << "[API] failed to set up the placeholder model" << std::endl;
+    return 1;
+  }
+
+  duorou::ApiServerOptions options;
+  options.port = 0;
+  options.max_header_bytes = 2048;
+  options.max_body_bytes = 4096;
+  duorou::ApiServer server(model_manager, std::make_shared<duorou::core::Logger>(), options);
+  if (!server.start() || server.getPort() == 0) {
+    std::cerr << "[API] server failed to start" << std::endl;
+    return 1;
+  }
+  const int port = server.getPort();
+
+  int failed = 0;
+  auto check = [&](bool ok, const std::string &what) {
+    if (!ok) {
+      ++failed;
+      std::cerr << "[API] FAILED: " << what << std::endl;
+    }
+  };
+
+  // Routing, with both requests on one keep-alive connection
+  {
+    Client client(port);
+    Response health, models, missing;
+    check(client.request("GET", "/health") && client.readResponse(health) &&
+              health.status == 200 && health.body.find("healthy") != std::string::npos,
+          "GET /health");
+    check(client.request("GET", "/v1/models") && client.readResponse(models) &&
+              models.status == 200 && models.body.find(kModel) != std::string::npos,
+          "GET /v1/models on the same connection");
+    check(client.request("GET", "/no/such/route") && client.readResponse(missing) &&
+              missing.status == 404,
+          "unknown route is 404");
+  }
+
+  // Limits: the server answers from the event loop and closes the connection
+  auto rejected = [&](const std::string &raw, int status, const std::string &what) {
+    Client client(port);
+    Response response;
+    check(client.sendRaw(raw) && client.readResponse(response) &&
+              response.status == status && client.closedByPeer(),
+          what);
+  };
+  rejected("POST /api/generate HTTP/1.1\r\nHost: x\r\nContent-Length: 8192\r\n\r\n", 413,
+           "body over max_body_bytes is 413");
+  rejected("GET /health HTTP/1.1\r\nX-Padding: " + std::string(4096, 'a') + "\r\n\r\n", 431,
+           "headers over max_header_bytes are 431");
+  rejected("NOT-HTTP\r\n\r\n", 400, "malformed request line is 400");
+  {
+    Client client(port);
+    Response response;
+    check(client.request("POST", "/api/generate", "{not json") &&
+              client.readResponse(response) && response.status == 400,
+          "invalid JSON body is 400");
+  }
+
+  // Ollama NDJSON: one JSON object per line, the last one done
+  {
+    Client client(port);
+    Response response;
+    const nlohmann::json body = {{"model", kModel}, {"prompt", "hello"}, {"stream", true}};
+    check(client.request("POST", "/api/generate", body.dump()) &&
+              client.readResponse(response) && response.status == 200 && response.chunked &&
+              response.headers.find("application/x-ndjson") != std::string::npos,
+          "streamed /api/generate is chunked NDJSON");
+    std::string text;
+    bool done = false;
+    size_t lines = 0;
+    size_t start = 0;
+    for (size_t end; (end = response.body.find('\n', start)) != std::string::npos;
+         start = end + 1) {
+      const auto line = nlohmann::json::parse(response.body.substr(start, end - start),
+                                              nullptr, false);
+      check(!line.is_discarded() && !done, "NDJSON line is a JSON object before done");
+      if (line.is_discarded()) {
+        break;
+      }
+      text += line.value("response", "");
+      done = line.value("done", false);
+      ++lines;
+    }
+    check(start == response.body.size(), "NDJSON body ends with a newline");
+    check(lines > 2 && done, "NDJSON streams several chunks and ends with done");
+    check(text.rfind("Hello!", 0) == 0, "NDJSON chunks join into the reply");
+  }
+
+  // OpenAI SSE: "data: {...}" events separated by blank lines, then [DONE]
+  {
+    Client client(port);
+    Response response;
+    const nlohmann::json body = {
+        {"model", kModel},
+        {"stream", true},
+        {"messages", {{{"role", "user"}, {"content", "hello"}}}}};
+    check(client.request("POST", "/v1/chat/completions", body.dump()) &&
+              client.readResponse(response) && response.status == 200 &&
+              response.headers.find("text/event-stream") != std::string::npos,
+          "streamed /v1/chat/completions is SSE");
+    std::vector<std::string> events;
+    size_t start = 0;
+    for (size_t end; (end = response.body.find("\n\n", start)) != std::string::npos;
+         start = end + 2) {
+      events.push_back(response.body.substr(start, end - start));
+    }
+    check(start == response.body.size() && events.size() > 2,
+          "SSE body is a sequence of complete events");
+    bool framed = true;
+    for (size_t i = 0; i + 1 < events.size(); ++i) {
+      framed = framed && events[i].rfind("data: ", 0) == 0 &&
+               nlohmann::json::parse(events[i].substr(6), nullptr, false).is_object();
+    }
+    check(framed, "every SSE event but the last carries a JSON chunk");
+    check(!events.empty() && events.back() == "data: [DONE]", "SSE ends with [DONE]");
+  }
+
+  // A client that goes away mid-stream stops its generation early
+  {
+    Client client(port);
+    Response response;
+    std::string chunk;
+    const nlohmann::json body = {
+        {"model", kModel}, {"prompt", "a long question"}, {"stream", true}};
+    check(client.request("POST", "/api/generate", body.dump()) && client.readHead(response) &&
+              client.readChunk(chunk),
+          "stream starts before the disconnect");
+    client.close();
+    // The full simulated reply takes over two seconds to stream
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1500);
+    bool stopped = false;
+    while (!stopped && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      stopped = model_manager->getInferenceQueue().getMetrics().running == 0;
+    }
+    check(stopped, "generation stops after the client disconnects");
+
+    Client after(port);
+    Response health;
+    check(after.request("GET", "/health") && after.readResponse(health) &&
+              health.status == 200,
+          "server keeps serving after a disconnect");
+  }
+
+  server.stop();
+  std::filesystem::remove_all(models_dir);
+  if (failed > 0) {
+    std::cerr << "[API] " << failed << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "[API] all checks passed" << std::endl;
+  return 0;
+}
@@ -1,5 +1,5 @@
 #include "application.h"
-// #include "../api/api_server.h"  // Comment: Temporarily disable API server
+#include "../api/api_server.h"
 #include "../gui/main_window.h"
 #include "../gui/system_tray.h"
 #include "config_manager.h"
@@ -13,6 +13,7 @@
 #include "../media/macos_screen_capture.h"
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <csignal>
 #include <cstdlib>
@@ -450,11 +451,38 @@ bool Application::initializeComponents() {
     }
     std::cout << "Model manager initialized successfully" << std::endl;
 
+    // Admission control shared by the GUI and the API server
+    InferenceQueueOptions queue_options;
+    queue_options.max_concurrent = static_cast<size_t>(std::max(
+        1, config_manager_->getInt("queue.max_concurrent",
+                                   static_cast<int>(queue_options.max_concurrent))));
+    queue_options.max_queue_depth = static_cast<size_t>(std::max(
+        1, config_manager_->getInt("queue.max_depth",
+                                   static_cast<int>(queue_options.max_queue_depth))));
+    queue_options.max_queued_per_client = static_cast<size_t>(std::max(
+        1, config_manager_->getInt("queue.max_per_client",
+                                   static_cast<int>(queue_options.max_queued_per_client))));
+    queue_options.client_tokens_per_second = config_manager_->getDouble(
+        "queue.client_rate", queue_options.client_tokens_per_second);
+    queue_options.client_burst_tokens = config_manager_->getDouble(
+        "queue.client_burst", queue_options.client_burst_tokens);
+    queue_options.max_queue_wait =
+        std::chrono::seconds(std::max(1, config_manager_->getInt("queue.max_wait", 60)));
+    model_manager_->getInferenceQueue().setOptions(queue_options);
+    model_manager_->getInferenceQueue().setClientWeight(
+        "gui", config_manager_->getDouble("queue.gui_weight", 4.0));
+
     // Initialize global model manager (only when Ollama is enabled)
 #if defined(DUOROU_ENABLE_OLLAMA)
     std::cout << "Initializing global model manager..." << std::endl;
     try {
       extensions::ollama::GlobalModelManager::initialize();
+      extensions::ollama::GlobalModelManager::getInstance().setParallelSequences(
+          static_cast<unsigned int>(
+              std::max(0, config_manager_->getInt("model.parallel_sequences", 0))));
+      extensions::ollama::GlobalModelManager::getInstance().setPrefillChunk(
+          static_cast<unsigned int>(
+              std::max(0, config_manager_->getInt("model.prefill_chunk", 0))));
       std::cout << "Global model manager initialized successfully" << std::endl;
     } catch (const std::exception& e) {
       logger_->error("Failed to initialize global model manager: " + std::string(e.what()));
@@ -474,29 +502,40 @@ bool Application::initializeComponents() {
     }
     std::cout << "Workflow engine initialized successfully" << std::endl;
 
-    // Start API server (regardless of service mode)
-    // Comment: Temporarily disable API server to resolve debugging issues
-    /*
-    std::cout << "Creating API server..." << std::endl;
-    api_server_ = std::make_unique<::duorou::ApiServer>(
-        std::shared_ptr<core::ModelManager>(model_manager_.get(),
-                                            [](core::ModelManager *) {}),
-        std::shared_ptr<core::Logger>(logger_.get(), [](core::Logger *) {}));
-
-    if (!api_server_->start()) {
-      logger_->error("Failed to start API server");
-      return false;
-    }
-    
-    std::cout << "API server started on port " << api_server_->getPort() << std::endl;
-    logger_->info("API server started on port " + std::to_string(api_server_->getPort()));
-    
-    if (service_mode_) {
-      std::cout << "Running in service mode" << std::endl;
-    } else {
-      std::cout << "API server started for GUI mode" << std::endl;
+    // Start API server: always in service mode, in GUI mode when enabled
+    if (service_mode_ || config_manager_->getBool("api.enabled", false)) {
+      std::cout << "Creating API server..." << std::endl;
+      ::duorou::ApiServerOptions api_options;
+      api_options.address = config_manager_->getString("api.address", api_options.address);
+      api_options.port = config_manager_->getInt("api.port", api_options.port);
+      api_options.worker_threads = static_cast<size_t>(std::max(
+          1, config_manager_->getInt("api.worker_threads",
+                                     static_cast<int>(api_options.worker_threads))));
+      api_options.max_body_bytes = static_cast<size_t>(std::max(
+          1, config_manager_->getInt("api.max_body_size", 8))) * 1024 * 1024;
+      api_options.keep_alive_timeout_ms =
+          config_manager_->getInt("api.keep_alive_timeout", 5) * 1000;
+      api_server_ = std::make_unique<::duorou::ApiServer>(
+          std::shared_ptr<core::ModelManager>(model_manager_.get(),
+                                              [](core::ModelManager *) {}),
+          std::shared_ptr<core::Logger>(logger_.get(), [](core::Logger *) {}),
+          api_options);
+
+      if (!api_server_->start()) {
+        logger_->error("Failed to start API server");
+        api_server_.reset();
+        if (service_mode_) {
+          return false;
+        }
+      } else {
+        std::cout << "API server started on port " << api_server_->getPort() << std::endl;
+        if (service_mode_) {
+          std::cout << "Running in service mode" << std::endl;
+        } else {
+          std::cout << "API server started for GUI mode" << std::endl;
+        }
+      }
     }
-    */
 
     // Initialize system tray (only in non-service mode)
     // Temporarily disable system tray to debug segfault issues in other components
@@ -536,13 +575,10 @@ void Application::cleanup() {
   stopMiniMemoryServer();
 
   // Stop API server
-  // Comment: API server has been disabled
-  /*
   if (api_server_) {
     api_server_->stop();
     api_server_.reset();
   }
-  */
 
 #ifdef __APPLE__
   // Clean up ScreenCaptureKit resources
@@ -633,13 +669,10 @@ void Application::onShutdown(GtkApplication *app, gpointer user_data) {
       application->logger_->info("Cleaning up application resources...");
     }
     
-    // Comment: API server has been disabled
-    /*
     if (application->api_server_) {
       application->api_server_->stop();
       application->api_server_.reset();
     }
-    */
     application->main_window_.reset();
     application->system_tray_.reset();
     application->workflow_engine_.reset();
@@ -12,12 +12,9 @@ typedef struct _GtkApplication GtkApplication;
 typedef void *gpointer;
 
 // API-related forward declarations - in duorou namespace
-// Note: API server temporarily disabled
-/*
 namespace duorou {
 class ApiServer;
 }
-*/
 
 namespace duorou {
 namespace core {
@@ -247,9 +244,8 @@ private:
   std::unique_ptr<ModelManager> model_manager_;
   std::unique_ptr<WorkflowEngine> workflow_engine_;
 
-  // API server
-  // Note: API server temporarily disabled
-  // std::unique_ptr<::duorou::ApiServer> api_server_;
+  // API server (always in service mode, with api.enabled in GUI mode)
+  std::unique_ptr<::duorou::ApiServer> api_server_;
 
   // GUI components
   std::unique_ptr<::duorou::gui::SystemTray> system_tray_;
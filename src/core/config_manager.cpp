@@ -466,12 +466,33 @@ void ConfigManager::createDefaultConfig() {
     config_map_["model.default_diffusion_model"] = std::string("");
     // 新增：文本生成后端强制开关（true=llama.cpp，false=内部前向）
     config_map_["model.force_llama"] = false;
+    // Continuous-batching slots per model (0 = off); each adds a context of KV cache
+    config_map_["model.parallel_sequences"] = 0;
+    // Prompt tokens a joining batched sequence prefills per step (0 = engine default)
+    config_map_["model.prefill_chunk"] = 0;
     
     // Workflow settings
     config_map_["workflow.worker_threads"] = 0; // 0 means auto-detect
     config_map_["workflow.max_queue_size"] = 100;
     config_map_["workflow.task_timeout"] = 300; // seconds
     
+    // API server settings
+    config_map_["api.enabled"] = false; // service mode always starts it
+    config_map_["api.address"] = std::string("127.0.0.1");
+    config_map_["api.port"] = 8080;
+    config_map_["api.worker_threads"] = 4;
+    config_map_["api.max_body_size"] = 8; // MB
+    config_map_["api.keep_alive_timeout"] = 5; // seconds
+    
+    // Inference queue (admission control for GUI and API generation)
+    config_map_["queue.max_concurrent"] = 2;
+    config_map_["queue.max_depth"] = 64;
+    config_map_["queue.max_per_client"] = 16;
+    config_map_["queue.client_rate"] = 2000.0; // tokens per second, 0 disables
+    config_map_["queue.client_burst"] = 16000.0; // tokens
+    config_map_["queue.max_wait"] = 60; // seconds
+    config_map_["queue.gui_weight"] = 4.0; // GUI share relative to one API client
+    
     // UI settings
     config_map_["ui.theme"] = std::string("default");
     config_map_["ui.window_width"] = 1200;
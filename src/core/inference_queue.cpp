@@ -0,0 +1,340 @@
+#include "inference_queue.h"
+
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <memory>
+
+namespace duorou {
+namespace core {
+
+namespace {
+
+// Queue-wait histogram buckets (ms); one overflow bucket follows
+const double kWaitBoundsMs[] = {1,    5,    10,   25,    50,    100,   250,   500,
+                                1000, 2500, 5000, 10000, 30000, 60000, 120000};
+constexpr size_t kWaitBuckets = sizeof(kWaitBoundsMs) / sizeof(kWaitBoundsMs[0]);
+
+// Forget idle clients once this many are tracked
+constexpr size_t kMaxTrackedClients = 1024;
+
+// Generation budget assumed when a request sets no max_tokens
+constexpr size_t kDefaultGenerationCost = 512;
+
+} // namespace
+
+double InferenceQueueMetrics::waitQuantileMs(double q) const {
+    if (wait_count == 0 || wait_counts.empty()) {
+        return 0.0;
+    }
+    const double target = std::min(1.0, std::max(0.0, q)) * static_cast<double>(wait_count);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < wait_counts.size(); ++b) {
+        if (wait_counts[b] == 0 || static_cast<double>(seen + wait_counts[b]) < target) {
+            seen += wait_counts[b];
+            continue;
+        }
+        if (b >= wait_bounds_ms.size()) {
+            return wait_bounds_ms.empty() ? 0.0 : wait_bounds_ms.back();
+        }
+        const double lower = b == 0 ? 0.0 : wait_bounds_ms[b - 1];
+        const double fraction = (target - static_cast<double>(seen)) / wait_counts[b];
+        return lower + (wait_bounds_ms[b] - lower) * fraction;
+    }
+    return wait_bounds_ms.empty() ? 0.0 : wait_bounds_ms.back();
+}
+
+InferenceQueue::InferenceQueue(const InferenceQueueOptions& options)
+    : options_(options), stopping_(false), virtual_time_(0.0), next_sequence_(0),
+      running_(0), admitted_(0), completed_(0), rate_limited_(0), queue_full_(0),
+      timed_out_(0), wait_counts_(kWaitBuckets + 1, 0), wait_sum_ms_(0.0),
+      wait_count_(0) {
+    options_.max_concurrent = std::max<size_t>(1, options_.max_concurrent);
+}
+
+InferenceQueue::~InferenceQueue() {
+    shutdown();
+}
+
+void InferenceQueue::setOptions(const InferenceQueueOptions& options) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options_ = options;
+        options_.max_concurrent = std::max<size_t>(1, options_.max_concurrent);
+        if (!runners_.empty()) {
+            startRunners();
+        }
+    }
+    cv_.notify_all();
+}
+
+InferenceQueueOptions InferenceQueue::getOptions() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return options_;
+}
+
+void InferenceQueue::setClientWeight(const std::string& client_id, double weight) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto inserted = clients_.emplace(client_id, ClientState());
+    ClientState& client = inserted.first->second;
+    if (inserted.second) {
+        client.tokens = options_.client_burst_tokens;
+        client.refilled = Clock::now();
+    }
+    client.weight = std::max(0.01, weight);
+}
+
+Admission InferenceQueue::submit(const std::string& client_id, size_t cost, Job job) {
+    Admission admission;
+    const auto now = Clock::now();
+    cost = std::max<size_t>(1, cost);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            admission.result = AdmissionResult::SHUTTING_DOWN;
+            return admission;
+        }
+
+        auto inserted = clients_.emplace(client_id, ClientState());
+        ClientState& client = inserted.first->second;
+        if (inserted.second) {
+            client.tokens = options_.client_burst_tokens;
+            client.refilled = now;
+        }
+
+        // Shed load before spending the client's budget on a request that
+        // cannot be queued anyway
+        if (queue_.size() >= options_.max_queue_depth ||
+            client.queued >= options_.max_queued_per_client) {
+            ++queue_full_;
+            admission.result = AdmissionResult::QUEUE_FULL;
+            admission.retry_after_seconds = 1.0;
+            return admission;
+        }
+
+        const double rate = options_.client_tokens_per_second;
+        if (rate > 0.0) {
+            const double burst = options_.client_burst_tokens;
+            const double elapsed = std::chrono::duration<double>(now - client.refilled).count();
+            client.tokens = std::min(burst, client.tokens + elapsed * rate);
+            client.refilled = now;
+            // A request larger than the bucket only needs a full one
+            const double needed = std::min(static_cast<double>(cost), burst);
+            if (client.tokens < needed) {
+                ++rate_limited_;
+                admission.result = AdmissionResult::RATE_LIMITED;
+                admission.retry_after_seconds = (needed - client.tokens) / rate;
+                return admission;
+            }
+            client.tokens -= needed;
+        }
+
+        const double start = std::max(virtual_time_, client.last_finish);
+        client.last_finish = start + static_cast<double>(cost) / client.weight;
+        ++client.queued;
+        queue_.emplace(std::make_pair(client.last_finish, next_sequence_++),
+                       Entry{client_id, std::move(job), now});
+        ++admitted_;
+        startRunners();
+        if (clients_.size() > kMaxTrackedClients) {
+            pruneClients();
+        }
+    }
+    cv_.notify_one();
+    return admission;
+}
+
+Admission InferenceQueue::run(const std::string& client_id, size_t cost,
+                              const std::function<void()>& fn) {
+    auto done = std::make_shared<std::promise<AdmissionResult>>();
+    std::future<AdmissionResult> result = done->get_future();
+    Admission admission = submit(client_id, cost, [done, &fn](const QueueGrant& grant) {
+        if (!grant.granted()) {
+            done->set_value(grant.timed_out ? AdmissionResult::TIMED_OUT
+                                            : AdmissionResult::SHUTTING_DOWN);
+            return;
+        }
+        try {
+            fn();
+            done->set_value(AdmissionResult::ADMITTED);
+        } catch (...) {
+            done->set_exception(std::current_exception());
+        }
+    });
+    if (admission.admitted()) {
+        admission.result = result.get();
+    }
+    return admission;
+}
+
+InferenceQueueMetrics InferenceQueue::getMetrics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    InferenceQueueMetrics metrics;
+    metrics.queued = queue_.size();
+    metrics.running = running_;
+    metrics.admitted = admitted_;
+    metrics.completed = completed_;
+    metrics.rate_limited = rate_limited_;
+    metrics.queue_full = queue_full_;
+    metrics.timed_out = timed_out_;
+    metrics.wait_bounds_ms.assign(kWaitBoundsMs, kWaitBoundsMs + kWaitBuckets);
+    metrics.wait_counts = wait_counts_;
+    metrics.wait_sum_ms = wait_sum_ms_;
+    metrics.wait_count = wait_count_;
+    return metrics;
+}
+
+void InferenceQueue::shutdown() {
+    std::vector<std::thread> runners;
+    std::vector<Entry> cancelled;
+    const auto now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        runners.swap(runners_);
+        for (auto& queued : queue_) {
+            cancelled.push_back(std::move(queued.second));
+        }
+        queue_.clear();
+    }
+    cv_.notify_all();
+    for (auto& runner : runners) {
+        if (runner.joinable()) {
+            runner.join();
+        }
+    }
+    for (auto& entry : cancelled) {
+        QueueGrant grant;
+        grant.wait_ms = std::chrono::duration<double, std::milli>(now - entry.enqueued).count();
+        grant.cancelled = true;
+        try {
+            entry.job(grant);
+        } catch (...) {
+        }
+    }
+}
+
+size_t InferenceQueue::estimateCost(size_t prompt_chars, int max_tokens) {
+    const size_t generation = max_tokens > 0 ? static_cast<size_t>(max_tokens)
+                                             : kDefaultGenerationCost;
+    return std::max<size_t>(1, prompt_chars / 4 + generation);
+}
+
+void InferenceQueue::startRunners() {
+    if (stopping_) {
+        return;
+    }
+    while (runners_.size() < options_.max_concurrent) {
+        runners_.emplace_back(&InferenceQueue::runnerLoop, this);
+    }
+}
+
+void InferenceQueue::runnerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        // Wake periodically so requests stuck behind long generations are
+        // dropped once they expire rather than when a slot frees up
+        cv_.wait_for(lock, std::chrono::seconds(1), [this] {
+            return stopping_ || (!queue_.empty() && running_ < options_.max_concurrent);
+        });
+        if (stopping_) {
+            return;
+        }
+
+        const auto now = Clock::now();
+        std::vector<Entry> expired;
+        for (auto it = queue_.begin(); it != queue_.end();) {
+            if (now - it->second.enqueued > options_.max_queue_wait) {
+                expired.push_back(std::move(it->second));
+                it = queue_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!expired.empty()) {
+            for (auto& entry : expired) {
+                auto client = clients_.find(entry.client_id);
+                if (client != clients_.end()) {
+                    --client->second.queued;
+                }
+                const double wait_ms =
+                    std::chrono::duration<double, std::milli>(now - entry.enqueued).count();
+                recordWait(wait_ms);
+                ++timed_out_;
+            }
+            lock.unlock();
+            for (auto& entry : expired) {
+                QueueGrant grant;
+                grant.wait_ms =
+                    std::chrono::duration<double, std::milli>(now - entry.enqueued).count();
+                grant.timed_out = true;
+                try {
+                    entry.job(grant);
+                } catch (...) {
+                }
+            }
+            expired.clear();
+            lock.lock();
+            continue;
+        }
+        if (queue_.empty() || running_ >= options_.max_concurrent) {
+            continue;
+        }
+
+        // Smallest virtual finish tag goes next
+        auto next = queue_.begin();
+        virtual_time_ = std::max(virtual_time_, next->first.first);
+        Entry entry = std::move(next->second);
+        queue_.erase(next);
+        auto client = clients_.find(entry.client_id);
+        if (client != clients_.end()) {
+            --client->second.queued;
+        }
+        QueueGrant grant;
+        grant.wait_ms = std::chrono::duration<double, std::milli>(now - entry.enqueued).count();
+        recordWait(grant.wait_ms);
+        ++running_;
+
+        lock.unlock();
+        try {
+            entry.job(grant);
+        } catch (...) {
+        }
+        entry.job = nullptr;  // release captured state outside the lock
+        lock.lock();
+
+        --running_;
+        ++completed_;
+        // The freed slot may be taken by another runner
+        cv_.notify_all();
+    }
+}
+
+void InferenceQueue::recordWait(double wait_ms) {
+    const size_t bucket =
+        std::lower_bound(kWaitBoundsMs, kWaitBoundsMs + kWaitBuckets, wait_ms) -
+        kWaitBoundsMs;
+    ++wait_counts_[bucket];
+    wait_sum_ms_ += wait_ms;
+    ++wait_count_;
+}
+
+void InferenceQueue::pruneClients() {
+    const auto now = Clock::now();
+    const double rate = options_.client_tokens_per_second;
+    for (auto it = clients_.begin(); it != clients_.end();) {
+        const ClientState& client = it->second;
+        const double elapsed = std::chrono::duration<double>(now - client.refilled).count();
+        const bool bucket_full =
+            rate <= 0.0 || client.tokens + elapsed * rate >= options_.client_burst_tokens;
+        if (client.queued == 0 && client.weight == 1.0 && bucket_full &&
+            client.last_finish <= virtual_time_) {
+            it = clients_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace core
+} // namespace duorou
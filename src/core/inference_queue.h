@@ -0,0 +1,191 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace duorou {
+namespace core {
+
+/**
+ * @brief Admission and scheduling limits of the inference queue
+ */
+struct InferenceQueueOptions {
+    size_t max_concurrent = 2;          ///< Requests generating at the same time
+    size_t max_queue_depth = 64;        ///< Waiting requests across all clients
+    size_t max_queued_per_client = 16;  ///< Waiting requests of one client
+    double client_tokens_per_second = 2000.0;  ///< Token bucket refill rate, 0 disables rate limiting
+    double client_burst_tokens = 16000.0;      ///< Token bucket capacity
+    std::chrono::milliseconds max_queue_wait{60000};  ///< Requests waiting longer are dropped
+};
+
+/**
+ * @brief Outcome of submitting a request
+ */
+enum class AdmissionResult {
+    ADMITTED,       ///< Queued, the job will run
+    RATE_LIMITED,   ///< Client is over its token budget
+    QUEUE_FULL,     ///< Queue (or the client's share of it) is full
+    TIMED_OUT,      ///< Waited longer than max_queue_wait (blocking run() only)
+    SHUTTING_DOWN   ///< Queue is shutting down
+};
+
+struct Admission {
+    AdmissionResult result = AdmissionResult::ADMITTED;
+    double retry_after_seconds = 0.0;  ///< Suggested back-off for rejected requests
+
+    bool admitted() const { return result == AdmissionResult::ADMITTED; }
+};
+
+/**
+ * @brief Handed to a job when it leaves the queue
+ *
+ * A job that is not granted must not generate; it should only report the
+ * failure to its client.
+ */
+struct QueueGrant {
+    double wait_ms = 0.0;    ///< Time spent queued
+    bool timed_out = false;  ///< Waited longer than max_queue_wait
+    bool cancelled = false;  ///< The queue shut down first
+
+    bool granted() const { return !timed_out && !cancelled; }
+};
+
+/**
+ * @brief Snapshot of queue counters and the queue-wait histogram
+ */
+struct InferenceQueueMetrics {
+    size_t queued = 0;
+    size_t running = 0;
+    uint64_t admitted = 0;
+    uint64_t completed = 0;
+    uint64_t rate_limited = 0;
+    uint64_t queue_full = 0;
+    uint64_t timed_out = 0;
+
+    std::vector<double> wait_bounds_ms;  ///< Upper bound of each histogram bucket
+    std::vector<uint64_t> wait_counts;   ///< Per bucket, plus one overflow bucket
+    double wait_sum_ms = 0.0;
+    uint64_t wait_count = 0;
+
+    /// Approximate queue-wait quantile (q in [0, 1]) from the histogram
+    double waitQuantileMs(double q) const;
+};
+
+/**
+ * @brief Admission control and weighted-fair queuing in front of generation
+ *
+ * Every request is charged its estimated token cost against its client's
+ * token bucket when it is submitted; a client out of budget, or a full
+ * queue, is rejected straight away with a suggested retry delay instead of
+ * waiting behind everyone else. Admitted requests are ordered by
+ * self-clocked fair queuing: each gets a virtual finish tag of
+ * max(virtual time, client's previous finish) + cost / weight, and the
+ * smallest tag runs next, so a client sending many requests cannot starve
+ * one sending few. Jobs run on the queue's own threads, at most
+ * max_concurrent at a time.
+ */
+class InferenceQueue {
+public:
+    using Job = std::function<void(const QueueGrant&)>;
+
+    explicit InferenceQueue(const InferenceQueueOptions& options = InferenceQueueOptions());
+    ~InferenceQueue();
+
+    InferenceQueue(const InferenceQueue&) = delete;
+    InferenceQueue& operator=(const InferenceQueue&) = delete;
+
+    void setOptions(const InferenceQueueOptions& options);
+    InferenceQueueOptions getOptions() const;
+
+    /**
+     * @brief Set a client's share of generation time (default 1.0)
+     */
+    void setClientWeight(const std::string& client_id, double weight);
+
+    /**
+     * @brief Queue a job without waiting for it
+     * @param client_id Client the request is accounted to
+     * @param cost Estimated tokens (see estimateCost())
+     * @param job Called exactly once on a queue thread if admitted
+     * @return Admission verdict; a rejected job is never called
+     */
+    Admission submit(const std::string& client_id, size_t cost, Job job);
+
+    /**
+     * @brief Queue a function and wait until it has run
+     * @return ADMITTED once fn has run, otherwise why it did not. Exceptions
+     *         thrown by fn are rethrown.
+     */
+    Admission run(const std::string& client_id, size_t cost, const std::function<void()>& fn);
+
+    InferenceQueueMetrics getMetrics() const;
+
+    /**
+     * @brief Reject new requests, cancel waiting ones and join the threads
+     */
+    void shutdown();
+
+    /**
+     * @brief Token cost of a request: prompt tokens (about 4 characters
+     *        each) plus the tokens it may generate
+     */
+    static size_t estimateCost(size_t prompt_chars, int max_tokens);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string client_id;
+        Job job;
+        Clock::time_point enqueued;
+    };
+
+    struct ClientState {
+        double tokens = 0.0;
+        Clock::time_point refilled;
+        double weight = 1.0;
+        double last_finish = 0.0;  ///< Virtual finish tag of its latest request
+        size_t queued = 0;
+    };
+
+    void runnerLoop();
+    void startRunners();
+    void recordWait(double wait_ms);
+    void pruneClients();
+
+    InferenceQueueOptions options_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::thread> runners_;
+    bool stopping_;
+
+    // Waiting requests by (finish tag, arrival order)
+    std::map<std::pair<double, uint64_t>, Entry> queue_;
+    std::unordered_map<std::string, ClientState> clients_;
+    double virtual_time_;
+    uint64_t next_sequence_;
+    size_t running_;
+
+    // Metrics
+    uint64_t admitted_;
+    uint64_t completed_;
+    uint64_t rate_limited_;
+    uint64_t queue_full_;
+    uint64_t timed_out_;
+    std::vector<uint64_t> wait_counts_;
+    double wait_sum_ms_;
+    uint64_t wait_count_;
+};
+
+} // namespace core
+} // namespace duorou
@@ -0,0 +1,181 @@
+#include "inference_queue.h"
+
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Deterministic test of InferenceQueue admission and ordering: per-client
+// token buckets, queue depth limits, self-clocked fair queuing and the
+// queue-wait timeout. A single runner is held busy by a gate job while
+// requests are queued, so their order depends only on the finish tags.
+
+namespace {
+
+using duorou::core::Admission;
+using duorou::core::AdmissionResult;
+using duorou::core::InferenceQueue;
+using duorou::core::InferenceQueueOptions;
+using duorou::core::QueueGrant;
+
+int failed = 0;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        ++failed;
+        std::cerr << "[Queue] FAILED: " << what << std::endl;
+    }
+}
+
+/**
+ * @brief Occupies the queue's only runner until released
+ */
+class Gate {
+public:
+    explicit Gate(InferenceQueue &queue) : released_(release_.get_future().share()) {
+        auto started = std::make_shared<std::promise<void>>();
+        auto running = started->get_future();
+        auto released = released_;
+        admitted_ = queue.submit("gate", 1, [started, released](const QueueGrant &) {
+                            started->set_value();
+                            released.wait();
+                        }).admitted();
+        if (admitted_) {
+            running.wait();
+        }
+    }
+    ~Gate() { open(); }
+
+    bool admitted() const { return admitted_; }
+    void open() {
+        if (!opened_) {
+            opened_ = true;
+            release_.set_value();
+        }
+    }
+
+private:
+    std::promise<void> release_;
+    std::shared_future<void> released_;
+    bool admitted_ = false;
+    bool opened_ = false;
+};
+
+InferenceQueueOptions singleRunner() {
+    InferenceQueueOptions options;
+    options.max_concurrent = 1;
+    options.client_tokens_per_second = 0.0;
+    return options;
+}
+
+// A client over its budget is turned away with a retry hint, while a
+// client with budget left is still admitted
+void testRateLimit() {
+    InferenceQueueOptions options;
+    options.client_tokens_per_second = 1.0;
+    options.client_burst_tokens = 100.0;
+    InferenceQueue queue(options);
+    auto noop = [](const QueueGrant &) {};
+
+    check(queue.submit("a", 100, noop).admitted(), "first request uses the full burst");
+    const Admission limited = queue.submit("a", 50, noop);
+    check(limited.result == AdmissionResult::RATE_LIMITED, "client over its rate is RATE_LIMITED");
+    check(limited.retry_after_seconds > 40.0 && limited.retry_after_seconds <= 50.0,
+          "retry_after covers the missing tokens at the refill rate");
+    check(queue.submit("b", 100, noop).admitted(), "another client is still admitted");
+    check(queue.getMetrics().rate_limited == 1, "rate_limited counter");
+}
+
+// Depth limits, then the order in which two backlogged clients are served
+void testQueueFullAndFairness() {
+    InferenceQueueOptions options = singleRunner();
+    options.max_queue_depth = 8;
+    options.max_queued_per_client = 4;
+    InferenceQueue queue(options);
+    Gate gate(queue);
+    check(gate.admitted(), "gate job admitted");
+
+    std::mutex order_mutex;
+    std::vector<std::string> order;
+    std::promise<void> all_done;
+    auto job = [&](const std::string &client) {
+        return [&, client](const QueueGrant &grant) {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(grant.granted() ? client : "!" + client);
+            if (order.size() == 8) {
+                all_done.set_value();
+            }
+        };
+    };
+
+    // Client a floods the queue first; b arrives afterwards
+    bool admitted = true;
+    for (int i = 0; i < 4; ++i) {
+        admitted = queue.submit("a", 10, job("a")).admitted() && admitted;
+    }
+    const Admission over_share = queue.submit("a", 10, job("a"));
+    for (int i = 0; i < 4; ++i) {
+        admitted = queue.submit("b", 10, job("b")).admitted() && admitted;
+    }
+    const Admission over_depth = queue.submit("c", 10, job("c"));
+    check(admitted, "requests within the limits are admitted");
+    check(over_share.result == AdmissionResult::QUEUE_FULL,
+          "client past max_queued_per_client gets QUEUE_FULL");
+    check(over_depth.result == AdmissionResult::QUEUE_FULL,
+          "full queue gets QUEUE_FULL");
+    check(over_depth.retry_after_seconds > 0.0, "QUEUE_FULL suggests a retry delay");
+    check(queue.getMetrics().queued == 8 && queue.getMetrics().queue_full == 2,
+          "queue depth and queue_full counter");
+
+    gate.open();
+    if (all_done.get_future().wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+        check(false, "queued jobs run after the gate opens");
+        return;
+    }
+    const std::vector<std::string> expected = {"a", "b", "a", "b", "a", "b", "a", "b"};
+    std::lock_guard<std::mutex> lock(order_mutex);
+    check(order == expected, "two backlogged clients alternate in fair order");
+}
+
+// A request that waits past max_queue_wait is handed a timed-out grant
+void testTimeout() {
+    InferenceQueueOptions options = singleRunner();
+    options.max_queue_wait = std::chrono::milliseconds(1);
+    InferenceQueue queue(options);
+    Gate gate(queue);
+
+    std::promise<QueueGrant> result;
+    check(queue.submit("a", 10, [&result](const QueueGrant &grant) { result.set_value(grant); })
+              .admitted(),
+          "request behind the gate admitted");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.open();
+
+    auto grant = result.get_future();
+    if (grant.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+        check(false, "expired request is called back");
+        return;
+    }
+    const QueueGrant g = grant.get();
+    check(g.timed_out && !g.granted(), "expired request is not granted");
+    check(g.wait_ms >= 1.0, "expired request reports its wait");
+    check(queue.getMetrics().timed_out == 1, "timed_out counter");
+}
+
+} // namespace
+
+int main() {
+    testRateLimit();
+    testQueueFullAndFairness();
+    testTimeout();
+    if (failed > 0) {
+        std::cerr << "[Queue] " << failed << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[Queue] all checks passed" << std::endl;
+    return 0;
+}
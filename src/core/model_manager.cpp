@@ -41,8 +41,20 @@ public:
   }
 
   bool load(const std::string &model_path) override {
+    return loadWith(model_path, false);
+  }
+
+  // Like load(), but a model the global manager already has gets a fresh
+  // engine swapped in instead of reusing the loaded one
+  bool reload(const std::string &model_path) {
+    return loadWith(model_path, true);
+  }
+
+private:
+  bool loadWith(const std::string &model_path, bool reload) {
     duorou::core::Logger logger;
-  logger.info("[OLLAMA] Loading model: " + model_path);
+    logger.info(std::string("[OLLAMA] ") + (reload ? "Reloading" : "Loading") +
+                " model: " + model_path);
 
     // Use new ollama extension architecture with global manager
     // First register the model by name (supports Ollama model names), then load it
@@ -84,7 +96,8 @@ public:
       return false;
     }
     
-    bool success = global_manager.loadModel(normalized_id);
+    bool success = reload ? global_manager.reloadModel(normalized_id)
+                          : global_manager.loadModel(normalized_id);
     if (!success) {
       std::cerr << "[ERROR] Failed to load Ollama model: " << normalized_id
                 << std::endl;
@@ -104,12 +117,13 @@ public:
          &global_manager, [](duorou::extensions::ollama::OllamaModelManager*) {
            // Empty deleter, because global manager is managed by GlobalModelManager
          });
-     text_generator_ = std::make_unique<duorou::core::TextGenerator>(
+     text_generator_ = std::make_shared<duorou::core::TextGenerator>(
          shared_manager, model_id_);
 
     return true;
   }
 
+public:
   void unload() override {
     if (!model_id_.empty()) {
       try {
@@ -130,17 +144,20 @@ public:
   duorou::core::ModelManagerInfo getInfo() const override { return model_info_; }
   size_t getMemoryUsage() const override { return memory_usage_; }
 
+  // Normalized id in the global manager (empty until loaded)
+  const std::string &getOllamaModelId() const { return model_id_; }
+
   // Get the model manager for text generation
   duorou::extensions::ollama::OllamaModelManager *getModelManager() const {
     return &duorou::extensions::ollama::GlobalModelManager::getInstance();
   }
 
   // Get text generator for this model
-  duorou::core::TextGenerator *getTextGenerator() const {
+  std::shared_ptr<duorou::core::TextGenerator> getTextGenerator() const {
     if (!loaded_ || !text_generator_) {
       return nullptr;
     }
-    return text_generator_.get();
+    return text_generator_;
   }
 
 private:
@@ -148,7 +165,7 @@ private:
   std::string model_id_;
   bool loaded_;
   size_t memory_usage_;
-  mutable std::unique_ptr<duorou::core::TextGenerator> text_generator_;
+  mutable std::shared_ptr<duorou::core::TextGenerator> text_generator_;
   duorou::core::ModelManagerInfo model_info_;
 };
 
@@ -162,7 +179,7 @@ public:
   }
 
   bool load(const std::string &model_path) override {
-    text_generator_ = std::make_unique<duorou::core::TextGenerator>();
+    text_generator_ = std::make_shared<duorou::core::TextGenerator>();
     loaded_ = true;
     info_.status = duorou::core::ModelStatus::LOADED;
     info_.path = model_path;
@@ -181,15 +198,15 @@ public:
   duorou::core::ModelManagerInfo getInfo() const override { return info_; }
   size_t getMemoryUsage() const override { return 0; }
 
-  duorou::core::TextGenerator *getTextGenerator() const {
+  std::shared_ptr<duorou::core::TextGenerator> getTextGenerator() const {
     if (!loaded_ || !text_generator_) return nullptr;
-    return text_generator_.get();
+    return text_generator_;
   }
 
 private:
   mutable duorou::core::ModelManagerInfo info_;
   bool loaded_;
-  mutable std::unique_ptr<duorou::core::TextGenerator> text_generator_;
+  mutable std::shared_ptr<duorou::core::TextGenerator> text_generator_;
 };
 
 #ifdef DUOROU_ENABLE_MNN
@@ -280,18 +297,18 @@ public:
   duorou::core::ModelManagerInfo getInfo() const override { return model_info_; }
   size_t getMemoryUsage() const override { return memory_usage_; }
 
-  duorou::core::TextGenerator *getTextGenerator() const {
+  std::shared_ptr<duorou::core::TextGenerator> getTextGenerator() const {
     if (!loaded_ || !text_generator_) {
       return nullptr;
     }
-    return text_generator_.get();
+    return text_generator_;
   }
 
 private:
   std::string model_path_;
   bool loaded_;
   size_t memory_usage_;
-  mutable std::unique_ptr<duorou::core::TextGenerator> text_generator_;
+  mutable std::shared_ptr<duorou::core::TextGenerator> text_generator_;
   duorou::core::ModelManagerInfo model_info_;
 };
 #endif
@@ -438,17 +455,36 @@ private:
   std::unique_ptr<ImageGenerator> image_generator_;
 };
 
+// Memory a model is expected to take once loaded (simple estimation)
+static size_t estimatedLoadMemory(const ModelManagerInfo &model_info) {
+  if (model_info.type == ModelType::DIFFUSION_MODEL) {
+    return 1024 * 1024 * 1024; // Diffusion model 1GB
+  }
+  return 512 * 1024 * 1024; // Default 512MB
+}
+
 // ModelManager implementation
 ModelManager::ModelManager()
     : memory_limit_(4ULL * 1024 * 1024 * 1024) // Default 4GB memory limit
       ,
-      initialized_(false), auto_memory_management_(false) {
+      initialized_(false), auto_memory_management_(false),
+      inference_queue_(std::make_unique<InferenceQueue>()),
+      pending_load_memory_(0), running_loads_(0) {
   // Initialize model downloader
   model_downloader_ = ModelDownloaderFactory::create();
   // ModelDownloader creation handled without verbose logging
 }
 
 ModelManager::~ModelManager() {
+  // Finish running generations and cancel queued ones before their models go
+  inference_queue_->shutdown();
+
+  // Background loads still publish into this object
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    load_cv_.wait(lock, [this]() { return running_loads_ == 0; });
+  }
+
   // Use try_lock to avoid deadlock during destruction
   std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
 
@@ -583,13 +619,39 @@ bool ModelManager::registerModel(const ModelManagerInfo &model_info) {
 }
 
 bool ModelManager::loadModel(const std::string &model_id) {
+  return loadModelAsync(model_id).get();
+}
+
+std::shared_future<bool>
+ModelManager::loadModelAsync(const std::string &model_id) {
+  return startLoad(model_id, false);
+}
+
+std::shared_future<bool>
+ModelManager::reloadModelAsync(const std::string &model_id) {
+  return startLoad(model_id, true);
+}
+
+std::shared_future<bool> ModelManager::startLoad(const std::string &model_id,
+                                                 bool reload) {
+  auto finished = [](bool success) {
+    std::promise<bool> promise;
+    promise.set_value(success);
+    return promise.get_future().share();
+  };
+
   if (!initialized_) {
     std::cerr << "ModelManager not initialized" << std::endl;
-    return false;
+    return finished(false);
   }
 
   std::lock_guard<std::mutex> lock(mutex_);
 
+  // Join a load of this model that is still running
+  if (loading_models_.count(model_id) != 0) {
+    return pending_loads_[model_id];
+  }
+
   // Check if model is already registered
   auto it = registered_models_.find(model_id);
   if (it == registered_models_.end()) {
@@ -615,62 +677,83 @@ bool ModelManager::loadModel(const std::string &model_id) {
         it = registered_models_.find(model_id);
       } else {
         std::cerr << "Model not registered: " << model_id << std::endl;
-        return false;
+        return finished(false);
       }
     } else {
       std::cerr << "Model not registered: " << model_id << std::endl;
-      return false;
+      return finished(false);
     }
   }
 
-  // Check if model is already loaded
-  if (loaded_models_.find(model_id) != loaded_models_.end()) {
+  // Check if model is already loaded; a reload keeps serving it meanwhile
+  const bool loaded = loaded_models_.find(model_id) != loaded_models_.end();
+  if (loaded && !reload) {
     std::cout << "Model already loaded: " << model_id << std::endl;
-    return true;
+    return finished(true);
   }
 
-  // Check memory limits
-  // Checking memory availability for model
+  // Check memory limits (loads in flight included)
   if (!hasEnoughMemory(model_id)) {
     std::cerr << "Not enough memory to load model: " << model_id << std::endl;
-    return false;
-  }
-  // Memory check passed for model
+    return finished(false);
+  }
+
+  // Update status to loading; the model itself is created and loaded on a
+  // load thread, without holding mutex_. The thread is detached rather than
+  // owned by its future, so dropping or replacing a future never joins a
+  // load (or a load callback) from under mutex_.
+  if (!loaded) {
+    updateModelStatus(model_id, duorou::core::ModelStatus::LOADING);
+  }
+  pending_load_memory_ += estimatedLoadMemory(it->second);
+  const ModelManagerInfo model_info = it->second;
+  auto promise = std::make_shared<std::promise<bool>>();
+  std::shared_future<bool> load = promise->get_future().share();
+  loading_models_.insert(model_id);
+  pending_loads_[model_id] = load;
+  ++running_loads_;
+  std::thread([this, model_id, model_info, promise, reload]() {
+    promise->set_value(runLoad(model_id, model_info, reload));
+    std::lock_guard<std::mutex> lock(mutex_);
+    --running_loads_;
+    load_cv_.notify_all();
+  }).detach();
+  return load;
+}
 
-  // Create model instance
-  // Creating model instance
-  auto model = createModel(it->second);
-  if (!model) {
-    std::cerr << "[ERROR] Failed to create model instance: " << model_id
-              << " (type: " << static_cast<int>(it->second.type) << ")"
-              << std::endl;
-    updateModelStatus(model_id, duorou::core::ModelStatus::LOAD_ERROR);
-    return false;
+bool ModelManager::runLoad(const std::string &model_id,
+                           const ModelManagerInfo &model_info, bool reload) {
+  // An unload of this model still releasing it goes first
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    load_cv_.wait(lock, [this, &model_id]() {
+      return unloading_models_.count(model_id) == 0;
+    });
   }
 
-  // Update status to loading
-  // Starting model load
-  updateModelStatus(model_id, duorou::core::ModelStatus::LOADING);
-
   // Record start time
   auto start_time = std::chrono::steady_clock::now();
 
-  // Load model (with timeout handling)
+  std::shared_ptr<BaseModel> model;
   bool success = false;
   std::string error_message;
 
   try {
-    // Direct synchronous loading, but add detailed error information
-    // Note: Asynchronous loading may not be safe in this context due to shared state
-    success = model->load(it->second.path);
+    // Create model instance
+    model = createModel(model_info);
+    if (!model) {
+      error_message = "Failed to create model instance (type: " +
+                      std::to_string(static_cast<int>(model_info.type)) + ")";
+    } else if (auto ollama = std::dynamic_pointer_cast<OllamaModelImpl>(model);
+               ollama && reload) {
+      success = ollama->reload(model_info.path);
+    } else {
+      success = model->load(model_info.path);
+    }
   } catch (const std::exception &e) {
     error_message = "Exception during model loading: " + std::string(e.what());
-    std::cerr << "[ERROR] " << error_message << " for model: " << model_id
-              << std::endl;
   } catch (...) {
     error_message = "Unknown exception during model loading";
-    std::cerr << "[ERROR] " << error_message << " for model: " << model_id
-              << std::endl;
   }
 
   // Calculate loading time
@@ -678,41 +761,61 @@ bool ModelManager::loadModel(const std::string &model_id) {
   auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
       end_time - start_time);
 
-  if (success) {
-    loaded_models_[model_id] = model;
-    updateModelStatus(model_id, duorou::core::ModelStatus::LOADED);
-
-    // Call callback function
-    if (load_callback_) {
-      load_callback_(model_id, true);
+  // Publish the fully loaded model in one step. A replaced instance is not
+  // unload()ed: it may share state with its successor (Ollama engines are
+  // per model id), so it is just released once its last user lets go.
+  std::function<void(const std::string &, bool)> callback;
+  std::shared_ptr<BaseModel> previous;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_load_memory_ -= std::min(pending_load_memory_, estimatedLoadMemory(model_info));
+    auto loaded_it = loaded_models_.find(model_id);
+    if (success) {
+      if (loaded_it != loaded_models_.end()) {
+        previous = std::move(loaded_it->second);
+        loaded_it->second = model;
+      } else {
+        loaded_models_[model_id] = model;
+      }
+      updateModelStatus(model_id, duorou::core::ModelStatus::LOADED);
+    } else if (loaded_it == loaded_models_.end()) {
+      updateModelStatus(model_id, duorou::core::ModelStatus::LOAD_ERROR);
     }
+    loading_models_.erase(model_id);
+    load_cv_.notify_all();
+    callback = load_callback_;
+  }
+
+  // Call callback function (outside the lock, so it may load or unload
+  // models itself)
+  if (callback) {
+    callback(model_id, success);
+  }
 
+  if (success) {
     std::cout << "[SUCCESS] Model loaded successfully: " << model_id
               << " (took " << duration.count() << "ms)" << std::endl;
   } else {
-    updateModelStatus(model_id, duorou::core::ModelStatus::LOAD_ERROR);
-
-    // Call callback function
-    if (load_callback_) {
-      load_callback_(model_id, false);
-    }
-
     std::cerr << "[ERROR] Failed to load model: " << model_id << " (took "
               << duration.count() << "ms)";
     if (!error_message.empty()) {
       std::cerr << " - " << error_message;
     }
     std::cerr << std::endl;
-
-    // Log detailed error information
-    // Model details logged at error above; suppress extra debug info
   }
 
   return success;
 }
 
 bool ModelManager::unloadModel(const std::string &model_id) {
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  // Let a load of this very model publish first; loads of other models
+  // carry on
+  load_cv_.wait(lock, [this, &model_id]() {
+    return loading_models_.count(model_id) == 0 &&
+           unloading_models_.count(model_id) == 0;
+  });
 
   auto it = loaded_models_.find(model_id);
   if (it == loaded_models_.end()) {
@@ -720,31 +823,58 @@ bool ModelManager::unloadModel(const std::string &model_id) {
     return false;
   }
 
-  // Unload model
-  it->second->unload();
+  // Take the model out, then release it without holding mutex_; a load of
+  // it waits in runLoad until the release is done
+  std::shared_ptr<BaseModel> model = std::move(it->second);
   loaded_models_.erase(it);
-
-  // Update status
   updateModelStatus(model_id, duorou::core::ModelStatus::NOT_LOADED);
+  unloading_models_.insert(model_id);
+  lock.unlock();
+
+  try {
+    model->unload();
+  } catch (const std::exception &e) {
+    std::cerr << "Error unloading model " << model_id << ": " << e.what()
+              << std::endl;
+  }
+
+  lock.lock();
+  unloading_models_.erase(model_id);
+  load_cv_.notify_all();
+  lock.unlock();
 
   std::cout << "Model unloaded: " << model_id << std::endl;
   return true;
 }
 
 void ModelManager::unloadAllModels() {
-  std::lock_guard<std::mutex> lock(mutex_);
+  // Same as unloadModel: take the models out, release them unlocked
+  std::unordered_map<std::string, std::shared_ptr<BaseModel>> models;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    models.swap(loaded_models_);
+    for (const auto &pair : models) {
+      updateModelStatus(pair.first, duorou::core::ModelStatus::NOT_LOADED);
+      unloading_models_.insert(pair.first);
+    }
+  }
 
-  for (auto &pair : loaded_models_) {
+  for (auto &pair : models) {
     try {
       pair.second->unload();
-      updateModelStatus(pair.first, duorou::core::ModelStatus::NOT_LOADED);
     } catch (const std::exception &e) {
       std::cerr << "Error unloading model " << pair.first << ": " << e.what()
                 << std::endl;
     }
   }
 
-  loaded_models_.clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &pair : models) {
+      unloading_models_.erase(pair.first);
+    }
+    load_cv_.notify_all();
+  }
   std::cout << "All models unloaded" << std::endl;
 }
 
@@ -966,15 +1096,11 @@ bool ModelManager::hasEnoughMemory(const std::string &model_id) const {
   }
 
   // Estimate model memory usage (using simple estimation here)
-  size_t estimated_usage = 512 * 1024 * 1024; // Default 512MB
-  if (it->second.type == ModelType::DIFFUSION_MODEL) {
-    estimated_usage = 1024 * 1024 * 1024; // Diffusion model 1GB
-  }
-  
+  size_t estimated_usage = estimatedLoadMemory(it->second);
 
   // Calculate current memory usage directly to avoid deadlock (don't call getTotalMemoryUsage)
   
-  size_t current_usage = 0;
+  size_t current_usage = pending_load_memory_;
   for (const auto &pair : loaded_models_) {
     current_usage += pair.second->getMemoryUsage();
   }
@@ -990,7 +1116,7 @@ void ModelManager::setLoadCallback(
   load_callback_ = callback;
 }
 
-TextGenerator *
+std::shared_ptr<TextGenerator>
 ModelManager::getTextGenerator(const std::string &model_id) const {
   std::lock_guard<std::mutex> lock(mutex_);
 
@@ -1036,6 +1162,52 @@ ModelManager::getImageGenerator(const std::string &model_id) const {
   return nullptr;
 }
 
+InferenceQueue &ModelManager::getInferenceQueue() const {
+  return *inference_queue_;
+}
+
+std::vector<ModelLatencyMetrics> ModelManager::getLatencyMetrics() const {
+  using duorou::extensions::ollama::LatencyHistogram;
+
+  // Engine ids of the loaded Ollama models; the engines are asked outside
+  // mutex_
+  std::vector<std::pair<std::string, std::string>> models;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &pair : loaded_models_) {
+      auto ollama_model = std::dynamic_pointer_cast<OllamaModelImpl>(pair.second);
+      if (ollama_model && !ollama_model->getOllamaModelId().empty()) {
+        models.emplace_back(pair.first, ollama_model->getOllamaModelId());
+      }
+    }
+  }
+
+  auto snapshot = [](const LatencyHistogram &histogram) {
+    LatencyHistogramMetrics metrics;
+    for (size_t b = 0; b + 1 < LatencyHistogram::kBuckets; ++b) {
+      metrics.bounds_ms.push_back(LatencyHistogram::upperEdgeMs(b));
+    }
+    metrics.counts.assign(histogram.counts,
+                          histogram.counts + LatencyHistogram::kBuckets);
+    metrics.sum_ms = histogram.sum_ms;
+    metrics.count = histogram.count;
+    return metrics;
+  };
+
+  auto &global_manager =
+      duorou::extensions::ollama::GlobalModelManager::getInstance();
+  std::vector<ModelLatencyMetrics> result;
+  for (const auto &model : models) {
+    const auto stats = global_manager.latencyStats(model.second);
+    ModelLatencyMetrics metrics;
+    metrics.model_id = model.first;
+    metrics.ttft = snapshot(stats.ttft);
+    metrics.itl = snapshot(stats.itl);
+    result.push_back(std::move(metrics));
+  }
+  return result;
+}
+
 size_t ModelManager::optimizeMemory() {
   std::lock_guard<std::mutex> lock(mutex_);
 
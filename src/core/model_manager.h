@@ -9,11 +9,14 @@
 #include <unordered_map>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <unordered_set>
 #include <functional>
 #include <future>
 #include <optional>
 #include "text_generator.h"
 #include "image_generator.h"
+#include "inference_queue.h"
 #include "model_downloader.h"
 #include "ollama_model_loader.h"
 #include "model_path_manager.h"
@@ -63,6 +66,25 @@ struct ModelManagerInfo {
     ModelManagerInfo() : type(ModelType::LANGUAGE_MODEL), format(ModelFormat::UNKNOWN), status(ModelStatus::NOT_LOADED), memory_usage(0) {}
 };
 
+/**
+ * @brief Snapshot of one latency histogram
+ */
+struct LatencyHistogramMetrics {
+    std::vector<double> bounds_ms;  ///< Upper bound of each histogram bucket
+    std::vector<uint64_t> counts;   ///< Per bucket, plus one overflow bucket
+    double sum_ms = 0.0;
+    uint64_t count = 0;
+};
+
+/**
+ * @brief Engine-side generation latency of one loaded language model
+ */
+struct ModelLatencyMetrics {
+    std::string model_id;
+    LatencyHistogramMetrics ttft;  ///< Request start to first token
+    LatencyHistogramMetrics itl;   ///< Gap between consecutive tokens
+};
+
 /**
  * @brief Base model class
  */
@@ -132,21 +154,52 @@ public:
     bool registerModel(const ModelManagerInfo& model_info);
     
     /**
-     * @brief Load model
+     * @brief Load model and wait for it
      * @param model_id Model ID
      * @return Returns true on success, false on failure
      */
     bool loadModel(const std::string& model_id);
     
+    /**
+     * @brief Start loading a model in the background
+     *
+     * The load runs without holding the manager lock, so queries and
+     * generation on already loaded models carry on meanwhile; the model
+     * becomes visible to getModel() / getTextGenerator() only once fully
+     * loaded. While it loads its status is LOADING, and callers asking for
+     * the same model share one load. The load callback runs without any
+     * manager lock held, before the future becomes ready.
+     * @param model_id Model ID
+     * @return Future that becomes true once loaded, false on failure
+     */
+    std::shared_future<bool> loadModelAsync(const std::string& model_id);
+    
+    /**
+     * @brief Load a fresh instance of a model in the background and swap it in
+     *
+     * Like loadModelAsync(), but a model that is already loaded is loaded
+     * again: the current instance keeps serving getModel() /
+     * getTextGenerator() until the new one is ready, then the new one
+     * replaces it in one step. Users still holding the old instance keep it
+     * until they let go. On failure the current instance stays.
+     * @param model_id Model ID
+     * @return Future that becomes true once swapped in, false on failure
+     */
+    std::shared_future<bool> reloadModelAsync(const std::string& model_id);
+    
     /**
      * @brief Unload model
+     *
+     * Waits for a load of this model that is still running; loads of other
+     * models do not hold the unload up. The model is released without
+     * holding the manager lock, and a new load of it starts only after.
      * @param model_id Model ID
      * @return Returns true on success, false on failure
      */
     bool unloadModel(const std::string& model_id);
     
     /**
-     * @brief Unload all models
+     * @brief Unload all models (loads still running publish afterwards)
      */
     void unloadAllModels();
     
@@ -216,10 +269,13 @@ public:
     
     /**
      * @brief Get text generator
+     *
+     * The generator stays valid for as long as the caller holds it, even if
+     * the model is unloaded or replaced meanwhile.
      * @param model_id Model ID
-     * @return Text generator pointer
+     * @return Text generator, nullptr if the model is not loaded
      */
-    duorou::core::TextGenerator* getTextGenerator(const std::string& model_id) const;
+    std::shared_ptr<duorou::core::TextGenerator> getTextGenerator(const std::string& model_id) const;
     
     /**
      * @brief Get image generator
@@ -228,6 +284,20 @@ public:
      */
     ImageGenerator* getImageGenerator(const std::string& model_id) const;
     
+    /**
+     * @brief Get the queue that admits and orders generation requests
+     *
+     * Callers that generate on behalf of a client (GUI, API server) run
+     * their generation through it so clients share the models fairly.
+     */
+    InferenceQueue& getInferenceQueue() const;
+
+    /**
+     * @brief Time to first token and inter-token latency of every loaded
+     *        language model whose engine records them, since it was loaded
+     */
+    std::vector<ModelLatencyMetrics> getLatencyMetrics() const;
+    
     /**
      * @brief Optimize memory usage
      * @return Size of freed memory (bytes)
@@ -337,6 +407,25 @@ private:
      */
     std::shared_ptr<BaseModel> createModel(const ModelManagerInfo& model_info);
     
+    /**
+     * @brief Start a background load, shared by loadModelAsync() and
+     * reloadModelAsync()
+     * @param model_id Model ID
+     * @param reload Load again and swap when the model is already loaded
+     * @return Future of the load
+     */
+    std::shared_future<bool> startLoad(const std::string& model_id, bool reload);
+    
+    /**
+     * @brief Create and load a model, then publish it (runs on a load thread)
+     * @param model_id Model ID
+     * @param model_info Registration snapshot taken when the load started
+     * @param reload Replace the loaded instance instead of adding one
+     * @return Returns true on success, false on failure
+     */
+    bool runLoad(const std::string& model_id, const ModelManagerInfo& model_info,
+                 bool reload);
+    
     /**
      * @brief Update model status
      * @param model_id Model ID
@@ -360,6 +449,13 @@ private:
     bool auto_memory_management_;                                      ///< Automatic memory management
     std::unique_ptr<ModelDownloader> model_downloader_;               ///< Model downloader
     std::function<void(const std::string&, bool)> load_callback_;     ///< Model load callback function
+    std::unique_ptr<InferenceQueue> inference_queue_;                  ///< Admission control for generation
+    std::unordered_map<std::string, std::shared_future<bool>> pending_loads_;  ///< Latest load per model
+    std::unordered_set<std::string> loading_models_;                   ///< Models whose load has not published yet
+    std::unordered_set<std::string> unloading_models_;                 ///< Models being released outside the lock
+    size_t pending_load_memory_;                                       ///< Estimated memory of loads in flight
+    size_t running_loads_;                                             ///< Load threads still running (callback included)
+    std::condition_variable load_cv_;                                  ///< Signalled when a load publishes or its thread ends
 
     // 记录与本地 LLM 关联的 mmproj 文件路径，键为 LLM 的 model_id（如 llm_<stem>）
     std::unordered_map<std::string, std::string> mmproj_paths_;
@@ -1,4 +1,5 @@
 #include "text_generator.h"
+#include "../model/streaming_decoder.h"
 #include <algorithm>
 #include <cctype>
 #include <chrono>
@@ -332,22 +333,32 @@ GenerationResult TextGenerator::generateStream(const std::string &prompt,
       StreamCallback cb;
       std::string buffer;
       size_t token_index = 0;
+      bool stopped = false;
+      // MNN writes token pieces that may end inside a UTF-8 character
+      duorou::model::StreamingDecoder decoder;
 
       explicit CallbackStreambuf(StreamCallback callback) : cb(std::move(callback)) {}
 
+      void emit(const std::string &bytes) {
+        buffer += bytes;
+        const std::string text = decoder.pushBytes(bytes);
+        if (!text.empty()) {
+          stopped = !cb(static_cast<int>(token_index++), text, false);
+        }
+      }
+
+      // Once the callback asks to stop, fail the write so the stream goes bad
       std::streamsize xsputn(const char* s, std::streamsize count) override {
+        if (stopped) return 0;
         if (count > 0) {
-          buffer.append(s, static_cast<size_t>(count));
-          cb(static_cast<int>(token_index++), std::string(s, static_cast<size_t>(count)), false);
+          emit(std::string(s, static_cast<size_t>(count)));
         }
         return count;
       }
 
       int overflow(int ch) override {
-        if (ch == EOF) return EOF;
-        char c = static_cast<char>(ch);
-        buffer.push_back(c);
-        cb(static_cast<int>(token_index++), std::string(1, c), false);
+        if (ch == EOF || stopped) return EOF;
+        emit(std::string(1, static_cast<char>(ch)));
         return ch;
       }
     };
@@ -362,11 +373,13 @@ GenerationResult TextGenerator::generateStream(const std::string &prompt,
       mnn_llm_->response(effective_prompt, &os, nullptr, params.max_tokens);
       auto end_time = std::chrono::high_resolution_clock::now();
 
-      callback(static_cast<int>(cb_buf.token_index), "", true);
+      if (!cb_buf.stopped) {
+        callback(static_cast<int>(cb_buf.token_index), cb_buf.decoder.flush(), true);
+      }
 
       result.text = cb_buf.buffer;
       result.finished = true;
-      result.stop_reason = "completed";
+      result.stop_reason = cb_buf.stopped ? "cancelled" : "completed";
       result.prompt_tokens = countTokens(prompt);
       result.generated_tokens = countTokens(result.text);
       result.generation_time =
@@ -404,12 +417,23 @@ GenerationResult TextGenerator::generateStream(const std::string &prompt,
       if (response.success) {
         // Simulate streaming output, send complete response in chunks
         std::string full_text = response.generated_text;
-        const size_t chunk_size = 10; // Send 10 characters each time
+        const size_t chunk_size = 10; // Send 10 bytes each time
+        bool stopped = false;
+        // Chunks never end inside a UTF-8 character
+        duorou::model::StreamingDecoder decoder;
 
         for (size_t i = 0; i < full_text.length(); i += chunk_size) {
-          std::string chunk = full_text.substr(i, chunk_size);
           bool is_final = (i + chunk_size >= full_text.length());
-          callback(i / chunk_size, chunk, is_final);
+          std::string chunk = decoder.pushBytes(full_text.substr(i, chunk_size));
+          if (is_final) {
+            chunk += decoder.flush();
+          } else if (chunk.empty()) {
+            continue;
+          }
+          if (!callback(i / chunk_size, chunk, is_final)) {
+            stopped = true;
+            break;
+          }
 
           // Simulate streaming delay
           std::this_thread::sleep_for(std::chrono::milliseconds(50));
@@ -417,7 +441,7 @@ GenerationResult TextGenerator::generateStream(const std::string &prompt,
 
         result.text = full_text;
         result.finished = true;
-        result.stop_reason = "completed";
+        result.stop_reason = stopped ? "cancelled" : "completed";
         result.prompt_tokens = countTokens(prompt);
         result.generated_tokens = response.tokens_generated;
         result.generation_time =
@@ -469,10 +493,20 @@ GenerationResult TextGenerator::generateStream(const std::string &prompt,
 
     // Send response in chunks
     const size_t chunk_size = 8;
+    bool stopped = false;
+    duorou::model::StreamingDecoder decoder;
     for (size_t i = 0; i < response_text.length(); i += chunk_size) {
-      std::string chunk = response_text.substr(i, chunk_size);
       bool is_final = (i + chunk_size >= response_text.length());
-      callback(i / chunk_size, chunk, is_final);
+      std::string chunk = decoder.pushBytes(response_text.substr(i, chunk_size));
+      if (is_final) {
+        chunk += decoder.flush();
+      } else if (chunk.empty()) {
+        continue;
+      }
+      if (!callback(i / chunk_size, chunk, is_final)) {
+        stopped = true;
+        break;
+      }
 
       // Simulate generation delay
       std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -480,7 +514,7 @@ GenerationResult TextGenerator::generateStream(const std::string &prompt,
 
     result.text = response_text;
     result.finished = true;
-    result.stop_reason = "completed";
+    result.stop_reason = stopped ? "cancelled" : "completed";
     result.prompt_tokens = countTokens(prompt);
     result.generated_tokens = countTokens(response_text);
     result.generation_time = 0.5;
@@ -520,66 +554,6 @@ int TextGenerator::getContextSize() const { return context_size_; }
 // Get vocabulary size
 int TextGenerator::getVocabSize() const { return vocab_size_; }
 
-// Apply Top-K sampling
-void TextGenerator::applyTopK(float *logits, int k) {
-  if (k <= 0 || !logits)
-    return;
-
-  // Simple implementation: set all values except the top k largest to negative
-  // infinity
-  std::vector<std::pair<float, int>> logit_pairs;
-  for (int i = 0; i < vocab_size_; ++i) {
-    logit_pairs.emplace_back(logits[i], i);
-  }
-
-  std::partial_sort(
-      logit_pairs.begin(), logit_pairs.begin() + k, logit_pairs.end(),
-      [](const auto &a, const auto &b) { return a.first > b.first; });
-
-  for (int i = k; i < vocab_size_; ++i) {
-    logits[logit_pairs[i].second] = -INFINITY;
-  }
-}
-
-// Apply Top-P sampling
-void TextGenerator::applyTopP(float *logits, float p) {
-  if (p <= 0.0f || p >= 1.0f || !logits)
-    return;
-
-  // Calculate softmax probabilities
-  std::vector<std::pair<float, int>> prob_pairs;
-  float max_logit = *std::max_element(logits, logits + vocab_size_);
-
-  float sum = 0.0f;
-  for (int i = 0; i < vocab_size_; ++i) {
-    float prob = std::exp(logits[i] - max_logit);
-    prob_pairs.emplace_back(prob, i);
-    sum += prob;
-  }
-
-  // Normalize
-  for (auto &pair : prob_pairs) {
-    pair.first /= sum;
-  }
-
-  // Sort by probability in descending order
-  std::sort(prob_pairs.begin(), prob_pairs.end(),
-            [](const auto &a, const auto &b) { return a.first > b.first; });
-
-  // Calculate cumulative probability and truncate
-  float cumulative = 0.0f;
-  for (size_t i = 0; i < prob_pairs.size(); ++i) {
-    cumulative += prob_pairs[i].first;
-    if (cumulative > p) {
-      // Set remaining token probabilities to 0
-      for (size_t j = i + 1; j < prob_pairs.size(); ++j) {
-        logits[prob_pairs[j].second] = -INFINITY;
-      }
-      break;
-    }
-  }
-}
-
 // Apply temperature sampling
 void TextGenerator::applyTemperature(float *logits, float temperature) {
   if (temperature <= 0.0f || !logits)
@@ -62,10 +62,11 @@ struct GenerationResult {
  * @param token Newly generated token
  * @param text Corresponding text fragment
  * @param finished Whether finished
+ * @return false to stop generation (e.g. the client went away)
  */
 // typedef std::function<void(llama_token token, const std::string& text, bool
 // finished)> StreamCallback;  // Temporarily disabled
-typedef std::function<void(int token, const std::string &text, bool finished)>
+typedef std::function<bool(int token, const std::string &text, bool finished)>
     StreamCallback;
 
 /**
@@ -175,20 +176,6 @@ public:
   int getVocabSize() const;
 
 private:
-  /**
-   * @brief Apply Top-K sampling
-   * @param logits Logits array
-   * @param k Top-K parameter
-   */
-  void applyTopK(float *logits, int k);
-
-  /**
-   * @brief Apply Top-P sampling
-   * @param logits Logits array
-   * @param p Top-P parameter
-   */
-  void applyTopP(float *logits, float p);
-
   /**
    * @brief Apply temperature sampling
    * @param logits Logits array
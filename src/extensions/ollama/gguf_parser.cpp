@@ -1062,6 +1062,38 @@ void GGUFParser::cleanupMmap() {
   current_offset_ = 0;
 }
 
+void GGUFParser::prefetch(uint64_t offset, uint64_t bytes) const {
+  if (!file_parsed_ || bytes == 0) {
+    return;
+  }
+  uint64_t begin = tensor_data_offset_ + offset;
+  uint64_t end = begin + bytes;
+  if (use_mmap_ && mapped_data_ != nullptr) {
+    end = std::min<uint64_t>(end, file_size_);
+    if (begin >= end) {
+      return;
+    }
+#ifndef _WIN32
+    // madvise wants a page-aligned start
+    const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    begin -= begin % page;
+    madvise(static_cast<uint8_t *>(mapped_data_) + begin,
+            static_cast<size_t>(end - begin), MADV_WILLNEED);
+#endif
+    return;
+  }
+#if !defined(_WIN32) && !defined(__APPLE__)
+  // Stream IO: warm the page cache; the readahead outlives the descriptor
+  int fd = open(file_path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  posix_fadvise(fd, static_cast<off_t>(begin), static_cast<off_t>(end - begin),
+                POSIX_FADV_WILLNEED);
+  close(fd);
+#endif
+}
+
 bool GGUFParser::readFromMmap(void *buffer, size_t size) {
   if (!mapped_data_ || current_offset_ + size > file_size_) {
     log("ERROR", "Read beyond file boundary or invalid mmap data");
@@ -78,6 +78,7 @@ public:
   bool readTensorData(const std::string&, void*, size_t, size_t = 0) const { return false; }
   bool readTensorData(const GGUFTensorInfo&, void*, size_t, size_t = 0) const { return false; }
   size_t getTensorSize(const std::string&) const { return 0ULL; }
+  void prefetch(uint64_t, uint64_t) const {}
 private:
   ModelArchitecture architecture_{};
   std::vector<GGUFTensorInfo> tensor_infos_{};
@@ -321,6 +322,15 @@ public:
    */
   size_t getTensorSize(const std::string& name) const;
 
+  /**
+   * Hint the OS to start reading a range of tensor data ahead of use
+   * (madvise(MADV_WILLNEED) on the mapping, posix_fadvise otherwise).
+   * Returns immediately; the range is clamped to the file.
+   * @param offset Byte offset relative to the tensor data section
+   * @param bytes Number of bytes
+   */
+  void prefetch(uint64_t offset, uint64_t bytes) const;
+
 private:
   /**
    * Read GGUF file header
@@ -15,6 +15,15 @@
 #include <algorithm>
 #include <filesystem>
 #include <cstdio>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
 
 // Windows CRT maps POSIX popen/pclose to _popen/_pclose
 #ifdef _WIN32
@@ -30,6 +39,7 @@
 // Explicit relative include to satisfy IDE/LSP resolution
 #include "../../../third_party/llama.cpp/include/llama.h"
 #include "ggml-backend.h"
+#include "latency_histogram.h"
 // mtmd helpers for multimodal image injection (llama.cpp tools)
 #include "../../../third_party/llama.cpp/tools/mtmd/mtmd.h"
 #include "../../../third_party/llama.cpp/tools/mtmd/mtmd-helper.h"
@@ -38,6 +48,41 @@ namespace duorou {
 namespace extensions {
 namespace ollama {
 
+// Counters of the last generateText call, for tuning speculative decoding and
+// checking prompt-prefix reuse
+struct GenerationStats {
+  unsigned int tokens = 0;          // tokens returned (EOG excluded)
+  unsigned int target_decodes = 0;  // llama_decode calls on the target model
+  unsigned int draft_proposed = 0;  // tokens proposed by the draft model
+  unsigned int draft_accepted = 0;  // proposals the target kept
+  unsigned int prompt_tokens = 0;   // tokens in the prompt
+  unsigned int prompt_reused = 0;   // prompt tokens already in the KV cache
+  double prompt_ms = 0.0;           // prompt evaluation (batched: from admission)
+  double generation_ms = 0.0;       // everything after the prompt
+  double ttft_ms = 0.0;             // request start (batched: submit) to first token
+  LatencyHistogram itl;             // gaps between consecutive returned tokens
+
+  double acceptanceRate() const {
+    return draft_proposed ? static_cast<double>(draft_accepted) / draft_proposed : 0.0;
+  }
+  double tokensPerSecond() const {
+    return generation_ms > 0.0 ? tokens * 1000.0 / generation_ms : 0.0;
+  }
+};
+
+// One prompt of a generateTextBatch call
+struct GenerationRequest {
+  std::string prompt;
+  unsigned int max_tokens = 64;
+  float temperature = 0.0f;
+  float top_p = 1.0f;
+};
+
+struct GenerationResult {
+  std::string text;
+  GenerationStats stats;
+};
+
 class InferenceEngine {
 public:
   virtual ~InferenceEngine() {}
@@ -54,16 +99,59 @@ public:
                                            float top_p) = 0;
   // Expose embedding dimension for pre-validation at manager level
   virtual int32_t getEmbeddingDim() const = 0;
+  // Counters of the most recent generateText call. With several callers on
+  // one engine that may already be someone else's call; use generate().
+  virtual GenerationStats lastGenerationStats() const { return GenerationStats(); }
+  // Generate one prompt and return its counters with the text. Engines
+  // shared between callers override this to take both from the same call.
+  virtual GenerationResult generate(const GenerationRequest &request) {
+    GenerationResult result;
+    result.text = generateText(request.prompt, request.max_tokens, request.temperature,
+                               request.top_p);
+    result.stats = lastGenerationStats();
+    return result;
+  }
+  // TTFT and inter-token latency over every request since initialize()
+  virtual LatencyStats latencyStats() const { return LatencyStats(); }
+  // Generate several prompts. Engines that can decode them together override
+  // this; the default runs them one after another.
+  virtual std::vector<GenerationResult>
+  generateTextBatch(const std::vector<GenerationRequest> &requests) {
+    std::vector<GenerationResult> results;
+    results.reserve(requests.size());
+    for (const auto &request : requests) {
+      results.push_back(generate(request));
+    }
+    return results;
+  }
 };
 
 class MLInferenceEngine : public InferenceEngine {
 public:
   MLInferenceEngine(const std::string &model_id, const std::string &gguf_path)
       : model_id_(model_id), gguf_path_(gguf_path), ready_(false), model_(nullptr),
-        ctx_(nullptr) {}
+        ctx_(nullptr) {
+    // Environment defaults; setParallelSequences() / setPrefillChunk() win
+    if (const char *env_parallel = std::getenv("DUOROU_PARALLEL")) {
+      n_parallel_ = static_cast<unsigned int>(std::strtoul(env_parallel, nullptr, 10));
+    }
+    if (const char *env_chunk = std::getenv("DUOROU_PREFILL_CHUNK")) {
+      prefill_chunk_ = static_cast<unsigned int>(std::strtoul(env_chunk, nullptr, 10));
+    }
+  }
 
   ~MLInferenceEngine() override {
+    // The scheduler thread decodes on ctx_; stop it first
+    stopScheduler();
     // Cleanup resources
+    if (draft_ctx_) {
+      llama_free(draft_ctx_);
+      draft_ctx_ = nullptr;
+    }
+    if (draft_model_) {
+      llama_model_free(draft_model_);
+      draft_model_ = nullptr;
+    }
     if (ctx_) {
       llama_free(ctx_);
       ctx_ = nullptr;
@@ -87,11 +175,19 @@ public:
       return false;
     }
 
+    // Sequence 0 serves generateText; sequences 1..n_parallel_ are the
+    // continuous-batching slots. Each slot gets a full context of KV cache,
+    // so batching is off unless asked for.
+    n_parallel_ = std::min(n_parallel_, 63u);
+
     llama_context_params cparams = llama_context_default_params();
     // Increase batch to accommodate prompt + last-logits without assert
-    cparams.n_ctx = 2048; // Default context size
+    cparams.n_ctx = 2048; // Default context size, per sequence
     cparams.n_batch = 512; // Larger batch to avoid n_tokens + n_outputs overflow
     cparams.no_perf = true; // Disable perf logs in production path
+    llama_context_params draft_cparams = cparams;
+    cparams.n_seq_max = n_parallel_ + 1;
+    cparams.n_ctx *= cparams.n_seq_max;
 
     ctx_ = llama_init_from_model(model_, cparams);
     if (!ctx_) {
@@ -100,59 +196,111 @@ public:
       return false;
     }
 
+    slot_tokens_.assign(n_parallel_, std::vector<llama_token>());
+    prefill_chunk_ = std::max(1u, std::min(prefill_chunk_, llama_n_batch(ctx_)));
     ready_ = true;
+    if (!draft_gguf_path_.empty()) {
+      // A draft that fails to load only disables speculation
+      loadDraftModel(mparams, draft_cparams);
+    }
     return true;
   }
 
   bool isReady() const override { return ready_ && model_ && ctx_; }
 
+  // Speculative decoding: a small draft model sharing the target's vocabulary
+  // (e.g. Qwen 0.5B next to 7B) proposes draft_tokens tokens per step and the
+  // target verifies them in one batched llama_decode. Must be set before
+  // initialize(); an empty path disables it.
+  void setDraftModel(const std::string &draft_gguf_path, unsigned int draft_tokens) {
+    draft_gguf_path_ = draft_gguf_path;
+    draft_tokens_ = std::max(1u, draft_tokens);
+  }
+  bool speculativeEnabled() const { return draft_model_ && draft_ctx_; }
+
+  // Continuous batching: number of sequences the scheduler decodes together
+  // (default 0, off). Overrides DUOROU_PARALLEL; must be set before
+  // initialize().
+  void setParallelSequences(unsigned int n_parallel) { n_parallel_ = n_parallel; }
+  // Prompt tokens decoded per step, shared by every sequence still reading
+  // its prompt (capped at n_batch): smaller keeps decode latency of the other
+  // sequences low, larger finishes long prompts sooner. Overrides
+  // DUOROU_PREFILL_CHUNK; must be set before initialize().
+  void setPrefillChunk(unsigned int tokens) { prefill_chunk_ = tokens; }
+  unsigned int prefillChunk() const { return prefill_chunk_; }
+  bool batchingEnabled() const {
+    return isReady() && n_parallel_ > 0 && !llama_model_has_encoder(model_);
+  }
+
+  GenerationStats lastGenerationStats() const override {
+    std::lock_guard<std::recursive_mutex> lock(seq0_mutex_);
+    return stats_;
+  }
+
+  GenerationResult generate(const GenerationRequest &request) override {
+    // stats_ belongs to sequence 0; keep it until ours are copied out
+    std::lock_guard<std::recursive_mutex> lock(seq0_mutex_);
+    GenerationResult result;
+    result.text = generateText(request.prompt, request.max_tokens, request.temperature,
+                               request.top_p);
+    result.stats = stats_;
+    return result;
+  }
+
+  LatencyStats latencyStats() const override {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    return latency_;
+  }
+
+  // Queue a prompt for the continuous-batching scheduler. Every decode step
+  // carries one token for each running sequence plus prompt chunks of newly
+  // admitted ones, so requests join and leave between steps instead of
+  // waiting for each other. Prompts with media, and engines without
+  // batching, are generated synchronously.
+  std::future<GenerationResult> submit(const GenerationRequest &request) {
+    std::vector<std::future<GenerationResult>> pending = submitAll({request});
+    return std::move(pending.front());
+  }
+
+  std::vector<GenerationResult>
+  generateTextBatch(const std::vector<GenerationRequest> &requests) override {
+    // A lone request keeps the single-stream path (prefix cache, draft model)
+    if (requests.size() <= 1 || !batchingEnabled()) {
+      std::lock_guard<std::recursive_mutex> lock(seq0_mutex_);
+      return InferenceEngine::generateTextBatch(requests);
+    }
+    std::vector<std::future<GenerationResult>> pending = submitAll(requests);
+    std::vector<GenerationResult> results;
+    results.reserve(requests.size());
+    for (auto &f : pending) {
+      results.push_back(f.get());
+    }
+    return results;
+  }
+
   std::string generateText(const std::string &prompt, unsigned int max_tokens,
                            float temperature, float top_p) override {
     if (!isReady()) {
       return std::string("[Engine not ready] ") + prompt;
     }
-
-    // Ensure the KV cache is clear for the new generation
-        llama_memory_clear(llama_get_memory(ctx_), false);
-
+    // Sequence 0 is ours for the whole call; ctx_ only around each decode
+    // and the logits it produced, so scheduler steps run in between.
+    // Recursive: media prompts continue in generateTextWithImages.
+    std::lock_guard<std::recursive_mutex> seq_lock(seq0_mutex_);
+    std::unique_lock<std::mutex> ctx_lock(ctx_mutex_, std::defer_lock);
+    stats_ = GenerationStats();
+    const auto call_start = std::chrono::steady_clock::now();
+
+    // The KV cache is not cleared here: prefillReusingPrefix() keeps whatever
+    // prefix the previous call left that the new prompt shares
     const llama_vocab *vocab = llama_model_get_vocab(model_);
     if (!vocab) {
       return std::string("[Vocab error] ") + prompt;
     }
 
-    // --------- Prompt heuristics for text path (handle media inlined with text) ---------
-    auto trim_copy = [](const std::string &s) -> std::string {
-      size_t start = 0, end = s.size();
-      while (start < end && std::isspace(static_cast<unsigned char>(s[start]))) ++start;
-      while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) --end;
-      return s.substr(start, end - start);
-    };
-
-    auto contains_md_image_any = [](const std::string &s) -> bool {
-      static const std::regex re("!\\[[^\\]]*\\]\\(([^)]+)\\)");
-      return std::regex_search(s, re);
-    };
-
-    auto contains_data_image = [](const std::string &s) -> bool {
-      static const std::regex re_data("data:image/[^;]+;base64,");
-      return std::regex_search(s, re_data);
-    };
-
-    auto contains_file_url = [](const std::string &s) -> bool {
-      static const std::regex re_file("file://[^\\s)]+");
-      return std::regex_search(s, re_file);
-    };
-
-    auto contains_http_image_url = [](const std::string &s) -> bool {
-      static const std::regex re_http_img("https?://[^\\s)]+\\.(png|jpg|jpeg|gif|webp|bmp|tiff|svg)(\\?[^\\s)]*)?", std::regex::icase);
-      return std::regex_search(s, re_http_img);
-    };
-
-    std::string prompt_effective = trim_copy(prompt);
-    const bool prompt_contains_media = contains_md_image_any(prompt) || contains_data_image(prompt) ||
-                                       contains_file_url(prompt) || contains_http_image_url(prompt);
+    std::string prompt_effective = trimCopy(prompt);
     // 如果提示中包含任何图片引用（即便混合文本），转到 generateTextWithImages
-    if (prompt_contains_media) {
+    if (promptHasMedia(prompt)) {
       return generateTextWithImages(prompt, /*image_features=*/{}, max_tokens, temperature, top_p);
     }
 
@@ -161,27 +309,27 @@ public:
     std::cout << "Text Prompt: " << prompt_effective << std::endl;
 
     // Tokenize prompt
-    int n_prompt = -llama_tokenize(vocab, prompt_effective.c_str(), (int)prompt_effective.size(),
-                                   nullptr, 0, /*add_special=*/true,
-                                   /*parse_special=*/true);
-    if (n_prompt <= 0) {
-      return std::string("[Tokenize error] ") + prompt_effective;
-    }
-    std::vector<llama_token> prompt_tokens((size_t)n_prompt);
-    int n_tok = llama_tokenize(vocab, prompt_effective.c_str(), (int)prompt_effective.size(),
-                               prompt_tokens.data(), (int)prompt_tokens.size(),
-                               /*add_special=*/true, /*parse_special=*/true);
-    if (n_tok < 0) {
+    std::vector<llama_token> prompt_tokens;
+    if (!tokenizePrompt(prompt_effective, prompt_tokens)) {
       return std::string("[Tokenize error] ") + prompt_effective;
     }
 
-    // Build batch from prompt; request logits only for last token by default
-    llama_batch batch =
-        llama_batch_get_one(prompt_tokens.data(), (int)prompt_tokens.size());
-    batch.logits = nullptr; // ensure only last token outputs logits
-
-    // If the model has an encoder, run encode first
-    if (llama_model_has_encoder(model_)) {
+    const bool has_encoder = llama_model_has_encoder(model_);
+    if (speculativeEnabled() && !has_encoder) {
+      return generateSpeculative(prompt_tokens, max_tokens, temperature, top_p, call_start);
+    }
+    const auto gen_start = std::chrono::steady_clock::now();
+    stats_.prompt_tokens = static_cast<unsigned int>(prompt_tokens.size());
+
+    bool ok = true;
+    ctx_lock.lock();
+    if (has_encoder) {
+      // Encoder-decoder: the decoder cache depends on the encoder output, so
+      // nothing carries over between calls
+      llama_memory_clear(llama_get_memory(ctx_), false);
+      cached_tokens_.clear();
+      llama_batch batch =
+          llama_batch_get_one(prompt_tokens.data(), (int)prompt_tokens.size());
       if (llama_encode(ctx_, batch)) {
         return std::string("[Encode error] ") + prompt;
       }
@@ -194,46 +342,44 @@ public:
       token_buf[0] = decoder_start_token_id;
       batch = llama_batch_get_one(token_buf.data(), 1);
       batch.logits = nullptr; // single-token decode outputs logits for that token
+      ok = llama_decode(ctx_, batch) == 0;
+      stats_.target_decodes += 1;
+    } else {
+      const int32_t reused = prefillReusingPrefix(ctx_, cached_tokens_, prompt_tokens, &ctx_lock);
+      ok = reused >= 0;
+      stats_.prompt_reused = static_cast<unsigned int>(std::max(0, reused));
+    }
+    if (!ok) {
+      return std::string("[Decode error] ") + prompt;
     }
 
     // Initialize sampler chain per call so temperature/top_p can vary
-    auto sparams = llama_sampler_chain_default_params();
-    sparams.no_perf = true;
-    llama_sampler *sampler = llama_sampler_chain_init(sparams);
-    if (temperature > 0.0f) {
-      llama_sampler_chain_add(sampler, llama_sampler_init_temp(temperature));
-    }
-    if (top_p > 0.0f && top_p < 1.0f) {
-      llama_sampler_chain_add(sampler, llama_sampler_init_top_p(top_p, /*min_keep*/ 1));
-    }
-    // 保证链上始终有“最终选择器”以设置 cur_p.selected
-    // - 当无随机性设置时使用贪心选择
-    // - 当使用温度/Top-P 等随机性时，使用分布采样选择
-    if (temperature <= 0.0f && !(top_p > 0.0f && top_p < 1.0f)) {
-      // 无随机性：贪心
-      llama_sampler_chain_add(sampler, llama_sampler_init_greedy());
-    } else {
-      // 有随机性：按概率分布采样（使用默认种子以获得合理随机性）
-      llama_sampler_chain_add(sampler, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
-    }
+    llama_sampler *sampler = makeSampler(temperature, top_p);
 
     std::string output;
     unsigned int to_predict = max_tokens == 0 ? 64u : max_tokens;
     unsigned int produced = 0;
 
-    // Main generation loop
+    // Main generation loop: sample from the last decoded position, then feed
+    // the token back; the final token is returned without being decoded
+    const auto decode_start = std::chrono::steady_clock::now();
+    stats_.prompt_ms = msBetween(gen_start, decode_start);
+    auto last_token = decode_start;
     while (produced < to_predict) {
-      if (llama_decode(ctx_, batch)) {
-        break; // decode error
+      llama_token new_token_id = llama_sampler_sample(sampler, ctx_, -1);
+      const uint64_t seen_step = scheduler_steps_;
+      ctx_lock.unlock();
+      const auto now = std::chrono::steady_clock::now();
+      if (produced == 0) {
+        stats_.ttft_ms = msBetween(call_start, now);
       }
-      // position advance is implicit; not used for output here
-
-      // 首次从提示词采样应使用最后一个被标记输出的位置（n_tokens-1）
-      // 后续单 token batch 的采样索引恒为 0
-      llama_token new_token_id = llama_sampler_sample(sampler, ctx_, batch.n_tokens - 1);
       if (llama_vocab_is_eog(vocab, new_token_id)) {
         break;
       }
+      if (produced > 0) {
+        stats_.itl.record(msBetween(last_token, now));
+      }
+      last_token = now;
 
       // Append piece for the sampled token
       char buf[256];
@@ -242,16 +388,36 @@ public:
       if (n > 0) {
         output.append(buf, (size_t)n);
       }
+      produced += 1;
+      if (produced >= to_predict) {
+        break;
+      }
 
       // Next step batch uses the sampled token（持久缓冲）
       // 复用或创建持久缓冲以避免传入局部地址
       static thread_local std::vector<llama_token> next_token_buf(1);
       next_token_buf[0] = new_token_id;
-      batch = llama_batch_get_one(next_token_buf.data(), 1);
+      llama_batch batch = llama_batch_get_one(next_token_buf.data(), 1);
       batch.logits = nullptr; // ensure single-token decode outputs logits
-      produced += 1;
+      lockAfterSchedulerStep(ctx_lock, seen_step);
+      if (llama_decode(ctx_, batch)) {
+        // The cache may hold a partial step; do not trust it next call
+        llama_memory_seq_rm(llama_get_memory(ctx_), 0, -1, -1);
+        cached_tokens_.clear();
+        break;
+      }
+      stats_.target_decodes += 1;
+      if (!has_encoder) {
+        cached_tokens_.push_back(new_token_id);
+      }
     }
 
+    if (ctx_lock.owns_lock()) {
+      ctx_lock.unlock();
+    }
+    stats_.tokens = produced;
+    stats_.generation_ms = msBetween(decode_start, std::chrono::steady_clock::now());
+    recordLatency(stats_);
     llama_sampler_free(sampler);
     return output.empty() ? std::string("") : output;
   }
@@ -263,9 +429,15 @@ public:
     if (!isReady()) {
       return std::string("[Engine not ready] ") + prompt;
     }
+    // mtmd decodes internally, so ctx_ stays locked for the whole call
+    std::lock_guard<std::recursive_mutex> seq_lock(seq0_mutex_);
+    std::lock_guard<std::mutex> ctx_lock(ctx_mutex_);
+    stats_ = GenerationStats();
 
-    // Ensure the KV cache is clear for the new generation
-    llama_memory_clear(llama_get_memory(ctx_), false);
+    // Ensure sequence 0 is clear for the new generation; the batching slots
+    // keep theirs
+    llama_memory_seq_rm(llama_get_memory(ctx_), 0, -1, -1);
+    cached_tokens_.clear();
 
     const llama_vocab *vocab = llama_model_get_vocab(model_);
     if (!vocab) {
@@ -856,11 +1028,761 @@ public:
   }
 
 private:
+  static double msBetween(std::chrono::steady_clock::time_point a,
+                          std::chrono::steady_clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+  }
+
+  // Load the draft model with the target's parameters and check that both
+  // tokenize alike; speculation stays off on any mismatch
+  void loadDraftModel(const llama_model_params &mparams, const llama_context_params &cparams) {
+    draft_model_ = llama_model_load_from_file(draft_gguf_path_.c_str(), mparams);
+    if (!draft_model_) {
+      std::cerr << "[Speculative] failed to load draft model " << draft_gguf_path_ << std::endl;
+      return;
+    }
+    const llama_vocab *tv = llama_model_get_vocab(model_);
+    const llama_vocab *dv = llama_model_get_vocab(draft_model_);
+    const int32_t nt = llama_vocab_n_tokens(tv);
+    const int32_t nd = llama_vocab_n_tokens(dv);
+    // Embedding tables of one family are padded to different sizes (Qwen2.5
+    // 0.5B vs 7B); the shared ids must spell the same pieces
+    bool compatible = std::abs(nt - nd) <= 128 && llama_vocab_bos(tv) == llama_vocab_bos(dv) &&
+                      llama_vocab_eos(tv) == llama_vocab_eos(dv);
+    for (int32_t id = 0; compatible && id < std::min(nt, nd); ++id) {
+      const char *a = llama_vocab_get_text(tv, id);
+      const char *b = llama_vocab_get_text(dv, id);
+      compatible = a && b && std::strcmp(a, b) == 0;
+    }
+    if (compatible) {
+      draft_ctx_ = llama_init_from_model(draft_model_, cparams);
+    } else {
+      std::cerr << "[Speculative] draft vocabulary differs from " << model_id_
+                << "; speculative decoding disabled" << std::endl;
+    }
+    if (!draft_ctx_) {
+      llama_model_free(draft_model_);
+      draft_model_ = nullptr;
+    }
+  }
+
+  // Next-token distribution at output `idx` of `ctx` over the target's n_vocab
+  // ids, shaped like the sampler chain in generateText (temperature, top-p);
+  // one-hot on the argmax when greedy
+  void tokenDistribution(llama_context *ctx, int32_t idx, llama_sampler *shaper, bool greedy,
+                         std::vector<float> &probs) {
+    const int32_t n_vocab = static_cast<int32_t>(probs.size());
+    const int32_t n_logits =
+        std::min(n_vocab, llama_vocab_n_tokens(llama_model_get_vocab(llama_get_model(ctx))));
+    const float *logits = llama_get_logits_ith(ctx, idx);
+    std::fill(probs.begin(), probs.end(), 0.0f);
+    if (greedy) {
+      probs[std::max_element(logits, logits + n_logits) - logits] = 1.0f;
+      return;
+    }
+    cur_.resize(static_cast<size_t>(n_logits));
+    for (int32_t i = 0; i < n_logits; ++i) {
+      cur_[i] = llama_token_data{i, logits[i], 0.0f};
+    }
+    llama_token_data_array arr{cur_.data(), cur_.size(), -1, false};
+    llama_sampler_apply(shaper, &arr);
+    float max_logit = -INFINITY;
+    for (size_t i = 0; i < arr.size; ++i) {
+      max_logit = std::max(max_logit, arr.data[i].logit);
+    }
+    double sum = 0.0;
+    for (size_t i = 0; i < arr.size; ++i) {
+      sum += std::exp(static_cast<double>(arr.data[i].logit - max_logit));
+    }
+    for (size_t i = 0; i < arr.size; ++i) {
+      probs[arr.data[i].id] =
+          static_cast<float>(std::exp(static_cast<double>(arr.data[i].logit - max_logit)) / sum);
+    }
+  }
+
+  static std::string trimCopy(const std::string &s) {
+    size_t start = 0, end = s.size();
+    while (start < end && std::isspace(static_cast<unsigned char>(s[start]))) ++start;
+    while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) --end;
+    return s.substr(start, end - start);
+  }
+
+  // Prompt heuristics for the text path: media inlined with text goes to
+  // generateTextWithImages
+  static bool promptHasMedia(const std::string &s) {
+    static const std::regex re_md("!\\[[^\\]]*\\]\\(([^)]+)\\)");
+    static const std::regex re_data("data:image/[^;]+;base64,");
+    static const std::regex re_file("file://[^\\s)]+");
+    static const std::regex re_http_img("https?://[^\\s)]+\\.(png|jpg|jpeg|gif|webp|bmp|tiff|svg)(\\?[^\\s)]*)?", std::regex::icase);
+    return std::regex_search(s, re_md) || std::regex_search(s, re_data) ||
+           std::regex_search(s, re_file) || std::regex_search(s, re_http_img);
+  }
+
+  bool tokenizePrompt(const std::string &text, std::vector<llama_token> &tokens) const {
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    const int n_prompt = -llama_tokenize(vocab, text.c_str(), (int)text.size(), nullptr, 0,
+                                         /*add_special=*/true, /*parse_special=*/true);
+    if (n_prompt <= 0) {
+      return false;
+    }
+    tokens.resize((size_t)n_prompt);
+    return llama_tokenize(vocab, text.c_str(), (int)text.size(), tokens.data(),
+                          (int)tokens.size(), /*add_special=*/true, /*parse_special=*/true) >= 0;
+  }
+
+  static llama_sampler *makeSampler(float temperature, float top_p) {
+    auto sparams = llama_sampler_chain_default_params();
+    sparams.no_perf = true;
+    llama_sampler *sampler = llama_sampler_chain_init(sparams);
+    if (temperature > 0.0f) {
+      llama_sampler_chain_add(sampler, llama_sampler_init_temp(temperature));
+    }
+    if (top_p > 0.0f && top_p < 1.0f) {
+      llama_sampler_chain_add(sampler, llama_sampler_init_top_p(top_p, /*min_keep*/ 1));
+    }
+    // 保证链上始终有“最终选择器”以设置 cur_p.selected
+    // - 当无随机性设置时使用贪心选择
+    // - 当使用温度/Top-P 等随机性时，使用分布采样选择
+    if (temperature <= 0.0f && !(top_p > 0.0f && top_p < 1.0f)) {
+      // 无随机性：贪心
+      llama_sampler_chain_add(sampler, llama_sampler_init_greedy());
+    } else {
+      // 有随机性：按概率分布采样（使用默认种子以获得合理随机性）
+      llama_sampler_chain_add(sampler, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
+    }
+    return sampler;
+  }
+
+  // Context length available to one sequence
+  uint32_t seqCtx() const { return llama_n_ctx(ctx_) / (n_parallel_ + 1); }
+
+  // Keep the longest common prefix of `cached` (the tokens of sequence `seq`)
+  // and `prompt`, dropping the divergent tail. At least the last prompt token
+  // is left to decode so its logits exist. Returns the kept length.
+  static size_t trimToCommonPrefix(llama_context *ctx, llama_seq_id seq,
+                                   std::vector<llama_token> &cached,
+                                   const std::vector<llama_token> &prompt) {
+    llama_memory_t mem = llama_get_memory(ctx);
+    const size_t limit = std::min(cached.size(), prompt.size() - 1);
+    size_t keep = 0;
+    while (keep < limit && cached[keep] == prompt[keep]) {
+      ++keep;
+    }
+    if (!llama_memory_seq_rm(mem, seq, static_cast<llama_pos>(keep), -1)) {
+      // Recurrent caches cannot drop a tail; start over
+      llama_memory_seq_rm(mem, seq, -1, -1);
+      keep = 0;
+    }
+    cached.assign(prompt.begin(), prompt.begin() + keep);
+    return keep;
+  }
+
+  // Bring sequence 0 of `ctx` from the tokens in `cached` to `prompt`,
+  // decoding only what follows the common prefix, prefill_chunk_ tokens at a
+  // time; the last prompt token's logits are at output -1. With `lock` (held
+  // on entry and on return) the scheduler gets a step between chunks, so a
+  // long prompt does not stall the batched sequences. Returns the number of
+  // reused tokens, or -1 on a decode error (the sequence is then cleared).
+  int32_t prefillReusingPrefix(llama_context *ctx, std::vector<llama_token> &cached,
+                               const std::vector<llama_token> &prompt,
+                               std::unique_lock<std::mutex> *lock) {
+    const size_t keep = trimToCommonPrefix(ctx, 0, cached, prompt);
+    std::vector<llama_token> chunk;
+    const size_t n_chunk = std::max<size_t>(1, std::min<size_t>(prefill_chunk_, llama_n_batch(ctx)));
+    for (size_t i = keep; i < prompt.size(); i += chunk.size()) {
+      if (lock && i > keep) {
+        const uint64_t seen_step = scheduler_steps_;
+        lock->unlock();
+        lockAfterSchedulerStep(*lock, seen_step);
+      }
+      chunk.assign(prompt.begin() + i, prompt.begin() + std::min(prompt.size(), i + n_chunk));
+      llama_batch batch = llama_batch_get_one(chunk.data(), static_cast<int32_t>(chunk.size()));
+      if (llama_decode(ctx, batch)) {
+        llama_memory_seq_rm(llama_get_memory(ctx), 0, -1, -1);
+        cached.clear();
+        return -1;
+      }
+      if (ctx == ctx_) {
+        stats_.target_decodes += 1;
+      }
+      cached.insert(cached.end(), chunk.begin(), chunk.end());
+    }
+    return static_cast<int32_t>(keep);
+  }
+
+  // Re-acquire ctx_ for sequence 0. If the scheduler has running sequences
+  // and has not stepped since `seen_step`, wait for one step first so
+  // sequence 0 and the batch take turns.
+  void lockAfterSchedulerStep(std::unique_lock<std::mutex> &lock, uint64_t seen_step) {
+    lock.lock();
+    step_cv_.wait(lock, [&] { return !scheduler_active_ || scheduler_steps_ != seen_step; });
+  }
+
+  // Fold a finished request into latencyStats()
+  void recordLatency(const GenerationStats &stats) {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    latency_.ttft.record(stats.ttft_ms);
+    latency_.itl.merge(stats.itl);
+  }
+
+  llama_token sampleFrom(const std::vector<float> &probs) {
+    std::discrete_distribution<llama_token> pick(probs.begin(), probs.end());
+    return pick(rng_);
+  }
+
+  // Draft-and-verify loop. Each round the draft proposes up to k tokens x_i
+  // from q_i; the target scores [last, x_0..x_{k-1}] in one batch and keeps
+  // x_i with probability min(1, p_i(x_i) / q_i(x_i)). The first rejected
+  // position is resampled from max(0, p_i - q_i) and ends the round; if all
+  // are kept, one more token comes from p_k. The output follows the target's
+  // distribution exactly (greedy: the target's argmax sequence).
+  std::string generateSpeculative(const std::vector<llama_token> &prompt_tokens,
+                                  unsigned int max_tokens, float temperature, float top_p,
+                                  std::chrono::steady_clock::time_point call_start) {
+    const auto gen_start = std::chrono::steady_clock::now();
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+
+    const bool use_top_p = top_p > 0.0f && top_p < 1.0f;
+    const bool greedy = temperature <= 0.0f && !use_top_p;
+    auto sparams = llama_sampler_chain_default_params();
+    sparams.no_perf = true;
+    llama_sampler *shaper = llama_sampler_chain_init(sparams);
+    if (temperature > 0.0f) {
+      llama_sampler_chain_add(shaper, llama_sampler_init_temp(temperature));
+    }
+    if (use_top_p) {
+      llama_sampler_chain_add(shaper, llama_sampler_init_top_p(top_p, /*min_keep*/ 1));
+    }
+
+    const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+    const int32_t n_ctx = static_cast<int32_t>(seqCtx());
+    const int32_t k = static_cast<int32_t>(draft_tokens_);
+    std::vector<float> p(static_cast<size_t>(n_vocab));
+    std::vector<std::vector<float>> q(static_cast<size_t>(k), std::vector<float>(p.size()));
+    std::vector<llama_token> history(prompt_tokens);
+    // What the target KV cache holds; emit() can stop partway through a
+    // round, so this may run ahead of history
+    std::vector<llama_token> target_tokens(prompt_tokens);
+    std::vector<llama_token> drafts;
+    llama_batch batch = llama_batch_init(std::max<int32_t>(k + 1, 1), 0, 1);
+    auto fill_batch = [&](const llama_token *tokens, int32_t count, llama_pos pos0, bool all_logits) {
+      batch.n_tokens = count;
+      for (int32_t i = 0; i < count; ++i) {
+        batch.token[i] = tokens[i];
+        batch.pos[i] = pos0 + i;
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = 0;
+        batch.logits[i] = all_logits || i == count - 1;
+      }
+    };
+
+    std::string output;
+    const unsigned int to_predict = max_tokens == 0 ? 64u : max_tokens;
+    bool done = false;
+    bool sampled = false;
+    auto last_token = call_start;
+    // Emit one token; false once generation has to stop
+    auto emit = [&](llama_token token) {
+      const auto now = std::chrono::steady_clock::now();
+      if (!sampled) {
+        stats_.ttft_ms = msBetween(call_start, now);
+        sampled = true;
+      }
+      if (llama_vocab_is_eog(vocab, token) || stats_.tokens >= to_predict) {
+        done = true;
+        return false;
+      }
+      if (stats_.tokens > 0) {
+        stats_.itl.record(msBetween(last_token, now));
+      }
+      last_token = now;
+      char buf[256];
+      const int n = llama_token_to_piece(vocab, token, buf, sizeof(buf), 0, true);
+      if (n > 0) {
+        output.append(buf, (size_t)n);
+      }
+      history.push_back(token);
+      stats_.tokens += 1;
+      return true;
+    };
+
+    // Both models read the new part of the prompt; the first token comes
+    // from the target
+    stats_.prompt_tokens = static_cast<unsigned int>(prompt_tokens.size());
+    bool ok = prefillReusingPrefix(draft_ctx_, draft_cached_tokens_, prompt_tokens, nullptr) >= 0;
+    std::unique_lock<std::mutex> ctx_lock(ctx_mutex_);
+    const int32_t reused =
+        ok ? prefillReusingPrefix(ctx_, cached_tokens_, prompt_tokens, &ctx_lock) : -1;
+    ok = ok && reused >= 0;
+    stats_.prompt_reused = static_cast<unsigned int>(std::max(0, reused));
+    const auto decode_start = std::chrono::steady_clock::now();
+    stats_.prompt_ms = msBetween(gen_start, decode_start);
+    if (ok) {
+      tokenDistribution(ctx_, -1, shaper, greedy, p);
+    }
+    uint64_t seen_step = scheduler_steps_;
+    ctx_lock.unlock();
+    if (ok) {
+      emit(sampleFrom(p));
+    }
+    int32_t n_past = static_cast<int32_t>(prompt_tokens.size()); // tokens in the target cache
+    int32_t draft_past = n_past;                                // tokens in the draft cache
+
+    while (ok && !done) {
+      // history[n_past] is the newest token, not yet seen by the target
+      const int32_t m = std::min(k, n_ctx - n_past - 1);
+      if (m <= 0) {
+        break;
+      }
+      // Draft: catch up on committed tokens, then propose m tokens
+      drafts.clear();
+      for (int32_t j = 0; j < m && ok; ++j) {
+        if (j == 0) {
+          // Catch-up is one or two tokens: the newest, plus the last
+          // proposal when the previous round kept all of them
+          fill_batch(history.data() + draft_past, n_past + 1 - draft_past, draft_past, false);
+          draft_past = n_past + 1;
+        } else {
+          fill_batch(&drafts.back(), 1, draft_past++, false);
+        }
+        ok = llama_decode(draft_ctx_, batch) == 0;
+        if (ok) {
+          tokenDistribution(draft_ctx_, batch.n_tokens - 1, shaper, greedy, q[j]);
+          drafts.push_back(sampleFrom(q[j]));
+        }
+      }
+      if (!ok) {
+        break;
+      }
+      stats_.draft_proposed += static_cast<unsigned int>(m);
+
+      // Target: score the newest token and every proposal in one batch
+      std::vector<llama_token> verify(1, history[n_past]);
+      verify.insert(verify.end(), drafts.begin(), drafts.end());
+      fill_batch(verify.data(), m + 1, n_past, true);
+      lockAfterSchedulerStep(ctx_lock, seen_step);
+      ok = llama_decode(ctx_, batch) == 0;
+      stats_.target_decodes += 1;
+      if (!ok) {
+        break;
+      }
+
+      int32_t accepted = 0;
+      llama_token next = LLAMA_TOKEN_NULL;
+      for (int32_t j = 0; j < m; ++j) {
+        tokenDistribution(ctx_, j, shaper, greedy, p);
+        const llama_token x = drafts[j];
+        std::uniform_real_distribution<float> u(0.0f, 1.0f);
+        if (u(rng_) * q[j][x] < p[x]) {
+          ++accepted;
+          continue;
+        }
+        // Rejected: resample from the part of p that q does not cover
+        double residual = 0.0;
+        for (size_t t = 0; t < p.size(); ++t) {
+          p[t] = std::max(0.0f, p[t] - q[j][t]);
+          residual += p[t];
+        }
+        if (residual <= 0.0) {
+          tokenDistribution(ctx_, j, shaper, greedy, p);
+        }
+        next = sampleFrom(p);
+        break;
+      }
+      if (accepted == m) {
+        tokenDistribution(ctx_, m, shaper, greedy, p);
+        next = sampleFrom(p);
+      }
+      stats_.draft_accepted += static_cast<unsigned int>(accepted);
+
+      // The target keeps the newest token plus the accepted proposals; the
+      // draft cache holds at most the same prefix
+      n_past += 1 + accepted;
+      target_tokens.insert(target_tokens.end(), verify.begin(), verify.begin() + 1 + accepted);
+      llama_memory_seq_rm(llama_get_memory(ctx_), 0, n_past, -1);
+      seen_step = scheduler_steps_;
+      ctx_lock.unlock();
+      draft_past = std::min(draft_past, n_past);
+      llama_memory_seq_rm(llama_get_memory(draft_ctx_), 0, draft_past, -1);
+      for (int32_t j = 0; j < accepted && !done; ++j) {
+        emit(drafts[j]);
+      }
+      if (!done) {
+        emit(next);
+      }
+    }
+
+    // Remember what each cache holds for the next call's prefix match
+    if (ok) {
+      cached_tokens_ = target_tokens;
+      draft_cached_tokens_.assign(target_tokens.begin(), target_tokens.begin() + draft_past);
+    } else {
+      if (!ctx_lock.owns_lock()) {
+        ctx_lock.lock();
+      }
+      llama_memory_seq_rm(llama_get_memory(ctx_), 0, -1, -1);
+      ctx_lock.unlock();
+      llama_memory_clear(llama_get_memory(draft_ctx_), false);
+      cached_tokens_.clear();
+      draft_cached_tokens_.clear();
+    }
+    stats_.generation_ms = msBetween(decode_start, std::chrono::steady_clock::now());
+    recordLatency(stats_);
+    llama_batch_free(batch);
+    llama_sampler_free(shaper);
+    return output;
+  }
+
+  // ---- Continuous batching ----
+  struct QueuedRequest {
+    GenerationRequest request;
+    std::promise<GenerationResult> result;
+    std::chrono::steady_clock::time_point enqueued;
+  };
+
+  // A running request. Slot s decodes as sequence s + 1; its cache holds
+  // slot_tokens_[s], kept after the request finishes for prefix reuse.
+  struct BatchSlot {
+    bool active = false;
+    llama_seq_id seq = 0;
+    QueuedRequest job;
+    std::vector<llama_token> prompt;
+    size_t n_prefilled = 0;               // prompt tokens in the cache
+    llama_token next = LLAMA_TOKEN_NULL;  // sampled, to be decoded next step
+    int32_t n_batched = 0;                // tokens this slot put in the batch
+    int32_t i_batch = -1;                 // batch row to sample from, if any
+    llama_sampler *sampler = nullptr;
+    std::string output;
+    GenerationStats stats;
+    std::chrono::steady_clock::time_point admitted;
+    std::chrono::steady_clock::time_point first_token;
+    std::chrono::steady_clock::time_point last_token;
+  };
+
+  // Queue the requests in one go so the scheduler admits them together
+  std::vector<std::future<GenerationResult>>
+  submitAll(const std::vector<GenerationRequest> &requests) {
+    std::vector<std::future<GenerationResult>> results;
+    std::vector<QueuedRequest> jobs;
+    for (const auto &request : requests) {
+      QueuedRequest job;
+      job.request = request;
+      job.enqueued = std::chrono::steady_clock::now();
+      results.push_back(job.result.get_future());
+      if (!batchingEnabled() || promptHasMedia(request.prompt)) {
+        job.result.set_value(generate(request));
+      } else {
+        jobs.push_back(std::move(job));
+      }
+    }
+    if (!jobs.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!scheduler_.joinable()) {
+          scheduler_ = std::thread([this] { schedulerLoop(); });
+        }
+        for (auto &job : jobs) {
+          queue_.push_back(std::move(job));
+        }
+      }
+      queue_cv_.notify_one();
+    }
+    return results;
+  }
+
+  void stopScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      stopping_ = true;
+    }
+    queue_cv_.notify_all();
+    if (scheduler_.joinable()) {
+      scheduler_.join();
+    }
+  }
+
+  void finishSlot(BatchSlot &slot) {
+    if (slot.first_token != std::chrono::steady_clock::time_point()) {
+      slot.stats.generation_ms = msBetween(slot.first_token, std::chrono::steady_clock::now());
+    }
+    recordLatency(slot.stats);
+    llama_sampler_free(slot.sampler);
+    slot.sampler = nullptr;
+    slot.active = false;
+    slot.next = LLAMA_TOKEN_NULL;
+    slot.job.result.set_value(GenerationResult{std::move(slot.output), slot.stats});
+    slot.output.clear();
+  }
+
+  // Put a queued request into the free slot whose cache shares the longest
+  // prefix with its prompt
+  void admitRequest(std::vector<BatchSlot> &slots, QueuedRequest job) {
+    std::vector<llama_token> prompt;
+    const std::string text = trimCopy(job.request.prompt);
+    if (!tokenizePrompt(text, prompt)) {
+      job.result.set_value(GenerationResult{std::string("[Tokenize error] ") + text, {}});
+      return;
+    }
+    if (prompt.size() >= seqCtx()) {
+      job.result.set_value(GenerationResult{std::string("[Prompt too long] tokens=") +
+                                                std::to_string(prompt.size()), {}});
+      return;
+    }
+    BatchSlot *best = nullptr;
+    size_t best_len = 0;
+    for (auto &slot : slots) {
+      if (slot.active) {
+        continue;
+      }
+      const auto &cached = slot_tokens_[slot.seq - 1];
+      size_t n = 0;
+      while (n < cached.size() && n < prompt.size() && cached[n] == prompt[n]) {
+        ++n;
+      }
+      if (!best || n > best_len) {
+        best = &slot;
+        best_len = n;
+      }
+    }
+    BatchSlot &slot = *best;
+    slot.active = true;
+    slot.prompt = std::move(prompt);
+    slot.n_prefilled = trimToCommonPrefix(ctx_, slot.seq, slot_tokens_[slot.seq - 1], slot.prompt);
+    slot.next = LLAMA_TOKEN_NULL;
+    slot.sampler = makeSampler(job.request.temperature, job.request.top_p);
+    slot.output.clear();
+    slot.admitted = std::chrono::steady_clock::now();
+    slot.first_token = std::chrono::steady_clock::time_point();
+    slot.stats = GenerationStats();
+    slot.stats.prompt_tokens = static_cast<unsigned int>(slot.prompt.size());
+    slot.stats.prompt_reused = static_cast<unsigned int>(slot.n_prefilled);
+    slot.job = std::move(job);
+  }
+
+  // One iteration: each decoding slot adds its pending token, then up to
+  // prefill_chunk_ prompt tokens of prefilling slots fill the rest of the
+  // batch, starting round-robin from prefill_cursor_ so one long prompt
+  // neither stalls the decoders nor starves other prompts. Every slot whose
+  // last token got logits then samples its next one.
+  void schedulerStep(std::vector<BatchSlot> &slots, llama_batch &batch) {
+    const int32_t n_batch = static_cast<int32_t>(llama_n_batch(ctx_));
+    batch.n_tokens = 0;
+    auto add = [&](llama_token token, size_t pos, llama_seq_id seq, bool logits) {
+      const int32_t i = batch.n_tokens++;
+      batch.token[i] = token;
+      batch.pos[i] = static_cast<llama_pos>(pos);
+      batch.n_seq_id[i] = 1;
+      batch.seq_id[i][0] = seq;
+      batch.logits[i] = logits;
+    };
+    for (auto &slot : slots) {
+      slot.n_batched = 0;
+      slot.i_batch = -1;
+      if (slot.active && slot.next != LLAMA_TOKEN_NULL) {
+        slot.i_batch = batch.n_tokens;
+        slot.n_batched = 1;
+        add(slot.next, slot_tokens_[slot.seq - 1].size(), slot.seq, true);
+      }
+    }
+    size_t budget = std::min<size_t>(prefill_chunk_, n_batch - batch.n_tokens);
+    const size_t start = prefill_cursor_;
+    for (size_t k = 0; k < slots.size() && budget > 0; ++k) {
+      auto &slot = slots[(start + k) % slots.size()];
+      if (!slot.active || slot.next != LLAMA_TOKEN_NULL) {
+        continue;
+      }
+      if (prefill_cursor_ == start) {
+        // The next step starts after the first slot served in this one
+        prefill_cursor_ = (start + k + 1) % slots.size();
+      }
+      const size_t n = std::min(budget, slot.prompt.size() - slot.n_prefilled);
+      budget -= n;
+      for (size_t i = 0; i < n; ++i) {
+        const size_t pos = slot.n_prefilled + i;
+        const bool last = pos + 1 == slot.prompt.size();
+        if (last) {
+          slot.i_batch = batch.n_tokens;
+        }
+        add(slot.prompt[pos], pos, slot.seq, last);
+      }
+      slot.n_batched = static_cast<int32_t>(n);
+    }
+    if (batch.n_tokens == 0) {
+      return;
+    }
+
+    int rc = llama_decode(ctx_, batch);
+    if (rc == 1) {
+      // No room in the KV cache: evict the sequences idle slots keep for
+      // prefix reuse and try once more
+      for (auto &slot : slots) {
+        if (!slot.active && !slot_tokens_[slot.seq - 1].empty()) {
+          llama_memory_seq_rm(llama_get_memory(ctx_), slot.seq, -1, -1);
+          slot_tokens_[slot.seq - 1].clear();
+        }
+      }
+      rc = llama_decode(ctx_, batch);
+    }
+    if (rc != 0) {
+      for (auto &slot : slots) {
+        if (slot.active && slot.n_batched > 0) {
+          llama_memory_seq_rm(llama_get_memory(ctx_), slot.seq, -1, -1);
+          slot_tokens_[slot.seq - 1].clear();
+          slot.output = std::string("[Decode error] ") + slot.output;
+          finishSlot(slot);
+        }
+      }
+      return;
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    const auto now = std::chrono::steady_clock::now();
+    for (auto &slot : slots) {
+      if (!slot.active || slot.n_batched == 0) {
+        continue;
+      }
+      auto &cached = slot_tokens_[slot.seq - 1];
+      if (slot.next != LLAMA_TOKEN_NULL) {
+        cached.push_back(slot.next);
+        slot.next = LLAMA_TOKEN_NULL;
+      } else {
+        cached.insert(cached.end(), slot.prompt.begin() + slot.n_prefilled,
+                      slot.prompt.begin() + slot.n_prefilled + slot.n_batched);
+        slot.n_prefilled += static_cast<size_t>(slot.n_batched);
+      }
+      slot.stats.target_decodes += 1;
+      if (slot.i_batch < 0) {
+        continue; // mid-prompt chunk
+      }
+      const llama_token token = llama_sampler_sample(slot.sampler, ctx_, slot.i_batch);
+      if (slot.first_token == std::chrono::steady_clock::time_point()) {
+        slot.first_token = now;
+        slot.stats.prompt_ms = msBetween(slot.admitted, now);
+        slot.stats.ttft_ms = msBetween(slot.job.enqueued, now);
+      }
+      if (llama_vocab_is_eog(vocab, token)) {
+        finishSlot(slot);
+        continue;
+      }
+      if (slot.stats.tokens > 0) {
+        slot.stats.itl.record(msBetween(slot.last_token, now));
+      }
+      slot.last_token = now;
+      char buf[256];
+      const int n = llama_token_to_piece(vocab, token, buf, sizeof(buf), 0, true);
+      if (n > 0) {
+        slot.output.append(buf, (size_t)n);
+      }
+      slot.stats.tokens += 1;
+      const unsigned int to_predict =
+          slot.job.request.max_tokens == 0 ? 64u : slot.job.request.max_tokens;
+      // As in generateText, the final token is returned without a decode
+      if (slot.stats.tokens >= to_predict || cached.size() + 1 >= seqCtx()) {
+        finishSlot(slot);
+        continue;
+      }
+      slot.next = token;
+    }
+  }
+
+  void schedulerLoop() {
+    std::vector<BatchSlot> slots(n_parallel_);
+    for (size_t s = 0; s < slots.size(); ++s) {
+      slots[s].seq = static_cast<llama_seq_id>(s + 1);
+    }
+    llama_batch batch = llama_batch_init(static_cast<int32_t>(llama_n_batch(ctx_)), 0, 1);
+    auto running = [&] {
+      return std::count_if(slots.begin(), slots.end(),
+                           [](const BatchSlot &slot) { return slot.active; });
+    };
+
+    for (;;) {
+      std::vector<QueuedRequest> admitted;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        queue_cv_.wait(lock, [&] { return stopping_ || !queue_.empty() || running() > 0; });
+        if (stopping_) {
+          break;
+        }
+        for (auto free_slots = slots.size() - running(); free_slots > 0 && !queue_.empty();
+             --free_slots) {
+          admitted.push_back(std::move(queue_.front()));
+          queue_.pop_front();
+        }
+      }
+      // Sequence 0 (generateText, one prompt chunk or token at a time) runs
+      // between steps
+      {
+        std::lock_guard<std::mutex> lock(ctx_mutex_);
+        for (auto &job : admitted) {
+          admitRequest(slots, std::move(job));
+        }
+        schedulerStep(slots, batch);
+        ++scheduler_steps_;
+        scheduler_active_ = running() > 0;
+      }
+      step_cv_.notify_all();
+    }
+
+    {
+      std::lock_guard<std::mutex> ctx_lock(ctx_mutex_);
+      for (auto &slot : slots) {
+        if (slot.active) {
+          finishSlot(slot);
+        }
+      }
+      scheduler_active_ = false;
+    }
+    step_cv_.notify_all();
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    for (auto &job : queue_) {
+      job.result.set_value(GenerationResult{std::string("[Engine stopped] ") + job.request.prompt, {}});
+    }
+    queue_.clear();
+    llama_batch_free(batch);
+  }
+
   std::string model_id_;
   std::string gguf_path_;
   bool ready_;
   llama_model *model_;
   llama_context *ctx_;
+  // Tokens in ctx_'s KV cache (sequence 0), matched against the next prompt
+  std::vector<llama_token> cached_tokens_;
+  // seq0_mutex_ owns sequence 0 (and the draft context) for a whole call;
+  // ctx_mutex_ is held around each decode on ctx_, so generateText and the
+  // scheduler interleave chunk by chunk
+  mutable std::recursive_mutex seq0_mutex_;
+  std::mutex ctx_mutex_;
+  std::condition_variable step_cv_;
+  uint64_t scheduler_steps_ = 0; // guarded by ctx_mutex_
+  bool scheduler_active_ = false;
+
+  // Chunked prefill and latency
+  unsigned int prefill_chunk_ = 256;
+  size_t prefill_cursor_ = 0;
+  mutable std::mutex latency_mutex_;
+  LatencyStats latency_;
+
+  // Speculative decoding
+  std::string draft_gguf_path_;
+  unsigned int draft_tokens_ = 4;
+  llama_model *draft_model_ = nullptr;
+  llama_context *draft_ctx_ = nullptr;
+  std::vector<llama_token> draft_cached_tokens_;
+  std::vector<llama_token_data> cur_;
+  std::mt19937 rng_{std::random_device{}()};
+
+  GenerationStats stats_;
+
+  // Continuous batching
+  unsigned int n_parallel_ = 0;
+  std::vector<std::vector<llama_token>> slot_tokens_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<QueuedRequest> queue_;
+  std::thread scheduler_;
+  bool stopping_ = false;
 };
 
 } // namespace ollama
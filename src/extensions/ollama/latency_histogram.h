@@ -0,0 +1,78 @@
+// Latency histograms shared by the inference engine and the model manager
+#ifndef DUOROU_EXTENSIONS_OLLAMA_LATENCY_HISTOGRAM_H
+#define DUOROU_EXTENSIONS_OLLAMA_LATENCY_HISTOGRAM_H
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace duorou {
+namespace extensions {
+namespace ollama {
+
+// Latency distribution in power-of-two buckets: bucket 0 is [0, 0.25) ms,
+// bucket b is [0.25 * 2^(b-1), 0.25 * 2^b) ms and the last one is open-ended
+// (about 65 s and up)
+struct LatencyHistogram {
+  static constexpr size_t kBuckets = 20;
+  static constexpr double kFirstEdgeMs = 0.25;
+
+  uint64_t counts[kBuckets] = {};
+  uint64_t count = 0;
+  double sum_ms = 0.0;
+  double max_ms = 0.0;
+
+  static double upperEdgeMs(size_t bucket) { return kFirstEdgeMs * static_cast<double>(1ull << bucket); }
+
+  void record(double ms) {
+    size_t b = 0;
+    while (b + 1 < kBuckets && ms >= upperEdgeMs(b)) {
+      ++b;
+    }
+    counts[b] += 1;
+    count += 1;
+    sum_ms += ms;
+    max_ms = std::max(max_ms, ms);
+  }
+  void merge(const LatencyHistogram &other) {
+    for (size_t b = 0; b < kBuckets; ++b) {
+      counts[b] += other.counts[b];
+    }
+    count += other.count;
+    sum_ms += other.sum_ms;
+    max_ms = std::max(max_ms, other.max_ms);
+  }
+  double meanMs() const { return count ? sum_ms / static_cast<double>(count) : 0.0; }
+  // Upper edge of the bucket holding quantile q, capped at the largest sample
+  double quantileMs(double q) const {
+    if (count == 0) {
+      return 0.0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+      seen += counts[b];
+      if (seen >= rank) {
+        return b + 1 < kBuckets ? std::min(upperEdgeMs(b), max_ms) : max_ms;
+      }
+    }
+    return max_ms;
+  }
+};
+
+// Time to first token over requests and inter-token latency over tokens
+struct LatencyStats {
+  LatencyHistogram ttft;
+  LatencyHistogram itl;
+};
+
+} // namespace ollama
+} // namespace extensions
+} // namespace duorou
+
+#endif // __cplusplus
+
+#endif // DUOROU_EXTENSIONS_OLLAMA_LATENCY_HISTOGRAM_H
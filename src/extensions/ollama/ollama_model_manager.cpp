@@ -4,6 +4,7 @@
 #include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <iterator>
 #include <optional>
 #include <sstream>
 
@@ -14,7 +15,7 @@ namespace ollama {
 // OllamaModelManager实现
 OllamaModelManager::OllamaModelManager(bool verbose)
     : verbose_(verbose), max_concurrent_models_(3), path_resolver_(verbose),
-      total_memory_usage_(0), active_models_count_(0) {
+      parallel_sequences_(0), prefill_chunk_(0), total_memory_usage_(0), active_models_count_(0) {
   log("INFO", "OllamaModelManager initialized");
 }
 
@@ -36,9 +37,12 @@ bool OllamaModelManager::registerModel(const std::string &model_id,
   }
 
   // 检查是否已经注册
-  if (registered_models_.find(model_id) != registered_models_.end()) {
-    log("WARNING", "Model already registered: " + model_id);
-    return true;
+  {
+    std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+    if (registered_models_.find(model_id) != registered_models_.end()) {
+      log("WARNING", "Model already registered: " + model_id);
+      return true;
+    }
   }
 
   // 解析模型信息
@@ -52,8 +56,12 @@ bool OllamaModelManager::registerModel(const std::string &model_id,
     return false;
   }
 
-  // 注册模型
-  registered_models_[model_id] = model_info;
+  // 注册模型（解析期间可能已被并发注册）
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+  if (!registered_models_.emplace(model_id, model_info).second) {
+    log("WARNING", "Model already registered: " + model_id);
+    return true;
+  }
   model_states_[model_id] = ModelLoadState::UNLOADED;
 
   log("INFO",
@@ -74,6 +82,7 @@ bool OllamaModelManager::registerModelByName(const std::string &model_name) {
       return false;
     }
 
+    std::lock_guard<std::recursive_mutex> lock(models_mutex_);
     // 如果已注册则直接返回
     if (registered_models_.find(model_id) != registered_models_.end()) {
       log("WARNING", "Model already registered (stub): " + model_id);
@@ -106,30 +115,40 @@ bool OllamaModelManager::registerModelByName(const std::string &model_name) {
 }
 
 bool OllamaModelManager::loadModel(const std::string &model_id) {
-  auto it = registered_models_.find(model_id);
-  if (it == registered_models_.end()) {
-    log("ERROR", "Model not registered: " + model_id);
-    return false;
-  }
+  {
+    std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+    auto it = registered_models_.find(model_id);
+    if (it == registered_models_.end()) {
+      log("ERROR", "Model not registered: " + model_id);
+      return false;
+    }
 
-  // 检查是否已经加载
-  if (isModelLoaded(model_id)) {
-    log("INFO", "Model already loaded: " + model_id);
-    return true;
-  }
+    // 检查是否已经加载
+    if (isModelLoaded(model_id)) {
+      log("INFO", "Model already loaded: " + model_id);
+      return true;
+    }
 
-  // 检查资源可用性
-  if (!checkResourceAvailability()) {
-    log("ERROR", "Insufficient resources to load model: " + model_id);
-    return false;
-  }
+    // 同一模型同时只能有一个加载
+    if (model_states_[model_id] == ModelLoadState::LOADING) {
+      log("ERROR", "Model is already being loaded: " + model_id);
+      return false;
+    }
+
+    // 检查资源可用性
+    if (!checkResourceAvailability()) {
+      log("ERROR", "Insufficient resources to load model: " + model_id);
+      return false;
+    }
 
-  // 设置加载状态
-  model_states_[model_id] = ModelLoadState::LOADING;
+    // 设置加载状态
+    model_states_[model_id] = ModelLoadState::LOADING;
+  }
 
-  // 执行加载
+  // 执行加载（锁外进行）
   bool success = loadModelInternal(model_id);
 
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   if (success) {
     model_states_[model_id] = ModelLoadState::LOADED;
     registered_models_[model_id].is_loaded = true;
@@ -144,11 +163,16 @@ bool OllamaModelManager::loadModel(const std::string &model_id) {
 }
 
 bool OllamaModelManager::unloadModel(const std::string &model_id) {
+  // 引擎在锁外析构，释放上下文期间不阻塞其他模型；仍在生成的调用
+  // 持有自己的引用，引擎在最后一个引用释放时才析构
+  std::shared_ptr<InferenceEngine> engine;
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   if (!isModelLoaded(model_id)) {
     log("WARNING", "Model not loaded: " + model_id);
     return true;
   }
 
+  engine = std::move(inference_engines_[model_id]);
   bool success = unloadModelInternal(model_id);
 
   if (success) {
@@ -163,7 +187,43 @@ bool OllamaModelManager::unloadModel(const std::string &model_id) {
   return success;
 }
 
+bool OllamaModelManager::reloadModel(const std::string &model_id) {
+  {
+    std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+    if (registered_models_.find(model_id) == registered_models_.end()) {
+      log("ERROR", "Model not registered: " + model_id);
+      return false;
+    }
+  }
+  if (!isModelLoaded(model_id)) {
+    return loadModel(model_id);
+  }
+
+  // 新引擎在锁外创建，期间旧引擎继续服务
+  std::shared_ptr<InferenceEngine> engine = createInferenceEngine(model_id);
+  if (!engine) {
+    log("ERROR", "Failed to reload model, keeping the loaded engine: " +
+                     model_id);
+    return false;
+  }
+
+  // 旧引擎在锁外析构；仍在生成的调用持有自己的引用
+  std::shared_ptr<InferenceEngine> previous;
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+  auto engine_it = inference_engines_.find(model_id);
+  if (engine_it == inference_engines_.end()) {
+    // 创建期间被卸载：不再装回
+    log("WARNING", "Model unloaded during reload: " + model_id);
+    return false;
+  }
+  previous = std::move(engine_it->second);
+  engine_it->second = std::move(engine);
+  log("INFO", "Model reloaded: " + model_id);
+  return true;
+}
+
 bool OllamaModelManager::isModelLoaded(const std::string &model_id) const {
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   // model_id should already be normalized when passed to this method
   auto state_it = model_states_.find(model_id);
   auto engine_it = inference_engines_.find(model_id);
@@ -173,7 +233,58 @@ bool OllamaModelManager::isModelLoaded(const std::string &model_id) const {
          engine_it != inference_engines_.end();
 }
 
+bool OllamaModelManager::setSpeculativeDraft(const std::string &model_id,
+                                             const std::string &draft_model,
+                                             unsigned int draft_tokens) {
+  const std::string normalized_id = normalizeModelId(model_id);
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+  if (draft_model.empty()) {
+    speculative_options_.erase(normalized_id);
+    log("INFO", "Speculative decoding disabled for: " + normalized_id);
+    return true;
+  }
+  if (draft_tokens == 0) {
+    log("ERROR", "Speculative draft_tokens must be at least 1");
+    return false;
+  }
+  // 草稿模型可以是已注册的模型 ID，也可以直接是 GGUF 路径
+  const std::string draft_id = normalizeModelId(draft_model);
+  if (registered_models_.find(draft_id) == registered_models_.end() &&
+      !std::filesystem::exists(draft_model)) {
+    log("ERROR", "Draft model is neither registered nor a file: " + draft_model);
+    return false;
+  }
+
+  SpeculativeOptions options;
+  options.draft_model = draft_model;
+  options.draft_tokens = draft_tokens;
+  speculative_options_[normalized_id] = options;
+  log("INFO", "Speculative decoding for " + normalized_id + ": draft=" +
+                  draft_model + " k=" + std::to_string(draft_tokens) +
+                  (isModelLoaded(normalized_id) ? " (applies on next load)" : ""));
+  return true;
+}
+
+void OllamaModelManager::setParallelSequences(unsigned int n_parallel) {
+  parallel_sequences_ = n_parallel;
+  log("INFO", "Continuous batching: " +
+                  (n_parallel > 0 ? std::to_string(n_parallel) + " sequences"
+                                  : std::string("off")));
+}
+
+void OllamaModelManager::setPrefillChunk(unsigned int tokens) {
+  prefill_chunk_ = tokens;
+  log("INFO", "Prefill chunk: " + (tokens > 0 ? std::to_string(tokens) + " tokens"
+                                               : std::string("engine default")));
+}
+
+LatencyStats OllamaModelManager::latencyStats(const std::string &model_id) const {
+  std::shared_ptr<InferenceEngine> engine = findEngine(normalizeModelId(model_id));
+  return engine ? engine->latencyStats() : LatencyStats();
+}
+
 std::vector<std::string> OllamaModelManager::getRegisteredModels() const {
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   std::vector<std::string> models;
   models.reserve(registered_models_.size());
 
@@ -185,6 +296,7 @@ std::vector<std::string> OllamaModelManager::getRegisteredModels() const {
 }
 
 std::vector<std::string> OllamaModelManager::getLoadedModels() const {
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   std::vector<std::string> models;
 
   for (const auto &pair : model_states_) {
@@ -199,6 +311,7 @@ std::vector<std::string> OllamaModelManager::getLoadedModels() const {
 const ModelInfo *
 OllamaModelManager::getModelInfo(const std::string &model_id) const {
   std::string normalized_id = normalizeModelId(model_id);
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   auto it = registered_models_.find(normalized_id);
   return (it != registered_models_.end()) ? &it->second : nullptr;
 }
@@ -206,6 +319,7 @@ OllamaModelManager::getModelInfo(const std::string &model_id) const {
 ModelLoadState
 OllamaModelManager::getModelLoadState(const std::string &model_id) const {
   std::string normalized_id = normalizeModelId(model_id);
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   auto it = model_states_.find(normalized_id);
   return (it != model_states_.end()) ? it->second : ModelLoadState::UNLOADED;
 }
@@ -230,8 +344,7 @@ OllamaModelManager::generateText(const InferenceRequest &request) {
   }
 
   // 先检查模型是否已注册
-  if (registered_models_.find(normalized_model_id) ==
-      registered_models_.end()) {
+  if (!getModelInfo(normalized_model_id)) {
     std::cout << "[ERROR] Model not registered: " << normalized_model_id
               << std::endl;
     response.error_message = "Model not registered: " + normalized_model_id;
@@ -269,16 +382,15 @@ OllamaModelManager::generateText(const InferenceRequest &request) {
     }
 
     // 获取已加载的推理引擎
-    auto engine_it = inference_engines_.find(normalized_model_id);
-    if (engine_it == inference_engines_.end()) {
+    std::shared_ptr<InferenceEngine> inference_engine =
+        findEngine(normalized_model_id);
+    if (!inference_engine) {
       response.error_message =
           "Inference engine not found for: " + normalized_model_id;
       response.success = false;
       return response;
     }
 
-    InferenceEngine *inference_engine = engine_it->second.get();
-
     // 双重校验：引擎存在但未就绪（理论上不应发生，但为了更好错误提示）
     if (!inference_engine || !inference_engine->isReady()) {
       std::cout << "[ERROR] Inference engine not ready: " << normalized_model_id
@@ -341,6 +453,7 @@ OllamaModelManager::generateText(const InferenceRequest &request) {
     };
 
     std::string generated_text;
+    GenerationStats stats;
     const bool has_vision = model_info && model_info->has_vision;
     const bool is_media_only = looks_like_image_reference(request.prompt);
 
@@ -353,10 +466,15 @@ OllamaModelManager::generateText(const InferenceRequest &request) {
           request.prompt, /*image_features*/ {}, request.max_tokens,
           request.temperature, request.top_p);
     } else {
-      // 走普通文本路径
-      generated_text =
-          inference_engine->generateText(request.prompt, request.max_tokens,
-                                         request.temperature, request.top_p);
+      // 走普通文本路径；统计随结果一起返回，不受并发请求覆盖
+      GenerationRequest generation;
+      generation.prompt = request.prompt;
+      generation.max_tokens = request.max_tokens;
+      generation.temperature = request.temperature;
+      generation.top_p = request.top_p;
+      GenerationResult result = inference_engine->generate(generation);
+      generated_text = std::move(result.text);
+      stats = result.stats;
     }
 
     // 计算推理时间
@@ -371,6 +489,29 @@ OllamaModelManager::generateText(const InferenceRequest &request) {
         static_cast<unsigned int>(generated_text.length() / 4 + 1); // 简单估算
     response.inference_time_ms = static_cast<float>(duration.count());
 
+    // 引擎统计（文本路径）：真实 token 数、吞吐、草稿接受率与提示词前缀复用
+    if (stats.target_decodes > 0) {
+      response.tokens_generated = stats.tokens;
+      response.tokens_per_second = static_cast<float>(stats.tokensPerSecond());
+      response.draft_tokens_proposed = stats.draft_proposed;
+      response.draft_tokens_accepted = stats.draft_accepted;
+      response.prompt_tokens_reused = stats.prompt_reused;
+      response.ttft_ms = static_cast<float>(stats.ttft_ms);
+      response.itl_p50_ms = static_cast<float>(stats.itl.quantileMs(0.5));
+      response.itl_p99_ms = static_cast<float>(stats.itl.quantileMs(0.99));
+      if (stats.draft_proposed > 0) {
+        std::ostringstream oss;
+        oss << "[SPEC] model=" << normalized_model_id
+            << " accepted=" << stats.draft_accepted << "/"
+            << stats.draft_proposed << " ("
+            << static_cast<int>(stats.acceptanceRate() * 100.0 + 0.5)
+            << "%) target_decodes=" << stats.target_decodes
+            << " tokens=" << stats.tokens
+            << " tok/s=" << static_cast<int>(stats.tokensPerSecond());
+        log("INFO", oss.str());
+      }
+    }
+
     // Text generation completed successfully
 
   } catch (const std::exception &e) {
@@ -402,8 +543,7 @@ OllamaModelManager::generateTextWithImages(const InferenceRequest &request) {
   }
 
   // 先检查模型是否已注册
-  if (registered_models_.find(normalized_model_id) ==
-      registered_models_.end()) {
+  if (!getModelInfo(normalized_model_id)) {
     std::cout << "[ERROR] Model not registered: " << normalized_model_id
               << std::endl;
     response.error_message = "Model not registered: " + normalized_model_id;
@@ -448,16 +588,15 @@ OllamaModelManager::generateTextWithImages(const InferenceRequest &request) {
     }
 
     // 获取已加载的推理引擎
-    auto engine_it = inference_engines_.find(normalized_model_id);
-    if (engine_it == inference_engines_.end()) {
+    std::shared_ptr<InferenceEngine> inference_engine =
+        findEngine(normalized_model_id);
+    if (!inference_engine) {
       response.error_message =
           "Inference engine not found for: " + normalized_model_id;
       response.success = false;
       return response;
     }
 
-    InferenceEngine *inference_engine = engine_it->second.get();
-
     if (!inference_engine || !inference_engine->isReady()) {
       std::cout << "[ERROR] Inference engine not ready: " << normalized_model_id
                 << std::endl;
@@ -517,31 +656,99 @@ OllamaModelManager::generateTextWithImages(const InferenceRequest &request) {
 std::vector<InferenceResponse> OllamaModelManager::generateTextBatch(
     const std::vector<InferenceRequest> &requests) {
 
-  std::vector<InferenceResponse> responses;
-  responses.reserve(requests.size());
+  std::vector<InferenceResponse> responses(requests.size());
+  const auto batch_start = std::chrono::steady_clock::now();
 
-  for (const auto &request : requests) {
+  // 同一模型的纯文本请求交给引擎一起解码（连续批处理），其余逐个处理
+  std::vector<std::pair<std::shared_ptr<InferenceEngine>, std::vector<size_t>>>
+      groups;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    const InferenceRequest &request = requests[i];
+    std::shared_ptr<InferenceEngine> engine;
     if (request.image_features.empty()) {
-      responses.push_back(generateText(request));
-    } else {
-      responses.push_back(generateTextWithImages(request));
+      const std::string model_id = normalizeModelId(request.model_id);
+      std::shared_ptr<InferenceEngine> loaded = findEngine(model_id);
+      if (getModelLoadState(model_id) == ModelLoadState::LOADED && loaded &&
+          loaded->isReady()) {
+        engine = loaded;
+      }
+    }
+    if (!engine) {
+      // generateText / generateTextWithImages report the exact error
+      responses[i] = request.image_features.empty()
+                         ? generateText(request)
+                         : generateTextWithImages(request);
+      continue;
+    }
+    auto group = std::find_if(groups.begin(), groups.end(),
+                              [engine](const auto &g) { return g.first == engine; });
+    if (group == groups.end()) {
+      groups.emplace_back(engine, std::vector<size_t>());
+      group = std::prev(groups.end());
+    }
+    group->second.push_back(i);
+  }
+
+  for (const auto &group : groups) {
+    std::vector<GenerationRequest> batch;
+    batch.reserve(group.second.size());
+    for (size_t i : group.second) {
+      GenerationRequest r;
+      r.prompt = requests[i].prompt;
+      r.max_tokens = requests[i].max_tokens;
+      r.temperature = requests[i].temperature;
+      r.top_p = requests[i].top_p;
+      batch.push_back(std::move(r));
+    }
+    try {
+      std::vector<GenerationResult> results = group.first->generateTextBatch(batch);
+      for (size_t k = 0; k < results.size() && k < group.second.size(); ++k) {
+        InferenceResponse &response = responses[group.second[k]];
+        const GenerationStats &stats = results[k].stats;
+        response.success = true;
+        response.generated_text = std::move(results[k].text);
+        response.tokens_generated = stats.tokens;
+        // ttft_ms counts from submission, so this includes queueing
+        response.inference_time_ms =
+            static_cast<float>(stats.ttft_ms + stats.generation_ms);
+        response.tokens_per_second = static_cast<float>(stats.tokensPerSecond());
+        response.draft_tokens_proposed = stats.draft_proposed;
+        response.draft_tokens_accepted = stats.draft_accepted;
+        response.prompt_tokens_reused = stats.prompt_reused;
+        response.ttft_ms = static_cast<float>(stats.ttft_ms);
+        response.itl_p50_ms = static_cast<float>(stats.itl.quantileMs(0.5));
+        response.itl_p99_ms = static_cast<float>(stats.itl.quantileMs(0.99));
+      }
+    } catch (const std::exception &e) {
+      for (size_t i : group.second) {
+        responses[i].success = false;
+        responses[i].error_message = "Inference error: " + std::string(e.what());
+      }
     }
   }
 
   // Batch-level summary logging only
   int success_count = 0;
   int total_tokens = 0;
-  double total_time_ms = 0.0;
+  float ttft_max_ms = 0.0f;
+  float itl_p99_max_ms = 0.0f;
   for (const auto &resp : responses) {
     if (resp.success)
       success_count++;
     total_tokens += resp.tokens_generated;
-    total_time_ms += resp.inference_time_ms;
+    ttft_max_ms = std::max(ttft_max_ms, resp.ttft_ms);
+    itl_p99_max_ms = std::max(itl_p99_max_ms, resp.itl_p99_ms);
   }
+  const double wall_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - batch_start)
+                             .count();
   std::ostringstream oss;
   oss << "[BATCH] size=" << requests.size() << " success=" << success_count
       << " tokens=" << total_tokens
-      << " time_ms=" << static_cast<int>(total_time_ms);
+      << " time_ms=" << static_cast<int>(wall_ms) << " tok/s="
+      << static_cast<int>(wall_ms > 0.0 ? total_tokens * 1000.0 / wall_ms : 0.0)
+      << " ttft_max_ms=" << static_cast<int>(ttft_max_ms)
+      << " itl_p99_max_ms=" << static_cast<int>(itl_p99_max_ms);
   log("INFO", oss.str());
 
   return responses;
@@ -604,6 +811,7 @@ void OllamaModelManager::clearAllModels() {
   }
 
   // 清空所有数据结构
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   registered_models_.clear();
   // inference_engines_.clear(); // TODO: 重新实现
   model_states_.clear();
@@ -634,32 +842,41 @@ size_t OllamaModelManager::getMemoryUsage() const {
 
 // 私有方法实现
 bool OllamaModelManager::loadModelInternal(const std::string &model_id) {
-  // 检查模型是否已注册
-  auto model_it = registered_models_.find(model_id);
-  if (model_it == registered_models_.end()) {
-    log("ERROR", "Model not registered: " + model_id);
-    return false;
-  }
+  std::string gguf_path;
+  {
+    std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+    // 检查模型是否已注册
+    auto model_it = registered_models_.find(model_id);
+    if (model_it == registered_models_.end()) {
+      log("ERROR", "Model not registered: " + model_id);
+      return false;
+    }
 
-  // 检查模型是否已加载
-  if (inference_engines_.find(model_id) != inference_engines_.end()) {
-    log("INFO", "Model already loaded: " + model_id);
-    return true;
+    // 检查模型是否已加载
+    if (inference_engines_.find(model_id) != inference_engines_.end()) {
+      log("INFO", "Model already loaded: " + model_id);
+      return true;
+    }
+
+    // 设置加载状态
+    model_states_[model_id] = ModelLoadState::LOADING;
+    gguf_path = model_it->second.file_path;
   }
 
-  // 设置加载状态
-  model_states_[model_id] = ModelLoadState::LOADING;
+  auto fail = [this, &model_id]() {
+    std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+    model_states_[model_id] = ModelLoadState::LOAD_ERROR;
+    return false;
+  };
 
   try {
     // 在创建推理引擎之前先验证 GGUF 文件的关键元数据是否齐全
-    const std::string &gguf_path = model_it->second.file_path;
     if (!gguf_path.empty()) {
       std::string validate_error;
       if (!validateModel(gguf_path, validate_error)) {
         log("ERROR", "GGUF validation failed for '" + gguf_path +
                          "': " + validate_error);
-        model_states_[model_id] = ModelLoadState::LOAD_ERROR;
-        return false;
+        return fail();
       }
     } else {
       log("WARNING",
@@ -670,13 +887,13 @@ bool OllamaModelManager::loadModelInternal(const std::string &model_id) {
     auto engine = createInferenceEngine(model_id);
     if (!engine) {
       log("ERROR", "Failed to create inference engine for: " + model_id);
-      model_states_[model_id] = ModelLoadState::LOAD_ERROR;
-      return false;
+      return fail();
     }
 
     // 推理引擎会在initialize时自动加载模型文件
 
     // 存储推理引擎
+    std::lock_guard<std::recursive_mutex> lock(models_mutex_);
     inference_engines_[model_id] = std::move(engine);
     model_states_[model_id] = ModelLoadState::LOADED;
     active_models_count_++;
@@ -686,12 +903,12 @@ bool OllamaModelManager::loadModelInternal(const std::string &model_id) {
 
   } catch (const std::exception &e) {
     log("ERROR", "Exception during model loading: " + std::string(e.what()));
-    model_states_[model_id] = ModelLoadState::LOAD_ERROR;
-    return false;
+    return fail();
   }
 }
 
 bool OllamaModelManager::unloadModelInternal(const std::string &model_id) {
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
   // 查找推理引擎
   auto engine_it = inference_engines_.find(model_id);
   if (engine_it == inference_engines_.end()) {
@@ -714,6 +931,13 @@ bool OllamaModelManager::unloadModelInternal(const std::string &model_id) {
   }
 }
 
+std::shared_ptr<InferenceEngine>
+OllamaModelManager::findEngine(const std::string &model_id) const {
+  std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+  auto engine_it = inference_engines_.find(model_id);
+  return engine_it != inference_engines_.end() ? engine_it->second : nullptr;
+}
+
 bool OllamaModelManager::parseModelInfo(const std::string &gguf_file_path,
                                         ModelInfo &model_info) {
   try {
@@ -786,6 +1010,27 @@ OllamaModelManager::createInferenceEngine(const std::string &model_id) {
   try {
     auto engine =
         std::make_unique<MLInferenceEngine>(model_id, model_info->file_path);
+    std::optional<SpeculativeOptions> spec;
+    {
+      std::lock_guard<std::recursive_mutex> lock(models_mutex_);
+      auto spec_it = speculative_options_.find(model_id);
+      if (spec_it != speculative_options_.end()) {
+        spec = spec_it->second;
+      }
+    }
+    if (spec) {
+      const ModelInfo *draft_info =
+          getModelInfo(normalizeModelId(spec->draft_model));
+      engine->setDraftModel(draft_info ? draft_info->file_path
+                                       : spec->draft_model,
+                            spec->draft_tokens);
+    }
+    if (parallel_sequences_ > 0) {
+      engine->setParallelSequences(parallel_sequences_);
+    }
+    if (prefill_chunk_ > 0) {
+      engine->setPrefillChunk(prefill_chunk_);
+    }
     if (!engine->initialize()) {
       log("ERROR", "Failed to initialize inference engine for: " + model_id);
       return nullptr;
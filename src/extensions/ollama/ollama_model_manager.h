@@ -4,11 +4,14 @@
 #ifdef __cplusplus
 
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "latency_histogram.h"
+
 // 注意：避免在命名空间内包含头文件，以防标准库命名空间被嵌套。
 // 所有包含应在命名空间之外进行。
 
@@ -51,6 +54,13 @@ struct InferenceResponse {
   std::string error_message;
   unsigned int tokens_generated = 0;
   float inference_time_ms = 0.0f;
+  float tokens_per_second = 0.0f;
+  unsigned int draft_tokens_proposed = 0;
+  unsigned int draft_tokens_accepted = 0;
+  unsigned int prompt_tokens_reused = 0;
+  float ttft_ms = 0.0f;
+  float itl_p50_ms = 0.0f;
+  float itl_p99_ms = 0.0f;
 };
 
 class OllamaModelManager {
@@ -62,7 +72,13 @@ public:
   bool registerModelByName(const std::string &/*model_name*/) { return false; }
   bool loadModel(const std::string &/*model_id*/) { return false; }
   bool unloadModel(const std::string &/*model_id*/) { return false; }
+  bool reloadModel(const std::string &/*model_id*/) { return false; }
   bool isModelLoaded(const std::string &/*model_id*/) const { return false; }
+  bool setSpeculativeDraft(const std::string &/*model_id*/, const std::string &/*draft_model*/,
+                           unsigned int /*draft_tokens*/ = 4) { return false; }
+  void setParallelSequences(unsigned int /*n_parallel*/) {}
+  void setPrefillChunk(unsigned int /*tokens*/) {}
+  LatencyStats latencyStats(const std::string &/*model_id*/) const { return LatencyStats(); }
 
   std::vector<std::string> getRegisteredModels() const { return {}; }
   std::vector<std::string> getLoadedModels() const { return {}; }
@@ -149,9 +165,32 @@ struct InferenceResponse {
   std::string error_message;
   unsigned int tokens_generated;
   float inference_time_ms;
+  // Decode throughput and, with a draft model, how many of its proposed
+  // tokens the target accepted
+  float tokens_per_second;
+  unsigned int draft_tokens_proposed;
+  unsigned int draft_tokens_accepted;
+  // Prompt tokens served from the KV cache left by the previous request
+  unsigned int prompt_tokens_reused;
+  // Time to first token (including queueing when batched) and the median
+  // and tail gap between later tokens
+  float ttft_ms;
+  float itl_p50_ms;
+  float itl_p99_ms;
 
   InferenceResponse()
-      : success(false), tokens_generated(0), inference_time_ms(0.0f) {}
+      : success(false), tokens_generated(0), inference_time_ms(0.0f),
+        tokens_per_second(0.0f), draft_tokens_proposed(0),
+        draft_tokens_accepted(0), prompt_tokens_reused(0), ttft_ms(0.0f),
+        itl_p50_ms(0.0f), itl_p99_ms(0.0f) {}
+};
+
+// 推测解码配置：草稿模型（已注册的模型 ID 或 GGUF 路径）与每轮草稿 token 数
+struct SpeculativeOptions {
+  std::string draft_model;
+  unsigned int draft_tokens;
+
+  SpeculativeOptions() : draft_tokens(4) {}
 };
 
 class OllamaModelManager {
@@ -164,8 +203,33 @@ public:
   bool registerModelByName(const std::string &model_name);
   bool loadModel(const std::string &model_id);
   bool unloadModel(const std::string &model_id);
+  // Build a fresh engine for a loaded model and swap it in once it is ready;
+  // generations already running finish on the old engine. Loads the model
+  // when it is not loaded yet.
+  bool reloadModel(const std::string &model_id);
   bool isModelLoaded(const std::string &model_id) const;
 
+  // Decode model_id speculatively with a small draft model (registered id or
+  // GGUF path) proposing draft_tokens tokens per step. Takes effect the next
+  // time model_id is loaded; an empty draft_model turns it off.
+  bool setSpeculativeDraft(const std::string &model_id,
+                           const std::string &draft_model,
+                           unsigned int draft_tokens = 4);
+
+  // Continuous-batching slots per model for generateTextBatch; every slot
+  // adds a full context of KV cache. 0 (default) leaves it to DUOROU_PARALLEL,
+  // which is off when unset. Takes effect for models loaded afterwards.
+  void setParallelSequences(unsigned int n_parallel);
+
+  // Prompt tokens a joining batched sequence prefills per decode step. 0
+  // (default) keeps the engine's own default or DUOROU_PREFILL_CHUNK. Takes
+  // effect for models loaded afterwards.
+  void setPrefillChunk(unsigned int tokens);
+
+  // TTFT and inter-token latency of a loaded model since it was loaded;
+  // empty when the model is not loaded
+  LatencyStats latencyStats(const std::string &model_id) const;
+
   std::vector<std::string> getRegisteredModels() const;
   std::vector<std::string> getLoadedModels() const;
   const ModelInfo *getModelInfo(const std::string &model_id) const;
@@ -189,6 +253,8 @@ public:
 private:
   bool loadModelInternal(const std::string &model_id);
   bool unloadModelInternal(const std::string &model_id);
+  // 返回引擎的共享引用：卸载只移除表项，进行中的生成持有引用直到结束
+  std::shared_ptr<InferenceEngine> findEngine(const std::string &model_id) const;
 
   bool parseModelInfo(const std::string &gguf_file_path, ModelInfo &model_info);
 
@@ -208,12 +274,25 @@ private:
 
   OllamaPathResolver path_resolver_;
 
+  // 保护注册表、加载状态与引擎表；引擎的创建与析构在锁外进行，
+  // 不同模型可以同时加载或卸载
+  mutable std::recursive_mutex models_mutex_;
+
   std::unordered_map<std::string, ModelInfo> registered_models_;
 
   std::unordered_map<std::string, ModelLoadState> model_states_;
 
-  // 存储已加载的推理引擎
-  std::unordered_map<std::string, std::unique_ptr<InferenceEngine>>
+  // 按模型配置的推测解码选项
+  std::unordered_map<std::string, SpeculativeOptions> speculative_options_;
+
+  // 连续批处理并行序列数（0 表示关闭）
+  unsigned int parallel_sequences_;
+
+  // 连续批处理每步预填充的提示词 token 数（0 表示使用引擎默认值）
+  unsigned int prefill_chunk_;
+
+  // 存储已加载的推理引擎（共享所有权，生成期间卸载不会释放正在使用的引擎）
+  std::unordered_map<std::string, std::shared_ptr<InferenceEngine>>
       inference_engines_;
 
   mutable size_t total_memory_usage_;
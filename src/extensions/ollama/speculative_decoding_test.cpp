@@ -0,0 +1,72 @@
+#include "inference_engine.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using duorou::extensions::ollama::MLInferenceEngine;
+
+// Greedy speculative decoding must produce exactly the target's own greedy
+// output, wherever generation stops inside a verification round, and leave
+// both KV caches consistent for the next call's prefix reuse.
+//
+// DUOROU_SPEC_TARGET_GGUF / DUOROU_SPEC_DRAFT_GGUF name the target and draft
+// models (same tokenizer); the test is skipped when they are not set.
+
+static std::string getEnv(const char *key) {
+  const char *v = std::getenv(key);
+  return v ? std::string(v) : std::string();
+}
+
+int main() {
+  const std::string target = getEnv("DUOROU_SPEC_TARGET_GGUF");
+  const std::string draft = getEnv("DUOROU_SPEC_DRAFT_GGUF");
+  if (target.empty() || draft.empty()) {
+    std::cout << "[SPEC] DUOROU_SPEC_TARGET_GGUF / DUOROU_SPEC_DRAFT_GGUF not set, skipping"
+              << std::endl;
+    return 77;
+  }
+
+  MLInferenceEngine plain("spec-test-plain", target);
+  MLInferenceEngine spec("spec-test-spec", target);
+  const unsigned int kDraftTokens = 3;
+  spec.setDraftModel(draft, kDraftTokens);
+  if (!plain.initialize() || !spec.initialize() || !spec.speculativeEnabled()) {
+    std::cerr << "[SPEC] failed to load models" << std::endl;
+    return 1;
+  }
+
+  int failed = 0;
+  int eogStops = 0;
+  auto check = [&](const std::string &prompt, unsigned int maxTokens) {
+    const std::string expected = plain.generateText(prompt, maxTokens, 0.0f, 1.0f);
+    const std::string actual = spec.generateText(prompt, maxTokens, 0.0f, 1.0f);
+    const auto stats = spec.lastGenerationStats();
+    if (actual != expected) {
+      ++failed;
+      std::cerr << "[SPEC] mismatch max_tokens=" << maxTokens << "\n  expected: " << expected
+                << "\n  actual:   " << actual << std::endl;
+    }
+    if (stats.tokens < maxTokens) {
+      ++eogStops;
+    }
+    return actual;
+  };
+
+  // Every stopping offset within the first few rounds of k proposals
+  const std::string prompt = "The capital of France is";
+  for (unsigned int maxTokens = 1; maxTokens <= 3 * (kDraftTokens + 1); ++maxTokens) {
+    check(prompt, maxTokens);
+  }
+
+  // Long enough to end on an end-of-generation token, then continue the
+  // conversation so the next call reuses what both caches kept
+  const std::string question = "Answer in one short sentence: what colour is the sky?";
+  const std::string answer = check(question, 256);
+  check(question + answer + "\nAnd at night?", 256);
+  check(question + answer + "\nAnd at night?", 5);
+
+  std::cout << "[SPEC] " << eogStops << " runs stopped on end-of-generation" << std::endl;
+  std::cout << "[SPEC] " << (failed == 0 ? "OK" : "FAILED") << std::endl;
+  return failed == 0 ? 0 : 1;
+}
@@ -281,6 +281,25 @@ static std::vector<float> convert_audio_for_models(
   return resample_linear_mono(mono, sample_rate, target_sample_rate);
 }
 
+// Chat text for a generation the inference queue did not run
+static std::string queue_rejection_message(const duorou::core::Admission &admission) {
+  switch (admission.result) {
+  case duorou::core::AdmissionResult::RATE_LIMITED:
+  case duorou::core::AdmissionResult::QUEUE_FULL:
+    return "Error: The model is busy, please try again in " +
+           std::to_string(static_cast<int>(std::ceil(
+               std::max(1.0, admission.retry_after_seconds)))) +
+           " s";
+  case duorou::core::AdmissionResult::TIMED_OUT:
+    return "Error: Timed out waiting for the model";
+  case duorou::core::AdmissionResult::SHUTTING_DOWN:
+    return "Error: Generation was cancelled because the application is "
+           "shutting down";
+  default:
+    return std::string();
+  }
+}
+
 } // namespace
 
 // Fallback stubs when GTK headers are unavailable (prefer header presence
@@ -4382,7 +4401,7 @@ std::string ChatView::generate_ai_response(const std::string &message) {
     // Get text generator
     std::cout << "[DEBUG] ChatView: Getting text generator for model: "
               << model_id << std::endl;
-    core::TextGenerator *text_generator =
+    std::shared_ptr<core::TextGenerator> text_generator =
         model_manager_->getTextGenerator(model_id);
     if (!text_generator) {
       std::cout << "[DEBUG] ChatView: Failed to get text generator for model: "
@@ -4406,9 +4425,15 @@ std::string ChatView::generate_ai_response(const std::string &message) {
     params.top_k = 40;
     params.repeat_penalty = 1.1f;
 
-    // Generate response
+    // Generate response, waiting for our turn in the inference queue
     std::cout << "[DEBUG] ChatView: Starting text generation..." << std::endl;
-    core::GenerationResult result = text_generator->generate(message, params);
+    core::GenerationResult result;
+    const core::Admission admission = model_manager_->getInferenceQueue().run(
+        "gui", core::InferenceQueue::estimateCost(message.size(), params.max_tokens),
+        [&] { result = text_generator->generate(message, params); });
+    if (!admission.admitted()) {
+      return queue_rejection_message(admission);
+    }
 
     if (result.finished && !result.text.empty()) {
       std::cout << "[DEBUG] ChatView: Text generation completed successfully"
@@ -4854,7 +4879,7 @@ void ChatView::stream_ai_response(const std::string &message) {
       return;
     }
 
-    core::TextGenerator *text_generator =
+    std::shared_ptr<core::TextGenerator> text_generator =
         model_manager_->getTextGenerator(model_id);
     if (!text_generator || !text_generator->canGenerate()) {
       struct Data {
@@ -4901,11 +4926,17 @@ void ChatView::stream_ai_response(const std::string &message) {
             return G_SOURCE_REMOVE;
           },
           d);
+      return true;
     };
 
-    // Start streaming; ignore return content here, chunks are handled by
-    // callback
-    text_generator->generateStream(message, cb, params);
+    // Start streaming once the inference queue admits us; ignore return
+    // content here, chunks are handled by callback
+    const core::Admission admission = model_manager_->getInferenceQueue().run(
+        "gui", core::InferenceQueue::estimateCost(message.size(), params.max_tokens),
+        [&] { text_generator->generateStream(message, cb, params); });
+    if (!admission.admitted()) {
+      cb(0, queue_rejection_message(admission), true);
+    }
   } catch (const std::exception &e) {
     struct Data {
       ChatView *self;
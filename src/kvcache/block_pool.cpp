@@ -0,0 +1,119 @@
+#include "block_pool.h"
+#include "cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace duorou {
+namespace kvcache {
+
+namespace {
+// Blocks per chunk, independent of the context length so that a long-context
+// cache only pays for the blocks it actually fills.
+constexpr size_t kChunkBlocks = 64;
+} // namespace
+
+void BlockPool::init(int32_t blockTokens, size_t tokenBytes, size_t initialBlocks) {
+    if (blockTokens <= 0 || tokenBytes == 0) {
+        throw CacheError("BlockPool: invalid block geometry");
+    }
+    reset();
+    blockTokens_ = blockTokens;
+    tokenBytes_ = tokenBytes;
+    chunkBlocks_ = kChunkBlocks;
+    while (totalBlocks() < initialBlocks) {
+        grow();
+    }
+}
+
+void BlockPool::reset() {
+    chunks_.clear();
+    freeList_.clear();
+    refCounts_.clear();
+}
+
+void BlockPool::grow() {
+    // Pages are only committed on first touch, so a large chunk is cheap
+    // until blocks are actually written.
+    std::unique_ptr<uint8_t[]> chunk(new (std::nothrow) uint8_t[chunkBlocks_ * blockBytes()]);
+    if (!chunk) {
+        throw OutOfMemoryError("BlockPool: failed to grow KV block pool");
+    }
+    int32_t first = static_cast<int32_t>(chunks_.size() * chunkBlocks_);
+    chunks_.push_back(std::move(chunk));
+    freeList_.reserve(totalBlocks());
+    refCounts_.resize(totalBlocks(), 0);
+    // Push in reverse so blocks are handed out in address order
+    for (int32_t i = static_cast<int32_t>(chunkBlocks_) - 1; i >= 0; --i) {
+        freeList_.push_back(first + i);
+    }
+}
+
+int32_t BlockPool::allocate() {
+    if (chunkBlocks_ == 0) {
+        throw CacheError("BlockPool: allocate() before init()");
+    }
+    if (freeList_.empty()) {
+        grow();
+    }
+    int32_t block = freeList_.back();
+    freeList_.pop_back();
+    refCounts_[static_cast<size_t>(block)] = 1;
+    return block;
+}
+
+void BlockPool::retain(int32_t block) {
+    if (block == kInvalidBlock) return;
+    ++refCounts_[static_cast<size_t>(block)];
+}
+
+void BlockPool::release(int32_t block) {
+    if (block == kInvalidBlock) return;
+    int32_t &refs = refCounts_[static_cast<size_t>(block)];
+    if (refs <= 0) {
+        throw CacheError("BlockPool: release of a free block");
+    }
+    if (--refs == 0) {
+        freeList_.push_back(block);
+    }
+}
+
+int32_t BlockPool::refCount(int32_t block) const {
+    if (block == kInvalidBlock) return 0;
+    return refCounts_[static_cast<size_t>(block)];
+}
+
+int32_t BlockPool::copyOnWrite(int32_t block, int32_t tokens) {
+    // allocate() may grow the pool, but chunks never move so `block` stays valid
+    int32_t copy = allocate();
+    size_t bytes = static_cast<size_t>(std::max(0, std::min(tokens, blockTokens_))) * tokenBytes_;
+    std::memcpy(keys(copy), keys(block), bytes);
+    std::memcpy(values(copy), values(block), bytes);
+    release(block);
+    return copy;
+}
+
+uint8_t* BlockPool::blockBase(int32_t block) const {
+    size_t id = static_cast<size_t>(block);
+    return chunks_[id / chunkBlocks_].get() + (id % chunkBlocks_) * blockBytes();
+}
+
+uint8_t* BlockPool::keys(int32_t block) {
+    return blockBase(block);
+}
+
+uint8_t* BlockPool::values(int32_t block) {
+    return blockBase(block) + static_cast<size_t>(blockTokens_) * tokenBytes_;
+}
+
+const uint8_t* BlockPool::keys(int32_t block) const {
+    return blockBase(block);
+}
+
+const uint8_t* BlockPool::values(int32_t block) const {
+    return blockBase(block) + static_cast<size_t>(blockTokens_) * tokenBytes_;
+}
+
+} // namespace kvcache
+} // namespace duorou
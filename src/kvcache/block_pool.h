@@ -0,0 +1,83 @@
+#ifndef DUOROU_KVCACHE_BLOCK_POOL_H
+#define DUOROU_KVCACHE_BLOCK_POOL_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace duorou {
+namespace kvcache {
+
+// Fixed-size KV block pool.
+// Every block holds `blockTokens` tokens of keys followed by the same number
+// of tokens of values. Blocks are carved out of fixed-size chunks that are
+// allocated on demand and never moved, so block pointers stay valid until
+// reset(). Released blocks go back to a free list and are reused before the
+// pool grows again.
+//
+// Blocks are reference counted so several sequences can share a prefix;
+// a block returns to the free list when its last reference is released.
+class BlockPool {
+public:
+    static constexpr int32_t kInvalidBlock = -1;
+
+    BlockPool() = default;
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    // (Re)configure the pool and preallocate at least `initialBlocks` blocks
+    // (0 = reserve nothing until the first allocate()). Any previously
+    // allocated memory is dropped.
+    void init(int32_t blockTokens, size_t tokenBytes, size_t initialBlocks = 0);
+
+    // Drop all chunks and bookkeeping
+    void reset();
+
+    // O(1) block allocation (refcount 1); grows the pool by one chunk when exhausted
+    int32_t allocate();
+
+    // Add a reference to a live block
+    void retain(int32_t block);
+
+    // Drop a reference; the block returns to the free list at zero
+    void release(int32_t block);
+
+    int32_t refCount(int32_t block) const;
+    bool isShared(int32_t block) const { return refCount(block) > 1; }
+
+    // Allocate a private copy of the first `tokens` tokens of `block` and
+    // drop one reference to the original (copy-on-write)
+    int32_t copyOnWrite(int32_t block, int32_t tokens);
+
+    uint8_t* keys(int32_t block);
+    uint8_t* values(int32_t block);
+    const uint8_t* keys(int32_t block) const;
+    const uint8_t* values(int32_t block) const;
+
+    int32_t blockTokens() const { return blockTokens_; }
+    size_t tokenBytes() const { return tokenBytes_; }
+    size_t blockBytes() const { return 2 * static_cast<size_t>(blockTokens_) * tokenBytes_; }
+
+    size_t chunkBlocks() const { return chunkBlocks_; }
+    size_t totalBlocks() const { return chunks_.size() * chunkBlocks_; }
+    size_t freeBlocks() const { return freeList_.size(); }
+    size_t usedBlocks() const { return totalBlocks() - freeBlocks(); }
+    size_t reservedBytes() const { return totalBlocks() * blockBytes(); }
+
+private:
+    void grow();
+    uint8_t* blockBase(int32_t block) const;
+
+    int32_t blockTokens_ = 0;
+    size_t tokenBytes_ = 0;
+    size_t chunkBlocks_ = 0;
+    std::vector<std::unique_ptr<uint8_t[]>> chunks_;
+    std::vector<int32_t> freeList_;
+    std::vector<int32_t> refCounts_;
+};
+
+} // namespace kvcache
+} // namespace duorou
+
+#endif // DUOROU_KVCACHE_BLOCK_POOL_H
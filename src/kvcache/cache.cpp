@@ -5,6 +5,23 @@
 namespace duorou {
 namespace kvcache {
 
+size_t dtypeBytes(DType dtype, size_t elements) {
+    switch (dtype) {
+        case DType::FLOAT32:
+            return elements * 4;
+        case DType::FLOAT16:
+            return elements * 2;
+        case DType::INT32:
+            return elements * 4;
+        case DType::INT64:
+            return elements * 8;
+        case DType::Q8_0:
+            // 32 int8 values + fp16 scale per block
+            return (elements + 31) / 32 * 34;
+    }
+    return 0;
+}
+
 // Tensor class implementation
 Tensor::Tensor(const std::vector<int>& shape, DType dtype) 
     : shape_(shape), dtype_(dtype), data_(nullptr), size_(0), backend_(nullptr) {
@@ -16,23 +33,7 @@ Tensor::Tensor(const std::vector<int>& shape, DType dtype)
     }
     
     // Calculate byte size based on data type
-    size_t elementSize = 0;
-    switch (dtype) {
-        case DType::FLOAT32:
-            elementSize = 4;
-            break;
-        case DType::FLOAT16:
-            elementSize = 2;
-            break;
-        case DType::INT32:
-            elementSize = 4;
-            break;
-        case DType::INT64:
-            elementSize = 8;
-            break;
-    }
-    
-    size_ = totalElements * elementSize;
+    size_ = dtypeBytes(dtype, totalElements);
     
     // Allocate memory
     if (size_ > 0) {
@@ -52,23 +53,7 @@ Tensor::Tensor(const std::vector<int>& shape, DType dtype, Backend* backend)
     }
 
     // Calculate byte size based on data type
-    size_t elementSize = 0;
-    switch (dtype) {
-        case DType::FLOAT32:
-            elementSize = 4;
-            break;
-        case DType::FLOAT16:
-            elementSize = 2;
-            break;
-        case DType::INT32:
-            elementSize = 4;
-            break;
-        case DType::INT64:
-            elementSize = 8;
-            break;
-    }
-
-    size_ = totalElements * elementSize;
+    size_ = dtypeBytes(dtype, totalElements);
 
     // Allocate using backend if provided, otherwise fallback to malloc
     if (size_ > 0) {
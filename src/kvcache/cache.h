@@ -26,9 +26,13 @@ enum class DType {
     FLOAT32,
     FLOAT16,
     INT32,
-    INT64
+    INT64,
+    Q8_0    // int8 in blocks of 32 values with one fp16 scale per block
 };
 
+// Storage size in bytes of `elements` values of the given type
+size_t dtypeBytes(DType dtype, size_t elements);
+
 // Cache configuration structure
 struct CacheConfig {
     int maxSeqLen;
@@ -1,21 +1,52 @@
 #include "causal.h"
+#include "kv_quant.h"
+#include <algorithm>
+#include <cstring>
 
 namespace duorou {
 namespace kvcache {
 
+namespace {
+void copyBytes(Context& ctx, void* dst, const void* src, size_t bytes) {
+    if (ctx.backend()) {
+        ctx.backend()->copy(dst, src, bytes);
+    } else {
+        std::memcpy(dst, src, bytes);
+    }
+}
+} // namespace
+
 CausalCache::CausalCache(const CausalOptions& options) 
     : options_(options), currentLayer_(0), initialized_(false) {
 }
 
 void CausalCache::init(Context& ctx, const CacheConfig& config) {
     config_ = config;
-    initialized_ = true;
     kv_store_.clear();
+    batchSlots_.clear();
     kv_stride_ = config_.numHeads * config_.headDim;
+    if (kv_stride_ <= 0) {
+        throw CacheError("CausalCache: numHeads * headDim must be positive");
+    }
+    // K/V are stored in config.dtype (FLOAT32, FLOAT16 or Q8_0) and
+    // dequantized to float32 on get()
+    if (!isKVStorageType(config_.dtype)) {
+        throw CacheError("CausalCache: unsupported KV storage dtype");
+    }
+    // Blocks are reserved chunk by chunk as tokens arrive, so memory tracks
+    // the cached length rather than maxSeqLen; poolBlocks only asks for an
+    // up-front reservation.
+    int32_t blockSize = std::max(1, options_.blockSize);
+    size_t poolBlocks = static_cast<size_t>(std::max(0, options_.poolBlocks));
+    pool_.init(blockSize, dtypeBytes(config_.dtype, static_cast<size_t>(kv_stride_)), poolBlocks);
+    initialized_ = true;
 }
 
 void CausalCache::close() {
     sequences_.clear();
+    kv_store_.clear();
+    batchSlots_.clear();
+    pool_.reset();
     initialized_ = false;
 }
 
@@ -50,100 +81,118 @@ std::tuple<Tensor, Tensor> CausalCache::get(Context& ctx, int seq, int32_t start
     std::vector<int> shape = {1, outLen, config_.numHeads, config_.headDim};
     Tensor key(shape, DType::FLOAT32, ctx.backend());
     Tensor value(shape, DType::FLOAT32, ctx.backend());
-    // Copy data from kv_store_ into tensors
-    if (outLen > 0 && itLayer != layers.end()) {
-        const LayerKV &kv = itLayer->second;
-        size_t perTok = static_cast<size_t>(kv_stride_);
-        size_t copyBytes = static_cast<size_t>(outLen) * perTok * sizeof(float);
+    // Gather data from the block table into tensors
+    if (outLen > 0 && itLayer != layers.end() && key.data() && value.data()) {
         // Source offset in tokens
         int32_t srcTok = totalLen - win + sPos;
         srcTok = std::max(0, srcTok);
-        const float *kSrc = kv.k.data() + static_cast<size_t>(srcTok) * perTok;
-        const float *vSrc = kv.v.data() + static_cast<size_t>(srcTok) * perTok;
-        if (key.data() && value.data()) {
-            if (ctx.backend()) {
-                ctx.backend()->copy(key.data(), kSrc, copyBytes);
-                ctx.backend()->copy(value.data(), vSrc, copyBytes);
-            } else {
-                std::memcpy(key.data(), kSrc, copyBytes);
-                std::memcpy(value.data(), vSrc, copyBytes);
-            }
-        }
+        readTokens(ctx, itLayer->second, srcTok, outLen,
+                   static_cast<float*>(key.data()), static_cast<float*>(value.data()));
     }
     return std::make_tuple(key, value);
 }
 
 void CausalCache::put(Context& ctx, const Tensor& key, const Tensor& value) {
-    // Append new K/V segment to kv_store_ for current layer
-    // NOTE: current implementation assumes single-sequence (seq=0).
-    // Future work: plumb sequence id through call sites.
-    int seq = 0;
-    auto &layers = kv_store_[seq];
-    LayerKV &kv = layers[currentLayer_];
+    // Store new K/V tokens for the current layer. Tokens are routed to the
+    // sequences recorded by the last startForward(): key/value are either
+    // [numSeqs, S, H, D] with row i holding seqLens[i] tokens, or flattened
+    // [1, sum(seqLens), H, D] in batch order.
     const auto &s = key.shape();
-    int newSk = (s.size() >= 2) ? s[1] : 0;
-    if (newSk <= 0) return;
-    size_t perTok = static_cast<size_t>(kv_stride_);
-    size_t add = static_cast<size_t>(newSk) * perTok;
-    size_t old = kv.k.size();
-    kv.k.resize(old + add);
-    kv.v.resize(old + add);
-    // Copy from tensor buffers
-    size_t copyBytes = add * sizeof(float);
-    if (key.data() && value.data()) {
-        if (ctx.backend()) {
-            ctx.backend()->copy(kv.k.data() + old, key.data(), copyBytes);
-            ctx.backend()->copy(kv.v.data() + old, value.data(), copyBytes);
-        } else {
-            std::memcpy(kv.k.data() + old, key.data(), copyBytes);
-            std::memcpy(kv.v.data() + old, value.data(), copyBytes);
-        }
+    if (s.size() < 2 || !key.data() || !value.data()) return;
+    int rows = s[0];
+    int rowLen = s[1];
+    if (rows <= 0 || rowLen <= 0) return;
+    const size_t perTok = static_cast<size_t>(kv_stride_);
+    const float *k = static_cast<const float*>(key.data());
+    const float *v = static_cast<const float*>(value.data());
+
+    if (batchSlots_.size() <= 1) {
+        // Single sequence (seq 0 when no batch was announced)
+        int seq = batchSlots_.empty() ? 0 : batchSlots_[0].seq;
+        int32_t firstPos = batchSlots_.empty() ? -1 : batchSlots_[0].firstPos;
+        storeTokens(ctx, seq, firstPos, k, v, rowLen);
+        return;
     }
-    kv.length += newSk;
-    // Update sequence length bookkeeping before eviction
-    auto &info = sequences_[seq];
-    info.active = true;
-    info.capacity = config_.maxSeqLen;
-    info.length = std::min(kv.length, info.capacity);
-    // Apply sliding window eviction to limit memory growth
-    if (options_.enableSlidingWindow && options_.slidingWindow > 0 && kv.length > options_.slidingWindow) {
-        int32_t evictTok = kv.length - options_.slidingWindow;
-        if (evictTok > 0) {
-            // Drop prefix tokens
-            size_t evict = static_cast<size_t>(evictTok) * perTok;
-            if (evict < kv.k.size()) {
-                kv.k.erase(kv.k.begin(), kv.k.begin() + static_cast<std::ptrdiff_t>(evict));
-                kv.v.erase(kv.v.begin(), kv.v.begin() + static_cast<std::ptrdiff_t>(evict));
-                kv.length = options_.slidingWindow;
-                // Keep sequence bookkeeping consistent with the windowed length
-                info.length = std::min(kv.length, info.capacity);
-            }
+
+    if (rows == static_cast<int>(batchSlots_.size())) {
+        // Padded layout: one row per sequence
+        size_t rowStride = static_cast<size_t>(rowLen) * perTok;
+        for (size_t i = 0; i < batchSlots_.size(); ++i) {
+            const BatchSlot &slot = batchSlots_[i];
+            int32_t n = std::min(slot.tokens, rowLen);
+            storeTokens(ctx, slot.seq, slot.firstPos, k + i * rowStride, v + i * rowStride, n);
         }
+        return;
+    }
+
+    // Flattened layout: tokens of each sequence follow one another
+    int64_t expected = 0;
+    for (const auto &slot : batchSlots_) {
+        expected += slot.tokens;
+    }
+    if (expected != static_cast<int64_t>(rows) * rowLen) {
+        throw CacheError("CausalCache::put: token count does not match the current batch");
+    }
+    size_t offset = 0;
+    for (const auto &slot : batchSlots_) {
+        storeTokens(ctx, slot.seq, slot.firstPos, k + offset * perTok, v + offset * perTok, slot.tokens);
+        offset += static_cast<size_t>(slot.tokens);
     }
 }
 
 void CausalCache::startForward(Context& ctx, const Batch& batch, bool reserve) {
-    // Implementation for starting forward propagation
-    for (int seq : batch.seqs) {
+    // Record how the upcoming put() calls map tokens to sequences.
+    // Batch.positions is honoured when it carries one position per token;
+    // otherwise new tokens are appended after the cached ones.
+    batchSlots_.clear();
+    int64_t totalTokens = 0;
+    for (size_t i = 0; i < batch.seqs.size() && i < batch.seqLens.size(); ++i) {
+        totalTokens += batch.seqLens[i];
+    }
+    bool perTokenPositions = !batch.positions.empty() &&
+                             static_cast<int64_t>(batch.positions.size()) == totalTokens;
+    size_t offset = 0;
+    for (size_t i = 0; i < batch.seqs.size(); ++i) {
+        int seq = batch.seqs[i];
         if (sequences_.find(seq) == sequences_.end()) {
             addSequence(seq, config_.maxSeqLen);
         }
         sequences_[seq].active = true;
         sequences_[seq].capacity = config_.maxSeqLen;
+        int32_t tokens = i < batch.seqLens.size() ? batch.seqLens[i] : 0;
+        BatchSlot slot;
+        slot.seq = seq;
+        slot.tokens = tokens;
+        slot.firstPos = (perTokenPositions && tokens > 0) ? batch.positions[offset] : -1;
+        batchSlots_.push_back(slot);
+        offset += static_cast<size_t>(std::max(0, tokens));
         // If reserve is set, optionally pre-set length
-        if (reserve && seq < static_cast<int>(batch.seqLens.size())) {
-            sequences_[seq].length = batch.seqLens[seq];
+        if (reserve && i < batch.seqLens.size()) {
+            sequences_[seq].length = batch.seqLens[i];
         }
     }
 }
 
 void CausalCache::copyPrefix(Context& ctx, int srcSeq, int dstSeq, int32_t length) {
-    // Implementation for copying prefix
-    if (sequences_.find(srcSeq) != sequences_.end() && 
-        sequences_.find(dstSeq) != sequences_.end()) {
-        // Simplified implementation: copy sequence information
-        sequences_[dstSeq].length = std::min(length, sequences_[srcSeq].length);
+    // Share the first `length` cached tokens of srcSeq with dstSeq. Blocks are
+    // reference counted and only copied once either side writes into them.
+    if (srcSeq == dstSeq || sequences_.find(srcSeq) == sequences_.end()) {
+        return;
+    }
+    if (sequences_.find(dstSeq) == sequences_.end()) {
+        addSequence(dstSeq, config_.maxSeqLen);
+    }
+    releaseSequence(dstSeq);
+    int32_t shared = std::min(std::max(0, length), sequences_[srcSeq].length);
+    if (kv_store_.find(srcSeq) != kv_store_.end()) {
+        // Insert the destination first: it may rehash kv_store_ and
+        // invalidate iterators into it
+        auto &dstLayers = kv_store_[dstSeq];
+        for (const auto &layer : kv_store_.find(srcSeq)->second) {
+            shareTokens(layer.second, dstLayers[layer.first], shared);
+        }
     }
+    sequences_[dstSeq].length = shared;
 }
 
 bool CausalCache::canResume(int seq, int32_t pos) const {
@@ -163,26 +212,12 @@ void CausalCache::remove(int seq, int32_t beginIndex, int32_t endIndex) {
         // Remove tokens from [beginIndex, endIndex)
         if (endIndex == std::numeric_limits<int32_t>::max()) {
             // truncate at beginIndex
-            int32_t keep = std::max(0, beginIndex);
-            size_t perTok = static_cast<size_t>(kv_stride_);
-            size_t keepElems = static_cast<size_t>(keep) * perTok;
-            if (keepElems < kv.k.size()) {
-                kv.k.resize(keepElems);
-                kv.v.resize(keepElems);
-                kv.length = keep;
-            }
+            truncate(kv, std::max(0, beginIndex));
         } else if (beginIndex < endIndex) {
             int32_t rem = std::min(kv.length, endIndex) - std::max(0, beginIndex);
             if (rem > 0) {
                 // We simply truncate for now to avoid fragmentation
-                int32_t keep = std::max(0, kv.length - rem);
-                size_t perTok = static_cast<size_t>(kv_stride_);
-                size_t keepElems = static_cast<size_t>(keep) * perTok;
-                if (keepElems < kv.k.size()) {
-                    kv.k.resize(keepElems);
-                    kv.v.resize(keepElems);
-                    kv.length = keep;
-                }
+                truncate(kv, std::max(0, kv.length - rem));
             }
         }
     }
@@ -194,11 +229,43 @@ void CausalCache::remove(int seq, int32_t beginIndex, int32_t endIndex) {
 }
 
 std::tuple<Tensor, Tensor, Tensor> CausalCache::buildOutputTensors(Context& ctx, const std::vector<int>& activeSeqs) {
-    // Implementation for building output tensors
-    std::vector<int> shape = {static_cast<int>(activeSeqs.size()), config_.numHeads, config_.headDim};
+    // Gather the current layer's K/V of every active sequence into
+    // [B, maxLen, H, D] tensors (left aligned, zero padded) together with a
+    // [B, maxLen] additive mask: 0 for cached tokens, -inf for padding.
+    std::vector<const BlockTable*> tables(activeSeqs.size(), nullptr);
+    int32_t maxLen = 0;
+    for (size_t i = 0; i < activeSeqs.size(); ++i) {
+        auto itSeq = kv_store_.find(activeSeqs[i]);
+        if (itSeq == kv_store_.end()) continue;
+        auto itLayer = itSeq->second.find(currentLayer_);
+        if (itLayer == itSeq->second.end()) continue;
+        tables[i] = &itLayer->second;
+        maxLen = std::max(maxLen, itLayer->second.length);
+    }
+
+    int batchSize = static_cast<int>(activeSeqs.size());
+    std::vector<int> shape = {batchSize, maxLen, config_.numHeads, config_.headDim};
     Tensor key(shape, DType::FLOAT32, ctx.backend());
     Tensor value(shape, DType::FLOAT32, ctx.backend());
-    Tensor mask(shape, DType::FLOAT32, ctx.backend());
+    Tensor mask({batchSize, maxLen}, DType::FLOAT32, ctx.backend());
+    if (maxLen == 0 || !key.data() || !value.data() || !mask.data()) {
+        return std::make_tuple(key, value, mask);
+    }
+
+    const size_t rowStride = static_cast<size_t>(maxLen) * static_cast<size_t>(kv_stride_);
+    std::vector<float> maskRow(static_cast<size_t>(maxLen));
+    for (size_t i = 0; i < tables.size(); ++i) {
+        int32_t len = tables[i] ? tables[i]->length : 0;
+        if (len > 0) {
+            readTokens(ctx, *tables[i], 0, len,
+                       static_cast<float*>(key.data()) + i * rowStride,
+                       static_cast<float*>(value.data()) + i * rowStride);
+        }
+        std::fill(maskRow.begin(), maskRow.begin() + len, 0.0f);
+        std::fill(maskRow.begin() + len, maskRow.end(), -std::numeric_limits<float>::infinity());
+        copyBytes(ctx, static_cast<float*>(mask.data()) + i * static_cast<size_t>(maxLen),
+                  maskRow.data(), maskRow.size() * sizeof(float));
+    }
     return std::make_tuple(key, value, mask);
 }
 
@@ -226,14 +293,23 @@ void CausalCache::addSequence(int seqId, int32_t capacity) {
     info.capacity = capacity;
     info.active = true;
     sequences_[seqId] = info;
-    kv_store_[seqId].clear();
+    releaseSequence(seqId);
 }
 
 void CausalCache::removeSequence(int seqId) {
+    releaseSequence(seqId);
+    kv_store_.erase(seqId);
     sequences_.erase(seqId);
 }
 
 void CausalCache::clearSequences() {
+    for (auto &entry : kv_store_) {
+        for (auto &layer : entry.second) {
+            releaseTable(layer.second);
+        }
+    }
+    kv_store_.clear();
+    batchSlots_.clear();
     sequences_.clear();
 }
 
@@ -275,5 +351,166 @@ bool CausalCache::isWithinSlidingWindow(int seq, int32_t pos) const {
     return pos <= win;
 }
 
+void CausalCache::storeTokens(Context& ctx, int seq, int32_t firstPos, const float* k, const float* v, int32_t count) {
+    if (count <= 0) return;
+    BlockTable &kv = kv_store_[seq][currentLayer_];
+    if (firstPos >= 0 && firstPos < kv.base + kv.length) {
+        // Rewriting already cached positions: drop the stale suffix first
+        if (firstPos <= kv.base) {
+            releaseTable(kv);
+            kv.base = firstPos;
+        } else {
+            truncate(kv, firstPos - kv.base);
+        }
+    }
+    appendTokens(ctx, kv, k, v, count);
+    // Update sequence length bookkeeping before eviction
+    auto &info = sequences_[seq];
+    info.active = true;
+    info.capacity = config_.maxSeqLen;
+    info.length = std::min(kv.length, info.capacity);
+    // Apply sliding window eviction to limit memory growth
+    if (options_.enableSlidingWindow && options_.slidingWindow > 0 && kv.length > options_.slidingWindow) {
+        int32_t evictTok = kv.length - options_.slidingWindow;
+        if (evictTok > 0) {
+            // Drop prefix tokens; whole blocks go back to the pool
+            evictFront(kv, evictTok);
+            // Keep sequence bookkeeping consistent with the windowed length
+            info.length = std::min(kv.length, info.capacity);
+        }
+    }
+}
+
+// Block table helpers
+void CausalCache::appendTokens(Context& ctx, BlockTable& table, const float* k, const float* v, int32_t count) {
+    const int32_t blockTokens = pool_.blockTokens();
+    const size_t tokBytes = pool_.tokenBytes();
+    const size_t perTok = static_cast<size_t>(kv_stride_);
+    int32_t done = 0;
+    while (done < count) {
+        int32_t used = table.head + table.length;
+        int32_t slot = used % blockTokens;
+        if (used == static_cast<int32_t>(table.blocks.size()) * blockTokens) {
+            table.blocks.push_back(pool_.allocate());
+        } else if (pool_.isShared(table.blocks.back())) {
+            // Tail block is shared with another sequence: copy before writing
+            table.blocks.back() = pool_.copyOnWrite(table.blocks.back(), slot);
+        }
+        int32_t n = std::min(count - done, blockTokens - slot);
+        int32_t block = table.blocks.back();
+        size_t dstOff = static_cast<size_t>(slot) * tokBytes;
+        size_t srcOff = static_cast<size_t>(done) * perTok;
+        if (config_.dtype == DType::FLOAT32) {
+            size_t bytes = static_cast<size_t>(n) * tokBytes;
+            copyBytes(ctx, pool_.keys(block) + dstOff, k + srcOff, bytes);
+            copyBytes(ctx, pool_.values(block) + dstOff, v + srcOff, bytes);
+        } else {
+            for (int32_t t = 0; t < n; ++t) {
+                size_t off = static_cast<size_t>(t);
+                quantizeRow(config_.dtype, k + srcOff + off * perTok, pool_.keys(block) + dstOff + off * tokBytes, perTok);
+                quantizeRow(config_.dtype, v + srcOff + off * perTok, pool_.values(block) + dstOff + off * tokBytes, perTok);
+            }
+        }
+        table.length += n;
+        done += n;
+    }
+}
+
+void CausalCache::readTokens(Context& ctx, const BlockTable& table, int32_t start, int32_t count, float* k, float* v) const {
+    const int32_t blockTokens = pool_.blockTokens();
+    const size_t tokBytes = pool_.tokenBytes();
+    const size_t perTok = static_cast<size_t>(kv_stride_);
+    int32_t pos = table.head + start;
+    int32_t done = 0;
+    while (done < count) {
+        int32_t block = table.blocks[static_cast<size_t>(pos / blockTokens)];
+        int32_t slot = pos % blockTokens;
+        int32_t n = std::min(count - done, blockTokens - slot);
+        size_t srcOff = static_cast<size_t>(slot) * tokBytes;
+        size_t dstOff = static_cast<size_t>(done) * perTok;
+        if (config_.dtype == DType::FLOAT32) {
+            size_t bytes = static_cast<size_t>(n) * tokBytes;
+            copyBytes(ctx, k + dstOff, pool_.keys(block) + srcOff, bytes);
+            copyBytes(ctx, v + dstOff, pool_.values(block) + srcOff, bytes);
+        } else {
+            for (int32_t t = 0; t < n; ++t) {
+                size_t off = static_cast<size_t>(t);
+                dequantizeRow(config_.dtype, pool_.keys(block) + srcOff + off * tokBytes, k + dstOff + off * perTok, perTok);
+                dequantizeRow(config_.dtype, pool_.values(block) + srcOff + off * tokBytes, v + dstOff + off * perTok, perTok);
+            }
+        }
+        pos += n;
+        done += n;
+    }
+}
+
+void CausalCache::evictFront(BlockTable& table, int32_t count) {
+    count = std::min(count, table.length);
+    if (count <= 0) return;
+    if (count == table.length) {
+        int32_t base = table.base + count;
+        releaseTable(table);
+        table.base = base;
+        return;
+    }
+    const int32_t blockTokens = pool_.blockTokens();
+    table.base += count;
+    table.head += count;
+    table.length -= count;
+    while (!table.blocks.empty() && table.head >= blockTokens) {
+        pool_.release(table.blocks.front());
+        table.blocks.pop_front();
+        table.head -= blockTokens;
+    }
+}
+
+void CausalCache::truncate(BlockTable& table, int32_t keep) {
+    if (keep >= table.length) return;
+    if (keep <= 0) {
+        releaseTable(table);
+        return;
+    }
+    const int32_t blockTokens = pool_.blockTokens();
+    table.length = keep;
+    size_t needed = static_cast<size_t>((table.head + keep + blockTokens - 1) / blockTokens);
+    while (table.blocks.size() > needed) {
+        pool_.release(table.blocks.back());
+        table.blocks.pop_back();
+    }
+}
+
+void CausalCache::shareTokens(const BlockTable& src, BlockTable& dst, int32_t count) {
+    releaseTable(dst);
+    count = std::min(std::max(0, count), src.length);
+    if (count == 0) return;
+    const int32_t blockTokens = pool_.blockTokens();
+    size_t needed = static_cast<size_t>((src.head + count + blockTokens - 1) / blockTokens);
+    for (size_t i = 0; i < needed; ++i) {
+        pool_.retain(src.blocks[i]);
+        dst.blocks.push_back(src.blocks[i]);
+    }
+    dst.head = src.head;
+    dst.base = src.base;
+    dst.length = count;
+}
+
+void CausalCache::releaseTable(BlockTable& table) {
+    for (int32_t block : table.blocks) {
+        pool_.release(block);
+    }
+    table.blocks.clear();
+    table.head = 0;
+    table.length = 0;
+}
+
+void CausalCache::releaseSequence(int seq) {
+    auto it = kv_store_.find(seq);
+    if (it == kv_store_.end()) return;
+    for (auto &layer : it->second) {
+        releaseTable(layer.second);
+    }
+    it->second.clear();
+}
+
 } // namespace kvcache
 } // namespace duorou
\ No newline at end of file
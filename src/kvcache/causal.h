@@ -2,9 +2,11 @@
 #define DUOROU_KVCACHE_CAUSAL_H
 
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <limits>
 #include "cache.h"
+#include "block_pool.h"
 
 namespace duorou {
 namespace kvcache {
@@ -13,8 +15,10 @@ namespace kvcache {
 struct CausalOptions {
     int slidingWindow;
     bool enableSlidingWindow;
+    int blockSize;      // tokens per KV block
+    int poolBlocks;     // blocks preallocated on init (0 = grow on demand)
     
-    CausalOptions() : slidingWindow(-1), enableSlidingWindow(false) {}
+    CausalOptions() : slidingWindow(-1), enableSlidingWindow(false), blockSize(16), poolBlocks(0) {}
 };
 
 // Sequence information structure
@@ -34,15 +38,25 @@ private:
     int currentLayer_;
     CacheConfig config_;
     bool initialized_;
-    // KV storage: seq_id -> layer_id -> contiguous K/V buffers
-    struct LayerKV {
-        std::vector<float> k; // [S * H * D] contiguous
-        std::vector<float> v; // [S * H * D] contiguous
-        int32_t length = 0;   // number of cached tokens (S)
+    // KV storage: seq_id -> layer_id -> block table into pool_.
+    // Tables may share reference-counted blocks after copyPrefix.
+    struct BlockTable {
+        std::deque<int32_t> blocks; // pool block ids, oldest first
+        int32_t head = 0;           // offset of the first live token in blocks.front()
+        int32_t length = 0;         // number of cached tokens (S)
+        int32_t base = 0;           // absolute position of the first live token
     };
-    std::unordered_map<int, std::unordered_map<int, LayerKV>> kv_store_;
+    std::unordered_map<int, std::unordered_map<int, BlockTable>> kv_store_;
+    BlockPool pool_;
     // per-token stride = H * D
     int kv_stride_ = 0;
+    // Token routing for put(), recorded by startForward()
+    struct BatchSlot {
+        int seq = 0;
+        int32_t tokens = 0;
+        int32_t firstPos = -1; // absolute position of the first token, -1 = append
+    };
+    std::vector<BatchSlot> batchSlots_;
 
 public:
     // Constructor
@@ -75,12 +89,27 @@ public:
     void clearSequences();
     bool hasSequence(int seq) const;
     int32_t getSequenceLength(int seq) const;
+
+    // Pool statistics
+    const BlockPool& blockPool() const { return pool_; }
     
 private:
     // Internal helper methods
     void validateSequence(int seq) const;
     void updateSequenceLength(int seq, int32_t newLength);
     bool isWithinSlidingWindow(int seq, int32_t pos) const;
+
+    // Store `count` tokens for seq at firstPos (-1 = append), then apply the sliding window
+    void storeTokens(Context& ctx, int seq, int32_t firstPos, const float* k, const float* v, int32_t count);
+
+    // Block table helpers
+    void appendTokens(Context& ctx, BlockTable& table, const float* k, const float* v, int32_t count);
+    void readTokens(Context& ctx, const BlockTable& table, int32_t start, int32_t count, float* k, float* v) const;
+    void evictFront(BlockTable& table, int32_t count);
+    void truncate(BlockTable& table, int32_t keep);
+    void shareTokens(const BlockTable& src, BlockTable& dst, int32_t count);
+    void releaseTable(BlockTable& table);
+    void releaseSequence(int seq);
 };
 
 } // namespace kvcache
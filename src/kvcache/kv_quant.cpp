@@ -0,0 +1,272 @@
+#include "kv_quant.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DUOROU_KV_X86_SIMD 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DUOROU_KV_NEON 1
+#endif
+
+namespace duorou {
+namespace kvcache {
+
+uint16_t fp32ToFp16(float value) {
+    uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t absx = x & 0x7fffffffu;
+    if (absx >= 0x7f800000u) {
+        // Inf / NaN
+        return static_cast<uint16_t>(sign | (absx > 0x7f800000u ? 0x7e00u : 0x7c00u));
+    }
+    if (absx >= 0x477ff000u) {
+        // Rounds past the largest half value
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+    if (absx < 0x38800000u) {
+        // Half subnormal (or zero): units of 2^-24
+        float a;
+        std::memcpy(&a, &absx, sizeof(a));
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(a * 16777216.0f)));
+    }
+    // Normal: rebias the exponent and round the mantissa to nearest even
+    uint32_t rounded = absx + 0xfffu + ((absx >> 13) & 1u);
+    return static_cast<uint16_t>(sign | ((rounded - 0x38000000u) >> 13));
+}
+
+float fp16ToFp32(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    uint32_t exp = (value >> 10) & 0x1fu;
+    uint32_t mant = value & 0x3ffu;
+    if (exp == 0) {
+        float f = static_cast<float>(mant) * 5.9604644775390625e-8f; // 2^-24
+        return sign ? -f : f;
+    }
+    uint32_t bits = (exp == 31) ? (sign | 0x7f800000u | (mant << 13))
+                                : (sign | ((exp + 112u) << 23) | (mant << 13));
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+namespace {
+
+// ---- scalar kernels ----
+
+void fp32ToFp16Scalar(const float* src, uint16_t* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = fp32ToFp16(src[i]);
+    }
+}
+
+void fp16ToFp32Scalar(const uint16_t* src, float* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = fp16ToFp32(src[i]);
+    }
+}
+
+void dequantizeQ8Block(const BlockQ8_0& block, float* dst, size_t n) {
+    float d = fp16ToFp32(block.d);
+    for (size_t j = 0; j < n; ++j) {
+        dst[j] = static_cast<float>(block.qs[j]) * d;
+    }
+}
+
+void quantizeQ8Row(const float* src, BlockQ8_0* dst, size_t n) {
+    // Quantization runs once per stored token, so the scalar path is enough
+    size_t blocks = (n + kQ8BlockSize - 1) / kQ8BlockSize;
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t begin = b * kQ8BlockSize;
+        size_t count = std::min(kQ8BlockSize, n - begin);
+        float amax = 0.0f;
+        for (size_t j = 0; j < count; ++j) {
+            amax = std::max(amax, std::fabs(src[begin + j]));
+        }
+        float d = amax / 127.0f;
+        float id = d > 0.0f ? 1.0f / d : 0.0f;
+        dst[b].d = fp32ToFp16(d);
+        for (size_t j = 0; j < count; ++j) {
+            dst[b].qs[j] = static_cast<int8_t>(std::nearbyint(src[begin + j] * id));
+        }
+        for (size_t j = count; j < kQ8BlockSize; ++j) {
+            dst[b].qs[j] = 0;
+        }
+    }
+}
+
+// ---- SIMD kernels ----
+
+#if defined(DUOROU_KV_X86_SIMD)
+
+bool hasAvx2F16c() {
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+    return supported;
+}
+
+__attribute__((target("avx2,f16c")))
+void fp32ToFp16Avx2(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    fp32ToFp16Scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2,f16c")))
+void fp16ToFp32Avx2(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    fp16ToFp32Scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2,f16c")))
+void dequantizeQ8Avx2(const BlockQ8_0* src, float* dst, size_t n) {
+    size_t full = n / kQ8BlockSize;
+    for (size_t b = 0; b < full; ++b) {
+        __m256 d = _mm256_set1_ps(_cvtsh_ss(src[b].d));
+        float* out = dst + b * kQ8BlockSize;
+        for (size_t j = 0; j < kQ8BlockSize; j += 8) {
+            __m128i q8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src[b].qs + j));
+            __m256 q = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q8));
+            _mm256_storeu_ps(out + j, _mm256_mul_ps(q, d));
+        }
+    }
+    if (full * kQ8BlockSize < n) {
+        dequantizeQ8Block(src[full], dst + full * kQ8BlockSize, n - full * kQ8BlockSize);
+    }
+}
+
+#elif defined(DUOROU_KV_NEON)
+
+void fp32ToFp16Neon(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float16x4_t h = vcvt_f16_f32(vld1q_f32(src + i));
+        vst1_u16(dst + i, vreinterpret_u16_f16(h));
+    }
+    fp32ToFp16Scalar(src + i, dst + i, n - i);
+}
+
+void fp16ToFp32Neon(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float16x4_t h = vreinterpret_f16_u16(vld1_u16(src + i));
+        vst1q_f32(dst + i, vcvt_f32_f16(h));
+    }
+    fp16ToFp32Scalar(src + i, dst + i, n - i);
+}
+
+void dequantizeQ8Neon(const BlockQ8_0* src, float* dst, size_t n) {
+    size_t full = n / kQ8BlockSize;
+    for (size_t b = 0; b < full; ++b) {
+        float d = fp16ToFp32(src[b].d);
+        float* out = dst + b * kQ8BlockSize;
+        for (size_t j = 0; j < kQ8BlockSize; j += 16) {
+            int8x16_t q = vld1q_s8(src[b].qs + j);
+            int16x8_t lo = vmovl_s8(vget_low_s8(q));
+            int16x8_t hi = vmovl_s8(vget_high_s8(q));
+            vst1q_f32(out + j + 0, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))), d));
+            vst1q_f32(out + j + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), d));
+            vst1q_f32(out + j + 8, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))), d));
+            vst1q_f32(out + j + 12, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), d));
+        }
+    }
+    if (full * kQ8BlockSize < n) {
+        dequantizeQ8Block(src[full], dst + full * kQ8BlockSize, n - full * kQ8BlockSize);
+    }
+}
+
+#endif
+
+void fp32ToFp16Row(const float* src, uint16_t* dst, size_t n) {
+#if defined(DUOROU_KV_X86_SIMD)
+    if (hasAvx2F16c()) {
+        fp32ToFp16Avx2(src, dst, n);
+        return;
+    }
+#elif defined(DUOROU_KV_NEON)
+    fp32ToFp16Neon(src, dst, n);
+    return;
+#endif
+    fp32ToFp16Scalar(src, dst, n);
+}
+
+void fp16ToFp32Row(const uint16_t* src, float* dst, size_t n) {
+#if defined(DUOROU_KV_X86_SIMD)
+    if (hasAvx2F16c()) {
+        fp16ToFp32Avx2(src, dst, n);
+        return;
+    }
+#elif defined(DUOROU_KV_NEON)
+    fp16ToFp32Neon(src, dst, n);
+    return;
+#endif
+    fp16ToFp32Scalar(src, dst, n);
+}
+
+void dequantizeQ8Row(const BlockQ8_0* src, float* dst, size_t n) {
+#if defined(DUOROU_KV_X86_SIMD)
+    if (hasAvx2F16c()) {
+        dequantizeQ8Avx2(src, dst, n);
+        return;
+    }
+#elif defined(DUOROU_KV_NEON)
+    dequantizeQ8Neon(src, dst, n);
+    return;
+#endif
+    size_t blocks = (n + kQ8BlockSize - 1) / kQ8BlockSize;
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t begin = b * kQ8BlockSize;
+        dequantizeQ8Block(src[b], dst + begin, std::min(kQ8BlockSize, n - begin));
+    }
+}
+
+} // namespace
+
+bool isKVStorageType(DType dtype) {
+    return dtype == DType::FLOAT32 || dtype == DType::FLOAT16 || dtype == DType::Q8_0;
+}
+
+void quantizeRow(DType dtype, const float* src, void* dst, size_t n) {
+    switch (dtype) {
+        case DType::FLOAT32:
+            std::memcpy(dst, src, n * sizeof(float));
+            return;
+        case DType::FLOAT16:
+            fp32ToFp16Row(src, static_cast<uint16_t*>(dst), n);
+            return;
+        case DType::Q8_0:
+            quantizeQ8Row(src, static_cast<BlockQ8_0*>(dst), n);
+            return;
+        default:
+            throw CacheError("quantizeRow: unsupported KV storage type");
+    }
+}
+
+void dequantizeRow(DType dtype, const void* src, float* dst, size_t n) {
+    switch (dtype) {
+        case DType::FLOAT32:
+            std::memcpy(dst, src, n * sizeof(float));
+            return;
+        case DType::FLOAT16:
+            fp16ToFp32Row(static_cast<const uint16_t*>(src), dst, n);
+            return;
+        case DType::Q8_0:
+            dequantizeQ8Row(static_cast<const BlockQ8_0*>(src), dst, n);
+            return;
+        default:
+            throw CacheError("dequantizeRow: unsupported KV storage type");
+    }
+}
+
+} // namespace kvcache
+} // namespace duorou
@@ -0,0 +1,40 @@
+#ifndef DUOROU_KVCACHE_KV_QUANT_H
+#define DUOROU_KVCACHE_KV_QUANT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "cache.h"
+
+namespace duorou {
+namespace kvcache {
+
+// Reduced-precision KV storage kernels.
+// FLOAT16 stores IEEE half values; Q8_0 stores blocks of 32 int8 values with
+// one fp16 scale (same layout as ggml's q8_0). Rows whose length is not a
+// multiple of 32 are zero padded to a whole block.
+
+constexpr size_t kQ8BlockSize = 32;
+
+struct BlockQ8_0 {
+    uint16_t d;                 // fp16 scale
+    int8_t qs[kQ8BlockSize];    // quantized values
+};
+static_assert(sizeof(BlockQ8_0) == 34, "unexpected BlockQ8_0 padding");
+
+// Whether CausalCache can store K/V in this type
+bool isKVStorageType(DType dtype);
+
+// float32 row -> storage row (FLOAT32 is a plain copy)
+void quantizeRow(DType dtype, const float* src, void* dst, size_t n);
+
+// storage row -> float32 row
+void dequantizeRow(DType dtype, const void* src, float* dst, size_t n);
+
+// Scalar IEEE half conversions (round to nearest even)
+uint16_t fp32ToFp16(float value);
+float fp16ToFp32(uint16_t value);
+
+} // namespace kvcache
+} // namespace duorou
+
+#endif // DUOROU_KVCACHE_KV_QUANT_H
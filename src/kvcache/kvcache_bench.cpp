@@ -0,0 +1,162 @@
+// KV cache layout micro-benchmark.
+// Compares the previous contiguous std::vector<float> layout (append via
+// resize, sliding-window eviction via erase) with the paged CausalCache.
+//
+// Also reports pool usage when forking one long prompt into several
+// copy-on-write branches via copyPrefix, and the memory / get() cost of
+// FLOAT16 and Q8_0 KV storage.
+//
+// Usage: kvcache_bench [heads] [head_dim] [window]
+
+#include "causal.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace duorou::kvcache;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Reproduction of the pre-paging CausalCache storage for one layer
+struct VectorKV {
+    std::vector<float> k;
+    std::vector<float> v;
+    int32_t length = 0;
+
+    void append(const float* kSrc, const float* vSrc, size_t perTok, int window) {
+        size_t old = k.size();
+        k.resize(old + perTok);
+        v.resize(old + perTok);
+        std::copy(kSrc, kSrc + perTok, k.begin() + static_cast<std::ptrdiff_t>(old));
+        std::copy(vSrc, vSrc + perTok, v.begin() + static_cast<std::ptrdiff_t>(old));
+        ++length;
+        if (window > 0 && length > window) {
+            k.erase(k.begin(), k.begin() + static_cast<std::ptrdiff_t>(perTok));
+            v.erase(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(perTok));
+            length = window;
+        }
+    }
+};
+
+double runVector(int tokens, int heads, int headDim, int window) {
+    size_t perTok = static_cast<size_t>(heads) * headDim;
+    std::vector<float> k(perTok, 1.0f), v(perTok, 2.0f);
+    VectorKV kv;
+    auto start = Clock::now();
+    for (int t = 0; t < tokens; ++t) {
+        kv.append(k.data(), v.data(), perTok, window);
+    }
+    return elapsedMs(start);
+}
+
+double runPaged(int tokens, int heads, int headDim, int window, size_t* usedBlocks) {
+    CausalOptions options;
+    if (window > 0) {
+        options.slidingWindow = window;
+        options.enableSlidingWindow = true;
+    }
+    CausalCache cache(options);
+    Context ctx(nullptr);
+    CacheConfig config;
+    config.numLayers = 1;
+    config.numHeads = heads;
+    config.headDim = headDim;
+    config.maxSeqLen = tokens;
+    cache.init(ctx, config);
+    cache.setLayer(0);
+
+    Tensor k({1, 1, heads, headDim}, DType::FLOAT32);
+    Tensor v({1, 1, heads, headDim}, DType::FLOAT32);
+    auto start = Clock::now();
+    for (int t = 0; t < tokens; ++t) {
+        cache.put(ctx, k, v);
+    }
+    double ms = elapsedMs(start);
+    *usedBlocks = cache.blockPool().usedBlocks();
+    return ms;
+}
+
+// Prefill one prompt, then fork it into `branches` sequences
+void runFork(int tokens, int heads, int headDim, int branches) {
+    CausalCache cache;
+    Context ctx(nullptr);
+    CacheConfig config;
+    config.numLayers = 1;
+    config.numHeads = heads;
+    config.headDim = headDim;
+    config.maxSeqLen = tokens;
+    cache.init(ctx, config);
+    cache.setLayer(0);
+    cache.addSequence(0, tokens);
+
+    Tensor k({1, tokens, heads, headDim}, DType::FLOAT32);
+    Tensor v({1, tokens, heads, headDim}, DType::FLOAT32);
+    cache.put(ctx, k, v);
+    size_t prefill = cache.blockPool().usedBlocks();
+    auto start = Clock::now();
+    for (int b = 1; b <= branches; ++b) {
+        cache.copyPrefix(ctx, 0, b, tokens);
+    }
+    double ms = elapsedMs(start);
+    std::printf("fork %d x %d tokens: %.3f ms, blocks %zu (prefill %zu, unshared %zu)\n",
+                branches, tokens, ms, cache.blockPool().usedBlocks(), prefill,
+                prefill * static_cast<size_t>(branches + 1));
+}
+
+// Store `tokens` tokens in the given storage type and time a full get()
+void runStorage(int tokens, int heads, int headDim, DType dtype, const char* name) {
+    CausalCache cache;
+    Context ctx(nullptr);
+    CacheConfig config;
+    config.numLayers = 1;
+    config.numHeads = heads;
+    config.headDim = headDim;
+    config.maxSeqLen = tokens;
+    config.dtype = dtype;
+    cache.init(ctx, config);
+    cache.setLayer(0);
+
+    Tensor k({1, tokens, heads, headDim}, DType::FLOAT32);
+    Tensor v({1, tokens, heads, headDim}, DType::FLOAT32);
+    auto start = Clock::now();
+    cache.put(ctx, k, v);
+    double putMs = elapsedMs(start);
+    start = Clock::now();
+    auto kv = cache.get(ctx, 0, 0, tokens);
+    double getMs = elapsedMs(start);
+    std::printf("%-8s %8d tokens: put %8.2f ms, get %8.2f ms, %6zu bytes/token\n",
+                name, tokens, putMs, getMs, 2 * cache.blockPool().tokenBytes());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int heads = argc > 1 ? std::atoi(argv[1]) : 8;
+    int headDim = argc > 2 ? std::atoi(argv[2]) : 128;
+    int window = argc > 3 ? std::atoi(argv[3]) : 1024;
+    const int lengths[] = {2048, 8192, 32768};
+
+    std::printf("heads=%d head_dim=%d (single layer, one token per put)\n", heads, headDim);
+    std::printf("%-8s %-10s %12s %12s %10s\n", "tokens", "window", "vector ms", "paged ms", "blocks");
+    for (int tokens : lengths) {
+        for (int w : {0, window}) {
+            size_t blocks = 0;
+            double vecMs = runVector(tokens, heads, headDim, w);
+            double pagedMs = runPaged(tokens, heads, headDim, w, &blocks);
+            std::printf("%-8d %-10d %12.2f %12.2f %10zu\n", tokens, w, vecMs, pagedMs, blocks);
+        }
+    }
+    runFork(8192, heads, headDim, 8);
+    runStorage(8192, heads, headDim, DType::FLOAT32, "f32");
+    runStorage(8192, heads, headDim, DType::FLOAT16, "f16");
+    runStorage(8192, heads, headDim, DType::Q8_0, "q8_0");
+    return 0;
+}
@@ -0,0 +1,215 @@
+// CausalCache unit test: copy-on-write prefix sharing, routing of batched
+// puts to interleaved sequences, and FLOAT16 / Q8_0 storage round trips.
+// Runs on the host (no backend) with small shapes.
+
+#include "causal.h"
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace duorou::kvcache;
+
+namespace {
+
+constexpr int kHeads = 2;
+constexpr int kHeadDim = 32;
+constexpr int kPerTok = kHeads * kHeadDim;
+
+int failed = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        ++failed;
+        std::fprintf(stderr, "[KVCache] FAILED: %s\n", what.c_str());
+    }
+}
+
+// Distinct value for every (sequence, position, element); values differ in
+// sign, so K and V of different tokens never coincide
+float keyAt(int seq, int pos, int i) {
+    return std::sin(0.37f * static_cast<float>(seq * 1000 + pos * kPerTok + i));
+}
+
+float valueAt(int seq, int pos, int i) {
+    return -keyAt(seq, pos, i) * 0.5f;
+}
+
+// [1, count, H, D] key/value tensors for positions [first, first + count)
+void fillTokens(Tensor& k, Tensor& v, size_t offset, int seq, int first, int count) {
+    float* kd = static_cast<float*>(k.data()) + offset * kPerTok;
+    float* vd = static_cast<float*>(v.data()) + offset * kPerTok;
+    for (int t = 0; t < count; ++t) {
+        for (int i = 0; i < kPerTok; ++i) {
+            kd[t * kPerTok + i] = keyAt(seq, first + t, i);
+            vd[t * kPerTok + i] = valueAt(seq, first + t, i);
+        }
+    }
+}
+
+void putTokens(CausalCache& cache, Context& ctx, int seq, int first, int count) {
+    Batch batch;
+    batch.seqs = {seq};
+    batch.seqLens = {count};
+    cache.startForward(ctx, batch, false);
+    Tensor k({1, count, kHeads, kHeadDim}, DType::FLOAT32);
+    Tensor v({1, count, kHeads, kHeadDim}, DType::FLOAT32);
+    fillTokens(k, v, 0, seq, first, count);
+    cache.put(ctx, k, v);
+}
+
+// Largest |cached - expected| over the whole sequence, where `source(pos)`
+// names the sequence whose values were written at that position
+template <typename Source>
+float maxError(CausalCache& cache, Context& ctx, int seq, int length, Source source) {
+    auto kv = cache.get(ctx, seq, 0, length);
+    const Tensor& k = std::get<0>(kv);
+    const Tensor& v = std::get<1>(kv);
+    if (k.shape().size() != 4 || k.shape()[1] != length) {
+        return INFINITY;
+    }
+    const float* kd = static_cast<const float*>(k.data());
+    const float* vd = static_cast<const float*>(v.data());
+    float err = 0.0f;
+    for (int t = 0; t < length; ++t) {
+        for (int i = 0; i < kPerTok; ++i) {
+            err = std::max(err, std::fabs(kd[t * kPerTok + i] - keyAt(source(t), t, i)));
+            err = std::max(err, std::fabs(vd[t * kPerTok + i] - valueAt(source(t), t, i)));
+        }
+    }
+    return err;
+}
+
+CacheConfig smallConfig(DType dtype = DType::FLOAT32) {
+    CacheConfig config;
+    config.numLayers = 1;
+    config.numHeads = kHeads;
+    config.headDim = kHeadDim;
+    config.maxSeqLen = 4096;
+    config.dtype = dtype;
+    return config;
+}
+
+// Fork a 20-token prompt (one full block plus a partly filled tail), then
+// extend both branches: each must see only its own suffix.
+void testCopyPrefix() {
+    CausalCache cache;
+    Context ctx(nullptr);
+    cache.init(ctx, smallConfig());
+    cache.setLayer(0);
+    check(cache.blockPool().totalBlocks() == 0, "pool reserves nothing before the first put");
+
+    putTokens(cache, ctx, 0, 0, 20);
+    const size_t prefill = cache.blockPool().usedBlocks();
+    cache.copyPrefix(ctx, 0, 1, 20);
+    check(cache.blockPool().usedBlocks() == prefill, "copyPrefix shares blocks instead of copying");
+    check(cache.getSequenceLength(1) == 20, "forked sequence has the prefix length");
+
+    // Branch 1 writes its own token 20, then branch 0 does the same
+    putTokens(cache, ctx, 1, 20, 1);
+    putTokens(cache, ctx, 0, 20, 1);
+    auto same = [](int) { return 0; };
+    auto forked = [](int pos) { return pos < 20 ? 0 : 1; };
+    check(maxError(cache, ctx, 0, 21, same) == 0.0f, "source branch unchanged by the fork's write");
+    check(maxError(cache, ctx, 1, 21, forked) == 0.0f, "fork keeps the prefix and its own suffix");
+    check(cache.blockPool().usedBlocks() == prefill + 1,
+          "only the shared tail block is copied on write");
+
+    cache.removeSequence(1);
+    check(maxError(cache, ctx, 0, 21, same) == 0.0f, "removing the fork leaves the source intact");
+    cache.removeSequence(0);
+    check(cache.blockPool().usedBlocks() == 0, "all blocks return to the pool");
+}
+
+// Two sequences fed through one batch (padded and flattened layouts) and
+// then alternately one token at a time
+void testInterleaved() {
+    CausalCache cache;
+    Context ctx(nullptr);
+    cache.init(ctx, smallConfig());
+    cache.setLayer(0);
+
+    // Padded: one [2, 3, H, D] tensor, row i for seqs[i]
+    Batch batch;
+    batch.seqs = {3, 7};
+    batch.seqLens = {3, 3};
+    cache.startForward(ctx, batch, false);
+    {
+        Tensor k({2, 3, kHeads, kHeadDim}, DType::FLOAT32);
+        Tensor v({2, 3, kHeads, kHeadDim}, DType::FLOAT32);
+        fillTokens(k, v, 0, 3, 0, 3);
+        fillTokens(k, v, 3, 7, 0, 3);
+        cache.put(ctx, k, v);
+    }
+
+    // Flattened: [1, 2 + 5, H, D] in batch order, uneven lengths
+    batch.seqLens = {2, 5};
+    cache.startForward(ctx, batch, false);
+    {
+        Tensor k({1, 7, kHeads, kHeadDim}, DType::FLOAT32);
+        Tensor v({1, 7, kHeads, kHeadDim}, DType::FLOAT32);
+        fillTokens(k, v, 0, 3, 3, 2);
+        fillTokens(k, v, 2, 7, 3, 5);
+        cache.put(ctx, k, v);
+    }
+
+    // Decode steps alternating between the two sequences
+    int len3 = 5;
+    int len7 = 8;
+    for (int step = 0; step < 20; ++step) {
+        if (step % 2 == 0) {
+            putTokens(cache, ctx, 3, len3++, 1);
+        } else {
+            putTokens(cache, ctx, 7, len7++, 1);
+        }
+    }
+
+    auto seq3 = [](int) { return 3; };
+    auto seq7 = [](int) { return 7; };
+    check(cache.getSequenceLength(3) == len3 && cache.getSequenceLength(7) == len7,
+          "interleaved sequences track their own lengths");
+    check(maxError(cache, ctx, 3, len3, seq3) == 0.0f, "sequence 3 reads back its own tokens");
+    check(maxError(cache, ctx, 7, len7, seq7) == 0.0f, "sequence 7 reads back its own tokens");
+}
+
+// Reduced-precision storage: get() must return the stored K/V within the
+// precision of the type
+void testStorage(DType dtype, const char* name, float tolerance) {
+    CausalCache cache;
+    Context ctx(nullptr);
+    cache.init(ctx, smallConfig(dtype));
+    cache.setLayer(0);
+    // Spans a block boundary, with a prefill and single-token appends
+    putTokens(cache, ctx, 0, 0, 18);
+    putTokens(cache, ctx, 0, 18, 1);
+    putTokens(cache, ctx, 0, 19, 1);
+    const float err = maxError(cache, ctx, 0, 20, [](int) { return 0; });
+    check(err <= tolerance, std::string(name) + " round trip within tolerance (max error " +
+                                std::to_string(err) + ")");
+    check(cache.blockPool().tokenBytes() == dtypeBytes(dtype, kPerTok),
+          std::string(name) + " blocks use the storage type's row size");
+}
+
+} // namespace
+
+int main() {
+    try {
+        testCopyPrefix();
+        testInterleaved();
+        testStorage(DType::FLOAT32, "f32", 0.0f);
+        // Values lie in [-1, 1]: half precision keeps ~11 bits, Q8_0 one
+        // step of max|x| / 127 per 32-value block
+        testStorage(DType::FLOAT16, "f16", 1.0f / 1024.0f);
+        testStorage(DType::Q8_0, "q8_0", 1.0f / 127.0f);
+    } catch (const CacheError& e) {
+        std::fprintf(stderr, "[KVCache] unexpected error: %s\n", e.what());
+        return 1;
+    }
+    if (failed > 0) {
+        std::fprintf(stderr, "[KVCache] %d check(s) failed\n", failed);
+        return 1;
+    }
+    std::printf("[KVCache] all checks passed\n");
+    return 0;
+}
@@ -4,8 +4,10 @@
 #include <ggml.h>
 #include <ggml-cpu.h>
 #include "tensor.h"
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <new>
 #include <iostream>
 #include <thread>
 #include <string>
@@ -20,7 +22,12 @@ namespace ml {
 Context::Context(Backend *backend)
     : backend_(backend), gradientEnabled_(false), profilingEnabled_(false) {}
 
-Context::~Context() { releaseTempTensors(); }
+Context::~Context() {
+  releaseTempTensors();
+  if (scratchCtx_) {
+    ggml_free(scratchCtx_);
+  }
+}
 
 void Context::setBackend(Backend *backend) { backend_ = backend; }
 
@@ -29,7 +36,7 @@ ggml_context *Context::ggml_ctx() const {
   return gb ? gb->ggml_ctx() : nullptr;
 }
 
-void Context::compute(ggml_cgraph *gf) const {
+void Context::compute(ggml_cgraph *gf) {
   unsigned n_threads = 4;
   // 允许通过环境变量覆盖线程数
   if (const char *env = std::getenv("DUOROU_NUM_THREADS")) {
@@ -50,15 +57,19 @@ void Context::compute(ggml_cgraph *gf) const {
   }
 
   // 使用 plan/work_data，避免将工作区占用到上下文内存池，降低 OOM 风险
+  // 工作区在多次 compute 之间复用，只在需要更大空间时重新分配
   ggml_cplan plan = ggml_graph_plan(gf, (int)n_threads, /*threadpool*/ nullptr);
-  std::unique_ptr<uint8_t, void(*)(void*)> work_buf(nullptr, [](void* p){ if (p) std::free(p); });
   if (plan.work_size > 0) {
-    void *buf = std::malloc(plan.work_size);
-    if (!buf) {
-      throw std::runtime_error("Context::compute: failed to allocate work buffer");
+    if (plan.work_size > workSize_) {
+      workBuffer_.reset();
+      workBuffer_.reset(new (std::nothrow) uint8_t[plan.work_size]);
+      if (!workBuffer_) {
+        workSize_ = 0;
+        throw std::runtime_error("Context::compute: failed to allocate work buffer");
+      }
+      workSize_ = plan.work_size;
     }
-    plan.work_data = reinterpret_cast<uint8_t*>(buf);
-    work_buf.reset(reinterpret_cast<uint8_t*>(buf));
+    plan.work_data = workBuffer_.get();
   }
 
   ggml_status st = ggml_graph_compute(gf, &plan);
@@ -73,6 +84,27 @@ void Context::compute(ggml_cgraph *gf) const {
   }
 }
 
+ggml_context *Context::scratchContext(size_t bytes) {
+  if (scratchCtx_ && bytes <= scratchSize_) {
+    ggml_reset(scratchCtx_);
+    return scratchCtx_;
+  }
+  // Grow with headroom so slowly increasing sizes do not reallocate each time
+  size_t size = std::max(bytes, scratchSize_ + scratchSize_ / 2);
+  if (scratchCtx_) {
+    ggml_free(scratchCtx_);
+    scratchCtx_ = nullptr;
+    scratchSize_ = 0;
+  }
+  ggml_init_params params{ .mem_size = size, .mem_buffer = nullptr, .no_alloc = false };
+  scratchCtx_ = ggml_init(params);
+  if (!scratchCtx_) {
+    throw std::runtime_error("Context::scratchContext: ggml_init failed");
+  }
+  scratchSize_ = size;
+  return scratchCtx_;
+}
+
 void *Context::allocate(size_t bytes) {
   if (backend_) {
     return backend_->allocate(bytes);
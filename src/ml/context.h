@@ -17,6 +17,9 @@ class Tensor;
 enum class DataType;
 
 // Computation context class
+//
+// Not thread-safe: compute() and scratchContext() reuse buffers owned by the
+// context, so each thread needs its own Context.
 class Context {
 public:
   Context(Backend *backend = nullptr);
@@ -27,8 +30,14 @@ public:
   Backend *getBackend() const { return backend_; }
 
   // ggml compute graph
-  ggml_context *ggml_ctx() const;      // get ggml_context*
-  void compute(ggml_cgraph *gf) const; // process graph
+  ggml_context *ggml_ctx() const; // get ggml_context*
+  void compute(ggml_cgraph *gf);  // process graph (reuses the work buffer)
+
+  // Reusable scratch ggml context for single-op graphs (e.g. matmul).
+  // Holds at least `bytes` of memory and is reset on every call, so tensors
+  // created after the previous call become invalid. Grow-only.
+  ggml_context *scratchContext(size_t bytes);
+  size_t scratchCapacity() const { return scratchSize_; }
 
   // Memory management
   void *allocate(size_t bytes);
@@ -63,6 +72,13 @@ private:
 
   // Performance statistics
   mutable std::unordered_map<std::string, double> timingStats_;
+
+  // Scratch arena and graph work buffer, kept across ops instead of being
+  // reallocated each time
+  ggml_context *scratchCtx_{nullptr};
+  size_t scratchSize_{0};
+  std::unique_ptr<uint8_t[]> workBuffer_;
+  size_t workSize_{0};
 };
 
 } // namespace ml
@@ -0,0 +1,536 @@
+#include "gemm.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DUOROU_GEMM_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DUOROU_GEMM_NEON 1
+#endif
+
+namespace duorou {
+namespace ml {
+
+namespace {
+
+// Cache blocking: a KC x NC panel of B stays in L2/L3, an MC x KC block
+// of A in L1/L2. MC/NC are rounded to the kernel's MR/NR.
+constexpr int64_t kKC = 256;
+constexpr int64_t kMC = 96;
+constexpr int64_t kNC = 2048;
+
+// Below this many multiply-adds the work is not split across threads
+constexpr int64_t kParallelMinMacs = 1 << 18;
+
+// Rows of A handled by the streaming (non-packed) path; packing B costs
+// more than it saves when only a few rows reuse it
+constexpr int64_t kSmallM = 4;
+
+// Micro-kernel: acc[MR][NR] = sum_k pa[k*MR + i] * pb[k*NR + j], then
+// C = acc (accumulate == false) or C += acc
+using MicroKernel = void (*)(int64_t kc, const float *pa, const float *pb,
+                             float *c, int64_t ldc, bool accumulate);
+
+// GEMV kernel: out[i] = rows[i] . x over n floats for kGemvRows rows, so
+// every load of x feeds several weight rows
+constexpr int kGemvRows = 4;
+using DotRowsKernel = void (*)(const float *const *rows, const float *x,
+                               int64_t n, float *out);
+
+struct KernelInfo {
+  const char *name;
+  int mr;
+  int nr;
+  MicroKernel fn;
+  DotRowsKernel dotRows;
+};
+
+// ---- generic kernel ----
+
+constexpr int kGenericMR = 4;
+constexpr int kGenericNR = 8;
+
+void kernelGeneric(int64_t kc, const float *pa, const float *pb, float *c,
+                   int64_t ldc, bool accumulate) {
+  float acc[kGenericMR][kGenericNR] = {};
+  for (int64_t k = 0; k < kc; ++k) {
+    for (int i = 0; i < kGenericMR; ++i) {
+      const float a = pa[i];
+      for (int j = 0; j < kGenericNR; ++j) {
+        acc[i][j] += a * pb[j];
+      }
+    }
+    pa += kGenericMR;
+    pb += kGenericNR;
+  }
+  for (int i = 0; i < kGenericMR; ++i) {
+    float *ci = c + i * ldc;
+    for (int j = 0; j < kGenericNR; ++j) {
+      ci[j] = accumulate ? ci[j] + acc[i][j] : acc[i][j];
+    }
+  }
+}
+
+void dotRowsGeneric(const float *const *rows, const float *x, int64_t n,
+                    float *out) {
+  const float *r0 = rows[0];
+  const float *r1 = rows[1];
+  const float *r2 = rows[2];
+  const float *r3 = rows[3];
+  float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+  for (int64_t k = 0; k < n; ++k) {
+    const float xk = x[k];
+    a0 += r0[k] * xk;
+    a1 += r1[k] * xk;
+    a2 += r2[k] * xk;
+    a3 += r3[k] * xk;
+  }
+  out[0] = a0;
+  out[1] = a1;
+  out[2] = a2;
+  out[3] = a3;
+}
+
+#if defined(DUOROU_GEMM_X86)
+
+__attribute__((target("avx2"))) inline float hsum256(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+// 4 rows x 16 floats per step: 8 ymm accumulators, x loaded once
+__attribute__((target("avx2,fma"))) void
+dotRowsAvx2(const float *const *rows, const float *x, int64_t n, float *out) {
+  __m256 acc[kGemvRows][2];
+  for (int i = 0; i < kGemvRows; ++i) {
+    acc[i][0] = _mm256_setzero_ps();
+    acc[i][1] = _mm256_setzero_ps();
+  }
+  int64_t k = 0;
+  for (; k + 16 <= n; k += 16) {
+    const __m256 x0 = _mm256_loadu_ps(x + k);
+    const __m256 x1 = _mm256_loadu_ps(x + k + 8);
+    for (int i = 0; i < kGemvRows; ++i) {
+      acc[i][0] = _mm256_fmadd_ps(_mm256_loadu_ps(rows[i] + k), x0, acc[i][0]);
+      acc[i][1] =
+          _mm256_fmadd_ps(_mm256_loadu_ps(rows[i] + k + 8), x1, acc[i][1]);
+    }
+  }
+  for (int i = 0; i < kGemvRows; ++i) {
+    float sum = hsum256(_mm256_add_ps(acc[i][0], acc[i][1]));
+    for (int64_t t = k; t < n; ++t) {
+      sum += rows[i][t] * x[t];
+    }
+    out[i] = sum;
+  }
+}
+
+// 4 rows x 32 floats per step: 8 zmm accumulators
+__attribute__((target("avx512f"))) void
+dotRowsAvx512(const float *const *rows, const float *x, int64_t n,
+              float *out) {
+  __m512 acc[kGemvRows][2];
+  for (int i = 0; i < kGemvRows; ++i) {
+    acc[i][0] = _mm512_setzero_ps();
+    acc[i][1] = _mm512_setzero_ps();
+  }
+  int64_t k = 0;
+  for (; k + 32 <= n; k += 32) {
+    const __m512 x0 = _mm512_loadu_ps(x + k);
+    const __m512 x1 = _mm512_loadu_ps(x + k + 16);
+    for (int i = 0; i < kGemvRows; ++i) {
+      acc[i][0] = _mm512_fmadd_ps(_mm512_loadu_ps(rows[i] + k), x0, acc[i][0]);
+      acc[i][1] =
+          _mm512_fmadd_ps(_mm512_loadu_ps(rows[i] + k + 16), x1, acc[i][1]);
+    }
+  }
+  for (int i = 0; i < kGemvRows; ++i) {
+    float lanes[16];
+    _mm512_storeu_ps(lanes, _mm512_add_ps(acc[i][0], acc[i][1]));
+    float sum = 0.0f;
+    for (float lane : lanes) {
+      sum += lane;
+    }
+    for (int64_t t = k; t < n; ++t) {
+      sum += rows[i][t] * x[t];
+    }
+    out[i] = sum;
+  }
+}
+
+// 6x16: 12 ymm accumulators + 2 for B + 1 broadcast
+__attribute__((target("avx2,fma"))) void
+kernelAvx2(int64_t kc, const float *pa, const float *pb, float *c, int64_t ldc,
+           bool accumulate) {
+  __m256 acc[6][2];
+  for (int i = 0; i < 6; ++i) {
+    acc[i][0] = _mm256_setzero_ps();
+    acc[i][1] = _mm256_setzero_ps();
+  }
+  for (int64_t k = 0; k < kc; ++k) {
+    const __m256 b0 = _mm256_loadu_ps(pb);
+    const __m256 b1 = _mm256_loadu_ps(pb + 8);
+    for (int i = 0; i < 6; ++i) {
+      const __m256 a = _mm256_broadcast_ss(pa + i);
+      acc[i][0] = _mm256_fmadd_ps(a, b0, acc[i][0]);
+      acc[i][1] = _mm256_fmadd_ps(a, b1, acc[i][1]);
+    }
+    pa += 6;
+    pb += 16;
+  }
+  for (int i = 0; i < 6; ++i) {
+    float *ci = c + i * ldc;
+    if (accumulate) {
+      acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(ci));
+      acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(ci + 8));
+    }
+    _mm256_storeu_ps(ci, acc[i][0]);
+    _mm256_storeu_ps(ci + 8, acc[i][1]);
+  }
+}
+
+// 6x32: 12 zmm accumulators
+__attribute__((target("avx512f"))) void
+kernelAvx512(int64_t kc, const float *pa, const float *pb, float *c,
+             int64_t ldc, bool accumulate) {
+  __m512 acc[6][2];
+  for (int i = 0; i < 6; ++i) {
+    acc[i][0] = _mm512_setzero_ps();
+    acc[i][1] = _mm512_setzero_ps();
+  }
+  for (int64_t k = 0; k < kc; ++k) {
+    const __m512 b0 = _mm512_loadu_ps(pb);
+    const __m512 b1 = _mm512_loadu_ps(pb + 16);
+    for (int i = 0; i < 6; ++i) {
+      const __m512 a = _mm512_set1_ps(pa[i]);
+      acc[i][0] = _mm512_fmadd_ps(a, b0, acc[i][0]);
+      acc[i][1] = _mm512_fmadd_ps(a, b1, acc[i][1]);
+    }
+    pa += 6;
+    pb += 32;
+  }
+  for (int i = 0; i < 6; ++i) {
+    float *ci = c + i * ldc;
+    if (accumulate) {
+      acc[i][0] = _mm512_add_ps(acc[i][0], _mm512_loadu_ps(ci));
+      acc[i][1] = _mm512_add_ps(acc[i][1], _mm512_loadu_ps(ci + 16));
+    }
+    _mm512_storeu_ps(ci, acc[i][0]);
+    _mm512_storeu_ps(ci + 16, acc[i][1]);
+  }
+}
+
+#elif defined(DUOROU_GEMM_NEON)
+
+// 8x8: 16 q-register accumulators
+void kernelNeon(int64_t kc, const float *pa, const float *pb, float *c,
+                int64_t ldc, bool accumulate) {
+  float32x4_t acc[8][2];
+  for (int i = 0; i < 8; ++i) {
+    acc[i][0] = vdupq_n_f32(0.0f);
+    acc[i][1] = vdupq_n_f32(0.0f);
+  }
+  for (int64_t k = 0; k < kc; ++k) {
+    const float32x4_t b0 = vld1q_f32(pb);
+    const float32x4_t b1 = vld1q_f32(pb + 4);
+    const float32x4_t a0 = vld1q_f32(pa);
+    const float32x4_t a1 = vld1q_f32(pa + 4);
+    acc[0][0] = vfmaq_laneq_f32(acc[0][0], b0, a0, 0);
+    acc[0][1] = vfmaq_laneq_f32(acc[0][1], b1, a0, 0);
+    acc[1][0] = vfmaq_laneq_f32(acc[1][0], b0, a0, 1);
+    acc[1][1] = vfmaq_laneq_f32(acc[1][1], b1, a0, 1);
+    acc[2][0] = vfmaq_laneq_f32(acc[2][0], b0, a0, 2);
+    acc[2][1] = vfmaq_laneq_f32(acc[2][1], b1, a0, 2);
+    acc[3][0] = vfmaq_laneq_f32(acc[3][0], b0, a0, 3);
+    acc[3][1] = vfmaq_laneq_f32(acc[3][1], b1, a0, 3);
+    acc[4][0] = vfmaq_laneq_f32(acc[4][0], b0, a1, 0);
+    acc[4][1] = vfmaq_laneq_f32(acc[4][1], b1, a1, 0);
+    acc[5][0] = vfmaq_laneq_f32(acc[5][0], b0, a1, 1);
+    acc[5][1] = vfmaq_laneq_f32(acc[5][1], b1, a1, 1);
+    acc[6][0] = vfmaq_laneq_f32(acc[6][0], b0, a1, 2);
+    acc[6][1] = vfmaq_laneq_f32(acc[6][1], b1, a1, 2);
+    acc[7][0] = vfmaq_laneq_f32(acc[7][0], b0, a1, 3);
+    acc[7][1] = vfmaq_laneq_f32(acc[7][1], b1, a1, 3);
+    pa += 8;
+    pb += 8;
+  }
+  for (int i = 0; i < 8; ++i) {
+    float *ci = c + i * ldc;
+    if (accumulate) {
+      acc[i][0] = vaddq_f32(acc[i][0], vld1q_f32(ci));
+      acc[i][1] = vaddq_f32(acc[i][1], vld1q_f32(ci + 4));
+    }
+    vst1q_f32(ci, acc[i][0]);
+    vst1q_f32(ci + 4, acc[i][1]);
+  }
+}
+
+// 4 rows x 8 floats per step: 8 q-register accumulators
+void dotRowsNeon(const float *const *rows, const float *x, int64_t n,
+                 float *out) {
+  float32x4_t acc[kGemvRows][2];
+  for (int i = 0; i < kGemvRows; ++i) {
+    acc[i][0] = vdupq_n_f32(0.0f);
+    acc[i][1] = vdupq_n_f32(0.0f);
+  }
+  int64_t k = 0;
+  for (; k + 8 <= n; k += 8) {
+    const float32x4_t x0 = vld1q_f32(x + k);
+    const float32x4_t x1 = vld1q_f32(x + k + 4);
+    for (int i = 0; i < kGemvRows; ++i) {
+      acc[i][0] = vfmaq_f32(acc[i][0], vld1q_f32(rows[i] + k), x0);
+      acc[i][1] = vfmaq_f32(acc[i][1], vld1q_f32(rows[i] + k + 4), x1);
+    }
+  }
+  for (int i = 0; i < kGemvRows; ++i) {
+    float sum = vaddvq_f32(vaddq_f32(acc[i][0], acc[i][1]));
+    for (int64_t t = k; t < n; ++t) {
+      sum += rows[i][t] * x[t];
+    }
+    out[i] = sum;
+  }
+}
+
+#endif
+
+KernelInfo detectKernel() {
+  const KernelInfo generic{"generic", kGenericMR, kGenericNR, kernelGeneric,
+                          dotRowsGeneric};
+  std::string forced;
+  if (const char *env = std::getenv("DUOROU_GEMM_KERNEL")) {
+    forced = env;
+  }
+  if (forced == "generic") {
+    return generic;
+  }
+#if defined(DUOROU_GEMM_X86)
+  if ((forced.empty() || forced == "avx512") &&
+      __builtin_cpu_supports("avx512f")) {
+    return {"avx512", 6, 32, kernelAvx512, dotRowsAvx512};
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return {"avx2", 6, 16, kernelAvx2, dotRowsAvx2};
+  }
+#elif defined(DUOROU_GEMM_NEON)
+  return {"neon", 8, 8, kernelNeon, dotRowsNeon};
+#endif
+  return generic;
+}
+
+const KernelInfo &kernel() {
+  static const KernelInfo info = detectKernel();
+  return info;
+}
+
+// Pack an mc x kc block of A into MR-row strips, zero padding the tail
+void packA(const float *A, int64_t lda, int64_t mc, int64_t kc, int mr,
+           float *out) {
+  for (int64_t i0 = 0; i0 < mc; i0 += mr) {
+    const int64_t rows = std::min<int64_t>(mr, mc - i0);
+    for (int64_t k = 0; k < kc; ++k) {
+      for (int64_t i = 0; i < rows; ++i) {
+        out[i] = A[(i0 + i) * lda + k];
+      }
+      for (int64_t i = rows; i < mr; ++i) {
+        out[i] = 0.0f;
+      }
+      out += mr;
+    }
+  }
+}
+
+// Pack a kc x nc panel of B into NR-column strips, zero padding the tail
+void packB(const float *B, int64_t ldb, int64_t kc, int64_t nc, int nr,
+           float *out) {
+  for (int64_t j0 = 0; j0 < nc; j0 += nr) {
+    const int64_t cols = std::min<int64_t>(nr, nc - j0);
+    for (int64_t k = 0; k < kc; ++k) {
+      const float *src = B + k * ldb + j0;
+      std::memcpy(out, src, static_cast<size_t>(cols) * sizeof(float));
+      for (int64_t j = cols; j < nr; ++j) {
+        out[j] = 0.0f;
+      }
+      out += nr;
+    }
+  }
+}
+
+void sgemmPacked(int64_t M, int64_t N, int64_t K, const float *A, int64_t lda,
+                 const float *B, int64_t ldb, float *C, int64_t ldc) {
+  const KernelInfo &kern = kernel();
+  const int mr = kern.mr;
+  const int nr = kern.nr;
+  const int64_t mcBlock = (kMC + mr - 1) / mr * mr;
+  const int64_t ncBlock = (kNC + nr - 1) / nr * nr;
+
+  // Per-thread packing buffers, reused across calls
+  thread_local std::vector<float> bufA;
+  thread_local std::vector<float> bufB;
+  bufA.resize(static_cast<size_t>(mcBlock * kKC));
+  bufB.resize(static_cast<size_t>(ncBlock * kKC));
+  float tile[32 * 32];
+
+  for (int64_t jc = 0; jc < N; jc += ncBlock) {
+    const int64_t nc = std::min(ncBlock, N - jc);
+    for (int64_t pc = 0; pc < K; pc += kKC) {
+      const int64_t kc = std::min(kKC, K - pc);
+      const bool accumulate = pc > 0;
+      packB(B + pc * ldb + jc, ldb, kc, nc, nr, bufB.data());
+      for (int64_t ic = 0; ic < M; ic += mcBlock) {
+        const int64_t mc = std::min(mcBlock, M - ic);
+        packA(A + ic * lda + pc, lda, mc, kc, mr, bufA.data());
+        for (int64_t jr = 0; jr < nc; jr += nr) {
+          const int64_t n = std::min<int64_t>(nr, nc - jr);
+          const float *pb = bufB.data() + jr * kc;
+          for (int64_t ir = 0; ir < mc; ir += mr) {
+            const int64_t m = std::min<int64_t>(mr, mc - ir);
+            const float *pa = bufA.data() + ir * kc;
+            float *c = C + (ic + ir) * ldc + jc + jr;
+            if (m == mr && n == nr) {
+              kern.fn(kc, pa, pb, c, ldc, accumulate);
+              continue;
+            }
+            // Edge tile: compute into scratch, copy the valid part
+            kern.fn(kc, pa, pb, tile, nr, false);
+            for (int64_t i = 0; i < m; ++i) {
+              for (int64_t j = 0; j < n; ++j) {
+                const float v = tile[i * nr + j];
+                c[i * ldc + j] = accumulate ? c[i * ldc + j] + v : v;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Few rows: stream B once per row, the inner loop vectorizes
+void sgemmSmallM(int64_t M, int64_t N, int64_t K, const float *A, int64_t lda,
+                 const float *B, int64_t ldb, float *C, int64_t ldc) {
+  for (int64_t i = 0; i < M; ++i) {
+    const float *Ai = A + i * lda;
+    float *Ci = C + i * ldc;
+    std::fill(Ci, Ci + N, 0.0f);
+    for (int64_t k = 0; k < K; ++k) {
+      const float a = Ai[k];
+      const float *Bk = B + k * ldb;
+      for (int64_t j = 0; j < N; ++j) {
+        Ci[j] += a * Bk[j];
+      }
+    }
+  }
+}
+
+void sgemmSerial(int64_t M, int64_t N, int64_t K, const float *A, int64_t lda,
+                 const float *B, int64_t ldb, float *C, int64_t ldc) {
+  if (K == 0) {
+    for (int64_t i = 0; i < M; ++i) {
+      std::fill(C + i * ldc, C + i * ldc + N, 0.0f);
+    }
+    return;
+  }
+  if (M <= kSmallM) {
+    sgemmSmallM(M, N, K, A, lda, B, ldb, C, ldc);
+  } else {
+    sgemmPacked(M, N, K, A, lda, B, ldb, C, ldc);
+  }
+}
+
+// y[i] = row(i) . x for i in [begin, end), kGemvRows rows per kernel call;
+// a short tail repeats its last row and drops the extra results
+template <typename RowFn>
+void gemvRange(RowFn row, const float *x, int64_t n, int64_t begin,
+               int64_t end, float *y) {
+  const DotRowsKernel dotRows = kernel().dotRows;
+  const float *rows[kGemvRows];
+  float out[kGemvRows];
+  for (int64_t i0 = begin; i0 < end; i0 += kGemvRows) {
+    const int64_t count = std::min<int64_t>(kGemvRows, end - i0);
+    for (int i = 0; i < kGemvRows; ++i) {
+      rows[i] = row(i0 + std::min<int64_t>(i, count - 1));
+    }
+    dotRows(rows, x, n, out);
+    for (int64_t i = 0; i < count; ++i) {
+      y[i0 + i] = out[i];
+    }
+  }
+}
+
+// Split `count` rows over the pool in whole kernel groups
+template <typename RowFn>
+void gemvParallel(RowFn row, int64_t count, const float *x, int64_t n,
+                  float *y, utils::ThreadPool *pool) {
+  if (!pool || pool->size() == 0 || count * n < kParallelMinMacs) {
+    gemvRange(row, x, n, 0, count, y);
+    return;
+  }
+  const size_t groups = static_cast<size_t>((count + kGemvRows - 1) / kGemvRows);
+  pool->parallelFor(groups, 16, [&](size_t begin, size_t end) {
+    gemvRange(row, x, n, static_cast<int64_t>(begin) * kGemvRows,
+              std::min(count, static_cast<int64_t>(end) * kGemvRows), y);
+  });
+}
+
+} // namespace
+
+void sgemm(int64_t M, int64_t N, int64_t K, const float *A, int64_t lda,
+           const float *B, int64_t ldb, float *C, int64_t ldc,
+           utils::ThreadPool *pool) {
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+  const int64_t macs = M * N * std::max<int64_t>(K, 1);
+  if (!pool || pool->size() == 0 || macs < kParallelMinMacs) {
+    sgemmSerial(M, N, K, A, lda, B, ldb, C, ldc);
+    return;
+  }
+
+  const KernelInfo &kern = kernel();
+  const size_t workers = pool->size() + 1;
+  // Split along the dimension that gives every worker whole tiles; decode
+  // shaped problems (tiny M) always split over N.
+  const bool splitM = M > kSmallM && M / kern.mr >= static_cast<int64_t>(workers);
+  if (splitM) {
+    const size_t tiles = static_cast<size_t>((M + kern.mr - 1) / kern.mr);
+    pool->parallelFor(tiles, 1, [&](size_t begin, size_t end) {
+      const int64_t i0 = static_cast<int64_t>(begin) * kern.mr;
+      const int64_t i1 = std::min(M, static_cast<int64_t>(end) * kern.mr);
+      sgemmSerial(i1 - i0, N, K, A + i0 * lda, lda, B, ldb, C + i0 * ldc, ldc);
+    });
+  } else {
+    // Column chunks are multiples of 16 floats to keep stores aligned to
+    // cache lines between workers
+    const int64_t unit = std::max<int64_t>(kern.nr, 16);
+    const size_t tiles = static_cast<size_t>((N + unit - 1) / unit);
+    pool->parallelFor(tiles, 1, [&](size_t begin, size_t end) {
+      const int64_t j0 = static_cast<int64_t>(begin) * unit;
+      const int64_t j1 = std::min(N, static_cast<int64_t>(end) * unit);
+      sgemmSerial(M, j1 - j0, K, A, lda, B + j0, ldb, C + j0, ldc);
+    });
+  }
+}
+
+void sgemv(int64_t rows, int64_t cols, const float *W, int64_t ldw,
+           const float *x, float *y, utils::ThreadPool *pool) {
+  if (rows <= 0) {
+    return;
+  }
+  gemvParallel([W, ldw](int64_t r) { return W + r * ldw; }, rows, x, cols, y,
+               pool);
+}
+
+const char *sgemmKernelName() { return kernel().name; }
+
+} // namespace ml
+} // namespace duorou
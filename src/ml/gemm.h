@@ -0,0 +1,38 @@
+#ifndef DUOROU_ML_GEMM_H
+#define DUOROU_ML_GEMM_H
+
+#include <cstdint>
+
+namespace duorou {
+namespace utils {
+class ThreadPool;
+}
+
+namespace ml {
+
+// Single-precision GEMM used by the CPU fallback of Tensor::matmul.
+//
+// C[M,N] = A[M,K] * B[K,N], all row-major with leading dimensions
+// lda/ldb/ldc. Cache-blocked (Goto/BLIS style packing) with a register
+// tiled micro-kernel picked at runtime: AVX-512F, AVX2+FMA, NEON, or a
+// portable scalar kernel. When `pool` is given, large problems are split
+// over M or N across its workers.
+void sgemm(int64_t M, int64_t N, int64_t K, const float *A, int64_t lda,
+           const float *B, int64_t ldb, float *C, int64_t ldc,
+           utils::ThreadPool *pool = nullptr);
+
+// Single-precision matrix-vector product y[rows] = W[rows, cols] x, W
+// row-major with leading dimension ldw. Each call streams several rows
+// against one load of x; rows are split across `pool` when given. This is
+// the decode-time shape of an LM head or any [out, in] weight.
+void sgemv(int64_t rows, int64_t cols, const float *W, int64_t ldw,
+           const float *x, float *y, utils::ThreadPool *pool = nullptr);
+
+// Name of the micro-kernel selected for this CPU ("avx512", "avx2",
+// "neon" or "generic")
+const char *sgemmKernelName();
+
+} // namespace ml
+} // namespace duorou
+
+#endif // DUOROU_ML_GEMM_H
@@ -0,0 +1,132 @@
+// GEMM micro-benchmark for the Tensor::matmul CPU fallback.
+// Sweeps M/N/K shapes of Qwen2/2.5 projections (0.5B/1.5B/7B hidden and
+// FFN sizes) for decode (M=1) and prefill sized M, comparing the previous
+// naive i-k-j loop with ml::sgemm single-threaded and on the thread pool.
+// Then the LM head GEMV (151936-token vocab) against the per-row scalar dot
+// it replaced.
+//
+// Usage: gemm_bench [max_m]
+
+#include "gemm.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void naiveGemm(int64_t M, int64_t N, int64_t K, const float *A, const float *B,
+               float *C) {
+  std::fill(C, C + M * N, 0.0f);
+  for (int64_t i = 0; i < M; ++i) {
+    for (int64_t k = 0; k < K; ++k) {
+      const float a = A[i * K + k];
+      for (int64_t j = 0; j < N; ++j) {
+        C[i * N + j] += a * B[k * N + j];
+      }
+    }
+  }
+}
+
+template <class F> double bestMs(F &&fn, int reps) {
+  double best = 1e30;
+  for (int r = 0; r < reps; ++r) {
+    auto t0 = Clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+  }
+  return best;
+}
+
+struct Shape {
+  const char *name;
+  int64_t N;
+  int64_t K;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int64_t maxM = argc > 1 ? std::atoll(argv[1]) : 128;
+  const Shape shapes[] = {
+      {"0.5b qkv", 896, 896},     {"0.5b ffn_up", 4864, 896},
+      {"0.5b ffn_down", 896, 4864}, {"1.5b ffn_up", 8960, 1536},
+      {"7b attn_o", 3584, 3584},  {"7b ffn_up", 18944, 3584},
+  };
+  const int64_t ms[] = {1, 16, 128, 512};
+
+  duorou::utils::ThreadPool &pool = duorou::utils::ThreadPool::global();
+  std::printf("kernel=%s threads=%zu\n", duorou::ml::sgemmKernelName(), pool.size() + 1);
+  std::printf("%-14s %5s %6s %6s %10s %10s %10s %9s\n", "shape", "M", "N", "K",
+              "naive GF", "1t GF", "mt GF", "max err");
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for (const Shape &s : shapes) {
+    for (int64_t M : ms) {
+      if (M > maxM) {
+        continue;
+      }
+      std::vector<float> A(static_cast<size_t>(M * s.K)), B(static_cast<size_t>(s.K * s.N));
+      std::vector<float> ref(static_cast<size_t>(M * s.N)), out(ref.size());
+      for (auto &v : A) v = dist(rng);
+      for (auto &v : B) v = dist(rng);
+
+      const double flops = 2.0 * M * s.N * s.K;
+      const int reps = flops > 1e10 ? 1 : 3;
+      double naive = bestMs([&] { naiveGemm(M, s.N, s.K, A.data(), B.data(), ref.data()); }, reps);
+      double single = bestMs([&] {
+        duorou::ml::sgemm(M, s.N, s.K, A.data(), s.K, B.data(), s.N, out.data(), s.N);
+      }, reps);
+      double multi = bestMs([&] {
+        duorou::ml::sgemm(M, s.N, s.K, A.data(), s.K, B.data(), s.N, out.data(), s.N, &pool);
+      }, reps);
+      float err = 0.0f;
+      for (size_t i = 0; i < ref.size(); ++i) {
+        err = std::max(err, std::fabs(ref[i] - out[i]));
+      }
+      std::printf("%-14s %5lld %6lld %6lld %10.2f %10.2f %10.2f %9.2e\n", s.name,
+                  static_cast<long long>(M), static_cast<long long>(s.N),
+                  static_cast<long long>(s.K), flops / naive / 1e6,
+                  flops / single / 1e6, flops / multi / 1e6, err);
+    }
+  }
+
+  std::printf("\n%-14s %6s %6s %10s %10s %10s\n", "lm head", "vocab",
+              "hidden", "naive ms", "1t ms", "mt ms");
+  const int64_t vocab = 151936;
+  for (int64_t hidden : {896, 1536}) {
+    std::vector<float> W(static_cast<size_t>(vocab * hidden));
+    std::vector<float> x(static_cast<size_t>(hidden));
+    std::vector<float> ref(static_cast<size_t>(vocab)), out(ref.size());
+    for (auto &v : W) v = dist(rng);
+    for (auto &v : x) v = dist(rng);
+
+    double naive = bestMs([&] {
+      for (int64_t v = 0; v < vocab; ++v) {
+        float sum = 0.0f;
+        for (int64_t i = 0; i < hidden; ++i) {
+          sum += x[i] * W[v * hidden + i];
+        }
+        ref[v] = sum;
+      }
+    }, 3);
+    double single = bestMs([&] {
+      duorou::ml::sgemv(vocab, hidden, W.data(), hidden, x.data(), out.data());
+    }, 3);
+    double multi = bestMs([&] {
+      duorou::ml::sgemv(vocab, hidden, W.data(), hidden, x.data(), out.data(), &pool);
+    }, 3);
+    std::printf("%-14s %6lld %6lld %10.2f %10.2f %10.2f\n", "",
+                static_cast<long long>(vocab), static_cast<long long>(hidden),
+                naive, single, multi);
+  }
+  return 0;
+}
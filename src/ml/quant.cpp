@@ -0,0 +1,557 @@
+#include "quant.h"
+#include "../kvcache/kv_quant.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DUOROU_QUANT_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DUOROU_QUANT_NEON 1
+#endif
+
+namespace duorou {
+namespace ml {
+
+namespace {
+
+using kvcache::fp16ToFp32;
+
+// Below this many weight-activation products a matmul stays on one thread
+constexpr size_t kParallelMinMacs = 1 << 18;
+
+// Dot of nb weight blocks with the matching Q8_0 activation blocks
+using DotFn = float (*)(const void *w, const BlockQ8_0 *x, size_t nb);
+
+// Q4_K packs eight 6-bit (scale, min) pairs into 12 bytes
+inline void scaleMinK4(int j, const uint8_t *q, uint8_t &sc, uint8_t &m) {
+  if (j < 4) {
+    sc = q[j] & 63;
+    m = q[j + 4] & 63;
+  } else {
+    sc = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4);
+    m = (q[j + 4] >> 4) | ((q[j] >> 6) << 4);
+  }
+}
+
+// Unpack one Q6_K super-block to signed 6-bit values in [-32, 31]
+void unpackQ6K(const BlockQ6_K &b, int8_t *q) {
+  for (int half = 0; half < 2; ++half) {
+    const uint8_t *ql = b.ql + 64 * half;
+    const uint8_t *qh = b.qh + 32 * half;
+    int8_t *out = q + 128 * half;
+    for (int l = 0; l < 32; ++l) {
+      out[l + 0] = static_cast<int8_t>(((ql[l] & 0xF) | (((qh[l] >> 0) & 3) << 4)) - 32);
+      out[l + 32] = static_cast<int8_t>(((ql[l + 32] & 0xF) | (((qh[l] >> 2) & 3) << 4)) - 32);
+      out[l + 64] = static_cast<int8_t>(((ql[l] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32);
+      out[l + 96] = static_cast<int8_t>(((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32);
+    }
+  }
+}
+
+// ---- dequantization ----
+
+void dequantizeQ4_0(const BlockQ4_0 *b, float *y, size_t nb) {
+  for (size_t i = 0; i < nb; ++i, y += kQK) {
+    const float d = fp16ToFp32(b[i].d);
+    for (size_t j = 0; j < kQK / 2; ++j) {
+      y[j] = static_cast<float>((b[i].qs[j] & 0xF) - 8) * d;
+      y[j + kQK / 2] = static_cast<float>((b[i].qs[j] >> 4) - 8) * d;
+    }
+  }
+}
+
+void dequantizeQ8_0(const BlockQ8_0 *b, float *y, size_t nb) {
+  for (size_t i = 0; i < nb; ++i, y += kQK) {
+    const float d = fp16ToFp32(b[i].d);
+    for (size_t j = 0; j < kQK; ++j) {
+      y[j] = static_cast<float>(b[i].qs[j]) * d;
+    }
+  }
+}
+
+void dequantizeQ4_K(const BlockQ4_K *b, float *y, size_t nb) {
+  for (size_t i = 0; i < nb; ++i) {
+    const float d = fp16ToFp32(b[i].d);
+    const float dmin = fp16ToFp32(b[i].dmin);
+    const uint8_t *q = b[i].qs;
+    for (int s = 0; s < 8; s += 2, q += 32, y += 64) {
+      uint8_t sc, m;
+      scaleMinK4(s, b[i].scales, sc, m);
+      const float d1 = d * sc, m1 = dmin * m;
+      scaleMinK4(s + 1, b[i].scales, sc, m);
+      const float d2 = d * sc, m2 = dmin * m;
+      for (int l = 0; l < 32; ++l) {
+        y[l] = d1 * static_cast<float>(q[l] & 0xF) - m1;
+        y[l + 32] = d2 * static_cast<float>(q[l] >> 4) - m2;
+      }
+    }
+  }
+}
+
+void dequantizeQ6_K(const BlockQ6_K *b, float *y, size_t nb) {
+  int8_t q[kQKK];
+  for (size_t i = 0; i < nb; ++i, y += kQKK) {
+    const float d = fp16ToFp32(b[i].d);
+    unpackQ6K(b[i], q);
+    for (size_t j = 0; j < kQKK; ++j) {
+      y[j] = d * static_cast<float>(b[i].scales[j / 16]) * static_cast<float>(q[j]);
+    }
+  }
+}
+
+// ---- generic dot kernels ----
+
+float dotQ4_0Generic(const void *wv, const BlockQ8_0 *x, size_t nb) {
+  const BlockQ4_0 *w = static_cast<const BlockQ4_0 *>(wv);
+  float sum = 0.0f;
+  for (size_t i = 0; i < nb; ++i) {
+    int isum = 0;
+    for (size_t j = 0; j < kQK / 2; ++j) {
+      isum += ((w[i].qs[j] & 0xF) - 8) * x[i].qs[j];
+      isum += ((w[i].qs[j] >> 4) - 8) * x[i].qs[j + kQK / 2];
+    }
+    sum += fp16ToFp32(w[i].d) * fp16ToFp32(x[i].d) * static_cast<float>(isum);
+  }
+  return sum;
+}
+
+float dotQ8_0Generic(const void *wv, const BlockQ8_0 *x, size_t nb) {
+  const BlockQ8_0 *w = static_cast<const BlockQ8_0 *>(wv);
+  float sum = 0.0f;
+  for (size_t i = 0; i < nb; ++i) {
+    int isum = 0;
+    for (size_t j = 0; j < kQK; ++j) {
+      isum += w[i].qs[j] * x[i].qs[j];
+    }
+    sum += fp16ToFp32(w[i].d) * fp16ToFp32(x[i].d) * static_cast<float>(isum);
+  }
+  return sum;
+}
+
+// Each 32-wide Q4_K sub-block lines up with one Q8_0 activation block:
+// sum(x * (d*sc*q - dmin*m)) = dx * (d*sc*sum(q*xq) - dmin*m*sum(xq))
+float dotQ4_KGeneric(const void *wv, const BlockQ8_0 *x, size_t nb) {
+  const BlockQ4_K *w = static_cast<const BlockQ4_K *>(wv);
+  float sum = 0.0f;
+  for (size_t i = 0; i < nb; ++i) {
+    const float d = fp16ToFp32(w[i].d);
+    const float dmin = fp16ToFp32(w[i].dmin);
+    for (int s = 0; s < 8; ++s) {
+      uint8_t sc, m;
+      scaleMinK4(s, w[i].scales, sc, m);
+      const uint8_t *q = w[i].qs + (s / 2) * 32;
+      const int shift = (s & 1) * 4;
+      const BlockQ8_0 &xb = x[i * 8 + s];
+      int isum = 0, xsum = 0;
+      for (int l = 0; l < 32; ++l) {
+        isum += ((q[l] >> shift) & 0xF) * xb.qs[l];
+        xsum += xb.qs[l];
+      }
+      sum += fp16ToFp32(xb.d) *
+             (d * sc * static_cast<float>(isum) - dmin * m * static_cast<float>(xsum));
+    }
+  }
+  return sum;
+}
+
+// Q6_K has 16-wide sub-blocks, two per Q8_0 activation block
+float dotQ6_KGeneric(const void *wv, const BlockQ8_0 *x, size_t nb) {
+  const BlockQ6_K *w = static_cast<const BlockQ6_K *>(wv);
+  int8_t q[kQKK];
+  float sum = 0.0f;
+  for (size_t i = 0; i < nb; ++i) {
+    unpackQ6K(w[i], q);
+    const float d = fp16ToFp32(w[i].d);
+    for (int g = 0; g < 16; ++g) {
+      const BlockQ8_0 &xb = x[i * 8 + g / 2];
+      const int8_t *xq = xb.qs + (g & 1) * 16;
+      const int8_t *wq = q + g * 16;
+      int isum = 0;
+      for (int l = 0; l < 16; ++l) {
+        isum += wq[l] * xq[l];
+      }
+      sum += d * w[i].scales[g] * fp16ToFp32(xb.d) * static_cast<float>(isum);
+    }
+  }
+  return sum;
+}
+
+// ---- SIMD dot kernels ----
+
+#if defined(DUOROU_QUANT_X86)
+
+#define DUOROU_QUANT_AVX2 __attribute__((target("avx2,fma,f16c")))
+
+DUOROU_QUANT_AVX2 inline float hsumAvx2(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+// Signed int8 x int8 products summed into eight int32 lanes
+DUOROU_QUANT_AVX2 inline __m256i mulSumI8(__m256i a, __m256i b) {
+  const __m256i absA = _mm256_sign_epi8(a, a);
+  const __m256i signedB = _mm256_sign_epi8(b, a);
+  return _mm256_madd_epi16(_mm256_maddubs_epi16(absA, signedB),
+                           _mm256_set1_epi16(1));
+}
+
+DUOROU_QUANT_AVX2 float dotQ4_0Avx2(const void *wv, const BlockQ8_0 *x,
+                                    size_t nb) {
+  const BlockQ4_0 *w = static_cast<const BlockQ4_0 *>(wv);
+  const __m256i lowMask = _mm256_set1_epi8(0x0F);
+  const __m256i eight = _mm256_set1_epi8(8);
+  __m256 acc = _mm256_setzero_ps();
+  for (size_t i = 0; i < nb; ++i) {
+    const __m256 d = _mm256_set1_ps(_cvtsh_ss(w[i].d) * _cvtsh_ss(x[i].d));
+    const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(w[i].qs));
+    __m256i q = _mm256_inserti128_si256(_mm256_castsi128_si256(packed),
+                                        _mm_srli_epi16(packed, 4), 1);
+    q = _mm256_sub_epi8(_mm256_and_si256(q, lowMask), eight);
+    const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x[i].qs));
+    acc = _mm256_fmadd_ps(d, _mm256_cvtepi32_ps(mulSumI8(q, y)), acc);
+  }
+  return hsumAvx2(acc);
+}
+
+DUOROU_QUANT_AVX2 float dotQ8_0Avx2(const void *wv, const BlockQ8_0 *x,
+                                    size_t nb) {
+  const BlockQ8_0 *w = static_cast<const BlockQ8_0 *>(wv);
+  __m256 acc = _mm256_setzero_ps();
+  for (size_t i = 0; i < nb; ++i) {
+    const __m256 d = _mm256_set1_ps(_cvtsh_ss(w[i].d) * _cvtsh_ss(x[i].d));
+    const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w[i].qs));
+    const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x[i].qs));
+    acc = _mm256_fmadd_ps(d, _mm256_cvtepi32_ps(mulSumI8(q, y)), acc);
+  }
+  return hsumAvx2(acc);
+}
+
+DUOROU_QUANT_AVX2 float dotQ4_KAvx2(const void *wv, const BlockQ8_0 *x,
+                                    size_t nb) {
+  const BlockQ4_K *w = static_cast<const BlockQ4_K *>(wv);
+  const __m256i lowMask = _mm256_set1_epi8(0x0F);
+  const __m256i ones8 = _mm256_set1_epi8(1);
+  const __m256i ones16 = _mm256_set1_epi16(1);
+  __m256 acc = _mm256_setzero_ps();
+  __m256 accMin = _mm256_setzero_ps();
+  for (size_t i = 0; i < nb; ++i) {
+    const float d = _cvtsh_ss(w[i].d);
+    const float dmin = _cvtsh_ss(w[i].dmin);
+    for (int s = 0; s < 8; ++s) {
+      uint8_t sc, m;
+      scaleMinK4(s, w[i].scales, sc, m);
+      const __m256i packed = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(w[i].qs + (s / 2) * 32));
+      const __m256i q = (s & 1) ? _mm256_and_si256(_mm256_srli_epi16(packed, 4), lowMask)
+                                : _mm256_and_si256(packed, lowMask);
+      const BlockQ8_0 &xb = x[i * 8 + s];
+      const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xb.qs));
+      // q is unsigned, so maddubs takes it directly
+      const __m256i prod = _mm256_madd_epi16(_mm256_maddubs_epi16(q, y), ones16);
+      const __m256i ysum = _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, y), ones16);
+      const float dx = _cvtsh_ss(xb.d);
+      acc = _mm256_fmadd_ps(_mm256_set1_ps(dx * d * sc), _mm256_cvtepi32_ps(prod), acc);
+      accMin = _mm256_fmadd_ps(_mm256_set1_ps(dx * dmin * m), _mm256_cvtepi32_ps(ysum), accMin);
+    }
+  }
+  return hsumAvx2(acc) - hsumAvx2(accMin);
+}
+
+// Q6_K: 6-bit values are unpacked 32 at a time and offset by -32 through
+// sum((q - 32) * y) = sum(q * y) - 32 * sum(y)
+DUOROU_QUANT_AVX2 float dotQ6_KAvx2(const void *wv, const BlockQ8_0 *x,
+                                    size_t nb) {
+  const BlockQ6_K *w = static_cast<const BlockQ6_K *>(wv);
+  const __m256i m4 = _mm256_set1_epi8(0x0F);
+  const __m256i m2 = _mm256_set1_epi8(0x03);
+  const __m256i ones8 = _mm256_set1_epi8(1);
+  __m256 acc = _mm256_setzero_ps();
+  for (size_t i = 0; i < nb; ++i) {
+    const float d = _cvtsh_ss(w[i].d);
+    for (int half = 0; half < 2; ++half) {
+      const uint8_t *ql = w[i].ql + 64 * half;
+      const __m256i qlA = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ql));
+      const __m256i qlB = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ql + 32));
+      const __m256i qh = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(w[i].qh + 32 * half));
+      const __m256i q[4] = {
+          _mm256_or_si256(_mm256_and_si256(qlA, m4),
+                          _mm256_slli_epi16(_mm256_and_si256(qh, m2), 4)),
+          _mm256_or_si256(_mm256_and_si256(qlB, m4),
+                          _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 2), m2), 4)),
+          _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(qlA, 4), m4),
+                          _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 4), m2), 4)),
+          _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(qlB, 4), m4),
+                          _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 6), m2), 4)),
+      };
+      for (int k = 0; k < 4; ++k) {
+        const BlockQ8_0 &xb = x[i * 8 + half * 4 + k];
+        const int8_t *sc = w[i].scales + half * 8 + k * 2;
+        const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xb.qs));
+        const __m256i prod = _mm256_sub_epi16(
+            _mm256_maddubs_epi16(q[k], y),
+            _mm256_slli_epi16(_mm256_maddubs_epi16(ones8, y), 5));
+        // First 16 values use sc[0], the next 16 sc[1]
+        const __m256i scales = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_set1_epi16(sc[0])), _mm_set1_epi16(sc[1]), 1);
+        const __m256i isum = _mm256_madd_epi16(prod, scales);
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(d * _cvtsh_ss(xb.d)),
+                              _mm256_cvtepi32_ps(isum), acc);
+      }
+    }
+  }
+  return hsumAvx2(acc);
+}
+
+#undef DUOROU_QUANT_AVX2
+
+#elif defined(DUOROU_QUANT_NEON)
+
+inline int32x4_t dot16Neon(int8x16_t a, int8x16_t b) {
+  const int16x8_t lo = vmull_s8(vget_low_s8(a), vget_low_s8(b));
+  const int16x8_t hi = vmull_s8(vget_high_s8(a), vget_high_s8(b));
+  return vaddq_s32(vpaddlq_s16(lo), vpaddlq_s16(hi));
+}
+
+float dotQ4_0Neon(const void *wv, const BlockQ8_0 *x, size_t nb) {
+  const BlockQ4_0 *w = static_cast<const BlockQ4_0 *>(wv);
+  const uint8x16_t lowMask = vdupq_n_u8(0x0F);
+  const int8x16_t eight = vdupq_n_s8(8);
+  float32x4_t acc = vdupq_n_f32(0.0f);
+  for (size_t i = 0; i < nb; ++i) {
+    const uint8x16_t packed = vld1q_u8(w[i].qs);
+    const int8x16_t lo = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(packed, lowMask)), eight);
+    const int8x16_t hi = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(packed, 4)), eight);
+    const int32x4_t s = vaddq_s32(dot16Neon(lo, vld1q_s8(x[i].qs)),
+                                  dot16Neon(hi, vld1q_s8(x[i].qs + 16)));
+    acc = vmlaq_n_f32(acc, vcvtq_f32_s32(s),
+                      fp16ToFp32(w[i].d) * fp16ToFp32(x[i].d));
+  }
+  return vaddvq_f32(acc);
+}
+
+float dotQ8_0Neon(const void *wv, const BlockQ8_0 *x, size_t nb) {
+  const BlockQ8_0 *w = static_cast<const BlockQ8_0 *>(wv);
+  float32x4_t acc = vdupq_n_f32(0.0f);
+  for (size_t i = 0; i < nb; ++i) {
+    const int32x4_t s = vaddq_s32(dot16Neon(vld1q_s8(w[i].qs), vld1q_s8(x[i].qs)),
+                                  dot16Neon(vld1q_s8(w[i].qs + 16), vld1q_s8(x[i].qs + 16)));
+    acc = vmlaq_n_f32(acc, vcvtq_f32_s32(s),
+                      fp16ToFp32(w[i].d) * fp16ToFp32(x[i].d));
+  }
+  return vaddvq_f32(acc);
+}
+
+#endif
+
+struct DotKernels {
+  const char *name;
+  DotFn q4_0;
+  DotFn q8_0;
+  DotFn q4_k;
+  DotFn q6_k;
+};
+
+DotKernels detectKernels() {
+  const DotKernels generic{"generic", dotQ4_0Generic, dotQ8_0Generic,
+                           dotQ4_KGeneric, dotQ6_KGeneric};
+  if (const char *env = std::getenv("DUOROU_QUANT_KERNEL")) {
+    if (std::string(env) == "generic") {
+      return generic;
+    }
+  }
+#if defined(DUOROU_QUANT_X86)
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+      __builtin_cpu_supports("f16c")) {
+    return {"avx2", dotQ4_0Avx2, dotQ8_0Avx2, dotQ4_KAvx2, dotQ6_KAvx2};
+  }
+#elif defined(DUOROU_QUANT_NEON)
+  return {"neon", dotQ4_0Neon, dotQ8_0Neon, dotQ4_KGeneric, dotQ6_KGeneric};
+#endif
+  return generic;
+}
+
+const DotKernels &kernels() {
+  static const DotKernels k = detectKernels();
+  return k;
+}
+
+DotFn dotFor(QuantType type) {
+  const DotKernels &k = kernels();
+  switch (type) {
+  case QuantType::Q4_0:
+    return k.q4_0;
+  case QuantType::Q8_0:
+    return k.q8_0;
+  case QuantType::Q4_K:
+    return k.q4_k;
+  case QuantType::Q6_K:
+    return k.q6_k;
+  }
+  throw std::invalid_argument("quant: unsupported quantization type");
+}
+
+} // namespace
+
+bool isSupportedQuantType(uint32_t ggmlType) {
+  switch (static_cast<QuantType>(ggmlType)) {
+  case QuantType::Q4_0:
+  case QuantType::Q8_0:
+  case QuantType::Q4_K:
+  case QuantType::Q6_K:
+    return true;
+  }
+  return false;
+}
+
+const char *quantTypeName(QuantType type) {
+  switch (type) {
+  case QuantType::Q4_0:
+    return "q4_0";
+  case QuantType::Q8_0:
+    return "q8_0";
+  case QuantType::Q4_K:
+    return "q4_K";
+  case QuantType::Q6_K:
+    return "q6_K";
+  }
+  return "unknown";
+}
+
+size_t quantBlockSize(QuantType type) {
+  return (type == QuantType::Q4_K || type == QuantType::Q6_K) ? kQKK : kQK;
+}
+
+size_t quantBlockBytes(QuantType type) {
+  switch (type) {
+  case QuantType::Q4_0:
+    return sizeof(BlockQ4_0);
+  case QuantType::Q8_0:
+    return sizeof(BlockQ8_0);
+  case QuantType::Q4_K:
+    return sizeof(BlockQ4_K);
+  case QuantType::Q6_K:
+    return sizeof(BlockQ6_K);
+  }
+  throw std::invalid_argument("quant: unsupported quantization type");
+}
+
+size_t quantRowBytes(QuantType type, size_t n) {
+  return n / quantBlockSize(type) * quantBlockBytes(type);
+}
+
+void dequantizeRow(QuantType type, const void *src, float *dst, size_t n) {
+  const size_t nb = n / quantBlockSize(type);
+  switch (type) {
+  case QuantType::Q4_0:
+    dequantizeQ4_0(static_cast<const BlockQ4_0 *>(src), dst, nb);
+    return;
+  case QuantType::Q8_0:
+    dequantizeQ8_0(static_cast<const BlockQ8_0 *>(src), dst, nb);
+    return;
+  case QuantType::Q4_K:
+    dequantizeQ4_K(static_cast<const BlockQ4_K *>(src), dst, nb);
+    return;
+  case QuantType::Q6_K:
+    dequantizeQ6_K(static_cast<const BlockQ6_K *>(src), dst, nb);
+    return;
+  }
+  throw std::invalid_argument("dequantizeRow: unsupported quantization type");
+}
+
+void quantizeRowQ8_0(const float *src, BlockQ8_0 *dst, size_t n) {
+  // Same block layout as the KV cache's Q8_0 storage
+  static_assert(sizeof(BlockQ8_0) == sizeof(kvcache::BlockQ8_0),
+                "Q8_0 layouts differ");
+  kvcache::quantizeRow(kvcache::DType::Q8_0, src, dst, n);
+}
+
+float quantDot(QuantType type, const void *row, const BlockQ8_0 *x, size_t n) {
+  return dotFor(type)(row, x, n / quantBlockSize(type));
+}
+
+void quantMatVec(const QuantMatrix &w, const float *x, float *y,
+                 utils::ThreadPool *pool) {
+  quantMatMul(w, x, 1, y, pool);
+}
+
+void quantMatMul(const QuantMatrix &w, const float *x, size_t tokens, float *y,
+                 utils::ThreadPool *pool) {
+  if (w.rows == 0 || tokens == 0) {
+    return;
+  }
+  const size_t blockSize = quantBlockSize(w.type);
+  if (w.cols == 0 || w.cols % blockSize != 0 ||
+      w.sizeBytes() < w.rows * w.rowBytes()) {
+    throw std::invalid_argument("quantMatMul: malformed quantized matrix");
+  }
+
+  // Activations are quantized once and shared by every row
+  const size_t xBlocks = w.cols / kQK;
+  std::vector<BlockQ8_0> xq(tokens * xBlocks);
+  for (size_t t = 0; t < tokens; ++t) {
+    quantizeRowQ8_0(x + t * w.cols, xq.data() + t * xBlocks, w.cols);
+  }
+
+  const DotFn dot = dotFor(w.type);
+  const size_t nb = w.cols / blockSize;
+  const size_t rowBytes = w.rowBytes();
+  auto runRows = [&](size_t r0, size_t r1) {
+    for (size_t r = r0; r < r1; ++r) {
+      const uint8_t *row = w.blocks() + r * rowBytes;
+      for (size_t t = 0; t < tokens; ++t) {
+        y[t * w.rows + r] = dot(row, xq.data() + t * xBlocks, nb);
+      }
+    }
+  };
+
+  if (!pool || pool->size() == 0 ||
+      w.rows * w.cols * tokens < kParallelMinMacs) {
+    runRows(0, w.rows);
+    return;
+  }
+  pool->parallelFor(w.rows, 16, runRows);
+}
+
+QuantMatrix quantizeMatrixQ8_0(const float *src, size_t rows, size_t cols,
+                               utils::ThreadPool *pool) {
+  if (cols == 0 || cols % kQK != 0) {
+    throw std::invalid_argument(
+        "quantizeMatrixQ8_0: cols must be a multiple of 32");
+  }
+  QuantMatrix m;
+  m.type = QuantType::Q8_0;
+  m.rows = rows;
+  m.cols = cols;
+  m.data.resize(rows * m.rowBytes());
+  const size_t rowBytes = m.rowBytes();
+  auto runRows = [&](size_t r0, size_t r1) {
+    for (size_t r = r0; r < r1; ++r) {
+      quantizeRowQ8_0(src + r * cols,
+                      reinterpret_cast<BlockQ8_0 *>(m.data.data() +
+                                                    r * rowBytes),
+                      cols);
+    }
+  };
+  if (!pool || pool->size() == 0 || rows * cols < kParallelMinMacs) {
+    runRows(0, rows);
+  } else {
+    pool->parallelFor(rows, 64, runRows);
+  }
+  return m;
+}
+
+const char *quantKernelName() { return kernels().name; }
+
+} // namespace ml
+} // namespace duorou
@@ -0,0 +1,121 @@
+#ifndef DUOROU_ML_QUANT_H
+#define DUOROU_ML_QUANT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace duorou {
+namespace utils {
+class ThreadPool;
+}
+
+namespace ml {
+
+// Block-quantized weights as stored in GGUF files, kept in their on-disk
+// layout so matvecs read 4.5-8.5 bits per weight instead of 32.
+//
+// Values match ggml_type so a QuantType converts directly to and from GGUF
+// tensor types and ggml tensors.
+enum class QuantType : uint32_t {
+  Q4_0 = 2,
+  Q8_0 = 8,
+  Q4_K = 12,
+  Q6_K = 14,
+};
+
+constexpr size_t kQK = 32;   // weights per Q4_0 / Q8_0 block
+constexpr size_t kQKK = 256; // weights per k-quant super-block
+
+struct BlockQ4_0 {
+  uint16_t d;          // fp16 scale
+  uint8_t qs[kQK / 2]; // nibbles: low = element j, high = element j + 16
+};
+static_assert(sizeof(BlockQ4_0) == 18, "unexpected BlockQ4_0 padding");
+
+struct BlockQ8_0 {
+  uint16_t d;     // fp16 scale
+  int8_t qs[kQK]; // quantized values
+};
+static_assert(sizeof(BlockQ8_0) == 34, "unexpected BlockQ8_0 padding");
+
+struct BlockQ4_K {
+  uint16_t d;            // fp16 super-block scale for the sub-block scales
+  uint16_t dmin;         // fp16 super-block scale for the sub-block mins
+  uint8_t scales[12];    // 8 x (6-bit scale, 6-bit min)
+  uint8_t qs[kQKK / 2];  // nibbles
+};
+static_assert(sizeof(BlockQ4_K) == 144, "unexpected BlockQ4_K padding");
+
+struct BlockQ6_K {
+  uint8_t ql[kQKK / 2];      // low 4 bits
+  uint8_t qh[kQKK / 4];      // high 2 bits
+  int8_t scales[kQKK / 16];  // 16 x 8-bit sub-block scales
+  uint16_t d;                // fp16 super-block scale
+};
+static_assert(sizeof(BlockQ6_K) == 210, "unexpected BlockQ6_K padding");
+
+// True for GGUF/ggml type ids handled by the kernels below
+bool isSupportedQuantType(uint32_t ggmlType);
+const char *quantTypeName(QuantType type);
+
+// Weights per block and bytes per block
+size_t quantBlockSize(QuantType type);
+size_t quantBlockBytes(QuantType type);
+// Bytes of one row of n weights (n must be a multiple of the block size)
+size_t quantRowBytes(QuantType type, size_t n);
+
+// Row-major quantized matrix [rows, cols], each row quantized along cols.
+// GGUF weights are [out, in] with ne0 = in, so rows = out and cols = in.
+//
+// Blocks live either in `data` (owned) or, when `view` is set, in borrowed
+// memory such as an mmap'd GGUF file; `owner` keeps that memory alive.
+struct QuantMatrix {
+  QuantType type = QuantType::Q8_0;
+  size_t rows = 0;
+  size_t cols = 0;
+  std::vector<uint8_t> data;
+  const uint8_t *view = nullptr;
+  std::shared_ptr<const void> owner;
+
+  bool empty() const { return view == nullptr && data.empty(); }
+  bool borrowed() const { return view != nullptr; }
+  const uint8_t *blocks() const { return view ? view : data.data(); }
+  size_t sizeBytes() const { return view ? rows * rowBytes() : data.size(); }
+  size_t rowBytes() const { return quantRowBytes(type, cols); }
+  const uint8_t *row(size_t r) const { return blocks() + r * rowBytes(); }
+};
+
+// Quantized row -> float32 (n must be a multiple of the block size)
+void dequantizeRow(QuantType type, const void *src, float *dst, size_t n);
+
+// float32 -> Q8_0, zero padding the last block when n % 32 != 0
+void quantizeRowQ8_0(const float *src, BlockQ8_0 *dst, size_t n);
+
+// Dot product of one quantized weight row with Q8_0 activations of the
+// same length
+float quantDot(QuantType type, const void *row, const BlockQ8_0 *x, size_t n);
+
+// y[rows] = W x. x (cols floats) is quantized to Q8_0 once, then rows are
+// split over `pool` when given.
+void quantMatVec(const QuantMatrix &w, const float *x, float *y,
+                 utils::ThreadPool *pool = nullptr);
+
+// Y[tokens, rows] = X[tokens, cols] W^T. Each weight row is read once for
+// all tokens.
+void quantMatMul(const QuantMatrix &w, const float *x, size_t tokens, float *y,
+                 utils::ThreadPool *pool = nullptr);
+
+// float32 [rows, cols] -> owned Q8_0 matrix (cols must be a multiple of 32)
+QuantMatrix quantizeMatrixQ8_0(const float *src, size_t rows, size_t cols,
+                               utils::ThreadPool *pool = nullptr);
+
+// Name of the dot kernels selected for this CPU ("avx2", "neon" or
+// "generic")
+const char *quantKernelName();
+
+} // namespace ml
+} // namespace duorou
+
+#endif // DUOROU_ML_QUANT_H
@@ -0,0 +1,131 @@
+// Quantized matvec micro-benchmark.
+// Runs decode-shaped (one token) projections of Qwen2/2.5 models with
+// weights in f32 (ml::sgemm) and in Q8_0/Q4_0/Q4_K/Q6_K blocks
+// (ml::quantMatVec), reporting weight bytes, effective bandwidth and the
+// error against a float matvec over the dequantized weights.
+//
+// Usage: quant_bench [reps]
+
+#include "gemm.h"
+#include "quant.h"
+#include "../kvcache/kv_quant.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using duorou::ml::QuantMatrix;
+using duorou::ml::QuantType;
+
+template <class F> double bestMs(F &&fn, int reps) {
+  double best = 1e30;
+  for (int r = 0; r < reps; ++r) {
+    auto t0 = Clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+  }
+  return best;
+}
+
+// Random blocks with a sane fp16 scale; kernel speed does not depend on the
+// values
+QuantMatrix randomMatrix(QuantType type, size_t rows, size_t cols, std::mt19937 &rng) {
+  QuantMatrix m;
+  m.type = type;
+  m.rows = rows;
+  m.cols = cols;
+  m.data.resize(rows * m.rowBytes());
+  std::uniform_int_distribution<int> byte(0, 255);
+  for (auto &b : m.data) b = static_cast<uint8_t>(byte(rng));
+  const size_t blockBytes = duorou::ml::quantBlockBytes(type);
+  const uint16_t d = duorou::kvcache::fp32ToFp16(0.01f);
+  const uint16_t dmin = duorou::kvcache::fp32ToFp16(0.005f);
+  // Offset of the fp16 scale inside each block
+  const size_t dOffset = type == QuantType::Q6_K ? offsetof(duorou::ml::BlockQ6_K, d) : 0;
+  for (size_t off = 0; off < m.data.size(); off += blockBytes) {
+    std::memcpy(m.data.data() + off + dOffset, &d, sizeof(d));
+    if (type == QuantType::Q4_K) {
+      std::memcpy(m.data.data() + off + 2, &dmin, sizeof(dmin));
+    }
+  }
+  return m;
+}
+
+struct Shape {
+  const char *name;
+  size_t rows; // out
+  size_t cols; // in
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int reps = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+  const Shape shapes[] = {
+      {"0.5b ffn_up", 4864, 896},   {"0.5b ffn_down", 896, 4864},
+      {"1.5b ffn_up", 8960, 1536},  {"7b attn_o", 3584, 3584},
+      {"7b ffn_up", 18944, 3584},   {"0.5b lm_head", 151936, 896},
+  };
+  const QuantType types[] = {QuantType::Q8_0, QuantType::Q4_0, QuantType::Q4_K,
+                             QuantType::Q6_K};
+
+  duorou::utils::ThreadPool &pool = duorou::utils::ThreadPool::global();
+  std::printf("kernel=%s gemm=%s threads=%zu\n", duorou::ml::quantKernelName(),
+              duorou::ml::sgemmKernelName(), pool.size() + 1);
+  std::printf("%-14s %-5s %9s %9s %9s %9s\n", "shape", "type", "MiB", "ms", "GB/s",
+              "rel err");
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for (const Shape &s : shapes) {
+    std::vector<float> x(s.cols), y(s.rows), ref(s.rows);
+    for (auto &v : x) v = dist(rng);
+
+    // f32 baseline: y^T = x^T W^T with W^T as the [cols, rows] B operand
+    std::vector<float> wt(s.cols * s.rows);
+    for (auto &v : wt) v = dist(rng) * 0.05f;
+    double ms = bestMs([&] {
+      duorou::ml::sgemm(1, static_cast<int64_t>(s.rows), static_cast<int64_t>(s.cols),
+                        x.data(), static_cast<int64_t>(s.cols), wt.data(),
+                        static_cast<int64_t>(s.rows), y.data(),
+                        static_cast<int64_t>(s.rows), &pool);
+    }, reps);
+    double bytes = static_cast<double>(wt.size() * sizeof(float));
+    std::printf("%-14s %-5s %9.1f %9.3f %9.2f %9s\n", s.name, "f32", bytes / (1 << 20), ms,
+                bytes / ms / 1e6, "-");
+    std::vector<float>().swap(wt);
+
+    for (QuantType type : types) {
+      if (s.cols % duorou::ml::quantBlockSize(type) != 0) {
+        continue;
+      }
+      QuantMatrix w = randomMatrix(type, s.rows, s.cols, rng);
+      ms = bestMs([&] { duorou::ml::quantMatVec(w, x.data(), y.data(), &pool); }, reps);
+      bytes = static_cast<double>(w.data.size());
+
+      // Reference: float dot over the dequantized row
+      std::vector<float> row(s.cols);
+      double errNum = 0.0, errDen = 0.0;
+      for (size_t r = 0; r < s.rows; r += std::max<size_t>(1, s.rows / 256)) {
+        duorou::ml::dequantizeRow(type, w.row(r), row.data(), s.cols);
+        double acc = 0.0;
+        for (size_t c = 0; c < s.cols; ++c) acc += static_cast<double>(row[c]) * x[c];
+        errNum += (acc - y[r]) * (acc - y[r]);
+        errDen += acc * acc;
+      }
+      std::printf("%-14s %-5s %9.1f %9.3f %9.2f %9.2e\n", s.name,
+                  duorou::ml::quantTypeName(type), bytes / (1 << 20), ms, bytes / ms / 1e6,
+                  errDen > 0.0 ? std::sqrt(errNum / errDen) : 0.0);
+    }
+  }
+  return 0;
+}
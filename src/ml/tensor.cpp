@@ -1,6 +1,8 @@
 #include "tensor.h"
 #include "backend/backend.h"
 #include "context.h"
+#include "gemm.h"
+#include "../utils/thread_pool.h"
 #include "ggml.h"
 #include "ggml-cpu.h"
 #include <algorithm>
@@ -14,7 +16,6 @@
 #include <random>
 #include <sstream>
 #include <stdexcept>
-#include <thread>
 #include <string>
 
 namespace duorou {
@@ -624,13 +625,26 @@ Tensor Tensor::matmul(Context &ctx, const Tensor &other) const {
     throw std::runtime_error("matmul: input tensors must have allocated data");
   }
 
+  // Small and medium products run on the blocked CPU GEMM below; setting up
+  // a ggml graph costs more than it saves there. DUOROU_GEMM_GGML_MIN_MACS
+  // overrides the cut-over point (0 = always use ggml when available).
+  static const int64_t ggmlMinMacs = []() -> int64_t {
+    if (const char *env = std::getenv("DUOROU_GEMM_GGML_MIN_MACS")) {
+      try { return std::stoll(std::string(env)); } catch (...) {}
+    }
+    return int64_t(1) << 28;
+  }();
+  const bool useGgml = M * N * K >= ggmlMinMacs;
+
   // ggml 加速路径（若上下文可用）
-  if (auto *gctx = ctx.ggml_ctx()) {
-    // 为本次 matmul 创建临时 ggml 上下文，避免长期复用导致内存池耗尽
+  if (useGgml && ctx.ggml_ctx()) {
+    // 复用 Context 持有的 scratch 上下文，只在需要更大空间时才重新分配；
+    // 计算工作区由 Context::compute 缓存，不再占用上下文内存
     const size_t bytesA = static_cast<size_t>(K * N) * sizeof(float);
     const size_t bytesB = static_cast<size_t>(M * K) * sizeof(float);
     const size_t bytesO = static_cast<size_t>(M * N) * sizeof(float);
-    size_t mem_size = bytesA + bytesB + bytesO + (64ull * 1024ull * 1024ull); // 额外留 64MB 余量
+    size_t mem_size = bytesA + bytesB + bytesO + ggml_graph_overhead() +
+                      8 * ggml_tensor_overhead();
     // 允许通过环境变量强制设定最小内存大小
     if (const char *env_mb = std::getenv("DUOROU_GGML_TMP_MB")) {
       try {
@@ -639,9 +653,7 @@ Tensor Tensor::matmul(Context &ctx, const Tensor &other) const {
         if (min_bytes > mem_size) mem_size = static_cast<size_t>(min_bytes);
       } catch (...) {}
     }
-    ggml_init_params params{ .mem_size = mem_size, .mem_buffer = nullptr, .no_alloc = false };
-    std::unique_ptr<ggml_context, decltype(&ggml_free)> local_ctx(ggml_init(params), ggml_free);
-    ggml_context *lc = local_ctx.get();
+    ggml_context *lc = ctx.scratchContext(mem_size);
 
     ggml_tensor *gg_A = other.to_ggml(lc); // [K, N]
     ggml_tensor *gg_B = this->to_ggml(lc); // [M, K]
@@ -649,15 +661,7 @@ Tensor Tensor::matmul(Context &ctx, const Tensor &other) const {
 
     struct ggml_cgraph *gf = ggml_new_graph(lc);
     ggml_build_forward_expand(gf, gg_out_nm);
-
-    // 线程数策略与 Context::compute 保持一致
-    unsigned n_threads = 4;
-    if (const char *env = std::getenv("DUOROU_NUM_THREADS")) {
-      try { int v = std::stoi(std::string(env)); if (v > 0) n_threads = static_cast<unsigned>(v); } catch (...) {}
-    } else {
-      unsigned hw = std::thread::hardware_concurrency(); if (hw > 0) n_threads = hw;
-    }
-    ggml_graph_compute_with_ctx(lc, gf, n_threads);
+    ctx.compute(gf);
 
     Tensor host_out;
     host_out.from_ggml(gg_out_nm);
@@ -673,20 +677,9 @@ Tensor Tensor::matmul(Context &ctx, const Tensor &other) const {
   const float *B = static_cast<const float *>(other.data_);
   float *C = static_cast<float *>(result.data_);
 
-  // Naive row-major GEMM: C[M,N] = A[M,K] x B[K,N]
-  // Initialize output to 0
-  std::fill(C, C + (M * N), 0.0f);
-  for (int64_t i = 0; i < M; ++i) {
-    const float *Ai = A + i * K;
-    float *Ci = C + i * N;
-    for (int64_t k = 0; k < K; ++k) {
-      const float a = Ai[k];
-      const float *Bk = B + k * N;
-      for (int64_t j = 0; j < N; ++j) {
-        Ci[j] += a * Bk[j];
-      }
-    }
-  }
+  // Row-major C[M,N] = A[M,K] x B[K,N], blocked SIMD kernel split over the
+  // shared worker pool
+  sgemm(M, N, K, A, K, B, N, C, N, &utils::ThreadPool::global());
 
   return result;
 }
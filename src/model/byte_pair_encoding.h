@@ -1,10 +1,13 @@
 #pragma once
 
+#include "pretoken_cache.h"
+#include "pretokenizer.h"
 #include "text_processor.h"
 #include "vocabulary.h"
-#include <regex>
+#include <array>
 #include <memory>
-#include <queue>
+#include <mutex>
+#include <string_view>
 
 namespace duorou {
 namespace model {
@@ -20,33 +23,6 @@ struct Fragment {
     Fragment(const std::string& v, const std::vector<int32_t>& i) : value(v), ids(i) {}
 };
 
-/**
- * Pair represents a pair of positions and its merge rank
- */
-struct Pair {
-    int a, b;
-    int rank;
-    std::string value;
-    
-    Pair(int a_, int b_, int rank_, const std::string& value_) 
-        : a(a_), b(b_), rank(rank_), value(value_) {}
-    
-    // For priority queue (min-heap based on rank)
-    bool operator>(const Pair& other) const {
-        return rank > other.rank;
-    }
-};
-
-/**
- * Merge represents a merge operation in the BPE algorithm
- */
-struct Merge {
-    int prev, next;
-    std::vector<uint32_t> runes;
-    
-    Merge() : prev(-1), next(-1) {}
-};
-
 /**
  * BytePairEncoding tokenizer implementation
  * Similar to Ollama's BytePairEncoding
@@ -55,7 +31,8 @@ class BytePairEncoding : public TextProcessor {
 public:
     /**
      * Constructor
-     * @param pattern Regular expression pattern for pre-tokenization
+     * @param pattern Regular expression pattern for pre-tokenization; known
+     *                GPT-2 / Qwen2 / cl100k patterns use a hand-written scanner
      * @param vocab Vocabulary to use
      */
     BytePairEncoding(const std::string& pattern, std::shared_ptr<Vocabulary> vocab);
@@ -69,15 +46,29 @@ public:
     bool isSpecial(int32_t id, Special special) const override;
     const Vocabulary* getVocabulary() const override;
     size_t getVocabSize() const override;
+
+    /**
+     * Bytes of one token with the GPT-2 byte mapping undone, read from a
+     * table built on first use
+     */
+    void appendTokenBytes(int32_t id, bool atStart, std::string& out) const override;
+
+    /**
+     * Pre-token -> ids cache. Sized by DUOROU_BPE_CACHE_SIZE (entries, 0
+     * disables) or PreTokenCache::kDefaultCapacity.
+     */
+    PreTokenCache::Stats cacheStats() const { return cache_.stats(); }
+    void setCacheCapacity(size_t entries) { cache_.setCapacity(entries); }
     
 private:
-    std::regex preTokenizeRegex_;
+    PreTokenizer preTokenizer_;
     std::shared_ptr<Vocabulary> vocab_;
+    PreTokenCache cache_;
     
     /**
-     * Split text using the pre-tokenization regex
+     * Split text into pre-tokens (views into text)
      */
-    std::vector<std::string> split(const std::string& text) const;
+    std::vector<std::string_view> split(std::string_view text) const;
     
     /**
      * Convert byte to Unicode codepoint for BPE processing
@@ -95,9 +86,35 @@ private:
     std::vector<Fragment> processSpecialTokens(const std::vector<Fragment>& fragments) const;
     
     /**
-     * Apply BPE merges to a text fragment
+     * Apply BPE merges to a pre-token and append its ids to out. Works on
+     * token ids through Vocabulary::getMergeTable().
+     */
+    void applyBPE(std::string_view text, std::vector<int32_t>& out) const;
+
+    /**
+     * Fill byteIds_ from the vocabulary
      */
-    std::vector<int32_t> applyBPE(const std::string& text) const;
+    void buildByteIds() const;
+
+    /**
+     * Undo the GPT-2 byte->unicode mapping of one token string into out
+     */
+    void unmapTokenBytes(const std::string& token, std::string& out) const;
+
+    /**
+     * Fill tokenBytes_ / tokenBytesOffsets_ for the whole vocabulary
+     */
+    void buildTokenBytes() const;
+
+    // UTF-8 of byteToUnicode(b) for every byte
+    std::array<std::string, 256> byteRunes_;
+    // Token id of byteRunes_[b], or -1 when the vocabulary lacks it
+    mutable std::once_flag byteIdsOnce_;
+    mutable std::array<int32_t, 256> byteIds_{};
+    // Decoded bytes of token i: tokenBytes_[offsets[i], offsets[i + 1])
+    mutable std::once_flag tokenBytesOnce_;
+    mutable std::string tokenBytes_;
+    mutable std::vector<uint32_t> tokenBytesOffsets_;
 };
 
 } // namespace model
@@ -0,0 +1,141 @@
+#include "double_array_trie.h"
+
+#include <algorithm>
+
+namespace duorou {
+namespace model {
+
+void DoubleArrayTrie::build(const std::vector<std::string> &values) {
+  clear();
+  nextCheckPos_ = 0;
+
+  std::vector<Key> keys;
+  keys.reserve(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (!values[i].empty()) {
+      keys.push_back(Key{&values[i], static_cast<int32_t>(i)});
+    }
+  }
+  // Stable so that of equal keys the one given last ends up last
+  std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) {
+    return *a.text < *b.text;
+  });
+  size_t kept = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (kept > 0 && *keys[kept - 1].text == *keys[i].text) {
+      keys[kept - 1] = keys[i];
+    } else {
+      keys[kept++] = keys[i];
+    }
+  }
+  keys.resize(kept);
+  if (keys.empty()) {
+    return;
+  }
+
+  units_.reserve(keys.size() * 4);
+  ensureSize(1);
+  units_[0].check = 0; // the root is never a free slot
+  insertChildren(0, keys, 0, keys.size(), 0);
+  size_ = keys.size();
+
+  // Trim the free tail left by the last allocations
+  size_t used = units_.size();
+  while (used > 1 && units_[used - 1].check < 0) {
+    --used;
+  }
+  units_.resize(used);
+  units_.shrink_to_fit();
+}
+
+void DoubleArrayTrie::insertChildren(int32_t state,
+                                     const std::vector<Key> &keys,
+                                     size_t begin, size_t end, size_t depth) {
+  // Keys are sorted and unique, so at most the first one ends here
+  if (keys[begin].text->size() == depth) {
+    units_[state].value = keys[begin].value;
+    ++begin;
+  }
+  if (begin == end) {
+    return;
+  }
+
+  // Group the remaining keys by their byte at depth
+  struct Child {
+    unsigned code;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<Child> children;
+  for (size_t i = begin; i < end;) {
+    const unsigned code = static_cast<unsigned char>((*keys[i].text)[depth]);
+    size_t j = i + 1;
+    while (j < end &&
+           static_cast<unsigned char>((*keys[j].text)[depth]) == code) {
+      ++j;
+    }
+    children.push_back(Child{code, i, j});
+    i = j;
+  }
+
+  // First base at which every child slot is free. Slots are never released,
+  // so the fully used prefix of the array can be skipped for good.
+  while (nextCheckPos_ < units_.size() && units_[nextCheckPos_].check >= 0) {
+    ++nextCheckPos_;
+  }
+  size_t slot = std::max<size_t>(nextCheckPos_, children.front().code + 1);
+  size_t base = 0;
+  for (;; ++slot) {
+    ensureSize(slot + 1);
+    if (units_[slot].check >= 0) {
+      continue;
+    }
+    base = slot - children.front().code - 1;
+    bool fits = true;
+    for (size_t k = 1; k < children.size() && fits; ++k) {
+      const size_t t = base + children[k].code + 1;
+      ensureSize(t + 1);
+      fits = units_[t].check < 0;
+    }
+    if (fits) {
+      break;
+    }
+  }
+
+  // Claim all child slots before descending so that deeper states cannot
+  // take them
+  units_[state].base = static_cast<int32_t>(base);
+  for (const Child &child : children) {
+    units_[base + child.code + 1].check = state;
+  }
+  for (const Child &child : children) {
+    insertChildren(static_cast<int32_t>(base + child.code + 1), keys,
+                   child.begin, child.end, depth + 1);
+  }
+}
+
+void DoubleArrayTrie::ensureSize(size_t n) {
+  if (units_.size() < n) {
+    units_.resize(std::max(n, units_.size() + units_.size() / 2 + 256));
+  }
+}
+
+int32_t DoubleArrayTrie::find(const char *key, size_t length) const {
+  if (units_.empty() || length == 0) {
+    return -1;
+  }
+  size_t state = 0;
+  for (size_t i = 0; i < length; ++i) {
+    const size_t next = static_cast<size_t>(units_[state].base) +
+                        static_cast<unsigned char>(key[i]) + 1;
+    if (next >= units_.size() ||
+        units_[next].check != static_cast<int32_t>(state)) {
+      return -1;
+    }
+    state = next;
+  }
+  return units_[state].value;
+}
+
+} // namespace model
+} // namespace duorou
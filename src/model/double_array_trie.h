@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace duorou {
+namespace model {
+
+/**
+ * Static byte-wise double-array trie mapping strings to int32 values.
+ *
+ * State s moves on byte c to t = base[s] + c + 1 when check[t] == s; the
+ * root is state 0. A state that ends a key carries its value. Walking the
+ * trie from one position reports every key that is a prefix of the input in
+ * a single pass, which is what a Viterbi lattice over a vocabulary needs.
+ */
+class DoubleArrayTrie {
+public:
+  /**
+   * Build with keys[i] mapping to i. Empty keys are ignored; when a key
+   * occurs more than once the last index wins, like a map filled in order.
+   */
+  void build(const std::vector<std::string> &keys);
+
+  void clear() {
+    units_.clear();
+    size_ = 0;
+  }
+
+  bool empty() const { return size_ == 0; }
+
+  // Number of distinct keys stored
+  size_t size() const { return size_; }
+
+  /**
+   * Call visit(value, length) for each key that is a prefix of
+   * text[0, length), shortest first.
+   */
+  template <typename Visit>
+  void commonPrefixSearch(const char *text, size_t length,
+                          Visit &&visit) const {
+    if (units_.empty()) {
+      return;
+    }
+    int32_t state = 0;
+    for (size_t i = 0; i < length; ++i) {
+      const size_t next = static_cast<size_t>(units_[state].base) +
+                          static_cast<unsigned char>(text[i]) + 1;
+      if (next >= units_.size() || units_[next].check != state) {
+        return;
+      }
+      state = static_cast<int32_t>(next);
+      if (units_[state].value >= 0) {
+        visit(units_[state].value, i + 1);
+      }
+    }
+  }
+
+  /**
+   * Exact lookup; -1 when key is absent
+   */
+  int32_t find(const char *key, size_t length) const;
+
+private:
+  struct Unit {
+    int32_t base = 0;
+    int32_t check = -1; // owning state, -1 while free
+    int32_t value = -1;
+  };
+
+  struct Key {
+    const std::string *text;
+    int32_t value;
+  };
+
+  void insertChildren(int32_t state, const std::vector<Key> &keys,
+                      size_t begin, size_t end, size_t depth);
+  void ensureSize(size_t n);
+
+  std::vector<Unit> units_;
+  size_t size_ = 0;
+  size_t nextCheckPos_ = 0;
+};
+
+} // namespace model
+} // namespace duorou
@@ -0,0 +1,63 @@
+#include "merge_table.h"
+
+namespace duorou {
+namespace model {
+
+void MergeTable::reserve(size_t n) {
+  size_t capacity = 16;
+  while (capacity < 2 * n) {
+    capacity <<= 1;
+  }
+  if (capacity > slots_.size()) {
+    rehash(capacity);
+  }
+}
+
+void MergeTable::insert(int32_t left, int32_t right, int32_t rank,
+                        int32_t merged) {
+  if (left < 0 || right < 0) {
+    return;
+  }
+  if (2 * (size_ + 1) > slots_.size()) {
+    rehash(slots_.empty() ? 16 : slots_.size() * 2);
+  }
+  const uint64_t key = makeKey(left, right);
+  const size_t mask = slots_.size() - 1;
+  for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+    Entry &e = slots_[i];
+    if (e.key == key) {
+      if (rank < e.rank) {
+        e.rank = rank;
+        e.merged = merged;
+      }
+      return;
+    }
+    if (e.key == kEmpty) {
+      e.key = key;
+      e.rank = rank;
+      e.merged = merged;
+      ++size_;
+      return;
+    }
+  }
+}
+
+void MergeTable::rehash(size_t capacity) {
+  std::vector<Entry> old;
+  old.swap(slots_);
+  slots_.assign(capacity, Entry());
+  const size_t mask = capacity - 1;
+  for (const Entry &e : old) {
+    if (e.key == kEmpty) {
+      continue;
+    }
+    size_t i = hash(e.key) & mask;
+    while (slots_[i].key != kEmpty) {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = e;
+  }
+}
+
+} // namespace model
+} // namespace duorou
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace duorou {
+namespace model {
+
+/**
+ * BPE merge rules keyed by token ids: (left id, right id) -> (rank, merged
+ * id). Stored in a flat open-addressing table with linear probing, so a
+ * lookup is one hash of a 64-bit key and usually one cache line, with no
+ * string building.
+ */
+class MergeTable {
+public:
+  struct Entry {
+    uint64_t key = kEmpty;
+    int32_t rank = -1;
+    int32_t merged = -1;
+  };
+
+  /**
+   * Insert a rule; an existing (left, right) pair keeps its lower rank
+   */
+  void insert(int32_t left, int32_t right, int32_t rank, int32_t merged);
+
+  /**
+   * Reserve for n rules (keeps the load factor at or below 1/2)
+   */
+  void reserve(size_t n);
+
+  void clear() {
+    slots_.clear();
+    size_ = 0;
+  }
+
+  size_t size() const { return size_; }
+
+  /**
+   * Find the rule for (left, right); nullptr when the pair never merges
+   */
+  const Entry *find(int32_t left, int32_t right) const {
+    if (slots_.empty() || left < 0 || right < 0) {
+      return nullptr;
+    }
+    const uint64_t key = makeKey(left, right);
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+      const Entry &e = slots_[i];
+      if (e.key == key) {
+        return &e;
+      }
+      if (e.key == kEmpty) {
+        return nullptr;
+      }
+    }
+  }
+
+private:
+  static constexpr uint64_t kEmpty = ~0ull;
+
+  static uint64_t makeKey(int32_t left, int32_t right) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) |
+           static_cast<uint32_t>(right);
+  }
+
+  // splitmix64 finalizer
+  static size_t hash(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return static_cast<size_t>(key);
+  }
+
+  void rehash(size_t capacity);
+
+  std::vector<Entry> slots_;
+  size_t size_ = 0;
+};
+
+} // namespace model
+} // namespace duorou
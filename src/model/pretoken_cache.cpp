@@ -0,0 +1,88 @@
+#include "pretoken_cache.h"
+
+#include <functional>
+
+namespace duorou {
+namespace model {
+
+PreTokenCache::PreTokenCache(size_t capacity) { setCapacity(capacity); }
+
+bool PreTokenCache::lookup(std::string_view word, std::vector<int32_t> &out) {
+  if (shardCapacity_.load(std::memory_order_relaxed) == 0 ||
+      word.size() > kMaxWordBytes) {
+    return false;
+  }
+  const uint64_t hash = std::hash<std::string_view>{}(word);
+  Shard &shard = shardFor(hash);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(hash);
+    if (it != shard.index.end() && it->second->word == word) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      const std::vector<int32_t> &ids = it->second->ids;
+      out.insert(out.end(), ids.begin(), ids.end());
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void PreTokenCache::insert(std::string_view word, const int32_t *ids,
+                           size_t count) {
+  const size_t capacity = shardCapacity_.load(std::memory_order_relaxed);
+  if (capacity == 0 || word.size() > kMaxWordBytes) {
+    return;
+  }
+  const uint64_t hash = std::hash<std::string_view>{}(word);
+  Shard &shard = shardFor(hash);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(hash);
+  if (it != shard.index.end()) {
+    // Same word stored by a concurrent encoder, or a hash collision: the
+    // newest word wins the slot
+    Node &node = *it->second;
+    node.word.assign(word.data(), word.size());
+    node.ids.assign(ids, ids + count);
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return;
+  }
+  shard.lru.push_front(
+      Node{hash, std::string(word), std::vector<int32_t>(ids, ids + count)});
+  shard.index.emplace(hash, shard.lru.begin());
+  while (shard.lru.size() > capacity) {
+    shard.index.erase(shard.lru.back().hash);
+    shard.lru.pop_back();
+  }
+}
+
+void PreTokenCache::setCapacity(size_t capacity) {
+  // Round up so that a small non-zero capacity still caches something
+  shardCapacity_.store((capacity + kShards - 1) / kShards,
+                       std::memory_order_relaxed);
+  clear();
+}
+
+void PreTokenCache::clear() {
+  for (Shard &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.lru.clear();
+    shard.index.clear();
+  }
+}
+
+PreTokenCache::Stats PreTokenCache::stats() const {
+  Stats s;
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.misses = misses_.load(std::memory_order_relaxed);
+  s.capacity = shardCapacity_.load(std::memory_order_relaxed) * kShards;
+  for (const Shard &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    s.entries += shard.lru.size();
+  }
+  return s;
+}
+
+} // namespace model
+} // namespace duorou
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace duorou {
+namespace model {
+
+/**
+ * Bounded, thread-safe cache from a pre-token (the bytes of one split piece)
+ * to its BPE token ids.
+ *
+ * Entries are spread over kShards independently locked LRU lists by hash, so
+ * concurrent encoders rarely contend. Lookups hash the string_view once and
+ * compare bytes on hit; nothing is allocated unless a new entry is stored.
+ */
+class PreTokenCache {
+public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t entries = 0;
+    size_t capacity = 0;
+  };
+
+  /**
+   * @param capacity Total number of entries kept; 0 disables the cache
+   */
+  explicit PreTokenCache(size_t capacity = kDefaultCapacity);
+
+  PreTokenCache(const PreTokenCache &) = delete;
+  PreTokenCache &operator=(const PreTokenCache &) = delete;
+
+  /**
+   * Append the cached ids of word to out. Returns false on a miss, leaving
+   * out untouched.
+   */
+  bool lookup(std::string_view word, std::vector<int32_t> &out);
+
+  /**
+   * Store ids[0, count) for word, evicting the least recently used entry of
+   * its shard when full.
+   */
+  void insert(std::string_view word, const int32_t *ids, size_t count);
+
+  /**
+   * Change the capacity (0 disables) and drop every entry
+   */
+  void setCapacity(size_t capacity);
+
+  void clear();
+
+  Stats stats() const;
+
+  static constexpr size_t kDefaultCapacity = 32768;
+  // Pieces longer than this are not cached (rare, and costly to keep)
+  static constexpr size_t kMaxWordBytes = 128;
+
+private:
+  static constexpr size_t kShards = 16;
+
+  struct Node {
+    uint64_t hash;
+    std::string word;
+    std::vector<int32_t> ids;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<Node> lru; // most recently used first
+    std::unordered_map<uint64_t, std::list<Node>::iterator> index;
+  };
+
+  Shard &shardFor(uint64_t hash) { return shards_[hash % kShards]; }
+
+  std::array<Shard, kShards> shards_;
+  std::atomic<size_t> shardCapacity_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace model
+} // namespace duorou
@@ -0,0 +1,304 @@
+#include "pretokenizer.h"
+#include "unicode_categories.h"
+
+#include <iostream>
+
+namespace duorou {
+namespace model {
+
+namespace {
+
+// Simple utility to replace all occurrences of a substring
+void replaceAll(std::string &s, const std::string &from,
+                const std::string &to) {
+  if (from.empty())
+    return;
+  size_t pos = 0;
+  while ((pos = s.find(from, pos)) != std::string::npos) {
+    s.replace(pos, from.length(), to);
+    pos += to.length();
+  }
+}
+
+// Sanitize a Unicode-property regex into an ECMAScript-compatible approximation
+// Notes:
+// - std::regex (ECMAScript) does not support \p{..} classes.
+// - We approximate:
+//   \p{L} -> [A-Za-z\x80-\xFF] (treat non-ASCII bytes as letters to keep them
+//   grouped)
+//   \p{N} -> \d
+//   [^\s\p{L}\p{N}] -> [^\sA-Za-z\d\x80-\xFF]
+//   [^\r\n\p{L}\p{N}] -> [^\r\nA-Za-z\d\x80-\xFF]
+// This is a pragmatic compromise to avoid over-fragmentation for UTF-8 text.
+std::string sanitizePatternForECMA(std::string pattern) {
+  // First handle common negated classes to avoid double-replacing inner tokens
+  // later
+  replaceAll(pattern, "[^\\s\\p{L}\\p{N}]", "[^\\sA-Za-z\\d\\x80-\\xFF]");
+  replaceAll(pattern, "[^\\r\\n\\p{L}\\p{N}]", "[^\\r\\nA-Za-z\\d\\x80-\\xFF]");
+
+  // Replace Unicode property classes with ECMAScript-compatible approximations
+  replaceAll(pattern, "\\p{L}", "[A-Za-z\\x80-\\xFF]");
+  replaceAll(pattern, "\\p{N}", "\\d");
+  // Some patterns might contain double-escaped forms from C++ string literals
+  // or env strings
+  replaceAll(pattern, "\\\\p{L}", "[A-Za-z\\x80-\\xFF]");
+  replaceAll(pattern, "\\\\p{N}", "\\d");
+
+  // Remove unsupported non-capturing groups (?:...) by turning them into normal
+  // groups
+  replaceAll(pattern, "(?:", "(");
+
+  // Approximate unsupported negative lookahead used by GPT-2 pattern: \s+(?!\S)
+  // -> \s+ This loses the end-of-string specificity but remains a safe
+  // over-approximation for token splitting
+  replaceAll(pattern, "\\s+(?!\\S)", "\\s+");
+
+  return pattern;
+}
+
+// Patterns the scanner implements exactly
+struct KnownPattern {
+  const char *pattern;
+  bool gpt2;
+  bool ignoreCaseContractions;
+  size_t maxDigits;
+};
+
+const KnownPattern kKnownPatterns[] = {
+    // GPT-2
+    {R"('s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+)",
+     true, false, 0},
+    // Qwen default in tokenizer_factory.cpp
+    {R"((?:'[sS]|'[tT]|'[rR][eE]|'[vV][eE]|'[mM]|'[lL][lL]|'[dD])|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}+| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)",
+     false, true, 0},
+    // Qwen2 tokenizer.json
+    {R"((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)",
+     false, true, 1},
+    // cl100k / Llama 3
+    {R"((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)",
+     false, true, 3},
+};
+
+// Character classes the split rules are written in
+enum : unsigned {
+  kLetter = 1u << 0,
+  kNumber = 1u << 1,
+  kSpace = 1u << 2,   // \s
+  kNewline = 1u << 3, // \r or \n (always also kSpace)
+};
+
+// Decode and classify the codepoint at pos. Bytes that are not valid UTF-8
+// are neither letters, numbers nor spaces.
+inline unsigned classify(std::string_view text, size_t pos, size_t &len) {
+  const auto b0 = static_cast<unsigned char>(text[pos]);
+  if (b0 < 0x80) {
+    len = 1;
+    if ((b0 | 0x20) >= 'a' && (b0 | 0x20) <= 'z')
+      return kLetter;
+    if (b0 >= '0' && b0 <= '9')
+      return kNumber;
+    if (b0 == '\r' || b0 == '\n')
+      return kSpace | kNewline;
+    if (b0 == ' ' || (b0 >= 0x09 && b0 <= 0x0D))
+      return kSpace;
+    return 0;
+  }
+  const uint32_t cp = decodeUtf8(text, pos, len);
+  if (len == 1)
+    return 0;
+  if (isUnicodeLetter(cp))
+    return kLetter;
+  if (isUnicodeNumber(cp))
+    return kNumber;
+  if (isUnicodeWhitespace(cp))
+    return kSpace;
+  return 0;
+}
+
+// End of the run of codepoints starting at pos whose class intersects mask
+inline size_t skipClass(std::string_view text, size_t pos, unsigned mask) {
+  size_t len = 0;
+  while (pos < text.size() && (classify(text, pos, len) & mask)) {
+    pos += len;
+  }
+  return pos;
+}
+
+// End of the run of codepoints starting at pos that are neither letters,
+// numbers nor spaces
+inline size_t skipOther(std::string_view text, size_t pos) {
+  size_t len = 0;
+  while (pos < text.size() && classify(text, pos, len) == 0) {
+    pos += len;
+  }
+  return pos;
+}
+
+inline char lowerAscii(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+} // namespace
+
+PreTokenizer::PreTokenizer(const std::string &pattern, bool forceRegex) {
+  std::string normalized = pattern;
+  replaceAll(normalized, "\\\\", "\\");
+  for (const KnownPattern &known : kKnownPatterns) {
+    if (!forceRegex && normalized == known.pattern) {
+      scanner_ = true;
+      family_ = known.gpt2 ? Family::Gpt2 : Family::Cl100k;
+      ignoreCaseContractions_ = known.ignoreCaseContractions;
+      maxDigits_ = known.maxDigits;
+      return;
+    }
+  }
+
+  try {
+    // Try to compile given pattern with ECMAScript first
+    std::string sanitized = sanitizePatternForECMA(pattern);
+    regex_ =
+        std::regex(sanitized, std::regex::ECMAScript | std::regex::optimize);
+  } catch (const std::regex_error &e) {
+    // Fallback to a safe, ECMAScript-compatible pattern that roughly mimics
+    // intended behavior
+    std::cerr << "[WARN] Invalid BPE regex pattern for std::regex "
+                 "(ECMAScript). Fallback to safe pattern. Reason: "
+              << e.what() << std::endl;
+    // This groups: ASCII letters, digits, runs of non-ASCII bytes (UTF-8),
+    // punctuation runs, and whitespace runs
+    const char *kSafeFallbackPattern =
+        R"([A-Za-z]+|\d+|[\x80-\xFF]+|[^\sA-Za-z\d\x80-\xFF]+|\s+)";
+    try {
+      regex_ = std::regex(kSafeFallbackPattern,
+                          std::regex::ECMAScript | std::regex::optimize);
+    } catch (...) {
+      // Ultimate guard: extremely simple splitter that always compiles
+      regex_ = std::regex(R"(\S+|\s+)", std::regex::ECMAScript);
+    }
+  }
+}
+
+void PreTokenizer::split(std::string_view text,
+                         std::vector<std::string_view> &out) const {
+  if (scanner_) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+      const size_t len = nextPiece(text, pos);
+      out.push_back(text.substr(pos, len));
+      pos += len;
+    }
+    return;
+  }
+
+  std::cregex_iterator iter(text.data(), text.data() + text.size(), regex_);
+  std::cregex_iterator end;
+  for (; iter != end; ++iter) {
+    out.push_back(text.substr(static_cast<size_t>(iter->position()),
+                              static_cast<size_t>(iter->length())));
+  }
+}
+
+// Alternatives are tried in pattern order, each with the result a
+// backtracking engine would produce:
+//   GPT-2:  's|'t|'re|'ve|'m|'ll|'d | ?\p{L}+ | ?\p{N}+ | ?[^\s\p{L}\p{N}]+
+//           | \s+(?!\S) | \s+
+//   cl100k: (?i:'s|'t|'re|'ve|'m|'ll|'d) | [^\r\n\p{L}\p{N}]?\p{L}+
+//           | \p{N}{1,maxDigits} | ?[^\s\p{L}\p{N}]+[\r\n]* | \s*[\r\n]+
+//           | \s+(?!\S) | \s+
+size_t PreTokenizer::nextPiece(std::string_view text, size_t pos) const {
+  const size_t n = text.size();
+  size_t len0 = 0;
+  const unsigned c0 = classify(text, pos, len0);
+  const size_t next = pos + len0;
+  size_t len1 = 0;
+  const unsigned c1 = next < n ? classify(text, next, len1) : 0;
+
+  // Contractions
+  if (text[pos] == '\'' && next < n) {
+    auto at = [&](size_t i) {
+      const char c = pos + i < n ? text[pos + i] : '\0';
+      return ignoreCaseContractions_ ? lowerAscii(c) : c;
+    };
+    const char a = at(1);
+    if (a == 's' || a == 't' || a == 'm' || a == 'd')
+      return 2;
+    const char b = at(2);
+    if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') ||
+        (a == 'l' && b == 'l'))
+      return 3;
+  }
+
+  if (family_ == Family::Gpt2) {
+    const bool lead = text[pos] == ' ';
+    //  ?\p{L}+ and  ?\p{N}+
+    for (unsigned cls : {unsigned(kLetter), unsigned(kNumber)}) {
+      if (c0 & cls)
+        return skipClass(text, pos, cls) - pos;
+      if (lead && (c1 & cls))
+        return skipClass(text, next, cls) - pos;
+    }
+    //  ?[^\s\p{L}\p{N}]+
+    if (c0 == 0)
+      return skipOther(text, pos) - pos;
+    if (lead && next < n && c1 == 0)
+      return skipOther(text, next) - pos;
+  } else {
+    // [^\r\n\p{L}\p{N}]?\p{L}+
+    if (c0 & kLetter)
+      return skipClass(text, pos, kLetter) - pos;
+    if (!(c0 & (kNewline | kNumber)) && (c1 & kLetter))
+      return skipClass(text, next, kLetter) - pos;
+    // \p{N}{1,maxDigits}
+    if (c0 & kNumber) {
+      size_t p = pos, len = 0, count = 0;
+      while (p < n && (maxDigits_ == 0 || count < maxDigits_) &&
+             (classify(text, p, len) & kNumber)) {
+        p += len;
+        ++count;
+      }
+      return p - pos;
+    }
+    //  ?[^\s\p{L}\p{N}]+[\r\n]*
+    const bool other = c0 == 0;
+    if (other || (text[pos] == ' ' && next < n && c1 == 0)) {
+      size_t p = skipOther(text, other ? pos : next);
+      while (p < n && (text[p] == '\r' || text[p] == '\n'))
+        ++p;
+      return p - pos;
+    }
+  }
+
+  if (c0 & kSpace) {
+    const size_t runEnd = skipClass(text, pos, kSpace);
+    if (family_ == Family::Cl100k) {
+      // \s*[\r\n]+ : up to and including the last newline of the run
+      size_t lastNewline = n;
+      for (size_t p = pos; p < runEnd; ++p) {
+        if (text[p] == '\r' || text[p] == '\n')
+          lastNewline = p;
+      }
+      if (lastNewline != n)
+        return lastNewline + 1 - pos;
+    }
+    // \s+(?!\S) : the whole run at end of text, otherwise all but its last
+    // codepoint so that the next piece can take it as a leading space
+    if (runEnd == n)
+      return runEnd - pos;
+    size_t lastStart = pos, p = pos, len = 0;
+    while (p < runEnd) {
+      lastStart = p;
+      classify(text, p, len);
+      p += len;
+    }
+    if (lastStart > pos)
+      return lastStart - pos;
+    // \s+
+    return runEnd - pos;
+  }
+
+  // Not reachable for valid rules; keep scanning progress
+  return len0;
+}
+
+} // namespace model
+} // namespace duorou
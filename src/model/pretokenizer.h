@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace duorou {
+namespace model {
+
+/**
+ * Splits text into pre-tokens before BPE merges are applied.
+ *
+ * The GPT-2 pattern and the Qwen2 / cl100k family of patterns are executed
+ * by a hand-written UTF-8 scanner with real Unicode letter/number/space
+ * tables (see unicode_categories.h). It produces the same pieces as a
+ * Unicode-aware regex engine without backtracking or allocating. Any other
+ * pattern falls back to std::regex after approximating \p{L} / \p{N} for
+ * ECMAScript.
+ */
+class PreTokenizer {
+public:
+  /**
+   * @param pattern Pre-tokenize regex from the model (tokenizer.ggml.pre or
+   *                the architecture default)
+   * @param forceRegex Always use the std::regex path (benchmarks, debugging)
+   */
+  explicit PreTokenizer(const std::string &pattern, bool forceRegex = false);
+
+  /**
+   * Append the pieces of text to out as views into text. Pieces are
+   * contiguous and cover the whole input.
+   */
+  void split(std::string_view text, std::vector<std::string_view> &out) const;
+
+  /**
+   * Whether the std::regex fallback is in use
+   */
+  bool usesRegex() const { return !scanner_; }
+
+private:
+  enum class Family { Gpt2, Cl100k };
+
+  // Byte length of the piece starting at pos (pos < text.size())
+  size_t nextPiece(std::string_view text, size_t pos) const;
+
+  bool scanner_ = false;
+  Family family_ = Family::Cl100k;
+  // Contractions match 'S / 'RE / ... as well ((?i:...) in the pattern)
+  bool ignoreCaseContractions_ = false;
+  // Longest \p{N} run per piece; 0 means unbounded (\p{N}+)
+  size_t maxDigits_ = 0;
+
+  std::regex regex_;
+};
+
+} // namespace model
+} // namespace duorou
@@ -0,0 +1,114 @@
+// Pre-tokenizer throughput benchmark.
+// Splits English, Chinese and mixed corpora with the hand-written scanner
+// and with the std::regex fallback for the same pattern, reporting MB/s and
+// the number of pieces. The regex path approximates \p{L} / \p{N}, so its
+// piece counts differ on non-ASCII text.
+//
+// Usage: pretokenizer_bench [megabytes]
+
+#include "pretokenizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using duorou::model::PreTokenizer;
+
+const char *kEnglishWords[] = {
+    "the",    "model",  "returns", "tokens", "it's",   "we'll",  "don't",
+    "cache",  "layer",  "Hello",   "World",  "2024",   "3.14",   "(x)",
+    "a+b=c",  "JSON",   "users",   "they're", "I'm",   "speed",  "GPU"};
+const char *kChineseWords[] = {"模型", "推理", "缓存", "我们", "今天",
+                               "数据", "中文", "分词", "速度", "：",
+                               "，",   "。",   "１２３", "（测试）", "的"};
+
+std::string makeCorpus(size_t bytes, int chinesePercent, std::mt19937 &rng) {
+  std::string out;
+  out.reserve(bytes + 64);
+  std::uniform_int_distribution<int> pct(0, 99);
+  std::uniform_int_distribution<size_t> en(0, std::size(kEnglishWords) - 1);
+  std::uniform_int_distribution<size_t> zh(0, std::size(kChineseWords) - 1);
+  while (out.size() < bytes) {
+    const bool chinese = pct(rng) < chinesePercent;
+    if (chinese) {
+      out += kChineseWords[zh(rng)];
+    } else {
+      if (!out.empty())
+        out += ' ';
+      out += kEnglishWords[en(rng)];
+    }
+    const int r = pct(rng);
+    if (r < 3)
+      out += "\n";
+    else if (r < 4)
+      out += "\n\n  ";
+  }
+  return out;
+}
+
+struct Result {
+  double mbps;
+  size_t pieces;
+};
+
+Result run(const PreTokenizer &pre, const std::string &corpus, int reps) {
+  std::vector<std::string_view> pieces;
+  double best = 1e30;
+  for (int r = 0; r < reps; ++r) {
+    pieces.clear();
+    auto t0 = Clock::now();
+    pre.split(corpus, pieces);
+    best = std::min(best,
+                    std::chrono::duration<double>(Clock::now() - t0).count());
+  }
+  return {static_cast<double>(corpus.size()) / best / 1e6, pieces.size()};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const double mb = argc > 1 ? std::max(0.1, std::atof(argv[1])) : 2.0;
+  const size_t bytes = static_cast<size_t>(mb * 1e6);
+  const int reps = 3;
+
+  struct Pattern {
+    const char *name;
+    const char *pattern;
+  };
+  const Pattern patterns[] = {
+      // Qwen default from tokenizer_factory.cpp
+      {"qwen",
+       R"((?:'[sS]|'[tT]|'[rR][eE]|'[vV][eE]|'[mM]|'[lL][lL]|'[dD])|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}+| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)"},
+      {"gpt2",
+       R"('s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+)"},
+  };
+  struct Corpus {
+    const char *name;
+    int chinesePercent;
+  };
+  const Corpus corpora[] = {{"english", 0}, {"mixed", 40}, {"chinese", 100}};
+
+  std::printf("%-6s %-8s %9s %12s %9s %12s %8s\n", "pat", "corpus", "scan MB/s",
+              "scan pieces", "regex MB/s", "regex pieces", "speedup");
+  std::mt19937 rng(11);
+  for (const Corpus &c : corpora) {
+    const std::string corpus = makeCorpus(bytes, c.chinesePercent, rng);
+    for (const Pattern &p : patterns) {
+      PreTokenizer scanner(p.pattern);
+      PreTokenizer regex(p.pattern, /*forceRegex=*/true);
+      const Result s = run(scanner, corpus, reps);
+      const Result r = run(regex, corpus, reps);
+      std::printf("%-6s %-8s %9.1f %12zu %9.1f %12zu %7.1fx\n", p.name, c.name,
+                  s.mbps, s.pieces, r.mbps, r.pieces, s.mbps / r.mbps);
+    }
+  }
+  return 0;
+}
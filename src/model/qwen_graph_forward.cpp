@@ -0,0 +1,326 @@
+#include "qwen_graph_forward.h"
+
+#include "../ml/quant.h"
+
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+namespace duorou {
+namespace model {
+
+namespace {
+// Upper bound of graph nodes per decoder layer (about 35 are used)
+constexpr size_t kNodesPerLayer = 64;
+constexpr size_t kExtraNodes = 32;
+} // namespace
+
+QwenGraphForward::~QwenGraphForward() { release(); }
+
+void QwenGraphForward::release() {
+  if (galloc_) {
+    ggml_gallocr_free(galloc_);
+    galloc_ = nullptr;
+  }
+  if (weightCtx_) {
+    ggml_free(weightCtx_);
+    weightCtx_ = nullptr;
+  }
+  layers_.clear();
+  owned_.clear();
+  outputNorm_ = nullptr;
+  output_ = nullptr;
+  ropeFactors_ = nullptr;
+  bound_ = false;
+}
+
+ggml_tensor *QwenGraphForward::bindTensor(const float *data, int64_t ne0,
+                                          int64_t ne1) {
+  ggml_tensor *t =
+      ne1 == 1 ? ggml_new_tensor_1d(weightCtx_, GGML_TYPE_F32, ne0)
+               : ggml_new_tensor_2d(weightCtx_, GGML_TYPE_F32, ne0, ne1);
+  // ggml never writes to weights, the const_cast only satisfies its API
+  t->data = const_cast<float *>(data);
+  return t;
+}
+
+ggml_tensor *QwenGraphForward::bindNorm(const float *weights) {
+  const size_t hidden = desc_.hiddenSize;
+  if (weights) {
+    return bindTensor(weights, static_cast<int64_t>(hidden));
+  }
+  // Same as the per-op RMSNorm: a missing scale means 1.0
+  owned_.emplace_back(hidden, 1.0f);
+  return bindTensor(owned_.back().data(), static_cast<int64_t>(hidden));
+}
+
+ggml_tensor *QwenGraphForward::bindBias(const float *bias, size_t dim) {
+  // Models without projection biases simply skip the add
+  return bias ? bindTensor(bias, static_cast<int64_t>(dim)) : nullptr;
+}
+
+ggml_tensor *QwenGraphForward::bindMatrix(const QwenGraphMatrix &weights,
+                                          size_t inDim, size_t outDim) {
+  if (inDim == 0 || outDim == 0) {
+    return nullptr;
+  }
+  if (weights.quant) {
+    const duorou::ml::QuantMatrix &q = *weights.quant;
+    if (q.empty() || q.cols != inDim || q.rows != outDim) {
+      return nullptr;
+    }
+    // QuantType values are ggml_type ids and the blocks use ggml's layout
+    ggml_tensor *t = ggml_new_tensor_2d(weightCtx_, static_cast<ggml_type>(q.type),
+                                        static_cast<int64_t>(inDim),
+                                        static_cast<int64_t>(outDim));
+    t->data = const_cast<uint8_t *>(q.blocks());
+    return t;
+  }
+  if (!weights.data) {
+    return nullptr;
+  }
+  if (!weights.inOut) {
+    // [out, in] row-major is ggml's ne0 = in, ne1 = out
+    return bindTensor(weights.data, static_cast<int64_t>(inDim),
+                      static_cast<int64_t>(outDim));
+  }
+  std::vector<float> t(inDim * outDim);
+  for (size_t i = 0; i < inDim; ++i) {
+    for (size_t o = 0; o < outDim; ++o) {
+      t[o * inDim + i] = weights.data[i * outDim + o];
+    }
+  }
+  owned_.push_back(std::move(t));
+  return bindTensor(owned_.back().data(), static_cast<int64_t>(inDim),
+                    static_cast<int64_t>(outDim));
+}
+
+bool QwenGraphForward::bind(const QwenGraphWeights &weights) {
+  release();
+  desc_ = weights;
+
+  const size_t E = desc_.hiddenSize;
+  const size_t H = desc_.numHeads;
+  const size_t HK = desc_.numKVHeads;
+  if (E == 0 || H == 0 || HK == 0 || E % H != 0 || H % HK != 0 ||
+      desc_.layers.empty() || desc_.outputRows == 0 || desc_.vocabSize == 0) {
+    return false;
+  }
+  const size_t D = E / H;
+  const size_t kvDim = HK * D;
+
+  const size_t nTensors = desc_.layers.size() * 12 + 3;
+  ggml_init_params params{
+      /*.mem_size   =*/ggml_tensor_overhead() * nTensors,
+      /*.mem_buffer =*/nullptr,
+      /*.no_alloc   =*/true,
+  };
+  weightCtx_ = ggml_init(params);
+  if (!weightCtx_) {
+    return false;
+  }
+  // Pointers into owned_ are handed to ggml, so it must never reallocate
+  owned_.reserve(desc_.layers.size() * 9 + 3);
+
+  bool ok = true;
+  layers_.resize(desc_.layers.size());
+  for (size_t li = 0; li < desc_.layers.size() && ok; ++li) {
+    const QwenGraphLayer &src = desc_.layers[li];
+    LayerWeights &lw = layers_[li];
+    const size_t F = src.ffnDim;
+
+    lw.attnNorm = bindNorm(src.attnNorm);
+    lw.ffnNorm = bindNorm(src.ffnNorm);
+    lw.wq = bindMatrix(src.wq, E, H * D);
+    lw.wk = bindMatrix(src.wk, E, kvDim);
+    lw.wv = bindMatrix(src.wv, E, kvDim);
+    lw.wo = bindMatrix(src.wo, H * D, E);
+    lw.bq = bindBias(src.bq, H * D);
+    lw.bk = bindBias(src.bk, kvDim);
+    lw.bv = bindBias(src.bv, kvDim);
+    lw.gate = bindMatrix(src.gate, E, F);
+    lw.up = bindMatrix(src.up, E, F);
+    lw.down = bindMatrix(src.down, F, E);
+    lw.ropeInAttention = src.ropeInAttention;
+
+    ok = lw.wq && lw.wk && lw.wv && lw.wo && lw.gate && lw.up && lw.down;
+  }
+  if (!ok) {
+    release();
+    return false;
+  }
+
+  outputNorm_ = bindNorm(desc_.outputNorm);
+  output_ = bindMatrix(desc_.output, E, desc_.outputRows);
+  if (!output_) {
+    release();
+    return false;
+  }
+
+  // Precomputed RoPE frequencies become ggml frequency factors:
+  // theta_i = pos * base^(-2i/n) / factor_i
+  const size_t ropeDim = std::min(desc_.ropeDim, D) & ~size_t(1);
+  if (ropeDim > 0 && desc_.ropeFreqs) {
+    std::vector<float> factors(ropeDim / 2);
+    for (size_t i = 0; i < factors.size(); ++i) {
+      const float base =
+          std::pow(desc_.ropeBase, -2.0f * static_cast<float>(i) /
+                                       static_cast<float>(ropeDim));
+      const float freq = desc_.ropeFreqs[i];
+      factors[i] = freq != 0.0f ? base / freq : 1.0f;
+    }
+    owned_.push_back(std::move(factors));
+    ropeFactors_ = bindTensor(owned_.back().data(),
+                              static_cast<int64_t>(ropeDim / 2));
+  }
+
+  galloc_ = ggml_gallocr_new(ggml_backend_cpu_buffer_type());
+  if (!galloc_) {
+    release();
+    return false;
+  }
+  bound_ = true;
+  return true;
+}
+
+std::vector<float>
+QwenGraphForward::forward(const std::vector<float> &embeddings,
+                          size_t seqLen, const ComputeFn &compute) {
+  const QwenGraphWeights &opt = desc_;
+  const int64_t E = static_cast<int64_t>(opt.hiddenSize);
+  if (!bound_ || !compute || seqLen == 0 ||
+      embeddings.size() != seqLen * opt.hiddenSize) {
+    return {};
+  }
+  const int64_t S = static_cast<int64_t>(seqLen);
+  const int64_t H = static_cast<int64_t>(opt.numHeads);
+  const int64_t HK = static_cast<int64_t>(opt.numKVHeads);
+  const int64_t D = E / H;
+  const int ropeDim =
+      static_cast<int>(std::min<int64_t>(static_cast<int64_t>(opt.ropeDim), D) &
+                       ~int64_t(1));
+  const float ropeScale = opt.ropeScale == 0.0f ? 1.0f : opt.ropeScale;
+  const float kqScale = 1.0f / std::sqrt(static_cast<float>(D));
+  const float residScale = 1.0f / std::sqrt(2.0f);
+
+  const size_t maxNodes = layers_.size() * kNodesPerLayer + kExtraNodes;
+  const size_t metaBytes = ggml_tensor_overhead() * maxNodes +
+                           ggml_graph_overhead_custom(maxNodes, false);
+  if (metaBuf_.size() < metaBytes) {
+    metaBuf_.resize(metaBytes);
+  }
+  ggml_init_params params{
+      /*.mem_size   =*/metaBuf_.size(),
+      /*.mem_buffer =*/metaBuf_.data(),
+      /*.no_alloc   =*/true,
+  };
+  ggml_context *g = ggml_init(params);
+  if (!g) {
+    return {};
+  }
+  ggml_cgraph *gf = ggml_new_graph_custom(g, maxNodes, false);
+
+  ggml_tensor *inp = ggml_new_tensor_2d(g, GGML_TYPE_F32, E, S);
+  ggml_set_input(inp);
+  ggml_tensor *pos = ggml_new_tensor_1d(g, GGML_TYPE_I32, S);
+  ggml_set_input(pos);
+
+  // Qwen2 rotates the two halves of each head (NeoX layout), not
+  // adjacent pairs
+  auto rope = [&](ggml_tensor *x) {
+    return ggml_rope_ext(g, x, pos, ropeFactors_, ropeDim, GGML_ROPE_TYPE_NEOX,
+                         static_cast<int>(opt.originalContextLength),
+                         opt.ropeBase, 1.0f / ropeScale, 0.0f, 1.0f, 0.0f,
+                         0.0f);
+  };
+
+  ggml_tensor *cur = inp;
+  for (const LayerWeights &lw : layers_) {
+    ggml_tensor *x = cur;
+    ggml_tensor *h = ggml_mul(g, ggml_rms_norm(g, x, opt.eps), lw.attnNorm);
+
+    // Self-attention: [D, H, S] views, GQA by broadcasting K/V heads
+    auto project = [&](ggml_tensor *w, ggml_tensor *b) {
+      ggml_tensor *y = ggml_mul_mat(g, w, h);
+      return b ? ggml_add(g, y, b) : y;
+    };
+    ggml_tensor *q = ggml_reshape_3d(g, project(lw.wq, lw.bq), D, H, S);
+    ggml_tensor *k = ggml_reshape_3d(g, project(lw.wk, lw.bk), D, HK, S);
+    ggml_tensor *v = ggml_reshape_3d(g, project(lw.wv, lw.bv), D, HK, S);
+    if (lw.ropeInAttention && ropeDim > 0) {
+      q = rope(q);
+      k = rope(k);
+    }
+    q = ggml_permute(g, q, 0, 2, 1, 3);                // [D, S, H]
+    k = ggml_permute(g, k, 0, 2, 1, 3);                // [D, S, HK]
+    v = ggml_cont(g, ggml_permute(g, v, 1, 2, 0, 3));  // [S, D, HK]
+
+    ggml_tensor *kq = ggml_mul_mat(g, k, q);           // [S, S, H]
+    kq = ggml_scale(g, kq, kqScale);
+    kq = ggml_diag_mask_inf(g, kq, 0);
+    kq = ggml_soft_max(g, kq);
+
+    ggml_tensor *kqv = ggml_mul_mat(g, v, kq);         // [D, S, H]
+    kqv = ggml_cont(g, ggml_permute(g, kqv, 0, 2, 1, 3));
+    kqv = ggml_reshape_2d(g, kqv, H * D, S);
+    ggml_tensor *attnOut = ggml_mul_mat(g, lw.wo, kqv);
+
+    ggml_tensor *resid = ggml_scale(g, ggml_add(g, x, attnOut), residScale);
+
+    // SwiGLU FFN
+    h = ggml_mul(g, ggml_rms_norm(g, resid, opt.eps), lw.ffnNorm);
+    ggml_tensor *gate = ggml_silu(g, ggml_mul_mat(g, lw.gate, h));
+    ggml_tensor *up = ggml_mul_mat(g, lw.up, h);
+    ggml_tensor *ffnOut = ggml_mul_mat(g, lw.down, ggml_mul(g, gate, up));
+
+    cur = ggml_scale(g, ggml_add(g, resid, ffnOut), residScale);
+  }
+
+  // Only the last token reaches the LM head
+  cur = ggml_view_2d(g, cur, E, 1, cur->nb[1], (S - 1) * cur->nb[1]);
+  cur = ggml_mul(g, ggml_rms_norm(g, cur, opt.eps), outputNorm_);
+  ggml_tensor *logits = ggml_mul_mat(g, output_, cur);
+  ggml_set_output(logits);
+  ggml_build_forward_expand(gf, logits);
+
+  std::vector<float> result;
+  if (!ggml_gallocr_alloc_graph(galloc_, gf)) {
+    std::cerr << "[ERROR] QwenGraphForward: failed to allocate graph for "
+              << seqLen << " tokens" << std::endl;
+    ggml_free(g);
+    return result;
+  }
+
+  std::memcpy(inp->data, embeddings.data(), ggml_nbytes(inp));
+  int32_t *posData = static_cast<int32_t *>(pos->data);
+  for (int64_t i = 0; i < S; ++i) {
+    posData[i] = static_cast<int32_t>(i);
+  }
+
+  try {
+    compute(gf);
+  } catch (const std::exception &e) {
+    std::cerr << "[ERROR] QwenGraphForward: " << e.what() << std::endl;
+    ggml_free(g);
+    return result;
+  }
+
+  // Sized to the tokenizer vocab like computeLogitsFromHidden
+  result.assign(opt.vocabSize, 0.0f);
+  const float *src = static_cast<const float *>(logits->data);
+  const size_t n = std::min(result.size(), opt.outputRows);
+  for (size_t i = 0; i < n; ++i) {
+    result[i] = std::isfinite(src[i]) ? src[i] : 0.0f;
+  }
+  ggml_free(g);
+  return result;
+}
+
+} // namespace model
+} // namespace duorou
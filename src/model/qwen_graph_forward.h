@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct ggml_context;
+struct ggml_tensor;
+struct ggml_gallocr;
+struct ggml_cgraph;
+
+namespace duorou {
+namespace ml {
+struct QuantMatrix;
+}
+
+namespace model {
+
+// One projection matrix of the decoder. Float weights are row-major
+// [out, in] unless inOut is set ([in, out], transposed into an owned copy
+// at bind time); quant takes precedence over data when both are set.
+struct QwenGraphMatrix {
+  const float *data = nullptr;
+  const duorou::ml::QuantMatrix *quant = nullptr;
+  bool inOut = false;
+};
+
+struct QwenGraphLayer {
+  const float *attnNorm = nullptr; // [hidden]; nullptr means all ones
+  const float *ffnNorm = nullptr;
+  QwenGraphMatrix wq, wk, wv, wo;
+  const float *bq = nullptr; // optional projection biases
+  const float *bk = nullptr;
+  const float *bv = nullptr;
+  size_t ffnDim = 0;
+  QwenGraphMatrix gate, up, down;
+  bool ropeInAttention = false;
+};
+
+// Borrowed view of the decoder weights; the pointed-to memory must outlive
+// the bound QwenGraphForward.
+struct QwenGraphWeights {
+  size_t hiddenSize = 0;
+  size_t numHeads = 0;
+  size_t numKVHeads = 0;
+  size_t ropeDim = 0;
+  size_t originalContextLength = 0;
+  float ropeBase = 10000.0f;
+  float ropeScale = 1.0f;
+  float eps = 1e-6f;
+  std::vector<QwenGraphLayer> layers;
+  const float *outputNorm = nullptr;
+  QwenGraphMatrix output; // [outputRows, hidden]
+  size_t outputRows = 0;
+  // Precomputed RoPE frequencies (ropeDim / 2 of them); nullptr means the
+  // plain base^(-2i/n) schedule
+  const float *ropeFreqs = nullptr;
+  // Logits size; rows past outputRows are left at zero
+  size_t vocabSize = 0;
+};
+
+// Runs the Qwen2 decoder stack as a single ggml compute graph.
+//
+// Weights are bound once: ggml tensors point straight at the described host
+// floats or quantized blocks. Each forward builds one graph over all
+// layers, lets ggml-alloc place the intermediates in a reused buffer, and
+// hands it to the caller's compute function (one ggml_graph_compute). Only
+// the embeddings go in and only the last-token logits come out.
+//
+// The graph mirrors the per-op path in qwen_text_model.cpp: pre-norm RMSNorm,
+// Q/K/V projections with their biases when the model has them, GQA causal
+// attention (NeoX-style RoPE in attention when enabled on the layers),
+// residuals scaled by 1/sqrt(2), SwiGLU FFN, final RMSNorm, LM head. The
+// all-zero perturbation fallbacks of the per-op path are not reproduced.
+// No KV cache: callers fall back to the per-op path when one is given.
+class QwenGraphForward {
+public:
+  using ComputeFn = std::function<void(ggml_cgraph *)>;
+
+  QwenGraphForward() = default;
+  ~QwenGraphForward();
+
+  QwenGraphForward(const QwenGraphForward &) = delete;
+  QwenGraphForward &operator=(const QwenGraphForward &) = delete;
+
+  // Bind the weights. Returns false when shapes are not usable, in which
+  // case the caller should stay on the per-op path.
+  bool bind(const QwenGraphWeights &weights);
+  bool isBound() const { return bound_; }
+
+  // embeddings: [seqLen * hidden] after embedding-stage positional encoding.
+  // Returns logits of the last token sized to weights.vocabSize, or an empty
+  // vector on failure (including compute throwing).
+  std::vector<float> forward(const std::vector<float> &embeddings,
+                             size_t seqLen, const ComputeFn &compute);
+
+private:
+  struct LayerWeights {
+    ggml_tensor *attnNorm = nullptr;
+    ggml_tensor *wq = nullptr;
+    ggml_tensor *wk = nullptr;
+    ggml_tensor *wv = nullptr;
+    ggml_tensor *wo = nullptr;
+    ggml_tensor *bq = nullptr;
+    ggml_tensor *bk = nullptr;
+    ggml_tensor *bv = nullptr;
+    ggml_tensor *ffnNorm = nullptr;
+    ggml_tensor *gate = nullptr;
+    ggml_tensor *up = nullptr;
+    ggml_tensor *down = nullptr;
+    bool ropeInAttention = false;
+  };
+
+  ggml_tensor *bindTensor(const float *data, int64_t ne0, int64_t ne1 = 1);
+  ggml_tensor *bindNorm(const float *weights);
+  ggml_tensor *bindBias(const float *bias, size_t dim);
+  ggml_tensor *bindMatrix(const QwenGraphMatrix &weights, size_t inDim,
+                          size_t outDim);
+  void release();
+
+  bool bound_ = false;
+  QwenGraphWeights desc_;
+
+  ggml_context *weightCtx_ = nullptr;
+  ggml_gallocr *galloc_ = nullptr;
+  std::vector<LayerWeights> layers_;
+  ggml_tensor *outputNorm_ = nullptr;
+  ggml_tensor *output_ = nullptr;
+  ggml_tensor *ropeFactors_ = nullptr;
+
+  // Host copies for weights that cannot be referenced in place
+  std::vector<std::vector<float>> owned_;
+  // Graph metadata arena, reused across forwards
+  std::vector<uint8_t> metaBuf_;
+};
+
+} // namespace model
+} // namespace duorou
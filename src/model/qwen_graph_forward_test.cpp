@@ -0,0 +1,354 @@
+// Compares the fused single-graph Qwen2 decoder against a scalar reference
+// forward on tiny random weights: Q/K/V biases, GQA, NeoX RoPE with
+// precomputed frequencies, a transposed ([in, out]) FFN matrix, and Q8_0
+// attention and FFN weights.
+
+#include "../ml/quant.h"
+#include "qwen_graph_forward.h"
+
+#include "ggml-cpu.h"
+#include "ggml.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace duorou::model;
+using duorou::ml::QuantMatrix;
+
+namespace {
+
+constexpr size_t kHidden = 64;
+constexpr size_t kHeads = 4;
+constexpr size_t kKVHeads = 2;
+constexpr size_t kHeadDim = kHidden / kHeads;
+constexpr size_t kRopeDim = 16;
+constexpr size_t kLayers = 2;
+constexpr size_t kFfn = 160;
+constexpr size_t kVocab = 97;
+constexpr float kRopeBase = 10000.0f;
+constexpr float kEps = 1e-6f;
+
+struct Rng {
+  uint32_t state;
+  float next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<float>(state >> 8) / 8388608.0f - 1.0f; // [-1, 1)
+  }
+  std::vector<float> fill(size_t n, float scale, float offset = 0.0f) {
+    std::vector<float> v(n);
+    for (auto &x : v)
+      x = offset + scale * next();
+    return v;
+  }
+};
+
+// Float weights, all row-major [out, in]
+struct Layer {
+  std::vector<float> attnNorm, ffnNorm;
+  std::vector<float> wq, wk, wv, wo, bq, bk, bv;
+  std::vector<float> gate, up, down;
+};
+
+struct Model {
+  float ropeScale = 1.0f;
+  bool ropeInAttention = true;
+  std::vector<Layer> layers;
+  std::vector<float> outputNorm, output, ropeFreqs, embeddings;
+};
+
+Model makeModel(uint32_t seed, size_t seqLen) {
+  Rng rng{seed};
+  Model m;
+  const size_t kvDim = kKVHeads * kHeadDim;
+  auto xavier = [&](size_t in, size_t out) {
+    return rng.fill(in * out, 1.0f / std::sqrt(static_cast<float>(in)));
+  };
+  for (size_t l = 0; l < kLayers; ++l) {
+    Layer L;
+    L.attnNorm = rng.fill(kHidden, 0.1f, 1.0f);
+    L.ffnNorm = rng.fill(kHidden, 0.1f, 1.0f);
+    L.wq = xavier(kHidden, kHidden);
+    L.wk = xavier(kHidden, kvDim);
+    L.wv = xavier(kHidden, kvDim);
+    L.wo = xavier(kHidden, kHidden);
+    L.bq = rng.fill(kHidden, 0.1f);
+    L.bk = rng.fill(kvDim, 0.1f);
+    L.bv = rng.fill(kvDim, 0.1f);
+    L.gate = xavier(kHidden, kFfn);
+    L.up = xavier(kHidden, kFfn);
+    L.down = xavier(kFfn, kHidden);
+    m.layers.push_back(std::move(L));
+  }
+  m.outputNorm = rng.fill(kHidden, 0.1f, 1.0f);
+  m.output = xavier(kHidden, kVocab);
+  // Off the plain schedule so the frequency factors matter
+  for (size_t i = 0; i < kRopeDim / 2; ++i) {
+    m.ropeFreqs.push_back(std::pow(kRopeBase, -2.0f * i / kRopeDim) *
+                          (1.0f + 0.05f * static_cast<float>(i)));
+  }
+  m.embeddings = rng.fill(seqLen * kHidden, 1.0f);
+  return m;
+}
+
+// ---- Scalar reference ----
+
+std::vector<float> rmsNorm(const float *x, const std::vector<float> &w) {
+  double ss = 0.0;
+  for (size_t i = 0; i < kHidden; ++i)
+    ss += static_cast<double>(x[i]) * x[i];
+  const float inv = 1.0f / std::sqrt(static_cast<float>(ss / kHidden) + kEps);
+  std::vector<float> y(kHidden);
+  for (size_t i = 0; i < kHidden; ++i)
+    y[i] = x[i] * inv * w[i];
+  return y;
+}
+
+std::vector<float> matVec(const std::vector<float> &w, const float *x,
+                          size_t in, size_t out) {
+  std::vector<float> y(out);
+  for (size_t o = 0; o < out; ++o) {
+    double acc = 0.0;
+    for (size_t i = 0; i < in; ++i)
+      acc += static_cast<double>(w[o * in + i]) * x[i];
+    y[o] = static_cast<float>(acc);
+  }
+  return y;
+}
+
+// NeoX layout: element i pairs with i + ropeDim/2 within each head
+void rope(float *head, size_t pos, const Model &m) {
+  const size_t half = kRopeDim / 2;
+  for (size_t i = 0; i < half; ++i) {
+    const float theta = static_cast<float>(pos) / m.ropeScale * m.ropeFreqs[i];
+    const float c = std::cos(theta), s = std::sin(theta);
+    const float a = head[i], b = head[i + half];
+    head[i] = a * c - b * s;
+    head[i + half] = a * s + b * c;
+  }
+}
+
+std::vector<float> referenceForward(const Model &m, size_t S) {
+  const size_t kvDim = kKVHeads * kHeadDim;
+  const float kqScale = 1.0f / std::sqrt(static_cast<float>(kHeadDim));
+  const float residScale = 1.0f / std::sqrt(2.0f);
+  std::vector<float> x = m.embeddings;
+
+  for (const Layer &L : m.layers) {
+    std::vector<float> q(S * kHidden), k(S * kvDim), v(S * kvDim);
+    for (size_t t = 0; t < S; ++t) {
+      const auto h = rmsNorm(&x[t * kHidden], L.attnNorm);
+      auto qt = matVec(L.wq, h.data(), kHidden, kHidden);
+      auto kt = matVec(L.wk, h.data(), kHidden, kvDim);
+      auto vt = matVec(L.wv, h.data(), kHidden, kvDim);
+      for (size_t i = 0; i < kHidden; ++i)
+        q[t * kHidden + i] = qt[i] + L.bq[i];
+      for (size_t i = 0; i < kvDim; ++i) {
+        k[t * kvDim + i] = kt[i] + L.bk[i];
+        v[t * kvDim + i] = vt[i] + L.bv[i];
+      }
+      if (m.ropeInAttention) {
+        for (size_t hh = 0; hh < kHeads; ++hh)
+          rope(&q[t * kHidden + hh * kHeadDim], t, m);
+        for (size_t hh = 0; hh < kKVHeads; ++hh)
+          rope(&k[t * kvDim + hh * kHeadDim], t, m);
+      }
+    }
+
+    std::vector<float> next(S * kHidden);
+    for (size_t t = 0; t < S; ++t) {
+      std::vector<float> attn(kHidden, 0.0f);
+      for (size_t hh = 0; hh < kHeads; ++hh) {
+        const size_t kvh = hh / (kHeads / kKVHeads);
+        std::vector<float> scores(t + 1);
+        float maxScore = -INFINITY;
+        for (size_t j = 0; j <= t; ++j) {
+          float dot = 0.0f;
+          for (size_t d = 0; d < kHeadDim; ++d)
+            dot += q[t * kHidden + hh * kHeadDim + d] *
+                   k[j * kvDim + kvh * kHeadDim + d];
+          scores[j] = dot * kqScale;
+          maxScore = std::max(maxScore, scores[j]);
+        }
+        float sum = 0.0f;
+        for (auto &s : scores) {
+          s = std::exp(s - maxScore);
+          sum += s;
+        }
+        for (size_t j = 0; j <= t; ++j)
+          for (size_t d = 0; d < kHeadDim; ++d)
+            attn[hh * kHeadDim + d] +=
+                scores[j] / sum * v[j * kvDim + kvh * kHeadDim + d];
+      }
+      const auto attnOut = matVec(L.wo, attn.data(), kHidden, kHidden);
+      std::vector<float> resid(kHidden);
+      for (size_t i = 0; i < kHidden; ++i)
+        resid[i] = (x[t * kHidden + i] + attnOut[i]) * residScale;
+
+      const auto h = rmsNorm(resid.data(), L.ffnNorm);
+      const auto g = matVec(L.gate, h.data(), kHidden, kFfn);
+      const auto u = matVec(L.up, h.data(), kHidden, kFfn);
+      std::vector<float> act(kFfn);
+      for (size_t i = 0; i < kFfn; ++i)
+        act[i] = g[i] / (1.0f + std::exp(-g[i])) * u[i];
+      const auto ffnOut = matVec(L.down, act.data(), kFfn, kHidden);
+      for (size_t i = 0; i < kHidden; ++i)
+        next[t * kHidden + i] = (resid[i] + ffnOut[i]) * residScale;
+    }
+    x = std::move(next);
+  }
+
+  const auto h = rmsNorm(&x[(S - 1) * kHidden], m.outputNorm);
+  return matVec(m.output, h.data(), kHidden, kVocab);
+}
+
+// ---- Fused graph ----
+
+void computeGraph(ggml_cgraph *gf) {
+  const int threads =
+      static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  ggml_cplan plan = ggml_graph_plan(gf, threads, nullptr);
+  std::vector<uint8_t> work(plan.work_size);
+  plan.work_data = work.empty() ? nullptr : work.data();
+  if (ggml_graph_compute(gf, &plan) != GGML_STATUS_SUCCESS) {
+    throw std::runtime_error("ggml_graph_compute failed");
+  }
+}
+
+std::vector<float> transpose(const std::vector<float> &w, size_t in,
+                             size_t out) {
+  std::vector<float> t(w.size());
+  for (size_t o = 0; o < out; ++o)
+    for (size_t i = 0; i < in; ++i)
+      t[i * out + o] = w[o * in + i];
+  return t;
+}
+
+size_t argmax(const std::vector<float> &v) {
+  return static_cast<size_t>(std::max_element(v.begin(), v.end()) - v.begin());
+}
+
+bool runCase(const std::string &name, size_t seqLen, bool ropeInAttention,
+             float ropeScale, bool quant) {
+  Model m = makeModel(0x5EED1234u + static_cast<uint32_t>(seqLen), seqLen);
+  m.ropeInAttention = ropeInAttention;
+  m.ropeScale = ropeScale;
+
+  // Layer 0 keeps its gate as [in, out] to cover the transposed copy
+  const std::vector<float> gateInOut =
+      transpose(m.layers[0].gate, kHidden, kFfn);
+  std::vector<QuantMatrix> quants;
+  quants.reserve(kLayers * 7);
+  auto quantize = [&](std::vector<float> &w, size_t in, size_t out) {
+    quants.push_back(duorou::ml::quantizeMatrixQ8_0(w.data(), out, in));
+    // The reference uses what the graph actually sees
+    for (size_t r = 0; r < out; ++r)
+      duorou::ml::dequantizeRow(quants.back().type, quants.back().row(r),
+                                &w[r * in], in);
+    return &quants.back();
+  };
+
+  QwenGraphWeights desc;
+  desc.hiddenSize = kHidden;
+  desc.numHeads = kHeads;
+  desc.numKVHeads = kKVHeads;
+  desc.ropeDim = kRopeDim;
+  desc.originalContextLength = 4096;
+  desc.ropeBase = kRopeBase;
+  desc.ropeScale = ropeScale;
+  desc.eps = kEps;
+  for (size_t l = 0; l < kLayers; ++l) {
+    Layer &L = m.layers[l];
+    QwenGraphLayer g;
+    g.attnNorm = L.attnNorm.data();
+    g.ffnNorm = L.ffnNorm.data();
+    g.bq = L.bq.data();
+    g.bk = L.bk.data();
+    g.bv = L.bv.data();
+    g.ffnDim = kFfn;
+    if (quant) {
+      const size_t kvDim = kKVHeads * kHeadDim;
+      g.wq.quant = quantize(L.wq, kHidden, kHidden);
+      g.wk.quant = quantize(L.wk, kHidden, kvDim);
+      g.wv.quant = quantize(L.wv, kHidden, kvDim);
+      g.wo.quant = quantize(L.wo, kHidden, kHidden);
+      g.gate.quant = quantize(L.gate, kHidden, kFfn);
+      g.up.quant = quantize(L.up, kHidden, kFfn);
+      g.down.quant = quantize(L.down, kFfn, kHidden);
+    } else {
+      g.wq.data = L.wq.data();
+      g.wk.data = L.wk.data();
+      g.wv.data = L.wv.data();
+      g.wo.data = L.wo.data();
+      g.gate.data = l == 0 ? gateInOut.data() : L.gate.data();
+      g.gate.inOut = l == 0;
+      g.up.data = L.up.data();
+      g.down.data = L.down.data();
+    }
+    g.ropeInAttention = ropeInAttention;
+    desc.layers.push_back(g);
+  }
+  desc.outputNorm = m.outputNorm.data();
+  desc.output.data = m.output.data();
+  desc.outputRows = kVocab;
+  desc.ropeFreqs = m.ropeFreqs.data();
+  desc.vocabSize = kVocab;
+
+  QwenGraphForward graph;
+  if (!graph.bind(desc)) {
+    std::cerr << "[" << name << "] bind failed" << std::endl;
+    return false;
+  }
+  const std::vector<float> fused =
+      graph.forward(m.embeddings, seqLen, computeGraph);
+  const std::vector<float> ref = referenceForward(m, seqLen);
+  if (fused.size() != ref.size()) {
+    std::cerr << "[" << name << "] size mismatch: ref=" << ref.size()
+              << " fused=" << fused.size() << std::endl;
+    return false;
+  }
+
+  float maxRef = 0.0f;
+  float maxDiff = 0.0f;
+  for (size_t i = 0; i < ref.size(); ++i) {
+    maxRef = std::max(maxRef, std::fabs(ref[i]));
+    maxDiff = std::max(maxDiff, std::fabs(ref[i] - fused[i]));
+  }
+  // Q8_0 weights also quantize the activations inside ggml's matmul
+  const float tol = (quant ? 2e-2f : 1e-3f) * std::max(1.0f, maxRef);
+  const bool ok = maxDiff <= tol && argmax(ref) == argmax(fused);
+  std::cout << "[" << name << "] tokens=" << seqLen << " max|diff|=" << maxDiff
+            << " tol=" << tol << " argmax=" << argmax(ref) << "/"
+            << argmax(fused) << (ok ? " OK" : " FAIL") << std::endl;
+  return ok;
+}
+
+} // namespace
+
+int main() {
+  bool ok = true;
+  ok &= runCase("prefill", 9, true, 1.0f, false);
+  ok &= runCase("prefill_rope_scaled", 9, true, 2.0f, false);
+  ok &= runCase("prefill_rope_at_embedding", 9, false, 1.0f, false);
+  ok &= runCase("single_token", 1, true, 1.0f, false);
+  ok &= runCase("prefill_q8_0", 9, true, 1.0f, true);
+
+  // Shapes the graph cannot take are refused rather than computed wrong
+  QwenGraphWeights bad;
+  bad.hiddenSize = kHidden;
+  bad.numHeads = 3;
+  bad.numKVHeads = 1;
+  QwenGraphForward graph;
+  if (graph.bind(bad)) {
+    std::cerr << "[bad_shapes] bind accepted hidden % heads != 0" << std::endl;
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
@@ -2,10 +2,14 @@
 #include "../core/logger.h"
 #include "../extensions/ollama/gguf_parser.h"
 #include "../ml/backend/backend.h"
+#include "../ml/gemm.h"
+#include "../utils/thread_pool.h"
 #include "ggml.h"
+#include "qwen_graph_forward.h"
 #include "tokenizer_factory.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -13,8 +17,8 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <numeric>
-#include <random>
 #include <sstream>
 
 // KV Cache backend adapter bridging ML backend to KV cache backend
@@ -167,6 +171,10 @@ static bool
 readGGUFTensorToFloat(duorou::extensions::ollama::GGUFParser &parser,
                       const std::string &name, std::vector<float> &out,
                       std::vector<int64_t> *shapeOut);
+static bool readGGUFTensorQuant(duorou::extensions::ollama::GGUFParser &parser,
+                                const std::string &name,
+                                duorou::ml::QuantMatrix &out,
+                                const std::shared_ptr<const void> &mapping);
 
 // ---------------- SelfAttention ----------------
 SelfAttention::SelfAttention(const TextModelOptions &options)
@@ -219,21 +227,48 @@ std::vector<float> SelfAttention::forward(
     const size_t vSz = static_cast<size_t>(E * HK * D);
     const size_t oSz = static_cast<size_t>(H * D * E); // outputWeight_ [H*D, E]
 
-    auto ensure_or_init = [&](std::vector<float> &w, size_t sz, uint32_t seed) {
+    // MHA takes floats: quantized projections are dequantized into
+    // temporaries here and the blocks stay the only resident copy
+    auto dequantized = [](const duorou::ml::QuantMatrix &q) {
+      std::vector<float> w(q.rows * q.cols);
+      for (size_t r = 0; r < q.rows; ++r) {
+        duorou::ml::dequantizeRow(q.type, q.row(r), &w[r * q.cols], q.cols);
+      }
+      return w;
+    };
+    std::vector<float> qW, kW, vW, oW;
+    auto ensure_or_init = [&](std::vector<float> &w,
+                              const duorou::ml::QuantMatrix &q,
+                              std::vector<float> &tmp, size_t sz,
+                              uint32_t seed) -> const std::vector<float> & {
+      if (!q.empty() && q.rows * q.cols == sz) {
+        tmp = dequantized(q);
+        return tmp;
+      }
       if (w.size() != sz || w.empty()) {
         // Treat as [E, E]
         xavier_fill(w, static_cast<size_t>(E), static_cast<size_t>(E), seed);
       }
+      return w;
     };
-    ensure_or_init(queryWeights_, qSz, 0xA1B2C3D4u);
-    ensure_or_init(keyWeights_, kSz, 0xB2C3D4E5u);
-    ensure_or_init(valueWeights_, vSz, 0xC3D4E5F6u);
-    ensure_or_init(outputWeights_, oSz, 0xD4E5F607u);
-
-    // Bind to MHA
-    bool ok = mha_->setWeights(ctx, queryWeights_, keyWeights_, valueWeights_,
-                               outputWeights_, /*qB*/ nullptr, /*kB*/ nullptr,
-                               /*vB*/ nullptr, /*oB*/ nullptr);
+    const auto &qWeights =
+        ensure_or_init(queryWeights_, queryQ_, qW, qSz, 0xA1B2C3D4u);
+    const auto &kWeights =
+        ensure_or_init(keyWeights_, keyQ_, kW, kSz, 0xB2C3D4E5u);
+    const auto &vWeights =
+        ensure_or_init(valueWeights_, valueQ_, vW, vSz, 0xC3D4E5F6u);
+    const auto &oWeights =
+        ensure_or_init(outputWeights_, outputQ_, oW, oSz, 0xD4E5F607u);
+
+    // Bind to MHA; biases only when they match the projection widths
+    auto bias = [](const std::vector<float> &b, size_t n) {
+      return b.size() == n ? &b : nullptr;
+    };
+    bool ok = mha_->setWeights(ctx, qWeights, kWeights, vWeights, oWeights,
+                               /*qB*/ bias(queryBias_, static_cast<size_t>(H * D)),
+                               /*kB*/ bias(keyBias_, static_cast<size_t>(HK * D)),
+                               /*vB*/ bias(valueBias_, static_cast<size_t>(HK * D)),
+                               /*oB*/ nullptr);
     if (!ok) {
       // Fallback: allocate via initializeWeights to avoid null data
       mha_->initializeWeights(ctx, "xavier_uniform");
@@ -274,26 +309,48 @@ bool SelfAttention::loadWeights(const std::string & /*weightsPath*/) {
 
 // New overload: load weights for a specific layer from a parsed GGUF
 bool SelfAttention::loadWeights(duorou::extensions::ollama::GGUFParser &parser,
-                                size_t layerIndex) {
+                                size_t layerIndex,
+                                const std::shared_ptr<const void> &mapping) {
   auto get = [&](const std::string &name, std::vector<float> &dst) {
     std::vector<float> tmp;
     std::vector<int64_t> shape;
     if (!readGGUFTensorToFloat(parser, name, tmp, &shape)) {
       return false;
     }
-    dst.assign(tmp.begin(), tmp.end());
+    dst.swap(tmp);
     return true;
   };
+  // Same as FeedForward: keep quantized blocks, float only as the fallback
+  auto getProjection = [&](const std::string &name, std::vector<float> &dst,
+                           duorou::ml::QuantMatrix &q) {
+    q = duorou::ml::QuantMatrix();
+    if (readGGUFTensorQuant(parser, name, q, mapping)) {
+      std::vector<float>().swap(dst);
+      return true;
+    }
+    return get(name, dst);
+  };
   char buf[128];
   bool ok = true;
   std::snprintf(buf, sizeof(buf), "blk.%zu.attn_q.weight", layerIndex);
-  ok &= get(buf, queryWeights_);
+  ok &= getProjection(buf, queryWeights_, queryQ_);
   std::snprintf(buf, sizeof(buf), "blk.%zu.attn_k.weight", layerIndex);
-  ok &= get(buf, keyWeights_);
+  ok &= getProjection(buf, keyWeights_, keyQ_);
   std::snprintf(buf, sizeof(buf), "blk.%zu.attn_v.weight", layerIndex);
-  ok &= get(buf, valueWeights_);
+  ok &= getProjection(buf, valueWeights_, valueQ_);
   std::snprintf(buf, sizeof(buf), "blk.%zu.attn_output.weight", layerIndex);
-  ok &= get(buf, outputWeights_);
+  ok &= getProjection(buf, outputWeights_, outputQ_);
+  mhaWeightsReady_ = false;
+  // Projection biases are optional (Qwen2/2.5 have them, Qwen3 does not)
+  std::snprintf(buf, sizeof(buf), "blk.%zu.attn_q.bias", layerIndex);
+  if (!get(buf, queryBias_))
+    queryBias_.clear();
+  std::snprintf(buf, sizeof(buf), "blk.%zu.attn_k.bias", layerIndex);
+  if (!get(buf, keyBias_))
+    keyBias_.clear();
+  std::snprintf(buf, sizeof(buf), "blk.%zu.attn_v.bias", layerIndex);
+  if (!get(buf, valueBias_))
+    valueBias_.clear();
   weightsLoaded_ = ok;
   return ok;
 }
@@ -350,6 +407,22 @@ std::vector<float> FeedForward::forward(const std::vector<float> &input) {
     return out;
   };
 
+  // Quantized projections run directly on their blocks; `q` is [out, in]
+  auto project = [&](const std::vector<float> &A, size_t in_dim,
+                     const std::vector<float> &W, const duorou::ml::QuantMatrix &q,
+                     size_t w_dim0, size_t w_dim1,
+                     bool w_is_in_out) -> std::vector<float> {
+    if (q.empty()) {
+      return matmul_seq_general(A, in_dim, W, w_dim0, w_dim1, w_is_in_out);
+    }
+    std::vector<float> out(seqLen * q.rows, 0.0f);
+    if (q.cols == in_dim) {
+      duorou::ml::quantMatMul(q, A.data(), seqLen, out.data(),
+                              &duorou::utils::ThreadPool::global());
+    }
+    return out;
+  };
+
   auto sigmoid = [](float x) -> float { return 1.0f / (1.0f + std::exp(-x)); };
   auto silu = [&](float x) -> float { return x * sigmoid(x); };
 
@@ -369,10 +442,10 @@ std::vector<float> FeedForward::forward(const std::vector<float> &input) {
   bool down_in_out = downIsInOut_;
 
   // Compute gate and up projections: [seq, inter]
-  std::vector<float> g = matmul_seq_general(input, hidden, gateWeights_,
-                                            gate_d0, gate_d1, gate_in_out);
+  std::vector<float> g = project(input, hidden, gateWeights_, gateQ_, gate_d0,
+                                 gate_d1, gate_in_out);
   std::vector<float> u =
-      matmul_seq_general(input, hidden, upWeights_, up_d0, up_d1, up_in_out);
+      project(input, hidden, upWeights_, upQ_, up_d0, up_d1, up_in_out);
 
   // element-wise SwiGLU: silu(g) * u
   std::vector<float> interVec(g.size());
@@ -383,8 +456,8 @@ std::vector<float> FeedForward::forward(const std::vector<float> &input) {
   // down projection back to hidden
   // Determine actual intermediate dimension from gate output
   size_t inter_dim_actual = g.empty() ? inter : (g.size() / seqLen);
-  std::vector<float> out = matmul_seq_general(
-      interVec, inter_dim_actual, downWeights_, down_d0, down_d1, down_in_out);
+  std::vector<float> out = project(interVec, inter_dim_actual, downWeights_,
+                                   downQ_, down_d0, down_d1, down_in_out);
   return out;
 }
 
@@ -395,15 +468,24 @@ bool FeedForward::loadWeights(const std::string & /*weightsPath*/) {
 
 // New overload: load weights for a specific layer from a parsed GGUF
 bool FeedForward::loadWeights(duorou::extensions::ollama::GGUFParser &parser,
-                              size_t layerIndex) {
-  auto get = [&](const std::string &name, std::vector<float> &dst, size_t &rows,
-                 size_t &cols) {
+                              size_t layerIndex,
+                              const std::shared_ptr<const void> &mapping) {
+  auto get = [&](const std::string &name, std::vector<float> &dst,
+                 duorou::ml::QuantMatrix &q, size_t &rows, size_t &cols) {
+    q = duorou::ml::QuantMatrix();
+    if (readGGUFTensorQuant(parser, name, q, mapping)) {
+      // Keep the blocks; rows/cols follow the GGUF dims like the float path
+      std::vector<float>().swap(dst);
+      rows = q.cols;
+      cols = q.rows;
+      return true;
+    }
     std::vector<float> tmp;
     std::vector<int64_t> shape;
     if (!readGGUFTensorToFloat(parser, name, tmp, &shape)) {
       return false;
     }
-    dst.assign(tmp.begin(), tmp.end());
+    dst.swap(tmp);
     if (shape.size() == 2) {
       rows = static_cast<size_t>(shape[0]);
       cols = static_cast<size_t>(shape[1]);
@@ -415,11 +497,11 @@ bool FeedForward::loadWeights(duorou::extensions::ollama::GGUFParser &parser,
   char buf[128];
   bool ok = true;
   std::snprintf(buf, sizeof(buf), "blk.%zu.ffn_gate.weight", layerIndex);
-  ok &= get(buf, gateWeights_, gateRows_, gateCols_);
+  ok &= get(buf, gateWeights_, gateQ_, gateRows_, gateCols_);
   std::snprintf(buf, sizeof(buf), "blk.%zu.ffn_up.weight", layerIndex);
-  ok &= get(buf, upWeights_, upRows_, upCols_);
+  ok &= get(buf, upWeights_, upQ_, upRows_, upCols_);
   std::snprintf(buf, sizeof(buf), "blk.%zu.ffn_down.weight", layerIndex);
-  ok &= get(buf, downWeights_, downRows_, downCols_);
+  ok &= get(buf, downWeights_, downQ_, downRows_, downCols_);
   // Infer intermediate dimension
   if (ok) {
     size_t hidden = options_.hiddenSize;
@@ -652,6 +734,13 @@ bool TransformerLayer::loadWeights(const std::string &weightsPath,
               << weightsPath << std::endl;
     return false;
   }
+  // The parser dies with this call, so nothing may borrow from its mapping
+  return loadWeights(parser, layerIndex, nullptr);
+}
+
+bool TransformerLayer::loadWeights(
+    duorou::extensions::ollama::GGUFParser &parser, size_t layerIndex,
+    const std::shared_ptr<const void> &mapping) {
   const size_t hidden = options_.hiddenSize;
   bool ok = true;
   auto get = [&](const std::string &name, std::vector<float> &dst) {
@@ -660,14 +749,14 @@ bool TransformerLayer::loadWeights(const std::string &weightsPath,
     if (!readGGUFTensorToFloat(parser, name, tmp, &shape)) {
       return false;
     }
-    // Resize destination and copy (no strict shape check here)
-    dst.assign(tmp.begin(), tmp.end());
+    // No strict shape check here
+    dst.swap(tmp);
     return true;
   };
 
   // Replace direct private-member access by delegating to subcomponents
-  bool attnOk = attention_->loadWeights(parser, layerIndex);
-  bool ffnOk = feedForward_->loadWeights(parser, layerIndex);
+  bool attnOk = attention_->loadWeights(parser, layerIndex, mapping);
+  bool ffnOk = feedForward_->loadWeights(parser, layerIndex, mapping);
   ok &= attnOk;
   ok &= ffnOk;
 
@@ -796,8 +885,14 @@ QwenTextModel::QwenTextModel(const TextModelOptions &options)
   tokenEmbeddings_.resize(vocabSize * options_.hiddenSize);
   outputWeights_.resize(options_.hiddenSize * vocabSize);
   outputNormWeights_.resize(options_.hiddenSize, 1.0f);
+
+  if (const char *env = std::getenv("DUOROU_FUSED_GRAPH")) {
+    useFusedGraph_ = std::string(env) != "0";
+  }
 }
 
+QwenTextModel::~QwenTextModel() = default;
+
 std::vector<int32_t> QwenTextModel::encode(const std::string &text,
                                            bool addSpecial) {
   if (!tokenizer_) {
@@ -838,6 +933,9 @@ size_t QwenTextModel::getVocabSize() const {
   }
 
   // If tokenizer is not available, fall back to output weights if present
+  if (!outputWeightsQ_.empty()) {
+    return outputWeightsQ_.rows;
+  }
   if (options_.hiddenSize != 0 && !outputWeights_.empty()) {
     return outputWeights_.size() / options_.hiddenSize;
   }
@@ -896,6 +994,7 @@ bool QwenTextModel::initialize(const std::string &configPath,
   }
 
   // Initialize transformer layers
+  graph_.reset();
   layers_.clear();
   layers_.reserve(options_.blockCount);
   for (size_t i = 0; i < options_.blockCount; ++i) {
@@ -916,12 +1015,69 @@ bool QwenTextModel::loadConfig(const std::string & /*configPath*/) {
 }
 
 bool QwenTextModel::loadWeights(const std::string &weightsPath) {
-  duorou::extensions::ollama::GGUFParser parser(/*verbose=*/false);
+  graph_.reset();
+  // The file is parsed once for all layers. Quantized weights borrow their
+  // blocks from the read-only mapping, which stays alive for as long as any
+  // QuantMatrix holds the parser; pages are faulted in on first use and
+  // shared with other processes mapping the same file. DUOROU_WEIGHTS_MMAP=0
+  // copies everything into private heap buffers instead.
+  const char *mmapEnv = std::getenv("DUOROU_WEIGHTS_MMAP");
+  const bool borrow = !(mmapEnv && std::string(mmapEnv) == "0");
+  auto parserOwner =
+      std::make_shared<duorou::extensions::ollama::GGUFParser>(/*verbose=*/false);
+  parserOwner->setUseMmap(borrow);
+  duorou::extensions::ollama::GGUFParser &parser = *parserOwner;
   if (!parser.parseFile(weightsPath)) {
     std::cerr << "[ERROR] Failed to parse GGUF file: " << weightsPath
               << std::endl;
     return false;
   }
+  std::shared_ptr<const void> mapping;
+  if (borrow && parser.useMmap()) {
+    mapping = parserOwner;
+  }
+  const auto loadStart = std::chrono::steady_clock::now();
+
+  // 0) Read ahead every tensor in file order so the disk streams while the
+  // layers below are converted. Tensors separated by small gaps are merged
+  // into one request.
+  {
+    std::vector<const duorou::extensions::ollama::GGUFTensorInfo *> infos;
+    for (const auto &info : parser.getAllTensorInfos()) {
+      infos.push_back(&info);
+    }
+    std::sort(infos.begin(), infos.end(),
+              [](const auto *a, const auto *b) { return a->offset < b->offset; });
+    constexpr uint64_t kMaxGap = 1ull << 20;
+    uint64_t runBegin = 0, runEnd = 0;
+    bool inRun = false;
+    for (const auto *info : infos) {
+      if (inRun && info->offset > runEnd + kMaxGap) {
+        parser.prefetch(runBegin, runEnd - runBegin);
+        inRun = false;
+      }
+      if (!inRun) {
+        runBegin = info->offset;
+        runEnd = info->offset;
+        inRun = true;
+      }
+      runEnd = std::max(runEnd, info->offset + info->size);
+    }
+    if (inRun) {
+      parser.prefetch(runBegin, runEnd - runBegin);
+    }
+  }
+
+  // Drop views into a previously loaded file before binding the new one
+  tokenEmbeddingsQ_ = duorou::ml::QuantMatrix();
+  outputWeightsQ_ = duorou::ml::QuantMatrix();
+  for (auto &layer : layers_) {
+    SelfAttention &attn = *layer->attention_;
+    attn.queryQ_ = attn.keyQ_ = attn.valueQ_ = attn.outputQ_ =
+        duorou::ml::QuantMatrix();
+    FeedForward &ffn = *layer->feedForward_;
+    ffn.gateQ_ = ffn.upQ_ = ffn.downQ_ = duorou::ml::QuantMatrix();
+  }
 
   auto get = [&](const std::string &name, std::vector<float> &dst,
                  std::vector<int64_t> *shapeOut = nullptr) {
@@ -932,7 +1088,7 @@ bool QwenTextModel::loadWeights(const std::string &weightsPath) {
     }
     if (shapeOut)
       *shapeOut = shape;
-    dst.assign(tmp.begin(), tmp.end());
+    dst.swap(tmp);
     return true;
   };
 
@@ -943,11 +1099,19 @@ bool QwenTextModel::loadWeights(const std::string &weightsPath) {
 
   // 1) Token embeddings: expected shape [vocab, hidden]
   std::vector<int64_t> embShape;
-  bool embOk = get("token_embd.weight", tokenEmbeddings_, &embShape);
+  const bool embQuant = readGGUFTensorQuant(parser, "token_embd.weight",
+                                            tokenEmbeddingsQ_, mapping);
+  bool embOk = embQuant || get("token_embd.weight", tokenEmbeddings_, &embShape);
   ok &= embOk;
   if (!embOk) {
     std::cerr << "[WARN] token_embd.weight not found or failed to load"
               << std::endl;
+  } else if (embQuant) {
+    // Quantized rows are tokens, columns the hidden size
+    std::vector<float>().swap(tokenEmbeddings_);
+    loadedVocab = tokenEmbeddingsQ_.rows;
+    options_.hiddenSize = tokenEmbeddingsQ_.cols;
+    outputNormWeights_.resize(options_.hiddenSize, 1.0f);
   } else {
     if (embShape.size() != 2) {
       std::cerr
@@ -976,11 +1140,26 @@ bool QwenTextModel::loadWeights(const std::string &weightsPath) {
 
   // 2) Output projection: expected shape [vocab, hidden]
   std::vector<int64_t> outShape;
-  bool outOk = get("output.weight", outputWeights_, &outShape);
+  const bool outQuant = readGGUFTensorQuant(parser, "output.weight",
+                                            outputWeightsQ_, mapping);
+  bool outOk = outQuant || get("output.weight", outputWeights_, &outShape);
   ok &= outOk;
   if (!outOk) {
     std::cerr << "[WARN] output.weight not found or failed to load"
               << std::endl;
+  } else if (outQuant) {
+    std::vector<float>().swap(outputWeights_);
+    if (outputWeightsQ_.cols != options_.hiddenSize) {
+      std::cerr << "[WARN] output.weight hidden mismatch: expected "
+                << options_.hiddenSize << ", got " << outputWeightsQ_.cols
+                << std::endl;
+      outputWeightsQ_ = duorou::ml::QuantMatrix();
+      consistent = false;
+    } else if (loadedVocab != 0 && outputWeightsQ_.rows != loadedVocab) {
+      std::cerr << "[WARN] output.weight vocab mismatch vs token_embd: "
+                << outputWeightsQ_.rows << " vs " << loadedVocab << std::endl;
+      consistent = false;
+    }
   } else {
     if (outShape.size() != 2) {
       std::cerr << "[WARN] output.weight expected shape [vocab, hidden], got "
@@ -1008,6 +1187,15 @@ bool QwenTextModel::loadWeights(const std::string &weightsPath) {
                   << expectedSize << ", got " << outputWeights_.size()
                   << std::endl;
         consistent = false;
+      } else if (const char *q8Env = std::getenv("DUOROU_LM_HEAD_Q8");
+                 q8Env && std::string(q8Env) != "0" &&
+                 options_.hiddenSize % duorou::ml::kQK == 0) {
+        // Float LM head requantized to Q8_0: a quarter of the bytes streamed
+        // per token, at Q8 accuracy
+        outputWeightsQ_ = duorou::ml::quantizeMatrixQ8_0(
+            outputWeights_.data(), outVocab, options_.hiddenSize,
+            &duorou::utils::ThreadPool::global());
+        std::vector<float>().swap(outputWeights_);
       }
     }
   }
@@ -1030,15 +1218,58 @@ bool QwenTextModel::loadWeights(const std::string &weightsPath) {
     // Some variants may not have output_norm; keep default scale of 1.0
   }
 
-  // 4) Per-layer weights
+  // 4) Per-layer weights. Layers only write their own members and the parser
+  // is read-only after parseFile, so they are converted in parallel.
+  std::vector<char> layerOk(layers_.size(), 0);
+  duorou::utils::ThreadPool::global().parallelFor(
+      layers_.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          layerOk[i] = layers_[i]->loadWeights(parser, i, mapping) ? 1 : 0;
+        }
+      });
   for (size_t i = 0; i < layers_.size(); ++i) {
-    bool layerOk = layers_[i]->loadWeights(weightsPath, i);
-    if (!layerOk) {
+    if (!layerOk[i]) {
       std::cerr << "[WARN] Failed to fully load weights for layer " << i
                 << std::endl;
-      ok = false; // continue loading other layers
+      ok = false; // continue reporting the other layers
     }
   }
+  const double loadMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - loadStart)
+                            .count();
+  std::cout << "[QwenTextModel] Loaded " << layers_.size() << " layers in "
+            << static_cast<long long>(loadMs) << " ms ("
+            << duorou::utils::ThreadPool::global().size() + 1 << " threads)"
+            << std::endl;
+
+  // Report how much stays in block-quantized form and how much of it is
+  // borrowed from the mapping
+  size_t quantBytes = 0;
+  size_t mappedBytes = 0;
+  auto account = [&](const duorou::ml::QuantMatrix &q) {
+    quantBytes += q.sizeBytes();
+    if (q.borrowed())
+      mappedBytes += q.sizeBytes();
+  };
+  account(tokenEmbeddingsQ_);
+  account(outputWeightsQ_);
+  for (const auto &layer : layers_) {
+    const SelfAttention &attn = *layer->attention_;
+    account(attn.queryQ_);
+    account(attn.keyQ_);
+    account(attn.valueQ_);
+    account(attn.outputQ_);
+    const FeedForward &ffn = *layer->feedForward_;
+    account(ffn.gateQ_);
+    account(ffn.upQ_);
+    account(ffn.downQ_);
+  }
+  if (quantBytes > 0) {
+    std::cout << "[QwenTextModel] Quantized weights kept in block form: "
+              << (quantBytes >> 20) << " MiB, " << (mappedBytes >> 20)
+              << " MiB mapped from file (kernel="
+              << duorou::ml::quantKernelName() << ")" << std::endl;
+  }
 
   return ok && consistent;
 }
@@ -1048,6 +1279,18 @@ QwenTextModel::embedTokens(const std::vector<int32_t> &tokenIds) {
   size_t hidden = options_.hiddenSize;
   size_t vocab = getVocabSize();
   std::vector<float> embeddings(tokenIds.size() * hidden, 0.0f);
+  if (!tokenEmbeddingsQ_.empty() && tokenEmbeddingsQ_.cols == hidden) {
+    // Dequantize only the rows that are looked up
+    const size_t rows = tokenEmbeddingsQ_.rows;
+    for (size_t t = 0; t < tokenIds.size(); ++t) {
+      size_t id = tokenIds[t] < 0 ? 0 : static_cast<size_t>(tokenIds[t]);
+      id = std::min(id, rows - 1);
+      duorou::ml::dequantizeRow(tokenEmbeddingsQ_.type,
+                                tokenEmbeddingsQ_.row(id),
+                                embeddings.data() + t * hidden, hidden);
+    }
+    return embeddings;
+  }
   if (tokenEmbeddings_.empty()) {
     // Fallback: generate deterministic pseudo-random embeddings per token
     for (size_t t = 0; t < tokenIds.size(); ++t) {
@@ -1194,13 +1437,19 @@ std::vector<float>
 QwenTextModel::forward(const std::vector<int32_t> &inputIds) {
   if (inputIds.empty())
     return {};
+  duorou::ml::Context dummyCtx;
+  if (useFusedGraph_) {
+    auto logits = forwardFused(dummyCtx, inputIds);
+    if (!logits.empty())
+      return logits;
+  }
+
   auto hiddenStates = embedTokens(inputIds);
   if (!applyRopeInAttention_) {
     hiddenStates = applyPositionalEncoding(hiddenStates, inputIds.size());
   }
 
   std::vector<float> attentionMask; // unused placeholder
-  duorou::ml::Context dummyCtx;
   for (auto &layer : layers_) {
     hiddenStates =
         layer->forward(dummyCtx, hiddenStates, attentionMask, nullptr);
@@ -1263,7 +1512,7 @@ std::vector<float> QwenTextModel::forwardWithExternalEmbeddings(
     duorou::kvcache::Batch batch;
     batch.seqs = {0};
     batch.seqLens = {static_cast<int>(seqLen)};
-    batch.positions = {static_cast<int>(seqLen > 0 ? seqLen - 1 : 0)};
+    // No per-token positions: the cache appends after the cached tokens
     batch.batchSize = 1;
     try {
       cache->startForward(kvCtx, batch, false);
@@ -1330,6 +1579,19 @@ duorou::ml::Tensor QwenTextModel::forward(duorou::ml::Context &ctx,
   token_stream << "]";
   // logger.debug(token_stream.str());
 
+  // Fused single-graph path; the KV cache still goes through the per-op path
+  if (useFusedGraph_ && !cache) {
+    std::vector<float> logits = forwardFused(ctx, ids);
+    if (!logits.empty()) {
+      duorou::ml::Tensor out = duorou::ml::Tensor::zeros(
+          {static_cast<int64_t>(logits.size())},
+          duorou::ml::DataType::FLOAT32);
+      if (float *outData = out.data<float>())
+        std::copy(logits.begin(), logits.end(), outData);
+      return out;
+    }
+  }
+
   // Embedding + positional encoding
   auto hiddenStates = embedTokens(ids);
   // logger.debug(
@@ -1354,7 +1616,7 @@ duorou::ml::Tensor QwenTextModel::forward(duorou::ml::Context &ctx,
     duorou::kvcache::Batch batch;
     batch.seqs = {0};
     batch.seqLens = {static_cast<int>(ids.size())};
-    batch.positions = {static_cast<int>(ids.size() > 0 ? ids.size() - 1 : 0)};
+    // No per-token positions: the cache appends after the cached tokens
     batch.batchSize = 1;
     try {
       cache->startForward(kvCtx, batch, false);
@@ -1493,26 +1755,34 @@ readGGUFTensorToFloat(duorou::extensions::ollama::GGUFParser &parser,
   if (bytes == 0 || nelems == 0) {
     return false;
   }
-  std::vector<uint8_t> buf(bytes);
-  if (!parser.readTensorData(*info, buf.data(), bytes)) {
-    return false;
+  // Convert straight out of the mapping when there is one; only stream IO
+  // needs a staging copy of the raw bytes
+  std::vector<uint8_t> buf;
+  const uint8_t *raw = parser.getTensorDataPtr(name);
+  if (!raw) {
+    buf.resize(bytes);
+    if (!parser.readTensorData(*info, buf.data(), bytes)) {
+      return false;
+    }
+    raw = buf.data();
   }
   out.resize(nelems);
   switch (info->type) {
   case GGMLTensorType::F32: {
-    const float *src = reinterpret_cast<const float *>(buf.data());
-    std::copy(src, src + nelems, out.begin());
+    if (bytes < nelems * sizeof(float))
+      return false;
+    std::memcpy(out.data(), raw, nelems * sizeof(float));
     break;
   }
   case GGMLTensorType::F16: {
-    const ggml_fp16_t *src = reinterpret_cast<const ggml_fp16_t *>(buf.data());
+    const ggml_fp16_t *src = reinterpret_cast<const ggml_fp16_t *>(raw);
     ggml_fp16_to_fp32_row(src, out.data(), static_cast<int64_t>(nelems));
     break;
   }
   case GGMLTensorType::BF16: {
     // Convert BF16 to FP32 manually to avoid dependency on optional ggml
     // helpers
-    const uint16_t *src = reinterpret_cast<const uint16_t *>(buf.data());
+    const uint16_t *src = reinterpret_cast<const uint16_t *>(raw);
     for (size_t i = 0; i < nelems; ++i) {
       uint32_t tmp = static_cast<uint32_t>(src[i]) << 16;
       float f;
@@ -1521,15 +1791,77 @@ readGGUFTensorToFloat(duorou::extensions::ollama::GGUFParser &parser,
     }
     break;
   }
-  default:
-    // Unsupported quantized type for direct float extraction in this minimal
-    // path
-    return false;
+  default: {
+    // Block-quantized types are expanded row by row (rows run along ne0)
+    const uint32_t typeId = static_cast<uint32_t>(info->type);
+    if (!duorou::ml::isSupportedQuantType(typeId) || shape.empty())
+      return false;
+    const auto qt = static_cast<duorou::ml::QuantType>(typeId);
+    const size_t rowLen = static_cast<size_t>(shape[0]);
+    if (rowLen % duorou::ml::quantBlockSize(qt) != 0)
+      return false;
+    const size_t rows = nelems / rowLen;
+    const size_t rowBytes = duorou::ml::quantRowBytes(qt, rowLen);
+    if (rows * rowBytes > bytes)
+      return false;
+    for (size_t r = 0; r < rows; ++r) {
+      duorou::ml::dequantizeRow(qt, raw + r * rowBytes,
+                                out.data() + r * rowLen, rowLen);
+    }
+    break;
+  }
   }
   if (shapeOut)
     *shapeOut = shape;
   return true;
 }
+
+// Helper: read a block-quantized GGUF tensor without expanding it. Rows are
+// ne1 and columns ne0, i.e. [out, in] for weight matrices. Returns false for
+// float types, which go through readGGUFTensorToFloat instead. With a
+// non-null `mapping` (the owner of the parser's mmap) the matrix borrows the
+// blocks in place; otherwise they are copied.
+static bool readGGUFTensorQuant(duorou::extensions::ollama::GGUFParser &parser,
+                                const std::string &name,
+                                duorou::ml::QuantMatrix &out,
+                                const std::shared_ptr<const void> &mapping) {
+  const auto *info = parser.getTensorInfo(name);
+  if (!info || info->dimensions.empty() || info->dimensions.size() > 2) {
+    return false;
+  }
+  const uint32_t typeId = static_cast<uint32_t>(info->type);
+  if (!duorou::ml::isSupportedQuantType(typeId)) {
+    return false;
+  }
+  const auto qt = static_cast<duorou::ml::QuantType>(typeId);
+  const size_t cols = static_cast<size_t>(info->dimensions[0]);
+  const size_t rows =
+      info->dimensions.size() == 2 ? static_cast<size_t>(info->dimensions[1]) : 1;
+  if (cols == 0 || rows == 0 || cols % duorou::ml::quantBlockSize(qt) != 0) {
+    return false;
+  }
+  const size_t bytes = rows * duorou::ml::quantRowBytes(qt, cols);
+  if (parser.getTensorSize(name) < bytes) {
+    return false;
+  }
+  duorou::ml::QuantMatrix q;
+  q.type = qt;
+  q.rows = rows;
+  q.cols = cols;
+  const uint8_t *mapped = mapping ? parser.getTensorDataPtr(name) : nullptr;
+  if (mapped) {
+    q.view = mapped;
+    q.owner = mapping;
+    out = std::move(q);
+    return true;
+  }
+  q.data.resize(bytes);
+  if (!parser.readTensorData(*info, q.data.data(), bytes)) {
+    return false;
+  }
+  out = std::move(q);
+  return true;
+}
 bool QwenTextModel::loadModel(const std::string &modelPath) {
   bool ok = initialize(modelPath);
   if (!ok)
@@ -1544,6 +1876,7 @@ void QwenTextModel::setOptions(const TextModelOptions &options) {
 
 void QwenTextModel::setRoPEFreqs(const std::vector<float> &freqs) {
   ropeFreqs_ = freqs;
+  graph_.reset();
   for (auto &layer : layers_) {
     if (layer) {
       layer->setRoPEFreqs(freqs);
@@ -1552,6 +1885,7 @@ void QwenTextModel::setRoPEFreqs(const std::vector<float> &freqs) {
 }
 
 void QwenTextModel::setApplyRopeInAttention(bool v) {
+  graph_.reset();
   for (auto &layer : layers_) {
     if (layer) {
       layer->setApplyRopeInAttention(v);
@@ -1611,7 +1945,7 @@ QwenTextModel::stepDecode(::duorou::ml::Context &ctx,
     ::duorou::kvcache::Batch batch;
     batch.seqs = {0};
     batch.seqLens = {static_cast<int>(ids.size())};
-    batch.positions = {static_cast<int>(ids.size() > 0 ? ids.size() - 1 : 0)};
+    // No per-token positions: the cache appends after the cached tokens
     batch.batchSize = 1;
     try {
       cache->startForward(kvCtx, batch, false);
@@ -1643,6 +1977,200 @@ QwenTextModel::stepDecode(::duorou::ml::Context &ctx,
   return out;
 }
 
+void QwenTextModel::setUseFusedGraph(bool enable) {
+  useFusedGraph_ = enable;
+  if (!enable)
+    graph_.reset();
+}
+
+bool QwenTextModel::describeGraphWeights(QwenGraphWeights &weights) const {
+  const size_t E = options_.hiddenSize;
+  const size_t H = options_.numHeads;
+  const size_t HK = options_.numKVHeads;
+  if (E == 0 || H == 0 || HK == 0 || E % H != 0 || layers_.empty()) {
+    return false;
+  }
+  const size_t D = E / H;
+  const size_t kvDim = HK * D;
+
+  // Float matrices must hold exactly in * out values; quantized ones are
+  // checked against their rows/cols by the graph
+  auto matrix = [](const std::vector<float> &data,
+                   const duorou::ml::QuantMatrix *quant, size_t in,
+                   size_t out, bool inOut) {
+    QwenGraphMatrix m;
+    if (quant && !quant->empty()) {
+      m.quant = quant;
+    } else if (data.size() == in * out) {
+      m.data = data.data();
+      m.inOut = inOut;
+    }
+    return m;
+  };
+  auto optional = [](const std::vector<float> &v, size_t n) {
+    return v.size() == n ? v.data() : nullptr;
+  };
+
+  weights.hiddenSize = E;
+  weights.numHeads = H;
+  weights.numKVHeads = HK;
+  weights.ropeDim = options_.ropeDim;
+  weights.originalContextLength = options_.originalContextLength;
+  weights.ropeBase = options_.ropeBase;
+  weights.ropeScale = options_.ropeScale;
+  weights.eps = options_.eps;
+  weights.layers.clear();
+  weights.layers.reserve(layers_.size());
+  for (const auto &layerPtr : layers_) {
+    const TransformerLayer &layer = *layerPtr;
+    const SelfAttention &attn = *layer.attention_;
+    const FeedForward &ffn = *layer.feedForward_;
+
+    // FFN shapes resolved exactly like FeedForward::forward
+    const size_t gateD0 = ffn.gateRows_ ? ffn.gateRows_ : E;
+    const size_t gateD1 = ffn.gateCols_ ? ffn.gateCols_ : E;
+    const size_t upD0 = ffn.upRows_ ? ffn.upRows_ : E;
+    const size_t upD1 = ffn.upCols_ ? ffn.upCols_ : E;
+    const size_t downD0 = ffn.downRows_ ? ffn.downRows_ : E;
+    const size_t downD1 = ffn.downCols_ ? ffn.downCols_ : E;
+    const size_t gateIn = ffn.gateIsInOut_ ? gateD0 : gateD1;
+    const size_t gateOut = ffn.gateIsInOut_ ? gateD1 : gateD0;
+    const size_t upIn = ffn.upIsInOut_ ? upD0 : upD1;
+    const size_t upOut = ffn.upIsInOut_ ? upD1 : upD0;
+    const size_t downIn = ffn.downIsInOut_ ? downD0 : downD1;
+    const size_t downOut = ffn.downIsInOut_ ? downD1 : downD0;
+    if (gateIn != E || upIn != E || gateOut != upOut || downIn != gateOut ||
+        downOut != E) {
+      return false;
+    }
+
+    QwenGraphLayer l;
+    l.attnNorm = optional(layer.inputNormWeights_, E);
+    l.ffnNorm = optional(layer.postAttentionNormWeights_, E);
+    l.wq = matrix(attn.queryWeights_, &attn.queryQ_, E, H * D, false);
+    l.wk = matrix(attn.keyWeights_, &attn.keyQ_, E, kvDim, false);
+    l.wv = matrix(attn.valueWeights_, &attn.valueQ_, E, kvDim, false);
+    l.wo = matrix(attn.outputWeights_, &attn.outputQ_, H * D, E, false);
+    l.bq = optional(attn.queryBias_, H * D);
+    l.bk = optional(attn.keyBias_, kvDim);
+    l.bv = optional(attn.valueBias_, kvDim);
+    l.ffnDim = gateOut;
+    l.gate = matrix(ffn.gateWeights_, &ffn.gateQ_, gateIn, gateOut,
+                    ffn.gateIsInOut_);
+    l.up = matrix(ffn.upWeights_, &ffn.upQ_, upIn, upOut, ffn.upIsInOut_);
+    l.down = matrix(ffn.downWeights_, &ffn.downQ_, downIn, downOut,
+                    ffn.downIsInOut_);
+    l.ropeInAttention = attn.applyRopeInAttention_;
+    weights.layers.push_back(l);
+  }
+
+  weights.outputNorm = optional(outputNormWeights_, E);
+  if (!outputWeightsQ_.empty()) {
+    weights.output.quant = &outputWeightsQ_;
+    weights.outputRows = outputWeightsQ_.rows;
+  } else if (outputWeights_.size() % E == 0) {
+    weights.output.data = outputWeights_.data();
+    weights.outputRows = outputWeights_.size() / E;
+  }
+
+  const SelfAttention &attn0 = *layers_[0]->attention_;
+  const size_t ropeDim = std::min(options_.ropeDim, D) & ~size_t(1);
+  weights.ropeFreqs =
+      ropeDim > 0 && attn0.ropeFreqs_.size() >= ropeDim / 2
+          ? attn0.ropeFreqs_.data()
+          : nullptr;
+  weights.vocabSize = getVocabSize();
+  return weights.outputRows > 0;
+}
+
+std::vector<float>
+QwenTextModel::forwardFused(duorou::ml::Context &ctx,
+                            const std::vector<int32_t> &inputIds) {
+  if (inputIds.empty())
+    return {};
+  if (!graph_) {
+    graph_ = std::make_unique<QwenGraphForward>();
+    QwenGraphWeights weights;
+    if (!describeGraphWeights(weights) || !graph_->bind(weights)) {
+      std::cerr << "[WARN] QwenTextModel fused graph unavailable for these "
+                   "weight shapes, using per-op path"
+                << std::endl;
+    }
+  }
+  if (!graph_->isBound())
+    return {};
+
+  // Embedding lookup and embedding-stage RoPE stay on the host so both paths
+  // share their fallbacks; everything after runs in one graph
+  auto hiddenStates = embedTokens(inputIds);
+  if (!applyRopeInAttention_) {
+    hiddenStates = applyPositionalEncoding(hiddenStates, inputIds.size());
+  }
+  return graph_->forward(hiddenStates, inputIds.size(),
+                         [&ctx](ggml_cgraph *gf) { ctx.compute(gf); });
+}
+
+void QwenTextModel::initializeRandomWeights(size_t vocabSize, size_t interDim,
+                                            uint32_t seed) {
+  graph_.reset();
+  const size_t E = options_.hiddenSize;
+  const size_t H = options_.numHeads;
+  const size_t HK = options_.numKVHeads;
+  const size_t D = H ? E / H : 0;
+
+  auto normFill = [&](std::vector<float> &w, uint32_t s) {
+    w.resize(E);
+    for (auto &x : w)
+      x = 1.0f + 0.1f * prng_float_sym(s);
+  };
+  auto biasFill = [&](std::vector<float> &b, size_t n, uint32_t s) {
+    b.resize(n);
+    for (auto &x : b)
+      x = 0.1f * prng_float_sym(s);
+  };
+
+  tokenEmbeddingsQ_ = duorou::ml::QuantMatrix();
+  outputWeightsQ_ = duorou::ml::QuantMatrix();
+  xavier_fill(tokenEmbeddings_, E, vocabSize, seed ^ 0x01u);
+  xavier_fill(outputWeights_, E, vocabSize, seed ^ 0x02u);
+  normFill(outputNormWeights_, seed ^ 0x03u);
+
+  for (size_t li = 0; li < layers_.size(); ++li) {
+    TransformerLayer &layer = *layers_[li];
+    SelfAttention &attn = *layer.attention_;
+    FeedForward &ffn = *layer.feedForward_;
+    const uint32_t ls = seed + static_cast<uint32_t>(li) * 0x9E3779B9u;
+
+    normFill(layer.inputNormWeights_, ls ^ 0x10u);
+    normFill(layer.postAttentionNormWeights_, ls ^ 0x11u);
+    // Attention in GGUF [out, in] layout
+    xavier_fill(attn.queryWeights_, E, H * D, ls ^ 0x20u);
+    xavier_fill(attn.keyWeights_, E, HK * D, ls ^ 0x21u);
+    xavier_fill(attn.valueWeights_, E, HK * D, ls ^ 0x22u);
+    xavier_fill(attn.outputWeights_, H * D, E, ls ^ 0x23u);
+    biasFill(attn.queryBias_, H * D, ls ^ 0x24u);
+    biasFill(attn.keyBias_, HK * D, ls ^ 0x25u);
+    biasFill(attn.valueBias_, HK * D, ls ^ 0x26u);
+    attn.queryQ_ = attn.keyQ_ = attn.valueQ_ = attn.outputQ_ =
+        duorou::ml::QuantMatrix();
+    attn.mhaWeightsReady_ = false;
+    attn.weightsLoaded_ = true;
+
+    // FFN as [out, in]: gate/up [inter, hidden], down [hidden, inter]
+    xavier_fill(ffn.gateWeights_, E, interDim, ls ^ 0x30u);
+    xavier_fill(ffn.upWeights_, E, interDim, ls ^ 0x31u);
+    xavier_fill(ffn.downWeights_, interDim, E, ls ^ 0x32u);
+    ffn.gateRows_ = ffn.upRows_ = interDim;
+    ffn.gateCols_ = ffn.upCols_ = E;
+    ffn.downRows_ = E;
+    ffn.downCols_ = interDim;
+    ffn.gateIsInOut_ = ffn.upIsInOut_ = ffn.downIsInOut_ = false;
+    ffn.interDim_ = interDim;
+    ffn.gateQ_ = ffn.upQ_ = ffn.downQ_ = duorou::ml::QuantMatrix();
+    ffn.weightsLoaded_ = true;
+  }
+}
+
 // New helper exposures
 size_t QwenTextModel::getHiddenSize() const { return options_.hiddenSize; }
 
@@ -1673,6 +2201,20 @@ QwenTextModel::computeLogitsFromHidden(const std::vector<float> &hidden) {
 
   size_t seq_len = hidden.size() / hidden_size;
   size_t vocab_tokenizer = getVocabSize();
+
+  // Quantized LM head: one matvec straight over the blocks
+  if (!outputWeightsQ_.empty() && outputWeightsQ_.cols == hidden_size) {
+    const float *last = hidden.data() + (seq_len - 1) * hidden_size;
+    const size_t rows = std::min<size_t>(outputWeightsQ_.rows, vocab_tokenizer);
+    std::vector<float> logits(vocab_tokenizer, 0.0f);
+    std::vector<float> full(outputWeightsQ_.rows);
+    duorou::ml::quantMatVec(outputWeightsQ_, last, full.data(),
+                            &duorou::utils::ThreadPool::global());
+    for (size_t i = 0; i < rows; ++i) {
+      logits[i] = std::isfinite(full[i]) ? full[i] : 0.0f;
+    }
+    return logits;
+  }
   size_t vocab_weights =
       (hidden_size == 0 ? 0 : outputWeights_.size() / hidden_size);
   // Provide non-zero fallback for output weights if missing
@@ -1720,28 +2262,13 @@ QwenTextModel::computeLogitsFromHidden(const std::vector<float> &hidden) {
 
   size_t last_offset = (seq_len > 0 ? (seq_len - 1) * hidden_size : 0);
   const float *hptr = hidden.data() + last_offset;
-
-  // Log statistics of the last token hidden state
-  std::vector<float> last_hidden(hptr, hptr + hidden_size);
-  auto hidden_stats = computeVectorStats(last_hidden);
-  // logger.debug("[computeLogitsFromHidden] Last token hidden state: " +
-  //              formatVectorStats(hidden_stats, "last_hidden"));
-
-  // Check output weights statistics
-  auto weights_stats = computeVectorStats(outputWeights_);
-  // logger.debug("[computeLogitsFromHidden] Output weights: " +
-  //              formatVectorStats(weights_stats, "output_weights"));
+  const size_t rows = std::min(vocab_weights, vocab_tokenizer);
+  const int64_t hs = static_cast<int64_t>(hidden_size);
 
   // Compute logits for entries that exist in weights; pad the rest with 0
-  // logits[v] = hidden dot outputWeights[v]
-  for (size_t v = 0; v < std::min(vocab_weights, vocab_tokenizer); ++v) {
-    float sum = 0.0f;
-    size_t woff = v * hidden_size;
-    for (size_t i = 0; i < hidden_size; ++i) {
-      sum += hptr[i] * outputWeights_[woff + i];
-    }
-    logits[v] = sum;
-  }
+  // logits[v] = hidden dot outputWeights[v], vocab rows split over the pool
+  duorou::ml::sgemv(static_cast<int64_t>(rows), hs, outputWeights_.data(), hs,
+                    hptr, logits.data(), &duorou::utils::ThreadPool::global());
 
   // Sanitize logits: replace NaN/Inf with 0 to avoid downstream instability
   for (size_t i = 0; i < logits.size(); ++i) {
@@ -1770,68 +2297,29 @@ QwenTextModel::computeLogitsFromHidden(const std::vector<float> &hidden) {
 int32_t QwenTextModel::nextToken(duorou::ml::Context &ctx,
                                  const duorou::ml::Tensor &lastTokenId,
                                  duorou::kvcache::Cache *cache,
-                                 float temperature, float topP) {
+                                 float temperature, float topP,
+                                 const TokenCounts *history,
+                                 float repetitionPenalty) {
   // Run stepDecode to get logits
   ::duorou::ml::Tensor logits_tensor = stepDecode(ctx, lastTokenId, cache);
   if (logits_tensor.numel() == 0) {
     return -1;
   }
-  std::vector<float> logits(static_cast<size_t>(logits_tensor.numel()));
+  static thread_local std::vector<float> logits;
+  logits.resize(static_cast<size_t>(logits_tensor.numel()));
   logits_tensor.copyToHost(logits.data(), logits.size() * sizeof(float));
 
-  // Temperature scaling
-  if (temperature > 0.0f) {
-    for (auto &x : logits)
-      x /= temperature;
-  }
-
-  // Softmax
-  std::vector<float> probs;
-  if (!logits.empty()) {
-    float maxLogit = *std::max_element(logits.begin(), logits.end());
-    probs.resize(logits.size());
-    double sum = 0.0;
-    for (size_t i = 0; i < logits.size(); ++i) {
-      double e = std::exp(static_cast<double>(logits[i] - maxLogit));
-      probs[i] = static_cast<float>(e);
-      sum += e;
-    }
-    if (sum > 0.0) {
-      for (auto &p : probs)
-        p = static_cast<float>(p / sum);
-    }
-  }
-
-  // Top-p sampling
-  if (probs.empty())
-    return -1;
-  if (topP >= 1.0f) {
-    std::discrete_distribution<int> dist(probs.begin(), probs.end());
-    static thread_local std::mt19937 rng(std::random_device{}());
-    return static_cast<int32_t>(dist(rng));
-  }
-  std::vector<int> idx(probs.size());
-  std::iota(idx.begin(), idx.end(), 0);
-  std::sort(idx.begin(), idx.end(),
-            [&](int a, int b) { return probs[a] > probs[b]; });
-  std::vector<int> kept;
-  std::vector<float> kept_probs;
-  float acc = 0.0f;
-  for (int id : idx) {
-    kept.push_back(id);
-    kept_probs.push_back(probs[id]);
-    acc += probs[id];
-    if (acc >= topP)
-      break;
-  }
-  if (acc > 0.0f) {
-    for (auto &p : kept_probs)
-      p = p / acc;
-  }
-  static thread_local std::mt19937 rng(std::random_device{}());
-  std::discrete_distribution<int> dist(kept_probs.begin(), kept_probs.end());
-  int sampled = dist(rng);
-  return static_cast<int32_t>(kept[sampled]);
+  // Temperature <= 0 is greedy unless top-p asks for sampling, in which case
+  // the distribution is used unscaled
+  SamplingParams params;
+  params.temperature = temperature;
+  params.topP = topP;
+  params.repetitionPenalty = repetitionPenalty;
+  if (temperature <= 0.0f && topP < 1.0f) {
+    params.temperature = 1.0f;
+  }
+  static thread_local Sampler sampler;
+  return sampler.sample(logits.data(), logits.size(), params, history);
 }
 
 } // namespace model
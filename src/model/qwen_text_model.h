@@ -6,12 +6,15 @@
 #include "../kvcache/cache.h"
 #include "../ml/context.h"
 #include "../ml/nn/attention.h"
+#include "../ml/quant.h"
 #include "../ml/tensor.h"
 #include "base_model.h"
 #include "byte_pair_encoding.h"
+#include "sampler.h"
 #include "vocabulary.h"
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -28,6 +31,9 @@ class GGUFParser;
 namespace duorou {
 namespace model {
 
+class QwenGraphForward;
+struct QwenGraphWeights;
+
 // Text model options/configuration
 struct TextModelOptions {
   size_t hiddenSize = 4096;
@@ -56,9 +62,12 @@ public:
 
   // Initialize weights (placeholder for actual weight loading)
   bool loadWeights(const std::string &weightsPath);
-  // New overload: load weights for a specific layer from a parsed GGUF
+  // New overload: load weights for a specific layer from a parsed GGUF.
+  // Quantized projections stay in block form (borrowed from `mapping` when
+  // set, like FeedForward::loadWeights).
   bool loadWeights(duorou::extensions::ollama::GGUFParser &parser,
-                   size_t layerIndex);
+                   size_t layerIndex,
+                   const std::shared_ptr<const void> &mapping = nullptr);
 
   // Set precomputed RoPE frequencies (size = ropeDim/2)
   void setRoPEFreqs(const std::vector<float> &freqs) { ropeFreqs_ = freqs; }
@@ -69,11 +78,23 @@ private:
   TextModelOptions options_;
   bool weightsLoaded_ = false;
   friend class TransformerLayer;
+  friend class QwenTextModel;
   // Weight matrices (simplified representation)
   std::vector<float> queryWeights_;
   std::vector<float> keyWeights_;
   std::vector<float> valueWeights_;
   std::vector<float> outputWeights_;
+  // Quantized projections ([out, in] blocks); when set, the float vector of
+  // the same projection is empty and the fused graph reads the blocks
+  // directly. The per-op MHA path dequantizes them once when binding.
+  duorou::ml::QuantMatrix queryQ_;
+  duorou::ml::QuantMatrix keyQ_;
+  duorou::ml::QuantMatrix valueQ_;
+  duorou::ml::QuantMatrix outputQ_;
+  // Q/K/V projection biases (Qwen2 has them); empty when the model has none
+  std::vector<float> queryBias_;
+  std::vector<float> keyBias_;
+  std::vector<float> valueBias_;
 
   // Multi-head attention implementation (Tensor-based)
   std::unique_ptr<duorou::ml::nn::MultiHeadAttention> mha_;
@@ -98,14 +119,18 @@ public:
 
   // Initialize weights
   bool loadWeights(const std::string &weightsPath);
-  // New overload: load weights for a specific layer from a parsed GGUF
+  // New overload: load weights for a specific layer from a parsed GGUF.
+  // When `mapping` is set and the parser is memory mapped, quantized
+  // projections borrow their blocks from the mapping instead of copying.
   bool loadWeights(duorou::extensions::ollama::GGUFParser &parser,
-                   size_t layerIndex);
+                   size_t layerIndex,
+                   const std::shared_ptr<const void> &mapping = nullptr);
 
 private:
   TextModelOptions options_;
   bool weightsLoaded_ = false;
   friend class TransformerLayer;
+  friend class QwenTextModel;
   // Weight matrices
   std::vector<float> gateWeights_;
   std::vector<float> upWeights_;
@@ -120,6 +145,11 @@ private:
   bool downIsInOut_ = false;
   // Derived intermediate dimension used by SwiGLU
   size_t interDim_ = 0;
+  // Quantized GGUF weights kept in block form ([out, in]); when set, the
+  // float vector of the same projection is empty
+  duorou::ml::QuantMatrix gateQ_;
+  duorou::ml::QuantMatrix upQ_;
+  duorou::ml::QuantMatrix downQ_;
 };
 
 // Transformer layer combining attention and FFN
@@ -136,6 +166,10 @@ public:
 
   // Load layer weights
   bool loadWeights(const std::string &weightsPath, size_t layerIndex);
+  // Same, from an already parsed GGUF (see FeedForward::loadWeights)
+  bool loadWeights(duorou::extensions::ollama::GGUFParser &parser,
+                   size_t layerIndex,
+                   const std::shared_ptr<const void> &mapping = nullptr);
 
   // Propagate precomputed RoPE frequencies to attention
   void setRoPEFreqs(const std::vector<float> &freqs);
@@ -143,6 +177,7 @@ public:
   void setApplyRopeInAttention(bool v);
 
 private:
+  friend class QwenTextModel;
   TextModelOptions options_;
   std::unique_ptr<SelfAttention> attention_;
   std::unique_ptr<FeedForward> feedForward_;
@@ -164,7 +199,7 @@ class QwenTextModel : public TextModel {
 public:
   QwenTextModel();
   explicit QwenTextModel(const TextModelOptions &options);
-  ~QwenTextModel() override = default;
+  ~QwenTextModel() override;
 
   // BaseModel interface implementation
   std::vector<int32_t> encode(const std::string &text,
@@ -211,7 +246,8 @@ public:
   int32_t nextToken(duorou::ml::Context &ctx,
                     const duorou::ml::Tensor &lastTokenId,
                     duorou::kvcache::Cache *cache, float temperature,
-                    float topP);
+                    float topP, const TokenCounts *history = nullptr,
+                    float repetitionPenalty = 1.0f);
 
   // Qwen-specific methods
   bool loadModel(const std::string &modelPath);
@@ -234,6 +270,23 @@ public:
   // matches expected.
   void setExternalVocabulary(std::shared_ptr<Vocabulary> vocab);
 
+  // Run the decoder as one ggml graph (see qwen_graph_forward.h) instead of
+  // per-op host vectors. Applies to forward() calls without a KV cache; the
+  // per-op path is used when fusing is off or the graph cannot be built.
+  // Defaults to on when DUOROU_FUSED_GRAPH=1.
+  void setUseFusedGraph(bool enable);
+  bool useFusedGraph() const { return useFusedGraph_; }
+
+  // Logits of the last token through the fused graph; empty on failure
+  std::vector<float> forwardFused(duorou::ml::Context &ctx,
+                                  const std::vector<int32_t> &inputIds);
+
+  // Fill all weights with deterministic Xavier values for a vocab of
+  // vocabSize and an FFN width of interDim. For tests and benchmarks that
+  // run without a GGUF file.
+  void initializeRandomWeights(size_t vocabSize, size_t interDim,
+                               uint32_t seed = 0x5EED1234u);
+
 private:
   TextModelOptions options_;
   std::vector<std::unique_ptr<TransformerLayer>> layers_;
@@ -243,6 +296,11 @@ private:
   std::vector<float> tokenEmbeddings_;   // Token embedding weights
   std::vector<float> outputWeights_;     // Output projection weights
   std::vector<float> outputNormWeights_; // Final layer norm weights
+  // Quantized token embeddings / output projection ([vocab, hidden] blocks);
+  // used instead of the float vectors above when the GGUF stores them
+  // quantized
+  duorou::ml::QuantMatrix tokenEmbeddingsQ_;
+  duorou::ml::QuantMatrix outputWeightsQ_;
 
   // Precomputed RoPE frequencies
   std::vector<float> ropeFreqs_;
@@ -258,6 +316,13 @@ private:
                       float temperature, float topP);
 
   bool applyRopeInAttention_ = false;
+
+  // Fused graph runner, bound lazily and dropped whenever weights change
+  bool useFusedGraph_ = false;
+  std::unique_ptr<QwenGraphForward> graph_;
+  // Point the fused graph at the loaded weights; false when a matrix is
+  // missing or its shape differs from what the per-op path would use
+  bool describeGraphWeights(QwenGraphWeights &weights) const;
 };
 
 std::unique_ptr<BaseModel> createQwenTextModel(const std::string &configPath);
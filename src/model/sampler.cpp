@@ -0,0 +1,405 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DUOROU_SAMPLER_X86 1
+#endif
+
+namespace duorou {
+namespace model {
+
+namespace {
+
+// Candidate set of the first nucleus pass when no top-k is given; widened
+// by kWidenFactor until it holds topP of the probability mass
+constexpr size_t kInitialCandidates = 64;
+constexpr size_t kWidenFactor = 8;
+
+// topK() switches from the heap scan to nth_element once k is at least
+// n / kSelectRatio
+constexpr size_t kSelectRatio = 8;
+
+// Block size of the cumulative walk when sampling the full distribution
+constexpr size_t kSampleBlock = 256;
+
+struct Kernels {
+  const char *name;
+  float (*maxOf)(const float *x, size_t n);
+  // sum of exp((x[i] - shift) * scale)
+  float (*expSum)(const float *x, size_t n, float shift, float scale);
+  // First i in [begin, n) with x[i] > threshold, or n
+  size_t (*nextAbove)(const float *x, size_t begin, size_t n, float threshold);
+};
+
+// ---- generic kernels ----
+
+float maxOfGeneric(const float *x, size_t n) {
+  float m = x[0];
+  for (size_t i = 1; i < n; ++i) {
+    m = x[i] > m ? x[i] : m;
+  }
+  return m;
+}
+
+float expSumGeneric(const float *x, size_t n, float shift, float scale) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    sum += std::exp((x[i] - shift) * scale);
+  }
+  return sum;
+}
+
+size_t nextAboveGeneric(const float *x, size_t begin, size_t n,
+                        float threshold) {
+  for (size_t i = begin; i < n; ++i) {
+    if (x[i] > threshold) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#if defined(DUOROU_SAMPLER_X86)
+
+// ---- AVX2 kernels ----
+
+// exp(x) for x <= 0 (Cephes polynomial, ~1 ulp); inputs below -87 flush
+// to a tiny normal instead of producing denormals
+__attribute__((target("avx2,fma"))) inline __m256 exp256(__m256 x) {
+  x = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+  __m256 fx = _mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f),
+                              _mm256_set1_ps(0.5f));
+  fx = _mm256_floor_ps(fx);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(0.693359375f), x);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(-2.12194440e-4f), x);
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x);
+  y = _mm256_add_ps(y, _mm256_set1_ps(1.0f));
+  const __m256i e = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+}
+
+__attribute__((target("avx2,fma"))) inline float hsum256(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma"))) float maxOfAvx2(const float *x,
+                                                    size_t n) {
+  if (n < 8) {
+    return maxOfGeneric(x, n);
+  }
+  __m256 m0 = _mm256_loadu_ps(x);
+  __m256 m1 = m0;
+  size_t i = 8;
+  for (; i + 16 <= n; i += 16) {
+    m0 = _mm256_max_ps(m0, _mm256_loadu_ps(x + i));
+    m1 = _mm256_max_ps(m1, _mm256_loadu_ps(x + i + 8));
+  }
+  m0 = _mm256_max_ps(m0, m1);
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(m0),
+                        _mm256_extractf128_ps(m0, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_movehdup_ps(m));
+  float r = _mm_cvtss_f32(m);
+  for (; i < n; ++i) {
+    r = x[i] > r ? x[i] : r;
+  }
+  return r;
+}
+
+__attribute__((target("avx2,fma"))) float
+expSumAvx2(const float *x, size_t n, float shift, float scale) {
+  const __m256 vshift = _mm256_set1_ps(shift);
+  const __m256 vscale = _mm256_set1_ps(scale);
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256 a = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vshift),
+                                   vscale);
+    const __m256 b = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_loadu_ps(x + i + 8), vshift), vscale);
+    acc0 = _mm256_add_ps(acc0, exp256(a));
+    acc1 = _mm256_add_ps(acc1, exp256(b));
+  }
+  for (; i + 8 <= n; i += 8) {
+    const __m256 a = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vshift),
+                                   vscale);
+    acc0 = _mm256_add_ps(acc0, exp256(a));
+  }
+  float sum = hsum256(_mm256_add_ps(acc0, acc1));
+  for (; i < n; ++i) {
+    sum += std::exp((x[i] - shift) * scale);
+  }
+  return sum;
+}
+
+__attribute__((target("avx2,fma"))) size_t
+nextAboveAvx2(const float *x, size_t begin, size_t n, float threshold) {
+  const __m256 t = _mm256_set1_ps(threshold);
+  size_t i = begin;
+  for (; i + 8 <= n; i += 8) {
+    const int mask =
+        _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(x + i), t, _CMP_GT_OQ));
+    if (mask != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+  }
+  return nextAboveGeneric(x, i, n, threshold);
+}
+
+#endif
+
+Kernels detectKernels() {
+  const Kernels generic{"generic", maxOfGeneric, expSumGeneric,
+                        nextAboveGeneric};
+  const char *forced = std::getenv("DUOROU_SAMPLER_KERNEL");
+  if (forced && std::strcmp(forced, "generic") == 0) {
+    return generic;
+  }
+#if defined(DUOROU_SAMPLER_X86)
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return {"avx2", maxOfAvx2, expSumAvx2, nextAboveAvx2};
+  }
+#endif
+  return generic;
+}
+
+const Kernels &kernels() {
+  static const Kernels k = detectKernels();
+  return k;
+}
+
+// Heap order: better candidates compare "less", so the heap front is the
+// worst kept candidate
+bool better(const Sampler::Candidate &a, const Sampler::Candidate &b) {
+  return a.logit > b.logit || (a.logit == b.logit && a.id < b.id);
+}
+
+} // namespace
+
+Sampler::Sampler() : rng_(std::random_device{}()) {}
+
+Sampler::Sampler(uint64_t seed)
+    : rng_(static_cast<std::mt19937::result_type>(seed)) {}
+
+const char *Sampler::kernelName() { return kernels().name; }
+
+size_t Sampler::argmax(const float *logits, size_t n) {
+  if (n == 0) {
+    return 0;
+  }
+  const float m = kernels().maxOf(logits, n);
+  for (size_t i = 0; i < n; ++i) {
+    if (logits[i] == m) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+void Sampler::topK(const float *logits, size_t n, size_t k,
+                   std::vector<Candidate> &out) {
+  out.clear();
+  k = std::min(k, n);
+  if (k == 0) {
+    return;
+  }
+  if (k * kSelectRatio >= n) {
+    // A large share of the row: a linear selection beats heap churn
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      out.push_back({logits[i], static_cast<int32_t>(i)});
+    }
+    if (k < n) {
+      std::nth_element(out.begin(), out.begin() + k, out.end(), better);
+      out.resize(k);
+    }
+    std::sort(out.begin(), out.end(), better);
+    return;
+  }
+  out.reserve(k);
+  for (size_t i = 0; i < k; ++i) {
+    out.push_back({logits[i], static_cast<int32_t>(i)});
+  }
+  std::make_heap(out.begin(), out.end(), better);
+
+  // Only logits above the current k-th best touch the heap; the scan
+  // itself is a vector compare
+  const Kernels &kern = kernels();
+  float threshold = out.front().logit;
+  for (size_t i = kern.nextAbove(logits, k, n, threshold); i < n;
+       i = kern.nextAbove(logits, i + 1, n, threshold)) {
+    std::pop_heap(out.begin(), out.end(), better);
+    out.back() = {logits[i], static_cast<int32_t>(i)};
+    std::push_heap(out.begin(), out.end(), better);
+    threshold = out.front().logit;
+  }
+  std::sort_heap(out.begin(), out.end(), better);
+}
+
+void Sampler::applyRepetitionPenalty(float *logits, size_t n,
+                                     const TokenCounts &counts,
+                                     float penalty) {
+  if (penalty == 1.0f || penalty <= 0.0f) {
+    return;
+  }
+  for (const auto &entry : counts) {
+    if (entry.first < 0 || static_cast<size_t>(entry.first) >= n ||
+        entry.second <= 0) {
+      continue;
+    }
+    float &l = logits[entry.first];
+    l = l > 0.0f ? l / penalty : l * penalty;
+  }
+}
+
+void Sampler::nucleus(const float *logits, size_t n, float invTemperature,
+                      float topP, std::vector<Candidate> &out) {
+  out.clear();
+  if (n == 0) {
+    return;
+  }
+  const Kernels &kern = kernels();
+  const float maxLogit = kern.maxOf(logits, n);
+  const float target =
+      std::min(topP, 1.0f) * kern.expSum(logits, n, maxLogit, invTemperature);
+
+  // Widen the head of the vocabulary until it holds the target mass
+  for (size_t m = std::min(n, kInitialCandidates);;
+       m = std::min(n, m * kWidenFactor)) {
+    topK(logits, n, m, out);
+    float covered = 0.0f;
+    for (size_t i = 0; i < out.size(); ++i) {
+      covered += std::exp((out[i].logit - maxLogit) * invTemperature);
+      if (covered >= target) {
+        out.resize(i + 1);
+        return;
+      }
+    }
+    if (m == n) {
+      return; // rounding: the whole vocabulary
+    }
+  }
+}
+
+int32_t Sampler::sample(float *logits, size_t n, const SamplingParams &params,
+                        const TokenCounts *counts) {
+  if (!logits || n == 0) {
+    return -1;
+  }
+  if (counts) {
+    applyRepetitionPenalty(logits, n, *counts, params.repetitionPenalty);
+  }
+  if (params.temperature <= 0.0f) {
+    return static_cast<int32_t>(argmax(logits, n));
+  }
+  const float invTemperature = 1.0f / params.temperature;
+
+  if (params.topK > 0 && static_cast<size_t>(params.topK) < n) {
+    topK(logits, n, static_cast<size_t>(params.topK), candidates_);
+    return sampleCandidates(invTemperature, params.topP);
+  }
+  if (params.topP < 1.0f) {
+    nucleus(logits, n, invTemperature, params.topP, candidates_);
+    return sampleCandidates(invTemperature, 1.0f);
+  }
+
+  const Kernels &kern = kernels();
+  const float maxLogit = kern.maxOf(logits, n);
+  const float sum = kern.expSum(logits, n, maxLogit, invTemperature);
+  return sampleFull(logits, n, maxLogit, invTemperature, sum);
+}
+
+int32_t Sampler::sampleCandidates(float invTemperature, float topP) {
+  const size_t count = candidates_.size();
+  if (count == 0) {
+    return -1;
+  }
+  // Weights relative to the best candidate, then top-p over the survivors
+  weights_.resize(count);
+  const float best = candidates_[0].logit;
+  float total = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    weights_[i] = std::exp((candidates_[i].logit - best) * invTemperature);
+    total += weights_[i];
+  }
+  size_t kept = count;
+  float keptSum = total;
+  if (topP < 1.0f) {
+    float acc = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+      acc += weights_[i];
+      if (acc >= topP * total) {
+        kept = i + 1;
+        keptSum = acc;
+        break;
+      }
+    }
+  }
+
+  std::uniform_real_distribution<float> uniform(0.0f, keptSum);
+  const float u = uniform(rng_);
+  float acc = 0.0f;
+  for (size_t i = 0; i < kept; ++i) {
+    acc += weights_[i];
+    if (u < acc) {
+      return candidates_[i].id;
+    }
+  }
+  return candidates_[kept - 1].id;
+}
+
+int32_t Sampler::sampleFull(const float *logits, size_t n, float maxLogit,
+                            float invTemperature, float sum) {
+  // Skip whole blocks by their vector sums, then walk one block by element
+  const Kernels &kern = kernels();
+  std::uniform_real_distribution<float> uniform(0.0f, sum);
+  const float u = uniform(rng_);
+  float acc = 0.0f;
+  size_t begin = 0;
+  for (; begin < n; begin += kSampleBlock) {
+    const size_t len = std::min(kSampleBlock, n - begin);
+    const float block =
+        kern.expSum(logits + begin, len, maxLogit, invTemperature);
+    if (acc + block > u) {
+      break;
+    }
+    acc += block;
+  }
+  if (begin >= n) {
+    // Rounding left u just past the end of the mass
+    return static_cast<int32_t>(argmax(logits, n));
+  }
+  const size_t end = std::min(n, begin + kSampleBlock);
+  size_t last = begin;
+  for (size_t i = begin; i < end; ++i) {
+    const float w = std::exp((logits[i] - maxLogit) * invTemperature);
+    if (w > 0.0f) {
+      last = i;
+    }
+    acc += w;
+    if (u < acc) {
+      return static_cast<int32_t>(i);
+    }
+  }
+  return static_cast<int32_t>(last);
+}
+
+} // namespace model
+} // namespace duorou
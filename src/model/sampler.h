@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace duorou {
+namespace model {
+
+struct SamplingParams {
+  float temperature = 1.0f;       // <= 0 picks the most likely token
+  int32_t topK = 0;               // 0 keeps every token
+  float topP = 1.0f;              // >= 1 disables nucleus filtering
+  float repetitionPenalty = 1.0f; // 1 disables
+};
+
+// Occurrences of each token in the context, for the repetition penalty
+using TokenCounts = std::unordered_map<int32_t, int32_t>;
+
+/**
+ * Fused next-token sampling over a logit row.
+ *
+ * Repetition penalty touches only the ids in the count map; top-k is a
+ * threshold scan that keeps a k-element heap; top-p runs over the sorted
+ * top-k survivors only. Without top-k, nucleus sampling starts from a small
+ * candidate set and widens it until it covers topP of the full softmax mass,
+ * so the vocabulary is never sorted. Max, exp and sums use AVX2 when the CPU
+ * has it.
+ */
+class Sampler {
+public:
+  struct Candidate {
+    float logit;
+    int32_t id;
+  };
+
+  Sampler();
+  explicit Sampler(uint64_t seed);
+
+  void seed(uint64_t seed) { rng_.seed(static_cast<std::mt19937::result_type>(seed)); }
+
+  /**
+   * Draw a token id from logits[0, n). logits is modified in place where
+   * the repetition penalty applies. Returns -1 when n == 0.
+   */
+  int32_t sample(float *logits, size_t n, const SamplingParams &params,
+                 const TokenCounts *counts = nullptr);
+
+  // Index of the largest logit (the first one on ties)
+  static size_t argmax(const float *logits, size_t n);
+
+  // The k largest logits, sorted by decreasing logit then increasing id
+  static void topK(const float *logits, size_t n, size_t k,
+                   std::vector<Candidate> &out);
+
+  // The fewest highest logits whose softmax mass at temperature
+  // 1 / invTemperature reaches topP, sorted like topK()
+  static void nucleus(const float *logits, size_t n, float invTemperature,
+                      float topP, std::vector<Candidate> &out);
+
+  // logit /= penalty when positive, *= penalty otherwise, for every id in
+  // counts
+  static void applyRepetitionPenalty(float *logits, size_t n,
+                                     const TokenCounts &counts, float penalty);
+
+  // Name of the kernel in use ("avx2" or "generic")
+  static const char *kernelName();
+
+private:
+  int32_t sampleCandidates(float invTemperature, float topP);
+  int32_t sampleFull(const float *logits, size_t n, float maxLogit,
+                     float invTemperature, float sum);
+
+  std::mt19937 rng_;
+  std::vector<Candidate> candidates_;
+  std::vector<float> weights_;
+};
+
+} // namespace model
+} // namespace duorou
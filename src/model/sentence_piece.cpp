@@ -1,5 +1,6 @@
 #include "sentence_piece.h"
 #include <algorithm>
+#include <cstdio>
 #include <sstream>
 #include <cmath>
 #include <limits>
@@ -9,6 +10,10 @@ namespace model {
 
 SentencePiece::SentencePiece(std::shared_ptr<Vocabulary> vocab)
     : vocab_(vocab) {
+    // Build the token trie up front rather than on the first encode
+    if (vocab_ && vocab_->size() > 0) {
+        vocab_->getPieceTrie();
+    }
 }
 
 std::vector<int32_t> SentencePiece::encode(const std::string& text, bool addSpecial) {
@@ -41,6 +46,20 @@ std::string SentencePiece::decode(const std::vector<int32_t>& ids) {
     return result.str();
 }
 
+void SentencePiece::appendTokenBytes(int32_t id, bool atStart, std::string& out) const {
+    // Same rule as decode(): a leading space symbol becomes a space unless
+    // it starts the output
+    const std::string token = vocab_->decode(id);
+    if (token.compare(0, 3, "\xe2\x96\x81") == 0) {
+        if (!atStart) {
+            out += ' ';
+        }
+        out.append(token, 3, std::string::npos);
+    } else {
+        out += token;
+    }
+}
+
 bool SentencePiece::isSpecial(int32_t id, Special special) const {
     return vocab_->isSpecial(id, special);
 }
@@ -105,17 +124,7 @@ std::vector<std::string> SentencePiece::splitByWhitespace(const std::string& tex
 
 std::vector<int32_t> SentencePiece::encodeWord(const std::string& word) const {
     // Use Viterbi algorithm to find the best segmentation
-    auto tokens = viterbiDecode(word);
-    
-    std::vector<int32_t> result;
-    for (const auto& token : tokens) {
-        int32_t id = vocab_->encode(token);
-        if (id >= 0) {
-            result.push_back(id);
-        }
-    }
-    
-    return result;
+    return viterbiDecode(word);
 }
 
 double SentencePiece::calculateScore(const std::vector<std::string>& tokens) const {
@@ -133,7 +142,7 @@ double SentencePiece::calculateScore(const std::vector<std::string>& tokens) con
     return score;
 }
 
-std::vector<std::string> SentencePiece::viterbiDecode(const std::string& text) const {
+std::vector<int32_t> SentencePiece::viterbiDecode(const std::string& text) const {
     if (text.empty()) {
         return {};
     }
@@ -141,64 +150,57 @@ std::vector<std::string> SentencePiece::viterbiDecode(const std::string& text) c
     size_t len = text.length();
     std::vector<double> dp(len + 1, -std::numeric_limits<double>::infinity());
     std::vector<int> prev(len + 1, -1);
+    std::vector<int32_t> prevId(len + 1, -1);
     dp[0] = 0.0;
 
     const auto& scores = vocab_->getScores();
+    const DoubleArrayTrie& trie = vocab_->getPieceTrie();
 
-    // Dynamic programming over substrings
+    // One trie walk per start position yields every vocabulary token that
+    // begins there, shortest first
     for (size_t i = 0; i < len; ++i) {
         if (dp[i] == -std::numeric_limits<double>::infinity()) continue;
-        for (size_t j = i + 1; j <= len; ++j) {
-            std::string token = text.substr(i, j - i);
-            int32_t id = vocab_->encode(token);
-            if (id >= 0) {
-                double tokenScore = 0.0;
-                if (static_cast<size_t>(id) < scores.size()) {
-                    tokenScore = static_cast<double>(scores[id]);
-                } else {
-                    // If no explicit score, approximate by length preference
-                    tokenScore = std::log(static_cast<double>(token.length()));
-                }
-                double newScore = dp[i] + tokenScore;
-                if (newScore > dp[j]) {
-                    dp[j] = newScore;
-                    prev[j] = static_cast<int>(i);
-                }
+        trie.commonPrefixSearch(text.data() + i, len - i, [&](int32_t id, size_t tokenLen) {
+            double tokenScore = 0.0;
+            if (static_cast<size_t>(id) < scores.size()) {
+                tokenScore = static_cast<double>(scores[id]);
+            } else {
+                // If no explicit score, approximate by length preference
+                tokenScore = std::log(static_cast<double>(tokenLen));
             }
-        }
+            size_t j = i + tokenLen;
+            double newScore = dp[i] + tokenScore;
+            if (newScore > dp[j]) {
+                dp[j] = newScore;
+                prev[j] = static_cast<int>(i);
+                prevId[j] = id;
+            }
+        });
     }
 
-    // Backtrack
-    std::vector<std::string> result;
-    int pos = static_cast<int>(len);
-    while (pos > 0 && prev[pos] >= 0) {
-        int start = prev[pos];
-        result.push_back(text.substr(start, pos - start));
-        pos = start;
-    }
-    std::reverse(result.begin(), result.end());
-
-    // Fallback: if no path, try byte-level <0x..> tokens if present
-    if ((result.empty() || prev[len] < 0) && !text.empty()) {
-        result.clear();
-        for (unsigned char b : std::string(text.begin(), text.end())) {
-            char buf[6];
-            std::snprintf(buf, sizeof(buf), "%02X", static_cast<unsigned int>(b));
-            std::string hex(buf);
-            std::string byteTok = std::string("<0x") + hex + ">";
-            if (vocab_->encode(byteTok) >= 0) {
-                result.push_back(byteTok);
-            } else {
-                // fallback to raw single-byte string
-                result.push_back(std::string(1, static_cast<char>(b)));
-            }
+    std::vector<int32_t> result;
+    if (prev[len] >= 0) {
+        // Backtrack
+        int pos = static_cast<int>(len);
+        while (pos > 0 && prev[pos] >= 0) {
+            result.push_back(prevId[pos]);
+            pos = prev[pos];
         }
+        std::reverse(result.begin(), result.end());
+        return result;
     }
 
-    // If still empty, final fallback to character-level split
-    if (result.empty() && !text.empty()) {
-        for (char c : text) {
-            result.push_back(std::string(1, c));
+    // Fallback: if no path, use byte-level <0x..> tokens if present, else the
+    // raw single-byte token; bytes with neither are dropped
+    for (unsigned char b : text) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "<0x%02X>", static_cast<unsigned int>(b));
+        int32_t id = vocab_->encode(buf);
+        if (id < 0) {
+            id = vocab_->encode(std::string(1, static_cast<char>(b)));
+        }
+        if (id >= 0) {
+            result.push_back(id);
         }
     }
 
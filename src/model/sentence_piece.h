@@ -20,6 +20,7 @@ public:
     bool isSpecial(int32_t id, Special special) const override;
     const Vocabulary* getVocabulary() const override;
     size_t getVocabSize() const override;
+    void appendTokenBytes(int32_t id, bool atStart, std::string& out) const override;
 
 private:
     std::shared_ptr<Vocabulary> vocab_;
@@ -32,7 +33,8 @@ private:
     
     // Unigram language model scoring
     double calculateScore(const std::vector<std::string>& tokens) const;
-    std::vector<std::string> viterbiDecode(const std::string& text) const;
+    // Best segmentation of text as token ids; byte tokens when none exists
+    std::vector<int32_t> viterbiDecode(const std::string& text) const;
     
     // Helper methods
     bool isWhitespace(char c) const;
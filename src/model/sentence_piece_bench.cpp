@@ -0,0 +1,211 @@
+// SentencePiece encode benchmark.
+// Builds a synthetic unigram vocabulary, then encodes long English and
+// Chinese paragraphs with SentencePiece (trie-driven Viterbi) and with a
+// reference Viterbi that looks up every substring in the token map, as the
+// encoder used to. Reports MB/s for both and checks the ids agree.
+//
+// Usage: sentence_piece_bench [paragraph_kb]
+
+#include "sentence_piece.h"
+#include "vocabulary.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using duorou::model::SentencePiece;
+using duorou::model::TOKEN_TYPE_BYTE;
+using duorou::model::TOKEN_TYPE_NORMAL;
+using duorou::model::Vocabulary;
+
+const char *kSpace = "\xe2\x96\x81";
+
+const char *kSyllables[] = {"th", "e",  "an", "in", "er", "on", "re", "at",
+                            "st", "en", "or", "ti", "es", "ar", "to", "ed",
+                            "is", "it", "al", "ou", "ng", "ca", "de", "mo"};
+const char *kHanzi[] = {"模", "型", "推", "理", "缓", "存", "我", "们",
+                        "今", "天", "数", "据", "中", "文", "分", "词",
+                        "速", "度", "的", "是", "在", "了", "和", "有"};
+
+std::string randomWord(std::mt19937 &rng, const char *const *parts,
+                       size_t count, int minParts, int maxParts) {
+  std::uniform_int_distribution<size_t> pick(0, count - 1);
+  std::uniform_int_distribution<int> n(minParts, maxParts);
+  std::string w;
+  for (int k = n(rng); k > 0; --k) {
+    w += parts[pick(rng)];
+  }
+  return w;
+}
+
+std::shared_ptr<Vocabulary> makeVocabulary(size_t target, std::mt19937 &rng) {
+  std::vector<std::string> values;
+  std::vector<int32_t> types;
+  std::vector<float> scores;
+  std::set<std::string> seen;
+  auto add = [&](const std::string &v, int32_t type, float score) {
+    if (seen.insert(v).second) {
+      values.push_back(v);
+      types.push_back(type);
+      scores.push_back(score);
+    }
+  };
+  for (int b = 0; b < 256; ++b) {
+    char buf[8];
+    std::snprintf(buf, sizeof(buf), "<0x%02X>", b);
+    add(buf, TOKEN_TYPE_BYTE, -20.0f);
+  }
+  add(kSpace, TOKEN_TYPE_NORMAL, -5.0f);
+  for (const char *s : kSyllables) {
+    add(s, TOKEN_TYPE_NORMAL, -6.0f);
+  }
+  for (const char *h : kHanzi) {
+    add(h, TOKEN_TYPE_NORMAL, -6.0f);
+  }
+  add("，", TOKEN_TYPE_NORMAL, -4.0f);
+  std::uniform_real_distribution<float> jitter(0.0f, 2.0f);
+  while (values.size() < target) {
+    const bool chinese = rng() % 3 == 0;
+    std::string w =
+        chinese ? randomWord(rng, kHanzi, std::size(kHanzi), 2, 4)
+                : randomWord(rng, kSyllables, std::size(kSyllables), 2, 5);
+    const float score = -2.0f * static_cast<float>(w.size()) / 3 - jitter(rng);
+    if (!chinese && rng() % 2 == 0) {
+      w = kSpace + w;
+    }
+    add(w, TOKEN_TYPE_NORMAL, score);
+  }
+  auto vocab = std::make_shared<Vocabulary>();
+  vocab->initialize(values, types, scores);
+  return vocab;
+}
+
+std::string makeParagraph(size_t bytes, bool chinese, std::mt19937 &rng) {
+  std::string out;
+  while (out.size() < bytes) {
+    if (chinese) {
+      // No whitespace: the whole paragraph is a single Viterbi lattice
+      out += randomWord(rng, kHanzi, std::size(kHanzi), 1, 4);
+      if (rng() % 40 == 0) {
+        out += "，";
+      }
+    } else {
+      if (!out.empty()) {
+        out += ' ';
+      }
+      out += randomWord(rng, kSyllables, std::size(kSyllables), 1, 6);
+    }
+  }
+  return out;
+}
+
+// The substring-lookup Viterbi that the trie replaced
+std::vector<int32_t> referenceEncodeWord(const Vocabulary &vocab,
+                                         const std::string &text) {
+  const size_t len = text.size();
+  std::vector<double> dp(len + 1, -std::numeric_limits<double>::infinity());
+  std::vector<int> prev(len + 1, -1);
+  dp[0] = 0.0;
+  const auto &scores = vocab.getScores();
+  for (size_t i = 0; i < len; ++i) {
+    if (dp[i] == -std::numeric_limits<double>::infinity())
+      continue;
+    for (size_t j = i + 1; j <= len; ++j) {
+      const int32_t id = vocab.encode(text.substr(i, j - i));
+      if (id < 0)
+        continue;
+      const double s = static_cast<size_t>(id) < scores.size()
+                           ? static_cast<double>(scores[id])
+                           : std::log(static_cast<double>(j - i));
+      if (dp[i] + s > dp[j]) {
+        dp[j] = dp[i] + s;
+        prev[j] = static_cast<int>(i);
+      }
+    }
+  }
+  std::vector<int32_t> ids;
+  if (prev[len] < 0) {
+    for (unsigned char b : text) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "<0x%02X>", b);
+      int32_t id = vocab.encode(buf);
+      if (id < 0)
+        id = vocab.encode(std::string(1, static_cast<char>(b)));
+      if (id >= 0)
+        ids.push_back(id);
+    }
+    return ids;
+  }
+  for (int pos = static_cast<int>(len); pos > 0; pos = prev[pos]) {
+    ids.push_back(vocab.encode(text.substr(prev[pos], pos - prev[pos])));
+  }
+  std::reverse(ids.begin(), ids.end());
+  return ids;
+}
+
+std::vector<int32_t> referenceEncode(const Vocabulary &vocab,
+                                     const std::string &text) {
+  std::vector<int32_t> ids;
+  std::istringstream iss(text);
+  std::string word;
+  while (iss >> word) {
+    const std::vector<int32_t> w = referenceEncodeWord(vocab, kSpace + word);
+    ids.insert(ids.end(), w.begin(), w.end());
+  }
+  return ids;
+}
+
+template <typename F> double bestSeconds(int reps, F &&f) {
+  double best = 1e30;
+  for (int r = 0; r < reps; ++r) {
+    auto t0 = Clock::now();
+    f();
+    best = std::min(best,
+                    std::chrono::duration<double>(Clock::now() - t0).count());
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const double kb = argc > 1 ? std::max(1.0, std::atof(argv[1])) : 4.0;
+  const size_t bytes = static_cast<size_t>(kb * 1024);
+  const int reps = 3;
+
+  std::mt19937 rng(7);
+  auto vocab = makeVocabulary(32000, rng);
+  auto t0 = Clock::now();
+  SentencePiece sp(vocab);
+  std::printf("vocab %zu tokens, trie built in %.1f ms\n", vocab->size(),
+              std::chrono::duration<double, std::milli>(Clock::now() - t0)
+                  .count());
+
+  std::printf("%-8s %8s %10s %10s %8s %6s\n", "corpus", "tokens", "ref MB/s",
+              "trie MB/s", "speedup", "match");
+  for (bool chinese : {false, true}) {
+    const std::string text = makeParagraph(bytes, chinese, rng);
+    std::vector<int32_t> fast, ref;
+    const double tf =
+        bestSeconds(reps, [&] { fast = sp.encode(text, false); });
+    const double tr =
+        bestSeconds(reps, [&] { ref = referenceEncode(*vocab, text); });
+    const double mb = static_cast<double>(text.size()) / 1e6;
+    std::printf("%-8s %8zu %10.2f %10.2f %7.1fx %6s\n",
+                chinese ? "chinese" : "english", fast.size(), mb / tr,
+                mb / tf, tr / tf, fast == ref ? "yes" : "NO");
+  }
+  return 0;
+}
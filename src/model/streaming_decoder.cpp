@@ -0,0 +1,70 @@
+#include "streaming_decoder.h"
+
+namespace duorou {
+namespace model {
+
+namespace {
+
+// Length of the prefix of s that ends on a UTF-8 character boundary. Only
+// the last (at most four) bytes are inspected; malformed input is passed
+// through rather than held forever.
+size_t completePrefix(const std::string &s) {
+  const size_t n = s.size();
+  for (size_t i = n; i > 0 && n - i < 4; --i) {
+    const unsigned char b = static_cast<unsigned char>(s[i - 1]);
+    if ((b & 0xC0) == 0x80) {
+      continue; // continuation byte, keep looking for the lead
+    }
+    size_t need = 1;
+    if ((b & 0xE0) == 0xC0) {
+      need = 2;
+    } else if ((b & 0xF0) == 0xE0) {
+      need = 3;
+    } else if ((b & 0xF8) == 0xF0) {
+      need = 4;
+    }
+    return n - (i - 1) < need ? i - 1 : n;
+  }
+  return n;
+}
+
+} // namespace
+
+std::string StreamingDecoder::push(int32_t id) {
+  if (!processor_) {
+    return {};
+  }
+  processor_->appendTokenBytes(id, atStart_, pending_);
+  if (!pending_.empty()) {
+    atStart_ = false;
+  }
+  const size_t cut = completePrefix(pending_);
+  std::string out(pending_, 0, cut);
+  pending_.erase(0, cut);
+  return out;
+}
+
+std::string StreamingDecoder::pushBytes(const std::string &bytes) {
+  pending_ += bytes;
+  if (!pending_.empty()) {
+    atStart_ = false;
+  }
+  const size_t cut = completePrefix(pending_);
+  std::string out(pending_, 0, cut);
+  pending_.erase(0, cut);
+  return out;
+}
+
+std::string StreamingDecoder::flush() {
+  std::string out;
+  out.swap(pending_);
+  return out;
+}
+
+void StreamingDecoder::reset() {
+  pending_.clear();
+  atStart_ = true;
+}
+
+} // namespace model
+} // namespace duorou
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "text_processor.h"
+
+#include <cstdint>
+#include <string>
+
+namespace duorou {
+namespace model {
+
+/**
+ * Incremental detokenizer for streaming output.
+ *
+ * Tokens are fed one at a time and only complete UTF-8 characters are
+ * returned; the bytes of a character split across tokens (for example
+ * byte-fallback <0xNN> tokens) are held until it is finished. Each push costs
+ * O(token length) regardless of how much has been decoded before, and the
+ * concatenation of all pushes plus flush() equals decode() of the full ids.
+ *
+ * Engines that stream text rather than ids (llama.cpp, MNN) feed their
+ * pieces through pushBytes() instead, which applies the same hold-back to
+ * pieces cut at arbitrary byte offsets.
+ */
+class StreamingDecoder {
+public:
+  // Byte-only decoder: only pushBytes() may be used
+  StreamingDecoder() = default;
+  explicit StreamingDecoder(const TextProcessor &processor)
+      : processor_(&processor) {}
+
+  /**
+   * Feed one token and return the text it completed (possibly empty)
+   */
+  std::string push(int32_t id);
+
+  /**
+   * Feed already detokenized bytes and return the complete characters
+   */
+  std::string pushBytes(const std::string &bytes);
+
+  /**
+   * Return whatever is still held back, complete or not, at end of stream
+   */
+  std::string flush();
+
+  /**
+   * Forget all state to start a new stream
+   */
+  void reset();
+
+  // True while bytes of an unfinished character are held back
+  bool hasPending() const { return !pending_.empty(); }
+
+private:
+  const TextProcessor *processor_ = nullptr;
+  std::string pending_;
+  bool atStart_ = true;
+};
+
+} // namespace model
+} // namespace duorou
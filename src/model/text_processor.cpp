@@ -0,0 +1,95 @@
+#include "text_processor.h"
+
+#include "../utils/thread_pool.h"
+#include "vocabulary.h"
+
+#include <algorithm>
+#include <string>
+
+namespace duorou {
+namespace model {
+
+namespace {
+
+// Batches smaller than this are encoded on the calling thread
+constexpr size_t kParallelMinBytes = 16 * 1024;
+
+// Call fn(i) for every text, in parallel when the batch is big enough.
+// Texts are cut into one consecutive group per thread with similar byte
+// totals, so a few long documents do not land on the same worker.
+template <typename Fn>
+void forEachText(const std::string_view *texts, size_t count, Fn &&fn) {
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    total += texts[i].size();
+  }
+  utils::ThreadPool &pool = utils::ThreadPool::global();
+  const size_t groups = std::min(count, pool.size() + 1);
+  if (total < kParallelMinBytes || groups <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::vector<size_t> bounds(1, 0);
+  size_t seen = 0;
+  for (size_t i = 0; i < count && bounds.size() < groups; ++i) {
+    seen += texts[i].size();
+    if (seen * groups >= total * bounds.size()) {
+      bounds.push_back(i + 1);
+    }
+  }
+  if (bounds.back() != count) {
+    bounds.push_back(count);
+  }
+
+  pool.parallelFor(bounds.size() - 1, 1, [&](size_t begin, size_t end) {
+    for (size_t g = begin; g < end; ++g) {
+      for (size_t i = bounds[g]; i < bounds[g + 1]; ++i) {
+        fn(i);
+      }
+    }
+  });
+}
+
+} // namespace
+
+TokenBatch TextProcessor::encodeBatch(const std::string_view *texts,
+                                      size_t count, bool addSpecial) {
+  std::vector<std::vector<int32_t>> perText(count);
+  forEachText(texts, count, [&](size_t i) {
+    perText[i] = encode(std::string(texts[i]), addSpecial);
+  });
+
+  TokenBatch batch;
+  batch.offsets.resize(count + 1, 0);
+  for (size_t i = 0; i < count; ++i) {
+    batch.offsets[i + 1] = batch.offsets[i] + perText[i].size();
+  }
+  batch.ids.reserve(batch.offsets[count]);
+  for (auto &ids : perText) {
+    batch.ids.insert(batch.ids.end(), ids.begin(), ids.end());
+    std::vector<int32_t>().swap(ids);
+  }
+  return batch;
+}
+
+std::vector<size_t> TextProcessor::countTokensBatch(
+    const std::string_view *texts, size_t count, bool addSpecial) {
+  std::vector<size_t> counts(count, 0);
+  forEachText(texts, count, [&](size_t i) {
+    counts[i] = encode(std::string(texts[i]), addSpecial).size();
+  });
+  return counts;
+}
+
+void TextProcessor::appendTokenBytes(int32_t id, bool /*atStart*/,
+                                     std::string &out) const {
+  if (const Vocabulary *vocab = getVocabulary()) {
+    out += vocab->decode(id);
+  }
+}
+
+} // namespace model
+} // namespace duorou
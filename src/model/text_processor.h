@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstddef>
 #include <cstdint>
 
 namespace duorou {
@@ -18,6 +20,17 @@ enum class Special {
     EOS = 3
 };
 
+// Token ids of several texts in one flat buffer: the ids of text i are
+// ids[offsets[i], offsets[i + 1])
+struct TokenBatch {
+    std::vector<int32_t> ids;
+    std::vector<size_t> offsets;
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    const int32_t* data(size_t i) const { return ids.data() + offsets[i]; }
+    size_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+};
+
 // Text processor interface
 class TextProcessor {
 public:
@@ -37,6 +50,32 @@ public:
     
     // Get vocabulary size
     virtual size_t getVocabSize() const = 0;
+
+    // Append the bytes token id contributes to decode() output; atStart is
+    // true while nothing has been produced yet. The bytes may end inside a
+    // UTF-8 sequence. Used by StreamingDecoder; must be O(token length).
+    virtual void appendTokenBytes(int32_t id, bool atStart, std::string& out) const;
+
+    // Encode independent texts, spread over the shared thread pool.
+    // Relies on encode() being safe to call concurrently, which holds for
+    // BytePairEncoding and SentencePiece. Only the golden tokenizer test
+    // calls it so far: the app's generators and file parsers go through
+    // llama.cpp/MNN and never hold a TextProcessor.
+    virtual TokenBatch encodeBatch(const std::string_view* texts, size_t count,
+                                   bool addSpecial = true);
+    TokenBatch encodeBatch(const std::vector<std::string_view>& texts,
+                           bool addSpecial = true) {
+        return encodeBatch(texts.data(), texts.size(), addSpecial);
+    }
+
+    // Token count of each text, without keeping the ids
+    virtual std::vector<size_t> countTokensBatch(const std::string_view* texts,
+                                                 size_t count,
+                                                 bool addSpecial = false);
+    std::vector<size_t> countTokensBatch(const std::vector<std::string_view>& texts,
+                                         bool addSpecial = false) {
+        return countTokensBatch(texts.data(), texts.size(), addSpecial);
+    }
 };
 
 } // namespace model
@@ -1,7 +1,10 @@
 #include "../extensions/ollama/gguf_parser.h"
 #include "../utils/string_utils.h"
 #include "byte_pair_encoding.h"
+#include "pretoken_cache.h"
+#include "pretokenizer.h"
 #include "sentence_piece.h"
+#include "streaming_decoder.h"
 #include "text_processor.h"
 #include "tokenizer_factory.h"
 #include "vocabulary.h"
@@ -13,6 +16,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace duorou::model;
@@ -51,7 +55,104 @@ readTSV(const std::string &path,
   return true;
 }
 
+// Pre-tokenizer splits for the Qwen2 pattern, as produced by a
+// Unicode-aware regex engine. Needs no tokenizer data. Returns the number of
+// mismatching cases.
+static int checkPreTokenizer() {
+  const std::string kQwen2Pattern =
+      R"((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)";
+  const std::vector<std::pair<std::string, std::vector<std::string>>> cases = {
+      {"Hello world",
+       {"Hello", " world"}},
+      {"I'm here, they'LL go!",
+       {"I", "'m", " here", ",", " they", "'LL", " go", "!"}},
+      {"  leading and trailing  ",
+       {" ", " leading", " and", " trailing", "  "}},
+      {"a\n\n  b",
+       {"a", "\n\n", " ", " b"}},
+      {"数字123和English混合。",
+       {"数字", "1", "2", "3", "和English混合", "。"}},
+      {"x  \n\t y",
+       {"x", "  \n", "\t", " y"}},
+      {"(hello) 'world'",
+       {"(hello", ")", " '", "world", "'"}},
+      {"价格：１２３元",
+       {"价格", "：", "１", "２", "３", "元"}},
+      {"tab\tsep",
+       {"tab", "\tsep"}},
+      {"naïve café",
+       {"naïve", " café"}},
+  };
+
+  PreTokenizer pre(kQwen2Pattern);
+  if (pre.usesRegex()) {
+    std::cerr << "[PRETOKENIZE] Qwen2 pattern not handled by the scanner"
+              << std::endl;
+    return static_cast<int>(cases.size());
+  }
+  int failed = 0;
+  std::vector<std::string_view> pieces;
+  for (const auto &c : cases) {
+    pieces.clear();
+    pre.split(c.first, pieces);
+    std::vector<std::string> got(pieces.begin(), pieces.end());
+    if (got != c.second) {
+      ++failed;
+      std::cerr << "[PRETOKENIZE MISMATCH] text='" << c.first << "'\n  got=";
+      for (size_t i = 0; i < got.size(); ++i)
+        std::cerr << (i ? "|" : "") << got[i];
+      std::cerr << std::endl;
+    }
+  }
+  std::cout << "[PRETOKENIZE] " << (cases.size() - failed) << "/"
+            << cases.size() << " matched" << std::endl;
+  return failed;
+}
+
+// PreTokenCache: hits return the stored ids, misses leave the output alone,
+// and each shard evicts its least recently used entry. Returns the number of
+// failed checks.
+static int checkPreTokenCache() {
+  int failed = 0;
+  auto expect = [&](bool ok, const char *what) {
+    if (!ok) {
+      ++failed;
+      std::cerr << "[CACHE MISMATCH] " << what << std::endl;
+    }
+  };
+
+  PreTokenCache cache(16); // one entry per shard
+  const int32_t ids[] = {7, 8, 9};
+  std::vector<int32_t> out = {1};
+  expect(!cache.lookup(" hello", out) && out.size() == 1, "miss appends");
+  cache.insert(" hello", ids, 3);
+  expect(cache.lookup(" hello", out) &&
+             out == std::vector<int32_t>({1, 7, 8, 9}),
+         "hit appends stored ids");
+  expect(!cache.lookup(" hell", out), "prefix is a different key");
+
+  // 64 distinct words through 16 single-entry shards keep at most 16
+  for (int i = 0; i < 64; ++i) {
+    const std::string w = "w" + std::to_string(i);
+    cache.insert(w, ids, 1);
+  }
+  const PreTokenCache::Stats st = cache.stats();
+  expect(st.entries <= 16 && st.capacity == 16, "capacity bound");
+  expect(st.hits == 1 && st.misses == 2, "hit/miss counters");
+
+  cache.setCapacity(0);
+  cache.insert(" hello", ids, 3);
+  expect(!cache.lookup(" hello", out), "capacity 0 disables");
+
+  std::cout << "[CACHE] " << (failed == 0 ? "OK" : "FAILED") << std::endl;
+  return failed;
+}
+
 int main() {
+  const int selfCheckFailures = checkPreTokenizer() + checkPreTokenCache();
+  // The batch and streaming APIs must agree with encode() / decode()
+  int apiFailures = 0;
+
   // Required envs
   const std::string dir = getEnv("DUOROU_TOKENIZER_DIR");
   const std::string type = getEnv("DUOROU_TOKENIZER_TYPE");    // "bpe" or "spm"
@@ -170,6 +271,33 @@ int main() {
         }
       }
       std::cout << "[ENCODE] " << ok << "/" << total << " matched" << std::endl;
+
+      // The same rows through the parallel batch API
+      std::vector<std::string_view> texts;
+      for (const auto &r : rows)
+        texts.push_back(r.first);
+      const TokenBatch batch = tokenizer->encodeBatch(texts, addSp);
+      const std::vector<size_t> counts =
+          tokenizer->countTokensBatch(texts, addSp);
+      size_t batchOk = 0;
+      for (size_t i = 0; i < rows.size(); ++i) {
+        const auto expected = tokenizer->encode(rows[i].first, addSp);
+        std::vector<int32_t> got;
+        if (i < batch.size())
+          got.assign(batch.data(i), batch.data(i) + batch.count(i));
+        if (i < batch.size() && got == expected && i < counts.size() &&
+            counts[i] == expected.size()) {
+          ++batchOk;
+        } else {
+          ++apiFailures;
+          std::cerr << "[ENCODE BATCH MISMATCH] text='" << rows[i].first
+                    << "' encode() gave " << expected.size()
+                    << " ids, encodeBatch() " << got.size() << ", count "
+                    << (i < counts.size() ? counts[i] : 0) << std::endl;
+        }
+      }
+      std::cout << "[ENCODE BATCH] " << batchOk << "/" << total << " matched"
+                << std::endl;
     }
   }
 
@@ -193,6 +321,33 @@ int main() {
         }
       }
       std::cout << "[DECODE] " << ok << "/" << total << " matched" << std::endl;
+
+      // Token-at-a-time decoding must give the same text
+      size_t streamOk = 0;
+      StreamingDecoder stream(*tokenizer);
+      for (const auto &r : rows) {
+        stream.reset();
+        std::string got;
+        for (int32_t id : r.second)
+          got += stream.push(id);
+        got += stream.flush();
+        const std::string expected = tokenizer->decode(r.second);
+        // Text streamed a byte at a time (llama.cpp/MNN) must come back whole
+        StreamingDecoder bytes;
+        std::string joined;
+        for (char c : expected)
+          joined += bytes.pushBytes(std::string(1, c));
+        joined += bytes.flush();
+        if (got == expected && joined == expected) {
+          ++streamOk;
+        } else {
+          ++apiFailures;
+          std::cerr << "[DECODE STREAM MISMATCH] expected='" << expected
+                    << "'\n  got='" << got << "'" << std::endl;
+        }
+      }
+      std::cout << "[DECODE STREAM] " << streamOk << "/" << total
+                << " matched" << std::endl;
     }
   }
 
@@ -231,5 +386,7 @@ int main() {
     }
   }
 
-  return 0;
+  if (selfCheckFailures != 0)
+    return 5;
+  return apiFailures == 0 ? 0 : 6;
 }
\ No newline at end of file
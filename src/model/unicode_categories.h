@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace duorou {
+namespace model {
+
+// Unicode general-category lookups used by the tokenizers. Tables are
+// generated from the Unicode 14.0 character database; ASCII is answered
+// without a table lookup.
+
+// \p{L}: Lu, Ll, Lt, Lm, Lo
+bool isUnicodeLetter(uint32_t cp);
+// \p{N}: Nd, Nl, No
+bool isUnicodeNumber(uint32_t cp);
+// \s: the White_Space property (as used by PCRE/Rust regex \s)
+bool isUnicodeWhitespace(uint32_t cp);
+
+// Decode one UTF-8 sequence at text[pos]. Returns the codepoint and stores
+// the sequence length in len. Malformed or truncated input decodes as the
+// single raw byte (len = 1), so scanning always makes progress.
+inline uint32_t decodeUtf8(std::string_view text, size_t pos, size_t &len) {
+  const auto b0 = static_cast<unsigned char>(text[pos]);
+  const size_t left = text.size() - pos;
+  auto cont = [&](size_t i) {
+    return (static_cast<unsigned char>(text[pos + i]) & 0xC0) == 0x80;
+  };
+  auto bits = [&](size_t i) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(text[pos + i]) &
+                                 0x3F);
+  };
+  if (b0 < 0x80) {
+    len = 1;
+    return b0;
+  }
+  if ((b0 & 0xE0) == 0xC0 && left >= 2 && cont(1)) {
+    len = 2;
+    return (static_cast<uint32_t>(b0 & 0x1F) << 6) | bits(1);
+  }
+  if ((b0 & 0xF0) == 0xE0 && left >= 3 && cont(1) && cont(2)) {
+    len = 3;
+    return (static_cast<uint32_t>(b0 & 0x0F) << 12) | (bits(1) << 6) | bits(2);
+  }
+  if ((b0 & 0xF8) == 0xF0 && left >= 4 && cont(1) && cont(2) && cont(3)) {
+    len = 4;
+    return (static_cast<uint32_t>(b0 & 0x07) << 18) | (bits(1) << 12) |
+           (bits(2) << 6) | bits(3);
+  }
+  len = 1;
+  return b0;
+}
+
+} // namespace model
+} // namespace duorou
@@ -76,8 +76,16 @@ void Vocabulary::initialize(const std::vector<std::string> &values,
   // Clear cached data (once_flag cannot be reset, so we clear the cached
   // results)
   specialTokens_.clear();
-  tokenToId_.clear();
   mergeMap_.clear();
+  pieceTrie_.clear();
+  pieceTrieReady_.store(false, std::memory_order_release);
+
+  // BPE reads the token map and merge table on every encode, so they are
+  // rebuilt here instead of lazily: a lazy build would not run again after
+  // a second initialize()
+  buildTokenMap();
+  std::call_once(valuesOnce_, [] {});
+  buildMergeTable();
 
   // Try to autodetect PAD/UNK ids if any
   autodetectPadUnk();
@@ -191,6 +199,19 @@ int Vocabulary::getMergeRank(const std::string &left,
   return (it != mergeMap_.end()) ? static_cast<int>(it->second) : -1;
 }
 
+const MergeTable &Vocabulary::getMergeTable() const { return mergeTable_; }
+
+const DoubleArrayTrie &Vocabulary::getPieceTrie() const {
+  if (!pieceTrieReady_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(pieceTrieMutex_);
+    if (!pieceTrieReady_.load(std::memory_order_relaxed)) {
+      pieceTrie_.build(values_);
+      pieceTrieReady_.store(true, std::memory_order_release);
+    }
+  }
+  return pieceTrie_;
+}
+
 void Vocabulary::setBOS(const std::vector<int32_t> &bos, bool addBOS) {
   bos_ = bos;
   addBOS_ = addBOS;
@@ -252,6 +273,31 @@ void Vocabulary::buildMergeMap() const {
   }
 }
 
+void Vocabulary::buildMergeTable() {
+  mergeTable_.clear();
+  mergeTable_.reserve(merges_.size());
+  std::string merged;
+  for (size_t i = 0; i < merges_.size(); ++i) {
+    const std::string &rule = merges_[i];
+    // "left right"; try every space in case a token itself contains one
+    for (size_t sp = rule.find(' '); sp != std::string::npos;
+         sp = rule.find(' ', sp + 1)) {
+      const int32_t left = encode(rule.substr(0, sp));
+      const int32_t right = encode(rule.substr(sp + 1));
+      if (left < 0 || right < 0) {
+        continue;
+      }
+      merged.assign(rule, 0, sp);
+      merged.append(rule, sp + 1, std::string::npos);
+      const int32_t id = encode(merged);
+      if (id >= 0) {
+        mergeTable_.insert(left, right, static_cast<int32_t>(i), id);
+      }
+      break;
+    }
+  }
+}
+
 std::string Vocabulary::decodeText(const std::string &text) const {
   std::string decoded_text;
 
@@ -4,7 +4,10 @@
 #include <string>
 #include <unordered_map>
 #include <cstdint>
+#include <atomic>
 #include <mutex>
+#include "double_array_trie.h"
+#include "merge_table.h"
 #include "text_processor.h"
 
 namespace duorou {
@@ -83,6 +86,20 @@ public:
      * @return Merge rank, or -1 if not found
      */
     int getMergeRank(const std::string& left, const std::string& right) const;
+
+    /**
+     * Merge rules keyed by token ids: (left, right) -> (rank, merged id).
+     * Rules whose parts or merged token are not in the vocabulary are
+     * dropped; the string path could never apply them either. Built by
+     * initialize().
+     */
+    const MergeTable& getMergeTable() const;
+
+    /**
+     * Double-array trie over the token strings (value = token id), for
+     * enumerating every token that starts at a given text position
+     */
+    const DoubleArrayTrie& getPieceTrie() const;
     
     /**
      * Set BOS (Beginning of Sequence) tokens
@@ -140,11 +157,19 @@ private:
     
     mutable std::once_flag mergeOnce_;
     mutable std::unordered_map<std::string, int32_t> mergeMap_;
+
+    MergeTable mergeTable_;
+
+    // Built on first use like the maps above, but re-armed by initialize()
+    mutable std::mutex pieceTrieMutex_;
+    mutable std::atomic<bool> pieceTrieReady_{false};
+    mutable DoubleArrayTrie pieceTrie_;
     
     // Helper methods
     void buildTokenMap() const;
     void buildSpecialTokens() const;
     void buildMergeMap() const;
+    void buildMergeTable();
 
     // GPT-2 byte-level BPE decoding
     std::string decodeText(const std::string& text) const;
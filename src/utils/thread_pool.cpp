@@ -0,0 +1,148 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+namespace duorou {
+namespace utils {
+
+namespace {
+thread_local bool t_inWorker = false;
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) {
+    threads = defaultThreadCount();
+  }
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+  t_inWorker = true;
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+      if (stopping_ && tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::parallelFor(size_t n, size_t minChunk,
+                             const std::function<void(size_t, size_t)> &fn) {
+  if (n == 0) {
+    return;
+  }
+  minChunk = std::max<size_t>(1, minChunk);
+  size_t maxChunks = workers_.size() + 1; // workers plus the caller
+  size_t chunks = std::min(maxChunks, (n + minChunk - 1) / minChunk);
+  if (chunks <= 1 || workers_.empty() || inWorker()) {
+    fn(0, n);
+    return;
+  }
+
+  // Chunks are claimed dynamically so a slow chunk does not stall the rest
+  struct State {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+  };
+  auto state = std::make_shared<State>();
+  const size_t chunkSize = (n + chunks - 1) / chunks;
+  auto runChunks = [state, chunks, chunkSize, n, &fn]() {
+    for (;;) {
+      size_t c = state->next.fetch_add(1);
+      if (c >= chunks) {
+        return;
+      }
+      size_t begin = c * chunkSize;
+      size_t end = std::min(n, begin + chunkSize);
+      if (begin < end) {
+        try {
+          fn(begin, end);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          if (!state->error) {
+            state->error = std::current_exception();
+          }
+        }
+      }
+      if (state->done.fetch_add(1) + 1 == chunks) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->cv.notify_all();
+      }
+    }
+  };
+
+  for (size_t i = 0; i + 1 < chunks; ++i) {
+    enqueue(runChunks);
+  }
+  runChunks();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&]() { return state->done.load() == chunks; });
+  if (state->error) {
+    std::rethrow_exception(state->error);
+  }
+}
+
+bool ThreadPool::inWorker() { return t_inWorker; }
+
+size_t ThreadPool::defaultThreadCount() {
+  if (const char *env = std::getenv("DUOROU_NUM_THREADS")) {
+    try {
+      int v = std::stoi(std::string(env));
+      if (v > 0) {
+        return static_cast<size_t>(v);
+      }
+    } catch (...) {
+      // ignore
+    }
+  }
+  unsigned hw = std::thread::hardware_concurrency();
+  return hw > 0 ? hw : 4;
+}
+
+ThreadPool &ThreadPool::global() {
+  // The caller thread also works in parallelFor, so one fewer worker
+  static ThreadPool pool(std::max<size_t>(1, defaultThreadCount() - 1));
+  return pool;
+}
+
+} // namespace utils
+} // namespace duorou
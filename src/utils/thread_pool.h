@@ -0,0 +1,72 @@
+// Fixed-size worker pool shared by CPU kernels, loaders and tokenizers.
+// parallelFor() lets the calling thread take part in the work and runs
+// inline when called from a pool worker, so nested use cannot deadlock.
+
+#ifndef DUOROU_UTILS_THREAD_POOL_H
+#define DUOROU_UTILS_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace duorou {
+namespace utils {
+
+class ThreadPool {
+public:
+  // threads == 0 uses defaultThreadCount()
+  explicit ThreadPool(size_t threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers_.size(); }
+
+  // Queue a task and return a future for its result
+  template <class F>
+  auto submit(F &&fn) -> std::future<typename std::invoke_result<F>::type> {
+    using R = typename std::invoke_result<F>::type;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+    std::future<R> result = task->get_future();
+    enqueue([task]() { (*task)(); });
+    return result;
+  }
+
+  // Split [0, n) into chunks of at least minChunk items and call
+  // fn(begin, end) for each chunk. Blocks until every chunk is done and
+  // rethrows the first exception raised by fn.
+  void parallelFor(size_t n, size_t minChunk,
+                   const std::function<void(size_t, size_t)> &fn);
+
+  // True when the current thread is a worker of any ThreadPool
+  static bool inWorker();
+
+  // DUOROU_NUM_THREADS if set, otherwise hardware_concurrency()
+  static size_t defaultThreadCount();
+
+  // Process-wide pool sized with defaultThreadCount()
+  static ThreadPool &global();
+
+private:
+  void enqueue(std::function<void()> task);
+  void workerLoop();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+};
+
+} // namespace utils
+} // namespace duorou
+
+#endif // DUOROU_UTILS_THREAD_POOL_H